@@ -15,66 +15,269 @@
 #ifndef BASE_TEST_H
 #define BASE_TEST_H
 
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
 #include <cstdint>
 #include <cstdio>
 #include <fstream>
 #include <iostream>
+#include <random>
 #include <string>
 #include <vector>
 
-class Object {
+/// Streaming JSON writer.
+/// All tokens are formatted directly into a single character buffer which is retained (together with its capacity)
+/// across calls to Clear(). Objects and arrays can be nested to any depth and are written in place, so a complete
+/// document is emitted with a single write. Object members are placed one per line; arrays are written inline.
+class JsonWriter {
   public:
-    Object() { m_content << "{"; }
-    ~Object() {}
+    /// Construct a writer. The indentation level is used when the output of this writer is to be spliced into
+    /// another document (see Raw()) at the given nesting depth.
+    explicit JsonWriter(int indent_level = 0, size_t capacity = 4096) : m_level(indent_level), m_key(false) {
+        m_buffer.reserve(capacity);
+    }
 
-    void AddMember(const std::string& key, double value, bool verbose) {
-        if (verbose)
-            std::cout << "Adding entry " << key << " (type double)" << std::endl;
-        m_content << "\n    \"" << key << "\": " << value << ",";
+    /// Discard the current content (the allocated buffer is kept for reuse).
+    void Clear() {
+        m_buffer.clear();
+        m_scopes.clear();
+        m_key = false;
     }
 
-    void AddMember(const std::string& key, Object& value, bool verbose) {
-        if (verbose)
-            std::cout << "Adding entry " << key << " (type Object)" << std::endl;
-        m_content << "\n    \"" << key << "\": " << value.GetContent() << ",";
+    void BeginObject() { OpenScope('{', true); }
+    void EndObject() { CloseScope('}'); }
+    void BeginArray() { OpenScope('[', false); }
+    void EndArray() { CloseScope(']'); }
+
+    /// Write the key of the next object member. Must be followed by exactly one value, object, or array.
+    void Key(const std::string& key) {
+        Separator();
+        String(key);
+        m_buffer.append(": ", 2);
+        m_key = true;
     }
 
-    void AddMember(const std::string& key, uint64_t value, bool verbose) {
-        if (verbose)
-            std::cout << "Adding entry " << key << " (type uint64)" << std::endl;
-        m_content << "\n    \"" << key << "\": " << value << ",";
+    void Value(double value) {
+        Separator();
+        // JSON has no representation for Inf and NaN.
+        if (!std::isfinite(value)) {
+            m_buffer.append("null", 4);
+            return;
+        }
+        char buf[32];
+        int n = std::snprintf(buf, sizeof(buf), "%.12g", value);
+        m_buffer.append(buf, n);
     }
 
-    void AddMember(const std::string& key, int value, bool verbose) {
-        if (verbose)
-            std::cout << "Adding entry " << key << " (type int)" << std::endl;
-        m_content << "\n    \"" << key << "\": " << value << ",";
+    void Value(int value) {
+        Separator();
+        char buf[16];
+        int n = std::snprintf(buf, sizeof(buf), "%d", value);
+        m_buffer.append(buf, n);
     }
 
-    void AddMember(const std::string& key, const std::string& value, bool verbose) {
-        if (verbose)
-            std::cout << "Adding entry " << key << " (type string)" << std::endl;
-        m_content << "\n    \"" << key << "\": \"" << value << "\",";
+    void Value(uint64_t value) {
+        Separator();
+        char buf[24];
+        int n = std::snprintf(buf, sizeof(buf), "%" PRIu64, value);
+        m_buffer.append(buf, n);
     }
 
-    std::string GetContent() const {
-        if (m_content.str().length() == 1) {
-            return m_content.str() + "}\n";
-        }
+    void Value(const std::string& value) {
+        Separator();
+        String(value);
+    }
 
-        // Remove last comma and close the JSON object.
-        return m_content.str().substr(0, m_content.str().length() - 1) + "\n}\n";
+    /// Write an array of values.
+    void Values(const double* values, size_t count) {
+        BeginArray();
+        for (size_t i = 0; i < count; i++)
+            Value(values[i]);
+        EndArray();
     }
 
+    /// Write an already formatted JSON value (e.g., the complete output of another writer).
+    void Raw(const char* data, size_t size) {
+        Separator();
+        m_buffer.append(data, size);
+    }
+
+    /// Write a key-value pair.
+    template <typename T>
+    void Member(const std::string& key, const T& value) {
+        Key(key);
+        Value(value);
+    }
+
+    const char* GetData() const { return m_buffer.data(); }
+    size_t GetSize() const { return m_buffer.size(); }
+
+    /// Write the current content to the given stream (single write).
+    void Flush(std::ostream& os) const { os.write(m_buffer.data(), m_buffer.size()); }
+
   private:
-    std::stringstream m_content;  // object content (JSON format)
+    struct Scope {
+        bool object;  ///< true for an object, false for an array
+        bool empty;   ///< no entries written yet
+    };
+
+    void OpenScope(char c, bool object) {
+        Separator();
+        m_buffer.push_back(c);
+        m_scopes.push_back({object, true});
+    }
+
+    void CloseScope(char c) {
+        Scope scope = m_scopes.back();
+        m_scopes.pop_back();
+        if (scope.object && !scope.empty)
+            NewLine();
+        m_buffer.push_back(c);
+        // A complete top-level document is terminated with a newline.
+        if (m_scopes.empty() && m_level == 0)
+            m_buffer.push_back('\n');
+    }
+
+    // Emit whatever must precede the next entry in the current scope.
+    void Separator() {
+        if (m_key) {
+            m_key = false;
+            return;
+        }
+        if (m_scopes.empty())
+            return;
+        Scope& scope = m_scopes.back();
+        if (!scope.empty)
+            m_buffer.push_back(',');
+        if (scope.object)
+            NewLine();
+        else if (!scope.empty)
+            m_buffer.push_back(' ');
+        scope.empty = false;
+    }
+
+    void NewLine() {
+        m_buffer.push_back('\n');
+        m_buffer.append(4 * (m_level + m_scopes.size()), ' ');
+    }
+
+    void String(const std::string& str) {
+        m_buffer.push_back('"');
+        for (char c : str) {
+            switch (c) {
+                case '"':
+                    m_buffer.append("\\\"", 2);
+                    break;
+                case '\\':
+                    m_buffer.append("\\\\", 2);
+                    break;
+                case '\n':
+                    m_buffer.append("\\n", 2);
+                    break;
+                case '\t':
+                    m_buffer.append("\\t", 2);
+                    break;
+                default:
+                    if ((unsigned char)c < 0x20) {
+                        char buf[8];
+                        std::snprintf(buf, sizeof(buf), "\\u%04x", (unsigned int)c);
+                        m_buffer.append(buf, 6);
+                    } else {
+                        m_buffer.push_back(c);
+                    }
+            }
+        }
+        m_buffer.push_back('"');
+    }
+
+    std::string m_buffer;        ///< output buffer
+    std::vector<Scope> m_scopes;  ///< stack of currently open objects and arrays
+    int m_level;                  ///< base indentation level
+    bool m_key;                   ///< a key was written and its value is pending
+};
+
+/// Summary statistics for a set of benchmark timing samples.
+struct BenchmarkStats {
+    double min = 0;
+    double median = 0;
+    double p90 = 0;
+    double mean = 0;
+    double stddev = 0;
+    double ci_level = 0;  ///< confidence level of the interval below
+    double ci_low = 0;    ///< lower bound of bootstrap confidence interval for the median
+    double ci_high = 0;   ///< upper bound of bootstrap confidence interval for the median
+
+    /// Compute statistics for the given samples.
+    /// The confidence interval for the median is obtained with the percentile bootstrap method, using the specified
+    /// number of resamples (drawn with a fixed seed, so that results are reproducible).
+    static BenchmarkStats Compute(const std::vector<double>& samples, double ci_level = 0.95, int resamples = 2000) {
+        BenchmarkStats stats;
+        stats.ci_level = ci_level;
+        size_t n = samples.size();
+        if (n == 0)
+            return stats;
+
+        std::vector<double> sorted(samples);
+        std::sort(sorted.begin(), sorted.end());
+        stats.min = sorted.front();
+        stats.median = Percentile(sorted, 0.5);
+        stats.p90 = Percentile(sorted, 0.9);
+
+        double sum = 0;
+        for (auto x : sorted)
+            sum += x;
+        stats.mean = sum / n;
+        double var = 0;
+        for (auto x : sorted)
+            var += (x - stats.mean) * (x - stats.mean);
+        stats.stddev = (n > 1) ? std::sqrt(var / (n - 1)) : 0;
+
+        std::mt19937 rng(42);
+        std::uniform_int_distribution<size_t> pick(0, n - 1);
+        std::vector<double> resample(n);
+        std::vector<double> medians(resamples);
+        for (int ir = 0; ir < resamples; ir++) {
+            for (size_t i = 0; i < n; i++)
+                resample[i] = sorted[pick(rng)];
+            std::sort(resample.begin(), resample.end());
+            medians[ir] = Percentile(resample, 0.5);
+        }
+        std::sort(medians.begin(), medians.end());
+        stats.ci_low = Percentile(medians, (1 - ci_level) / 2);
+        stats.ci_high = Percentile(medians, (1 + ci_level) / 2);
+
+        return stats;
+    }
+
+    /// Return the p-th quantile (0 <= p <= 1) of the sorted data, using linear interpolation.
+    static double Percentile(const std::vector<double>& sorted, double p) {
+        if (sorted.empty())
+            return 0;
+        double pos = p * (sorted.size() - 1);
+        size_t i = (size_t)pos;
+        if (i + 1 >= sorted.size())
+            return sorted.back();
+        return sorted[i] + (pos - i) * (sorted[i + 1] - sorted[i]);
+    }
 };
 
 class BaseTest {
   public:
     /// Constructor: Every test has to have a name and an associated project to it.
     BaseTest(const std::string& testName, const std::string& testProjectName)
-        : m_name(testName), m_projectName(testProjectName), m_outDir("."), m_verbose(false) {}
+        : m_name(testName),
+          m_projectName(testProjectName),
+          m_outDir("."),
+          m_verbose(false),
+          m_repetitions(0),
+          m_warmup(0),
+          m_timing(false),
+          m_timedTime(0),
+          m_jsonMetrics(1) {
+        m_jsonMetrics.BeginObject();
+    }
 
     virtual ~BaseTest() {}
 
@@ -93,17 +296,56 @@ class BaseTest {
     /// Set output directory (default: current directory).
     void setOutDir(const std::string& outDir) { m_outDir = outDir; }
 
+    /// Enable benchmark mode.
+    /// In benchmark mode, run() first executes the test 'warmup' times (results discarded) and then 'repetitions'
+    /// times, recording one timing sample per repetition. Summary statistics of the samples are included in the
+    /// output and the median is reported as the test execution time. Metrics are those cached during the last
+    /// repetition. A value repetitions = 0 disables benchmark mode.
+    void setBenchmark(int repetitions, int warmup = 1) {
+        m_repetitions = std::max(repetitions, 0);
+        m_warmup = std::max(warmup, 0);
+    }
+
+    /// Get the statistics of the timing samples from the last run in benchmark mode.
+    const BenchmarkStats& getBenchmarkStats() const { return m_stats; }
+
     /// Main function for running the test.
     bool run() {
-        // Execute the actual test and collect metrics
-        bool passed = execute();
+        // Execute the actual test (possibly repeatedly) and collect metrics
+        bool passed = (m_repetitions > 0) ? benchmark() : execute();
+        m_jsonMetrics.EndObject();
+
+        // Populate output JSON document
+        m_jsonTest.Clear();
+        m_jsonTest.BeginObject();
+        m_jsonTest.Member("name", m_name);
+        m_jsonTest.Member("project_name", m_projectName);
+        m_jsonTest.Member("passed", passed ? 1 : 0);
+        m_jsonTest.Member("execution_time", (m_repetitions > 0) ? m_stats.median : getExecutionTime());
+        m_jsonTest.Key("metrics");
+        m_jsonTest.Raw(m_jsonMetrics.GetData(), m_jsonMetrics.GetSize());
+        if (m_repetitions > 0) {
+            m_jsonTest.Key("benchmark");
+            m_jsonTest.BeginObject();
+            m_jsonTest.Member("warmup", m_warmup);
+            m_jsonTest.Member("repetitions", m_repetitions);
+            m_jsonTest.Key("samples");
+            m_jsonTest.Values(m_samples.data(), m_samples.size());
+            m_jsonTest.Member("min", m_stats.min);
+            m_jsonTest.Member("median", m_stats.median);
+            m_jsonTest.Member("p90", m_stats.p90);
+            m_jsonTest.Member("mean", m_stats.mean);
+            m_jsonTest.Member("stddev", m_stats.stddev);
+            m_jsonTest.Member("ci_level", m_stats.ci_level);
+            m_jsonTest.Member("ci_low", m_stats.ci_low);
+            m_jsonTest.Member("ci_high", m_stats.ci_high);
+            m_jsonTest.EndObject();
+        }
+        m_jsonTest.EndObject();
 
-        // Populate output JSON string
-        m_jsonTest.AddMember("name", m_name, false);
-        m_jsonTest.AddMember("project_name", m_projectName, false);
-        m_jsonTest.AddMember("passed", passed, false);
-        m_jsonTest.AddMember("execution_time", getExecutionTime(), false);
-        m_jsonTest.AddMember("metrics", m_jsonMetrics, false);
+        // Start a new set of metrics (for any subsequent run)
+        m_jsonMetrics.Clear();
+        m_jsonMetrics.BeginObject();
 
         // Write output file
         std::string fname = m_outDir + "/" + m_name + ".json";
@@ -111,7 +353,7 @@ class BaseTest {
             std::cout << "Write output file: " << fname << std::endl;
         m_jsonfile.open(fname);
         if (m_jsonfile.is_open()) {
-            m_jsonfile << m_jsonTest.GetContent();
+            m_jsonTest.Flush(m_jsonfile);
             m_jsonfile.close();
         } else {
             std::cerr << "UNABLE to open file." << std::endl;
@@ -122,25 +364,31 @@ class BaseTest {
 
     /// Add a test-specific metric (a key-value pair)
     void addMetric(const std::string& metricName, double metricValue) {
-        m_jsonMetrics.AddMember(metricName, metricValue, m_verbose);
+        logMetric(metricName, "double");
+        m_jsonMetrics.Member(metricName, metricValue);
     }
 
     void addMetric(const std::string& metricName, int metricValue) {
-        m_jsonMetrics.AddMember(metricName, metricValue, m_verbose);
+        logMetric(metricName, "int");
+        m_jsonMetrics.Member(metricName, metricValue);
     }
 
     void addMetric(const std::string& metricName, uint64_t metricValue) {
-        m_jsonMetrics.AddMember(metricName, metricValue, m_verbose);
+        logMetric(metricName, "uint64");
+        m_jsonMetrics.Member(metricName, metricValue);
     }
 
     void addMetric(const std::string& metricName, const std::string& metricValue) {
-        m_jsonMetrics.AddMember(metricName, metricValue, m_verbose);
+        logMetric(metricName, "string");
+        m_jsonMetrics.Member(metricName, metricValue);
     }
 
-    // void addMetric(const std::string&   metricName,
-    //                std::vector<double>& metricValue) {
-    //   m_jsonMetrics.AddMember(metricName, metricValue, m_verbose);
-    // }
+    /// Add a test-specific series metric (e.g., a per-step time history), written as a JSON array.
+    void addMetric(const std::string& metricName, const std::vector<double>& metricValue) {
+        logMetric(metricName, "array");
+        m_jsonMetrics.Key(metricName);
+        m_jsonMetrics.Values(metricValue.data(), metricValue.size());
+    }
 
     /// Execute the actual test.
     /// A derived class must implement this function to return true if the test passes
@@ -154,17 +402,72 @@ class BaseTest {
     /// Print the content of the JSON string.
     void print() {
         std::cout << "Test Information: " << std::endl;
-        std::cout << m_jsonTest.GetContent();
+        m_jsonTest.Flush(std::cout);
+    }
+
+  protected:
+    /// Mark the beginning of a timed region in execute().
+    /// If a derived test marks timed regions, the benchmark sample for a repetition is the total time spent in these
+    /// regions (thus excluding any setup); otherwise, the value reported by getExecutionTime() is used.
+    void startTiming() {
+        m_timing = true;
+        m_timerStart = std::chrono::steady_clock::now();
+    }
+
+    /// Mark the end of a timed region in execute().
+    void stopTiming() {
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - m_timerStart;
+        m_timedTime += elapsed.count();
     }
 
   private:
-    std::ofstream m_jsonfile;   ///< Output JSON file
-    std::string m_name;         ///< Name of test
-    std::string m_projectName;  ///< Name of the project
-    std::string m_outDir;       ///< Name of output directory
-    bool m_verbose;             ///< Verbose output
-    Object m_jsonMetrics;       ///< collected metrics
-    Object m_jsonTest;          ///< JSON output of the test
+    bool benchmark() {
+        bool passed = true;
+        m_samples.clear();
+        for (int i = 0; i < m_warmup + m_repetitions; i++) {
+            // Only keep metrics from the last repetition
+            m_jsonMetrics.Clear();
+            m_jsonMetrics.BeginObject();
+
+            m_timing = false;
+            m_timedTime = 0;
+            passed &= execute();
+            double sample = m_timing ? m_timedTime : getExecutionTime();
+
+            if (m_verbose)
+                std::cout << (i < m_warmup ? "Warmup run " : "Timed run ") << i + 1 << ": " << sample << std::endl;
+            if (i >= m_warmup)
+                m_samples.push_back(sample);
+        }
+
+        m_stats = BenchmarkStats::Compute(m_samples);
+        if (m_verbose) {
+            std::cout << "Median: " << m_stats.median << "  (" << 100 * m_stats.ci_level << "% CI: [" << m_stats.ci_low
+                      << ", " << m_stats.ci_high << "])" << std::endl;
+        }
+
+        return passed;
+    }
+
+    void logMetric(const std::string& metricName, const char* type) const {
+        if (m_verbose)
+            std::cout << "Adding entry " << metricName << " (type " << type << ")" << std::endl;
+    }
+
+    std::ofstream m_jsonfile;                            ///< Output JSON file
+    std::string m_name;                                  ///< Name of test
+    std::string m_projectName;                           ///< Name of the project
+    std::string m_outDir;                                ///< Name of output directory
+    bool m_verbose;                                      ///< Verbose output
+    int m_repetitions;                                   ///< Number of timed repetitions (benchmark mode)
+    int m_warmup;                                        ///< Number of warmup runs (benchmark mode)
+    bool m_timing;                                       ///< Timed regions marked during current repetition?
+    double m_timedTime;                                  ///< Total time in timed regions during current repetition
+    std::chrono::steady_clock::time_point m_timerStart;  ///< Start of current timed region
+    std::vector<double> m_samples;                       ///< Timing samples (benchmark mode)
+    BenchmarkStats m_stats;                              ///< Statistics of timing samples (benchmark mode)
+    JsonWriter m_jsonMetrics;                            ///< collected metrics
+    JsonWriter m_jsonTest;                               ///< JSON output of the test
 };
 
 #endif
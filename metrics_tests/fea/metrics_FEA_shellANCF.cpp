@@ -57,6 +57,9 @@ int numDiv_x = 30;  // mesh divisions in X direction
 int numDiv_y = 30;  // mesh divisions in Y direction
 int numDiv_z = 1;    // mesh divisions in Z direction
 
+int num_repetitions = 5;  // timed repetitions of each test (benchmark mode)
+int num_warmup = 1;       // warmup runs before timed repetitions
+
 // -----------------------------------------------------------------------------
 
 // Test class
@@ -383,6 +386,7 @@ int main(int argc, char* argv[]) {
                                   false, verbose_solver);
     test_minres_full.setOutDir(out_dir);
     test_minres_full.setVerbose(verbose_test);
+    test_minres_full.setBenchmark(num_repetitions, num_warmup);
     test_minres_full.run();
     test_minres_full.print();
 
@@ -390,6 +394,7 @@ int main(int argc, char* argv[]) {
                                  ChSolver::Type::MINRES, true, verbose_solver);
     test_minres_mod.setOutDir(out_dir);
     test_minres_mod.setVerbose(verbose_test);
+    test_minres_mod.setBenchmark(num_repetitions, num_warmup);
     test_minres_mod.run();
     test_minres_mod.print();
 
@@ -398,6 +403,7 @@ int main(int argc, char* argv[]) {
                                ChSolver::Type::PARDISO_MKL, false, verbose_solver);
     test_mkl_full.setOutDir(out_dir);
     test_mkl_full.setVerbose(verbose_test);
+    test_mkl_full.setBenchmark(num_repetitions, num_warmup);
     test_mkl_full.run();
     test_mkl_full.print();
 
@@ -405,6 +411,7 @@ int main(int argc, char* argv[]) {
                               ChSolver::Type::PARDISO_MKL, true, verbose_solver);
     test_mkl_mod.setOutDir(out_dir);
     test_mkl_mod.setVerbose(verbose_test);
+    test_mkl_mod.setBenchmark(num_repetitions, num_warmup);
     test_mkl_mod.run();
     test_mkl_mod.print();
 #endif
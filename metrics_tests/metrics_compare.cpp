@@ -0,0 +1,616 @@
+// =============================================================================
+// PROJECT CHRONO - http://projectchrono.org
+//
+// Copyright (c) 2016 projectchrono.org
+// All right reserved.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file at the top level of the distribution and at
+// http://projectchrono.org/license-chrono.txt.
+//
+// =============================================================================
+//
+// Regression gate for the output of the metrics tests.
+//
+// Compares all JSON files in a current output directory (as written by
+// BaseTest, by default ../METRICS) against those in a stored baseline directory
+// and reports, for every test, any metric that differs from its baseline value
+// by more than the allowed tolerance. Returns 0 if no regressions were found,
+// 1 if any regression was found, and 2 on usage or I/O errors.
+//
+// Usage:
+//    metrics_compare <baseline_dir> [<current_dir>] [-t <tolerances.json>] [-r <rel_tol>] [-a <abs_tol>] [-v]
+//
+// Metrics whose name contains "time" are treated as costs: only an increase is
+// a regression, while a decrease is reported as an improvement. All other
+// metrics (results) are flagged on a deviation in either direction. When both
+// runs were produced in benchmark mode, an increase in the execution time is
+// only a regression if, in addition, the bootstrap confidence intervals of the
+// two medians do not overlap.
+//
+// Per-metric settings can be provided in a tolerance file of the form:
+//    {
+//        "default": { "rel": 0.1, "abs": 0 },
+//        "metrics": {
+//            "avg_solve_time_per_step (ms)": { "rel": 0.2 },
+//            "metrics_PAR_settling_DEM_2/number_contacts": { "rel": 0.05, "direction": "both" }
+//        }
+//    }
+// where a metric key is either a metric name (applies to all tests) or
+// "<test name>/<metric name>" (takes precedence), and "direction" is one of
+// "lower" (lower is better), "higher" (higher is better), or "both".
+//
+// =============================================================================
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// =============================================================================
+// Minimal JSON reader (sufficient for the BaseTest output and tolerance files)
+// =============================================================================
+
+struct JsonValue {
+    enum class Type { NUL, BOOL, NUMBER, STRING, ARRAY, OBJECT };
+
+    Type type = Type::NUL;
+    bool boolean = false;
+    double number = 0;
+    std::string str;
+    std::vector<JsonValue> array;
+    std::vector<std::pair<std::string, JsonValue>> members;
+
+    bool IsNumber() const { return type == Type::NUMBER; }
+    bool IsObject() const { return type == Type::OBJECT; }
+    bool IsArray() const { return type == Type::ARRAY; }
+
+    const JsonValue* Find(const std::string& key) const {
+        for (const auto& m : members) {
+            if (m.first == key)
+                return &m.second;
+        }
+        return nullptr;
+    }
+
+    double GetNumber(const std::string& key, double def) const {
+        const JsonValue* v = Find(key);
+        return (v && v->IsNumber()) ? v->number : def;
+    }
+};
+
+class JsonReader {
+  public:
+    explicit JsonReader(const std::string& text) : m_text(text), m_pos(0) {}
+
+    bool Parse(JsonValue& value, std::string& error) {
+        bool ok = ParseValue(value);
+        SkipSpace();
+        if (ok && m_pos != m_text.size())
+            ok = Fail("unexpected trailing characters");
+        if (!ok)
+            error = m_error + " (at offset " + std::to_string(m_pos) + ")";
+        return ok;
+    }
+
+  private:
+    bool Fail(const std::string& msg) {
+        m_error = msg;
+        return false;
+    }
+
+    void SkipSpace() {
+        while (m_pos < m_text.size() && std::isspace((unsigned char)m_text[m_pos]))
+            m_pos++;
+    }
+
+    bool Match(const char* literal) {
+        size_t n = std::char_traits<char>::length(literal);
+        if (m_text.compare(m_pos, n, literal) != 0)
+            return false;
+        m_pos += n;
+        return true;
+    }
+
+    bool ParseValue(JsonValue& value) {
+        SkipSpace();
+        if (m_pos >= m_text.size())
+            return Fail("unexpected end of input");
+        char c = m_text[m_pos];
+        switch (c) {
+            case '{':
+                return ParseObject(value);
+            case '[':
+                return ParseArray(value);
+            case '"':
+                value.type = JsonValue::Type::STRING;
+                return ParseString(value.str);
+            case 't':
+            case 'f':
+                value.type = JsonValue::Type::BOOL;
+                value.boolean = (c == 't');
+                return Match(c == 't' ? "true" : "false") || Fail("invalid literal");
+            case 'n':
+                value.type = JsonValue::Type::NUL;
+                return Match("null") || Fail("invalid literal");
+            default:
+                return ParseNumber(value);
+        }
+    }
+
+    bool ParseNumber(JsonValue& value) {
+        const char* start = m_text.c_str() + m_pos;
+        char* end = nullptr;
+        value.number = std::strtod(start, &end);
+        if (end == start)
+            return Fail("invalid value");
+        value.type = JsonValue::Type::NUMBER;
+        m_pos += end - start;
+        return true;
+    }
+
+    bool ParseString(std::string& str) {
+        m_pos++;  // opening quote
+        str.clear();
+        while (m_pos < m_text.size()) {
+            char c = m_text[m_pos++];
+            if (c == '"')
+                return true;
+            if (c != '\\') {
+                str.push_back(c);
+                continue;
+            }
+            if (m_pos >= m_text.size())
+                break;
+            char e = m_text[m_pos++];
+            switch (e) {
+                case 'n':
+                    str.push_back('\n');
+                    break;
+                case 't':
+                    str.push_back('\t');
+                    break;
+                case 'r':
+                    str.push_back('\r');
+                    break;
+                case 'b':
+                    str.push_back('\b');
+                    break;
+                case 'f':
+                    str.push_back('\f');
+                    break;
+                case 'u': {
+                    if (m_pos + 4 > m_text.size())
+                        return Fail("invalid escape sequence");
+                    unsigned long code = std::strtoul(m_text.substr(m_pos, 4).c_str(), nullptr, 16);
+                    str.push_back(code < 0x80 ? (char)code : '?');
+                    m_pos += 4;
+                    break;
+                }
+                default:
+                    str.push_back(e);
+                    break;
+            }
+        }
+        return Fail("unterminated string");
+    }
+
+    bool ParseArray(JsonValue& value) {
+        value.type = JsonValue::Type::ARRAY;
+        m_pos++;
+        SkipSpace();
+        if (Match("]"))
+            return true;
+        while (true) {
+            value.array.emplace_back();
+            if (!ParseValue(value.array.back()))
+                return false;
+            SkipSpace();
+            if (Match("]"))
+                return true;
+            if (!Match(","))
+                return Fail("expected ',' or ']'");
+        }
+    }
+
+    bool ParseObject(JsonValue& value) {
+        value.type = JsonValue::Type::OBJECT;
+        m_pos++;
+        SkipSpace();
+        if (Match("}"))
+            return true;
+        while (true) {
+            SkipSpace();
+            if (m_pos >= m_text.size() || m_text[m_pos] != '"')
+                return Fail("expected member name");
+            value.members.emplace_back();
+            if (!ParseString(value.members.back().first))
+                return false;
+            SkipSpace();
+            if (!Match(":"))
+                return Fail("expected ':'");
+            if (!ParseValue(value.members.back().second))
+                return false;
+            SkipSpace();
+            if (Match("}"))
+                return true;
+            if (!Match(","))
+                return Fail("expected ',' or '}'");
+        }
+    }
+
+    const std::string& m_text;
+    size_t m_pos;
+    std::string m_error;
+};
+
+bool ReadJsonFile(const fs::path& filename, JsonValue& value) {
+    std::ifstream ifile(filename);
+    if (!ifile.is_open()) {
+        std::cerr << "Cannot open file " << filename.string() << std::endl;
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << ifile.rdbuf();
+    std::string text = buffer.str();
+
+    std::string error;
+    if (!JsonReader(text).Parse(value, error)) {
+        std::cerr << "Error parsing " << filename.string() << ": " << error << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// =============================================================================
+// Tolerance settings
+// =============================================================================
+
+enum class Direction { LOWER_IS_BETTER, HIGHER_IS_BETTER, BOTH };
+
+struct Tolerance {
+    double rel;
+    double abs;
+    Direction direction;
+};
+
+class ToleranceTable {
+  public:
+    ToleranceTable(double rel, double abs) : m_rel(rel), m_abs(abs) {}
+
+    bool Load(const fs::path& filename) {
+        if (!ReadJsonFile(filename, m_spec))
+            return false;
+        if (const JsonValue* def = m_spec.Find("default")) {
+            m_rel = def->GetNumber("rel", m_rel);
+            m_abs = def->GetNumber("abs", m_abs);
+        }
+        return true;
+    }
+
+    /// Return the tolerance for the given metric of the given test.
+    Tolerance Get(const std::string& test, const std::string& metric) const {
+        Tolerance tol{m_rel, m_abs, DefaultDirection(metric)};
+        const JsonValue* metrics = m_spec.Find("metrics");
+        if (!metrics)
+            return tol;
+        const JsonValue* spec = metrics->Find(test + "/" + metric);
+        if (!spec)
+            spec = metrics->Find(metric);
+        if (!spec)
+            return tol;
+        tol.rel = spec->GetNumber("rel", tol.rel);
+        tol.abs = spec->GetNumber("abs", tol.abs);
+        if (const JsonValue* dir = spec->Find("direction")) {
+            if (dir->str == "lower")
+                tol.direction = Direction::LOWER_IS_BETTER;
+            else if (dir->str == "higher")
+                tol.direction = Direction::HIGHER_IS_BETTER;
+            else if (dir->str == "both")
+                tol.direction = Direction::BOTH;
+        }
+        return tol;
+    }
+
+  private:
+    static Direction DefaultDirection(const std::string& metric) {
+        return (metric.find("time") != std::string::npos) ? Direction::LOWER_IS_BETTER : Direction::BOTH;
+    }
+
+    double m_rel;
+    double m_abs;
+    JsonValue m_spec;
+};
+
+// =============================================================================
+// Comparison
+// =============================================================================
+
+enum class Status { OK, IMPROVED, REGRESSED };
+
+// Classify the change from 'base' to 'cur' under the given tolerance.
+Status Classify(double base, double cur, const Tolerance& tol) {
+    double diff = cur - base;
+    if (std::abs(diff) <= tol.abs + tol.rel * std::abs(base))
+        return Status::OK;
+    switch (tol.direction) {
+        case Direction::LOWER_IS_BETTER:
+            return (diff > 0) ? Status::REGRESSED : Status::IMPROVED;
+        case Direction::HIGHER_IS_BETTER:
+            return (diff < 0) ? Status::REGRESSED : Status::IMPROVED;
+        default:
+            return Status::REGRESSED;
+    }
+}
+
+class Report {
+  public:
+    Report(bool verbose) : m_verbose(verbose), m_num_tests(0), m_num_metrics(0), m_num_regressions(0) {}
+
+    void BeginTest(const std::string& test) {
+        m_test = test;
+        m_header = false;
+        m_num_tests++;
+    }
+
+    void Line(Status status, const std::string& metric, const std::string& detail) {
+        m_num_metrics++;
+        if (status == Status::REGRESSED)
+            m_num_regressions++;
+        if (status == Status::OK && !m_verbose)
+            return;
+        if (!m_header) {
+            std::cout << m_test << std::endl;
+            m_header = true;
+        }
+        const char* tag = (status == Status::REGRESSED) ? "REGRESSED" : (status == Status::IMPROVED) ? "improved " : "ok       ";
+        std::printf("  %s  %-40s %s\n", tag, metric.c_str(), detail.c_str());
+    }
+
+    void Error(const std::string& metric, const std::string& msg) {
+        m_num_regressions++;
+        if (!m_header) {
+            std::cout << m_test << std::endl;
+            m_header = true;
+        }
+        std::printf("  %s  %-40s %s\n", "REGRESSED", metric.c_str(), msg.c_str());
+    }
+
+    void Summary() const {
+        std::cout << std::endl;
+        std::cout << "Compared " << m_num_metrics << " metrics in " << m_num_tests << " tests: ";
+        if (m_num_regressions == 0)
+            std::cout << "no regressions." << std::endl;
+        else
+            std::cout << m_num_regressions << " regression(s)." << std::endl;
+    }
+
+    int GetNumRegressions() const { return m_num_regressions; }
+
+  private:
+    bool m_verbose;
+    std::string m_test;
+    bool m_header;
+    int m_num_tests;
+    int m_num_metrics;
+    int m_num_regressions;
+};
+
+std::string FormatChange(double base, double cur) {
+    char buf[128];
+    if (base != 0)
+        std::snprintf(buf, sizeof(buf), "%12.6g -> %12.6g  (%+.1f%%)", base, cur, 100 * (cur - base) / std::abs(base));
+    else
+        std::snprintf(buf, sizeof(buf), "%12.6g -> %12.6g", base, cur);
+    return buf;
+}
+
+// Compare two series element-wise, reporting the largest deviation.
+void CompareSeries(const std::string& metric,
+                   const JsonValue& base,
+                   const JsonValue& cur,
+                   const Tolerance& tol,
+                   Report& report) {
+    if (base.array.size() != cur.array.size()) {
+        report.Error(metric, "series length changed: " + std::to_string(base.array.size()) + " -> " +
+                                 std::to_string(cur.array.size()));
+        return;
+    }
+    Status status = Status::OK;
+    size_t worst = 0;
+    double worst_diff = -1;
+    for (size_t i = 0; i < base.array.size(); i++) {
+        double b = base.array[i].number;
+        double c = cur.array[i].number;
+        Status s = Classify(b, c, tol);
+        if (s == Status::REGRESSED || (s == Status::IMPROVED && status == Status::OK))
+            status = s;
+        if (std::abs(c - b) > worst_diff) {
+            worst_diff = std::abs(c - b);
+            worst = i;
+        }
+    }
+    std::string detail = "[" + std::to_string(base.array.size()) + " samples]";
+    if (!base.array.empty()) {
+        detail += " max deviation at " + std::to_string(worst) + ": " +
+                  FormatChange(base.array[worst].number, cur.array[worst].number);
+    }
+    report.Line(status, metric, detail);
+}
+
+void CompareScalar(const std::string& metric, double base, double cur, const Tolerance& tol, Report& report) {
+    report.Line(Classify(base, cur, tol), metric, FormatChange(base, cur));
+}
+
+// Compare the execution times, using the benchmark statistics if available for both runs.
+void CompareExecutionTime(const std::string& test,
+                          const JsonValue& base,
+                          const JsonValue& cur,
+                          const ToleranceTable& tolerances,
+                          Report& report) {
+    const JsonValue* tb = base.Find("execution_time");
+    const JsonValue* tc = cur.Find("execution_time");
+    if (!tb || !tc || !tb->IsNumber() || !tc->IsNumber())
+        return;
+
+    Tolerance tol = tolerances.Get(test, "execution_time");
+    Status status = Classify(tb->number, tc->number, tol);
+    std::string detail = FormatChange(tb->number, tc->number);
+
+    const JsonValue* bb = base.Find("benchmark");
+    const JsonValue* bc = cur.Find("benchmark");
+    if (bb && bc && status != Status::OK) {
+        // Require the confidence intervals of the medians to be disjoint
+        double b_low = bb->GetNumber("ci_low", tb->number);
+        double b_high = bb->GetNumber("ci_high", tb->number);
+        double c_low = bc->GetNumber("ci_low", tc->number);
+        double c_high = bc->GetNumber("ci_high", tc->number);
+        bool overlap = c_low <= b_high && b_low <= c_high;
+        if (overlap) {
+            status = Status::OK;
+            detail += "  (confidence intervals overlap)";
+        }
+    }
+
+    report.Line(status, "execution_time", detail);
+}
+
+void CompareTest(const std::string& test,
+                 const JsonValue& base,
+                 const JsonValue& cur,
+                 const ToleranceTable& tolerances,
+                 Report& report) {
+    report.BeginTest(test);
+
+    const JsonValue* pb = base.Find("passed");
+    const JsonValue* pc = cur.Find("passed");
+    if (pb && pc && pb->number != 0 && pc->number == 0)
+        report.Error("passed", "test no longer passes");
+
+    CompareExecutionTime(test, base, cur, tolerances, report);
+
+    const JsonValue* mb = base.Find("metrics");
+    const JsonValue* mc = cur.Find("metrics");
+    if (!mb || !mb->IsObject())
+        return;
+
+    for (const auto& member : mb->members) {
+        const std::string& metric = member.first;
+        const JsonValue& vb = member.second;
+        const JsonValue* vc = mc ? mc->Find(metric) : nullptr;
+        if (!vc) {
+            report.Error(metric, "missing from current run");
+            continue;
+        }
+        Tolerance tol = tolerances.Get(test, metric);
+        if (vb.IsNumber() && vc->IsNumber())
+            CompareScalar(metric, vb.number, vc->number, tol, report);
+        else if (vb.IsArray() && vc->IsArray())
+            CompareSeries(metric, vb, *vc, tol, report);
+        else if (vb.type == JsonValue::Type::STRING && vc->type == JsonValue::Type::STRING)
+            report.Line(vb.str == vc->str ? Status::OK : Status::REGRESSED, metric, vb.str + " -> " + vc->str);
+        else if (vb.type != vc->type)
+            report.Error(metric, "type changed");
+    }
+}
+
+// =============================================================================
+
+void ShowUsage(const char* name) {
+    std::cout << "Usage: " << name
+              << " <baseline_dir> [<current_dir>] [-t <tolerances.json>] [-r <rel_tol>] [-a <abs_tol>] [-v]"
+              << std::endl;
+    std::cout << "  <current_dir>  directory with current metrics output (default: ../METRICS)" << std::endl;
+    std::cout << "  -t             JSON file with per-metric tolerances" << std::endl;
+    std::cout << "  -r             default relative tolerance (default: 0.1)" << std::endl;
+    std::cout << "  -a             default absolute tolerance (default: 0)" << std::endl;
+    std::cout << "  -v             also list metrics within tolerance" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> dirs;
+    std::string tol_file;
+    double rel_tol = 0.1;
+    double abs_tol = 0;
+    bool verbose = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-t" && i + 1 < argc) {
+            tol_file = argv[++i];
+        } else if (arg == "-r" && i + 1 < argc) {
+            rel_tol = std::atof(argv[++i]);
+        } else if (arg == "-a" && i + 1 < argc) {
+            abs_tol = std::atof(argv[++i]);
+        } else if (arg == "-v") {
+            verbose = true;
+        } else if (arg[0] == '-') {
+            ShowUsage(argv[0]);
+            return 2;
+        } else {
+            dirs.push_back(arg);
+        }
+    }
+    if (dirs.empty() || dirs.size() > 2) {
+        ShowUsage(argv[0]);
+        return 2;
+    }
+
+    fs::path base_dir(dirs[0]);
+    fs::path cur_dir(dirs.size() > 1 ? dirs[1] : "../METRICS");
+    if (!fs::is_directory(base_dir) || !fs::is_directory(cur_dir)) {
+        std::cerr << "Invalid baseline or current directory" << std::endl;
+        return 2;
+    }
+
+    ToleranceTable tolerances(rel_tol, abs_tol);
+    if (!tol_file.empty() && !tolerances.Load(tol_file))
+        return 2;
+
+    // Process baseline files in a deterministic order
+    std::vector<fs::path> files;
+    for (const auto& entry : fs::directory_iterator(base_dir)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".json")
+            files.push_back(entry.path());
+    }
+    std::sort(files.begin(), files.end());
+
+    std::cout << "Baseline: " << base_dir.string() << std::endl;
+    std::cout << "Current:  " << cur_dir.string() << std::endl << std::endl;
+
+    Report report(verbose);
+
+    for (const auto& file : files) {
+        JsonValue base;
+        if (!ReadJsonFile(file, base))
+            return 2;
+        const JsonValue* name = base.Find("name");
+        std::string test = name ? name->str : file.stem().string();
+
+        fs::path cur_file = cur_dir / file.filename();
+        if (!fs::exists(cur_file)) {
+            report.BeginTest(test);
+            report.Error("-", "no current output (" + cur_file.string() + ")");
+            continue;
+        }
+        JsonValue cur;
+        if (!ReadJsonFile(cur_file, cur))
+            return 2;
+
+        CompareTest(test, base, cur, tolerances, report);
+    }
+
+    report.Summary();
+
+    return report.GetNumRegressions() > 0 ? 1 : 0;
+}
@@ -14,13 +14,37 @@
 //
 // Chrono::Multicore test program for settling process of granular material.
 //
+// When invoked without arguments, runs the settling test with SMC and NSC
+// contact (the latter with and without warm starting) on 2 and 4 threads.
+// Otherwise, runs a thread-scaling sweep:
+//
+//    metrics_MCORE_settling [-t <threads>] [-n <particles>] [-w <particles_per_thread>] [-m SMC|NSC|both]
+//                           [-s 0|1]
+//
+// where <threads>, <particles>, and <particles_per_thread> are comma-separated
+// lists. For each contact method, a strong-scaling table is produced for every
+// particle count (over all thread counts) and, if -w is specified, a
+// weak-scaling table for every per-thread particle count. Tables include the
+// speedup, parallel efficiency, and per-phase timing breakdown; they are
+// printed and also written to the output directory. With -s 1, the NSC solver
+// is warm-started from the contact impulses of the previous step.
+//
+// All tests report the average number of solver iterations and the average
+// residual per step, so that the effect of warm starting can be measured.
+// Broadphase bins are tuned at run time (see BinTuner), starting from an
+// estimate based on the container size; the final bins and the number of tuner
+// decisions are reported as metrics.
+//
 // The global reference frame has Z up.
 // All units SI (CGS, i.e., centimeter - gram - second)
 //
 // =============================================================================
 
+#include <algorithm>
 #include <cmath>
+#include <iomanip>
 #include <iostream>
+#include <memory>
 #include <sstream>
 #include <string>
 #include <valarray>
@@ -29,6 +53,7 @@
 
 #include "chrono/ChConfig.h"
 #include "chrono/core/ChTimer.h"
+#include "chrono/parallel/ChOpenMP.h"
 #include "chrono/utils/ChUtilsCreators.h"
 #include "chrono/utils/ChUtilsGenerators.h"
 #include "chrono/utils/ChUtilsInputOutput.h"
@@ -43,57 +68,41 @@
 #endif
 
 #include "../BaseTest.h"
+#include "../../projects/bin_tuner.h"
+#include "../../projects/timeline.h"
+#include "../../projects/warm_start.h"
 
 using namespace chrono;
 
-// --------------------------------------------------------------------------
-
-void TimingHeader() {
-    printf("    TIME    |");
-    printf("    STEP |");
-    printf("   BROAD |");
-    printf("  NARROW |");
-    printf("  SOLVER |");
-    printf("  UPDATE |");
-    printf("# BODIES |");
-    printf("# CONTACT|");
-    printf(" # ITERS |");
-    printf("   RESID |");
-    printf("\n\n");
-}
-
-void TimingOutput(chrono::ChSystem* mSys) {
-    double TIME = mSys->GetChTime();
-    double STEP = mSys->GetTimerStep();
-    double BROD = mSys->GetTimerCollisionBroad();
-    double NARR = mSys->GetTimerCollisionNarrow();
-    double SOLVER = mSys->GetTimerAdvance();
-    double UPDT = mSys->GetTimerUpdate();
-    double RESID = 0;
-    int REQ_ITS = 0;
-    int BODS = mSys->GetNbodies();
-    int CNTC = mSys->GetNcontacts();
-    if (chrono::ChSystemMulticore* mc_sys = dynamic_cast<chrono::ChSystemMulticore*>(mSys)) {
-        RESID = std::static_pointer_cast<chrono::ChIterativeSolverMulticore>(mSys->GetSolver())->GetResidual();
-        REQ_ITS = std::static_pointer_cast<chrono::ChIterativeSolverMulticore>(mSys->GetSolver())->GetIterations();
-        BODS = mc_sys->GetNbodies();
-        CNTC = mc_sys->GetNcontacts();
-    }
-
-    printf("   %8.5f | %7.4f | %7.4f | %7.4f | %7.4f | %7.4f | %7d | %7d | %7d | %7.4f |\n", TIME, STEP, BROD, NARR,
-           SOLVER, UPDT, BODS, CNTC, REQ_ITS, RESID);
-}
-
 // ====================================================================================
 
 // Test class
 class PARSettlingTest : public BaseTest {
   public:
+    /// Construct a settling test with given contact method and number of threads.
+    /// If num_particles > 0, the length of the container is adjusted to generate approximately the requested number
+    /// of particles; otherwise the default container is used.
+    /// If warm_start is true, the NSC solver is warm-started from the contact impulses of the previous step.
     PARSettlingTest(const std::string& testName,
                     const std::string& testProjectName,
                     ChContactMethod method,
-                    int num_threads)
-        : BaseTest(testName, testProjectName), m_method(method), m_execTime(0), m_num_threads(num_threads) {}
+                    int num_threads,
+                    int num_particles = 0,
+                    bool warm_start = false)
+        : BaseTest(testName, testProjectName),
+          m_method(method),
+          m_warm_start(warm_start),
+          m_execTime(0),
+          m_num_threads(num_threads),
+          m_req_particles(num_particles),
+          m_num_particles(0),
+          m_num_steps(0),
+          m_broad_time(0),
+          m_narrow_time(0),
+          m_update_time(0),
+          m_solve_time(0),
+          m_iterations(0),
+          m_residual(0) {}
 
     ~PARSettlingTest() {}
 
@@ -101,10 +110,30 @@ class PARSettlingTest : public BaseTest {
     virtual bool execute() override;
     virtual double getExecutionTime() const override { return m_execTime; }
 
+    int getNumThreads() const { return m_num_threads; }
+    int getNumParticles() const { return m_num_particles; }
+    int getNumSteps() const { return m_num_steps; }
+    double getBroadTime() const { return m_broad_time; }
+    double getNarrowTime() const { return m_narrow_time; }
+    double getUpdateTime() const { return m_update_time; }
+    double getSolveTime() const { return m_solve_time; }
+    double getIterations() const { return m_iterations; }
+    double getResidual() const { return m_residual; }
+
   private:
     ChContactMethod m_method;
+    bool m_warm_start;     // warm-start the NSC solver?
     double m_execTime;
     int m_num_threads;
+    int m_req_particles;   // requested number of particles (0: default container)
+    int m_num_particles;   // number of generated particles
+    int m_num_steps;       // number of simulation steps
+    double m_broad_time;   // total time in broad phase
+    double m_narrow_time;  // total time in narrow phase
+    double m_update_time;  // total time in update phase
+    double m_solve_time;   // total time in solve phase
+    double m_iterations;   // average number of solver iterations per step
+    double m_residual;     // average solver residual per step
 };
 
 // ====================================================================================
@@ -135,6 +164,15 @@ bool PARSettlingTest::execute() {
     ChVector<> inertia_g = 0.4 * mass_g * radius_g * radius_g * ChVector<>(1, 1, 1);
     int num_layers = 10;
 
+    // Adjust container length for the requested number of particles. The estimate assumes that Poisson disk
+    // sampling reaches the random sequential adsorption limit (packing fraction ~0.547) in each layer.
+    if (m_req_particles > 0) {
+        double d = 2 * 1.01 * radius_g;
+        double per_layer = m_req_particles / (double)num_layers;
+        double area = per_layer * (CH_C_PI * d * d / 4) / 0.547;
+        hdimX = area / (4 * (hdimY - d / 2)) + d / 2;
+    }
+
     // Terrain contact properties
     float friction_terrain = 0.9f;
     float restitution_terrain = 0.0f;
@@ -145,7 +183,7 @@ bool PARSettlingTest::execute() {
     float kt_terrain = 2.86e6f;
     float gt_terrain = 1.0e3f;
 
-    // Estimates for number of bins for broad-phase
+    // Estimates for number of bins for broad-phase (starting point of the bin tuner)
     int factor = 2;
     int binsX = (int)std::ceil(hdimX / radius_g) / factor;
     int binsY = (int)std::ceil(hdimY / radius_g) / factor;
@@ -156,8 +194,10 @@ bool PARSettlingTest::execute() {
     // Create the multicore system
     // ---------------------------
 
-    // Create system and set method-specific solver settings
-    chrono::ChSystemMulticore* system;
+    // Create system and set method-specific solver settings (released on every exit path, since the test may be
+    // executed repeatedly in benchmark mode)
+    std::unique_ptr<chrono::ChSystemMulticore> system;
+    ContactCache* warm_start = nullptr;
     double time_step;
 
     switch (m_method) {
@@ -167,7 +207,7 @@ bool PARSettlingTest::execute() {
             sys->GetSettings()->solver.contact_force_model = ChSystemSMC::Hooke;
             sys->GetSettings()->solver.tangential_displ_mode = ChSystemSMC::TangentialDisplacementModel::OneStep;
             sys->GetSettings()->solver.use_material_properties = use_mat_properties;
-            system = sys;
+            system.reset(sys);
 
             break;
         }
@@ -182,7 +222,9 @@ bool PARSettlingTest::execute() {
             sys->GetSettings()->solver.contact_recovery_speed = -1;
             sys->GetSettings()->collision.collision_envelope = 0.1 * radius_g;
             sys->ChangeSolverType(SolverType::APGD);
-            system = sys;
+            if (m_warm_start)
+                warm_start = EnableWarmStart(sys);
+            system.reset(sys);
 
             break;
         }
@@ -265,7 +307,7 @@ bool PARSettlingTest::execute() {
     // ----------------
 
     // Create a particle generator and a mixture entirely made out of spheres
-    utils::Generator gen(system);
+    utils::Generator gen(system.get());
     std::shared_ptr<utils::MixtureIngredient> m1 = gen.AddMixtureIngredient(utils::MixtureType::SPHERE, 1.0);
     m1->setDefaultMaterial(material_terrain);
     m1->setDefaultDensity(rho_g);
@@ -285,6 +327,7 @@ bool PARSettlingTest::execute() {
     }
 
     unsigned int num_particles = gen.getTotalNumBodies();
+    m_num_particles = (int)num_particles;
     std::cout << "Generated particles:  " << num_particles << std::endl;
     double total_weight = num_particles * (4 * CH_C_PI / 3) * r * r * r * rho_g * g;
     std::cout << "Total weigth:  " << total_weight << std::endl;
@@ -295,7 +338,7 @@ bool PARSettlingTest::execute() {
     // -------------------------------
     if (render) {
         opengl::ChOpenGLWindow& gl_window = opengl::ChOpenGLWindow::getInstance();
-        gl_window.Initialize(1280, 720, "Settling test", system);
+        gl_window.Initialize(1280, 720, "Settling test", system.get());
         gl_window.SetCamera(ChVector<>(0, -1, 0), ChVector<>(0, 0, 0), ChVector<>(0, 0, 1), 0.05f);
         gl_window.SetRenderMode(opengl::WIREFRAME);
     }
@@ -311,9 +354,12 @@ bool PARSettlingTest::execute() {
     double update_time = 0;
     double solve_time = 0;
     int num_steps = 0;
+    double matched = 0;
 
-    ////TimingHeader();
     double time_end = 0.5;
+    TimelineRecorder timeline((size_t)std::ceil(time_end / time_step) + 1);
+    BinTuner bin_tuner(system.get());
+    bin_tuner.SetTimeline(&timeline);
     while (system->GetChTime() < time_end) {
         system->DoStepDynamics(time_step);
 
@@ -324,7 +370,10 @@ bool PARSettlingTest::execute() {
         solve_time += system->GetTimerAdvance();
         num_steps++;
 
-        ////TimingOutput(system);
+        timeline.Record(system.get());
+        bin_tuner.Update();
+        if (warm_start)
+            matched += warm_start->GetMatchedFraction();
 
 #ifdef CHRONO_OPENGL
         if (render) {
@@ -348,19 +397,149 @@ bool PARSettlingTest::execute() {
     std::cout << "    Narrow phase:      " << narrow_time << std::endl;
     std::cout << "    Update phase:      " << update_time << std::endl;
     std::cout << "    Solve phase:       " << solve_time << std::endl;
+    vec3 bins = bin_tuner.GetBins();
+    std::cout << "Broad-phase bins (tuned): " << bins.x << " x " << bins.y << " x " << bins.z << "  ("
+              << bin_tuner.GetNumDecisions() << " decisions)" << std::endl;
+
+    // Find the most expensive step and the average solver iterations and residual
+    double max_step_time = 0;
+    double iterations = 0;
+    double residual = 0;
+    for (size_t i = 0; i < timeline.GetNumSamples(); i++) {
+        max_step_time = std::max(max_step_time, timeline.GetSample(i).step);
+        iterations += timeline.GetSample(i).iterations;
+        residual += timeline.GetSample(i).residual;
+    }
+    size_t num_samples = std::max(timeline.GetNumSamples(), (size_t)1);
+    std::cout << "Average solver iterations:  " << iterations / num_samples << std::endl;
+    std::cout << "Average solver residual:    " << residual / num_samples << std::endl;
+    if (warm_start)
+        std::cout << "Warm-started contacts:      " << 100 * matched / num_steps << " %" << std::endl;
 
     m_execTime = sim_time;
+    m_num_steps = num_steps;
+    m_broad_time = broad_time;
+    m_narrow_time = narrow_time;
+    m_update_time = update_time;
+    m_solve_time = solve_time;
+    m_iterations = iterations / num_samples;
+    m_residual = residual / num_samples;
+
+    addMetric("number_particles", m_num_particles);
     addMetric("number_contacts", ncontacts);
     addMetric("vertical_force", cforce.z);
     addMetric("avg_sim_time_per_step (ms)", 1000 * sim_time / num_steps);
+    addMetric("max_sim_time_per_step (ms)", 1000 * max_step_time);
     addMetric("avg_broad_time_per_step (ms)", 1000 * broad_time / num_steps);
     addMetric("avg_narrow_time_per_step (ms)", 1000 * narrow_time / num_steps);
     addMetric("avg_update_time_per_step (ms)", 1000 * update_time / num_steps);
     addMetric("avg_solve_time_per_step (ms)", 1000 * solve_time / num_steps);
+    addMetric("avg_solver_iterations", m_iterations);
+    addMetric("avg_solver_residual", m_residual);
+    addMetric("final_bins_x", bins.x);
+    addMetric("final_bins_y", bins.y);
+    addMetric("final_bins_z", bins.z);
+    addMetric("bin_tuner_decisions", bin_tuner.GetNumDecisions());
+    if (warm_start)
+        addMetric("avg_warm_started_contacts (%)", 100 * matched / num_steps);
 
     return true;
 }
 
+// ====================================================================================
+
+// Parse a comma-separated list of positive integers.
+std::vector<int> ParseList(const char* text) {
+    std::vector<int> values;
+    std::stringstream ss(text);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        int val = std::atoi(item.c_str());
+        if (val > 0)
+            values.push_back(val);
+    }
+    return values;
+}
+
+// Per-step timing results for one row of a scaling table.
+struct ScalingEntry {
+    int threads;
+    int particles;
+    double step;    // average time per step (ms)
+    double broad;   // average broad phase time per step (ms)
+    double narrow;  // average narrow phase time per step (ms)
+    double update;  // average update time per step (ms)
+    double solve;   // average solve time per step (ms)
+    double iters;   // average solver iterations per step
+};
+
+// Run the settling test for one combination of method, number of threads, and number of particles.
+ScalingEntry RunSettling(const std::string& name,
+                         ChContactMethod method,
+                         int num_threads,
+                         int num_particles,
+                         bool warm_start,
+                         const std::string& out_dir,
+                         int num_repetitions,
+                         int num_warmup,
+                         bool& passed) {
+    PARSettlingTest test(name, "Chrono::Multicore", method, num_threads, num_particles, warm_start);
+    test.setOutDir(out_dir);
+    test.setVerbose(true);
+    test.setBenchmark(num_repetitions, num_warmup);
+    passed &= test.run();
+    test.print();
+
+    // Scale the phase breakdown of the last repetition to the median step time
+    int n = std::max(test.getNumSteps(), 1);
+    double scale = 1;
+    if (num_repetitions > 0 && test.getExecutionTime() > 0)
+        scale = test.getBenchmarkStats().median / test.getExecutionTime();
+    ScalingEntry entry;
+    entry.threads = num_threads;
+    entry.particles = test.getNumParticles();
+    entry.step = 1000 * scale * test.getExecutionTime() / n;
+    entry.broad = 1000 * scale * test.getBroadTime() / n;
+    entry.narrow = 1000 * scale * test.getNarrowTime() / n;
+    entry.update = 1000 * scale * test.getUpdateTime() / n;
+    entry.solve = 1000 * scale * test.getSolveTime() / n;
+    entry.iters = test.getIterations();
+
+    return entry;
+}
+
+// Print a scaling table and write it to the specified file.
+// For strong scaling, the speedup is relative to the first entry (T_0 / T_i) and the efficiency is the speedup
+// divided by the relative increase in number of threads. For weak scaling, the efficiency is T_0 / T_i.
+void ReportScaling(const std::string& title,
+                   const std::vector<ScalingEntry>& table,
+                   bool weak,
+                   const std::string& filename) {
+    utils::CSV_writer csv("\t");
+    csv.stream().setf(std::ios::fixed);
+    csv.stream().precision(4);
+
+    std::cout << std::endl << title << std::endl;
+    std::cout << "  threads  particles   step(ms)  speedup  effic.   broad(ms)  narrow(ms)  update(ms)  solve(ms)"
+              << "  iterations" << std::endl;
+
+    const ScalingEntry& ref = table.front();
+    for (const auto& e : table) {
+        double speedup = ref.step / e.step;
+        double efficiency = weak ? speedup : speedup * ref.threads / e.threads;
+        std::cout << std::fixed << std::setprecision(4);
+        std::cout << std::setw(9) << e.threads << std::setw(11) << e.particles << std::setw(11) << e.step
+                  << std::setw(9) << std::setprecision(2) << speedup << std::setw(8) << efficiency
+                  << std::setprecision(4) << std::setw(12) << e.broad << std::setw(12) << e.narrow << std::setw(12)
+                  << e.update << std::setw(11) << e.solve << std::setw(12) << std::setprecision(1) << e.iters
+                  << std::endl;
+        csv << e.threads << e.particles << e.step << speedup << efficiency << e.broad << e.narrow << e.update
+            << e.solve << e.iters << std::endl;
+    }
+
+    csv.write_to_file(filename, "# threads particles step speedup efficiency broad narrow update solve iterations\n");
+}
+
 int main(int argc, char** argv) {
     std::string out_dir = "../METRICS";
     if (!filesystem::create_directory(filesystem::path(out_dir))) {
@@ -368,32 +547,101 @@ int main(int argc, char** argv) {
         return 1;
     }
 
-    bool passed = true;
+    // Benchmark mode: number of timed repetitions and warmup runs for each test
+    int num_repetitions = 3;
+    int num_warmup = 1;
 
-    PARSettlingTest testDEM2("metrics_PAR_settling_DEM_2", "Chrono::Multicore", ChContactMethod::SMC, 2);
-    PARSettlingTest testDEM4("metrics_PAR_settling_DEM_4", "Chrono::Multicore", ChContactMethod::SMC, 4);
-    PARSettlingTest testDVI2("metrics_PAR_settling_DVI_2", "Chrono::Multicore", ChContactMethod::NSC, 2);
-    PARSettlingTest testDVI4("metrics_PAR_settling_DVI_4", "Chrono::Multicore", ChContactMethod::NSC, 4);
-
-    testDEM2.setOutDir(out_dir);
-    testDEM2.setVerbose(true);
-    passed &= testDEM2.run();
-    testDEM2.print();
+    bool passed = true;
 
-    testDEM4.setOutDir(out_dir);
-    testDEM4.setVerbose(true);
-    passed &= testDEM4.run();
-    testDEM4.print();
+    // Default: run the nightly settling tests (NSC with and without warm starting)
+    if (argc == 1) {
+        for (auto method : {ChContactMethod::SMC, ChContactMethod::NSC}) {
+            for (int num_threads : {2, 4}) {
+                std::string name = std::string("metrics_PAR_settling_") +
+                                   (method == ChContactMethod::SMC ? "DEM_" : "DVI_") + std::to_string(num_threads);
+                RunSettling(name, method, num_threads, 0, false, out_dir, num_repetitions, num_warmup, passed);
+            }
+        }
+        for (int num_threads : {2, 4}) {
+            std::string name = "metrics_PAR_settling_DVI_WS_" + std::to_string(num_threads);
+            RunSettling(name, ChContactMethod::NSC, num_threads, 0, true, out_dir, num_repetitions, num_warmup, passed);
+        }
+        return !passed;
+    }
 
-    testDVI2.setOutDir(out_dir);
-    testDVI2.setVerbose(true);
-    passed &= testDVI2.run();
-    testDVI2.print();
+    // Scaling sweep
+    std::vector<int> threads_list = {1, 2, 4, 8};
+    std::vector<int> particles_list;
+    std::vector<int> weak_list;
+    std::vector<ChContactMethod> methods = {ChContactMethod::SMC, ChContactMethod::NSC};
+    bool warm_start = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cout << "Missing value for option " << arg << std::endl;
+            return 1;
+        }
+        if (arg == "-t") {
+            threads_list = ParseList(argv[++i]);
+        } else if (arg == "-n") {
+            particles_list = ParseList(argv[++i]);
+        } else if (arg == "-w") {
+            weak_list = ParseList(argv[++i]);
+        } else if (arg == "-m") {
+            std::string m = argv[++i];
+            if (m == "SMC")
+                methods = {ChContactMethod::SMC};
+            else if (m == "NSC")
+                methods = {ChContactMethod::NSC};
+        } else if (arg == "-s") {
+            warm_start = std::atoi(argv[++i]) != 0;
+        } else {
+            std::cout << "Unknown option " << arg << std::endl;
+            return 1;
+        }
+    }
+    if (threads_list.empty()) {
+        std::cout << "Empty thread list" << std::endl;
+        return 1;
+    }
+    std::sort(threads_list.begin(), threads_list.end());
+    if (particles_list.empty() && weak_list.empty())
+        particles_list.push_back(0);
+
+    int max_threads = ChOMP::GetNumProcs();
+    if (threads_list.back() > max_threads)
+        std::cout << "WARNING: more threads requested than available processors (" << max_threads << ")" << std::endl;
+
+    for (auto method : methods) {
+        std::string mname = (method == ChContactMethod::SMC) ? "SMC" : (warm_start ? "NSC_WS" : "NSC");
+
+        // Strong scaling: fixed problem size, increasing number of threads
+        for (int np : particles_list) {
+            std::vector<ScalingEntry> table;
+            for (int nt : threads_list) {
+                std::string name = "metrics_PAR_settling_" + mname + "_strong_N" + std::to_string(np) + "_T" +
+                                   std::to_string(nt);
+                table.push_back(
+                    RunSettling(name, method, nt, np, warm_start, out_dir, num_repetitions, num_warmup, passed));
+            }
+            ReportScaling("Strong scaling " + mname + " (" + std::to_string(table.front().particles) + " particles)",
+                          table, false, out_dir + "/settling_strong_" + mname + "_N" + std::to_string(np) + ".dat");
+        }
 
-    testDVI4.setOutDir(out_dir);
-    testDVI4.setVerbose(true);
-    passed &= testDVI4.run();
-    testDVI4.print();
+        // Weak scaling: fixed problem size per thread
+        for (int np : weak_list) {
+            std::vector<ScalingEntry> table;
+            for (int nt : threads_list) {
+                std::string name = "metrics_PAR_settling_" + mname + "_weak_N" + std::to_string(np) + "_T" +
+                                   std::to_string(nt);
+                table.push_back(
+                    RunSettling(name, method, nt, np * nt, warm_start, out_dir, num_repetitions, num_warmup, passed));
+            }
+            ReportScaling("Weak scaling " + mname + " (" + std::to_string(np) + " particles per thread)", table, true,
+                          out_dir + "/settling_weak_" + mname + "_N" + std::to_string(np) + ".dat");
+        }
+    }
 
-    return 0;
+    return !passed;
 }
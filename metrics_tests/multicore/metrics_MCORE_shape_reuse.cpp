@@ -0,0 +1,228 @@
+// =============================================================================
+// PROJECT CHRONO - http://projectchrono.org
+//
+// Copyright (c) 2014 projectchrono.org
+// All right reserved.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file at the top level of the distribution and at
+// http://projectchrono.org/license-chrono.txt.
+//
+// =============================================================================
+//
+// Chrono::Multicore test program for the reuse of released bodies (see
+// ShapeManager).
+//
+// A grid of spheres rests on a fixed plate, with gaps between the spheres, so
+// that every sphere has exactly one contact. Half of the spheres are released,
+// acquired again, put back in place, and the system is stepped. The test fails
+// if the number of collision shapes or the number of contacts differs from
+// that before the release (e.g. because acquiring a body added a second copy
+// of its shapes), or if released spheres still collide.
+//
+// The global reference frame has Z up.
+// All units SI.
+//
+// =============================================================================
+
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "chrono/utils/ChUtilsCreators.h"
+
+#include "chrono_multicore/physics/ChSystemMulticore.h"
+
+#include "chrono_thirdparty/filesystem/path.h"
+
+#include "../BaseTest.h"
+#include "../../projects/shape_manager.h"
+
+using namespace chrono;
+
+// ====================================================================================
+
+// Test class
+class PARShapeReuseTest : public BaseTest {
+  public:
+    PARShapeReuseTest(const std::string& testName, const std::string& testProjectName, ChContactMethod method)
+        : BaseTest(testName, testProjectName), m_method(method), m_execTime(0) {}
+
+    ~PARShapeReuseTest() {}
+
+    // Override corresponding functions in BaseTest
+    virtual bool execute() override;
+    virtual double getExecutionTime() const override { return m_execTime; }
+
+  private:
+    ChContactMethod m_method;
+    double m_execTime;
+};
+
+// ====================================================================================
+
+bool PARShapeReuseTest::execute() {
+    std::cout << "Test: " << getTestName() << std::endl;
+
+    // Sphere grid and plate dimensions
+    int num_x = 6;
+    int num_y = 6;
+    double radius = 0.05;
+    double spacing = 3 * radius;
+    double hthick = 0.1;
+    double hdim = 0.5 * (num_x + 1) * spacing;
+
+    // Create the system
+    std::unique_ptr<ChSystemMulticore> system;
+    std::shared_ptr<ChMaterialSurface> material;
+    double time_step;
+
+    switch (m_method) {
+        case ChContactMethod::SMC: {
+            time_step = 1e-4;
+            system.reset(new ChSystemMulticoreSMC);
+            material = chrono_types::make_shared<ChMaterialSurfaceSMC>();
+            break;
+        }
+        case ChContactMethod::NSC: {
+            time_step = 1e-3;
+            ChSystemMulticoreNSC* sys = new ChSystemMulticoreNSC;
+            sys->GetSettings()->solver.solver_mode = SolverMode::SLIDING;
+            sys->GetSettings()->solver.max_iteration_sliding = 50;
+            sys->GetSettings()->collision.collision_envelope = 0.1 * radius;
+            system.reset(sys);
+            material = chrono_types::make_shared<ChMaterialSurfaceNSC>();
+            break;
+        }
+    }
+
+    system->Set_G_acc(ChVector<>(0, 0, -9.81));
+    system->GetSettings()->collision.narrowphase_algorithm = NarrowPhaseType::NARROWPHASE_HYBRID_MPR;
+    system->GetSettings()->collision.bins_per_axis = vec3(4, 4, 1);
+    system->SetNumThreads(2);
+
+    // Create the plate
+    auto plate = std::shared_ptr<ChBody>(system->NewBody());
+    plate->SetIdentifier(-1);
+    plate->SetBodyFixed(true);
+    plate->SetCollide(true);
+    plate->GetCollisionModel()->ClearModel();
+    utils::AddBoxGeometry(plate.get(), material, ChVector<>(hdim, hdim, hthick), ChVector<>(0, 0, -hthick));
+    plate->GetCollisionModel()->BuildModel();
+    system->AddBody(plate);
+
+    // Create the spheres, resting on the plate (with a small initial overlap, so that the contacts are detected
+    // without a collision envelope)
+    double mass = 1000 * (4.0 / 3) * CH_C_PI * radius * radius * radius;
+    std::vector<std::shared_ptr<ChBody>> spheres;
+    std::vector<ChVector<>> positions;
+    for (int ix = 0; ix < num_x; ix++) {
+        for (int iy = 0; iy < num_y; iy++) {
+            ChVector<> pos((ix - 0.5 * (num_x - 1)) * spacing, (iy - 0.5 * (num_y - 1)) * spacing, 0.999 * radius);
+            auto sphere = std::shared_ptr<ChBody>(system->NewBody());
+            sphere->SetIdentifier((int)spheres.size());
+            sphere->SetMass(mass);
+            sphere->SetInertiaXX(0.4 * mass * radius * radius * ChVector<>(1, 1, 1));
+            sphere->SetPos(pos);
+            sphere->SetCollide(true);
+            sphere->GetCollisionModel()->ClearModel();
+            utils::AddSphereGeometry(sphere.get(), material, radius);
+            sphere->GetCollisionModel()->BuildModel();
+            system->AddBody(sphere);
+            spheres.push_back(sphere);
+            positions.push_back(pos);
+        }
+    }
+
+    ShapeManager shapes(system.get());
+
+    // Number of shapes in the data manager and number of contacts after one step
+    auto num_shapes = [&]() { return (int)system->data_manager->shape_data.id_rigid.size(); };
+    auto step = [&]() {
+        system->DoStepDynamics(time_step);
+        m_execTime += system->GetTimerStep();
+        return system->GetNcontacts();
+    };
+
+    int num_spheres = (int)spheres.size();
+    int shapes_before = num_shapes();
+    int contacts_before = step();
+    std::cout << "Shapes: " << shapes_before << "  contacts: " << contacts_before << std::endl;
+
+    // Release every other sphere
+    int num_released = 0;
+    for (int i = 0; i < num_spheres; i += 2) {
+        shapes.ReleaseBody(spheres[i]);
+        num_released++;
+    }
+    int contacts_released = step();
+    std::cout << "Released: " << num_released << "  contacts: " << contacts_released << std::endl;
+
+    // Acquire the released spheres again and put them back in place
+    int num_acquired = 0;
+    while (auto body = shapes.AcquireBody()) {
+        body->SetPos(positions[body->GetIdentifier()]);
+        body->SetRot(QUNIT);
+        body->SetPos_dt(ChVector<>(0, 0, 0));
+        body->SetWvel_loc(ChVector<>(0, 0, 0));
+        num_acquired++;
+    }
+    int contacts_after = step();
+    int shapes_after = num_shapes();
+    std::cout << "Acquired: " << num_acquired << "  shapes: " << shapes_after << "  contacts: " << contacts_after
+              << std::endl;
+
+    addMetric("number_shapes_before", shapes_before);
+    addMetric("number_shapes_after", shapes_after);
+    addMetric("number_contacts_before", contacts_before);
+    addMetric("number_contacts_released", contacts_released);
+    addMetric("number_contacts_after", contacts_after);
+
+    bool passed = true;
+    if (contacts_before != num_spheres) {
+        std::cout << "ERROR: expected " << num_spheres << " contacts before the release" << std::endl;
+        passed = false;
+    }
+    if (contacts_released != num_spheres - num_released) {
+        std::cout << "ERROR: released spheres still collide" << std::endl;
+        passed = false;
+    }
+    if (num_acquired != num_released) {
+        std::cout << "ERROR: acquired " << num_acquired << " of " << num_released << " released spheres" << std::endl;
+        passed = false;
+    }
+    if (shapes_after != shapes_before || (int)system->data_manager->num_rigid_shapes != shapes_before) {
+        std::cout << "ERROR: number of shapes changed from " << shapes_before << " to " << shapes_after << std::endl;
+        passed = false;
+    }
+    if (contacts_after != contacts_before) {
+        std::cout << "ERROR: number of contacts changed from " << contacts_before << " to " << contacts_after
+                  << std::endl;
+        passed = false;
+    }
+
+    return passed;
+}
+
+// ====================================================================================
+
+int main() {
+    std::string out_dir = "../METRICS";
+    if (!filesystem::create_directory(filesystem::path(out_dir))) {
+        std::cout << "Error creating directory " << out_dir << std::endl;
+        return 1;
+    }
+
+    bool passed = true;
+    for (auto method : {ChContactMethod::SMC, ChContactMethod::NSC}) {
+        std::string name =
+            std::string("metrics_PAR_shape_reuse_") + (method == ChContactMethod::SMC ? "DEM" : "DVI");
+        PARShapeReuseTest test(name, "Chrono::Multicore", method);
+        test.setOutDir(out_dir);
+        test.setVerbose(true);
+        passed &= test.run();
+        test.print();
+    }
+
+    return !passed;
+}
@@ -0,0 +1,282 @@
+#ifndef DEMOS_ACTIVE_WINDOW_H
+#define DEMOS_ACTIVE_WINDOW_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "chrono/physics/ChBody.h"
+#include "chrono_multicore/physics/ChSystemMulticore.h"
+
+#include "shape_manager.h"
+
+// =============================================================================
+// Moving active domain for large granular terrains.
+//
+// Only the granular particles in a horizontal window following one or more
+// tracked bodies (e.g. a vehicle chassis or wheels) are simulated. The window
+// is the bounding box of the tracked body positions, enlarged by the specified
+// margins. Particles outside the window are frozen (fixed, so they are
+// excluded from the solver):
+// - particles in a buffer ring around the window keep colliding, so that they
+//   support the active particles at the window boundary like a rigid wall;
+// - particles further away also stop colliding, so that they are excluded
+//   from collision detection. Their shapes are disabled through the family
+//   masks (see ShapeManager); toggling ChBody::SetCollide would append a new
+//   copy of the shapes every time a particle starts colliding again.
+// Frozen particles become active again when the window reaches them. Shapes
+// of other bodies of the system must be removed through the window's shape
+// manager (GetShapeManager), so that all shape indices stay consistent.
+//
+// The horizontal plane is divided in square cells; frozen particles are stored
+// in per-cell buckets (their positions do not change). The state of particles
+// changes only when the window moves into another cell: the active particles
+// are checked against the new window, and only the buckets of cells entering
+// or leaving the window or the buffer ring are visited. The cost of an update
+// therefore scales with the window size, not with the terrain size. Only the
+// first update, which buckets all particles, visits the whole terrain.
+//
+// Granular particles are selected by identifier range (by default, all bodies
+// with strictly positive identifiers).
+//
+//   ActiveWindow window(sys, Id_g);
+//   window.AddTrackedBody(vehicle->GetChassisBody());
+//   window.SetMargins(3.0, 2.0);
+//   window.SetCellSize(0.1);
+//   while (...) {
+//       window.Update();
+//       sys->DoStepDynamics(time_step);
+//   }
+
+class ActiveWindow {
+  public:
+    ActiveWindow(chrono::ChSystemMulticore* sys, int min_id = 1, int max_id = std::numeric_limits<int>::max())
+        : m_sys(sys),
+          m_shapes(sys),
+          m_min_id(min_id),
+          m_max_id(max_id),
+          m_margin_x(1),
+          m_margin_y(1),
+          m_cell_size(0.1),
+          m_buffer_cells(1),
+          m_initialized(false),
+          m_num_particles(0),
+          m_num_active(0) {}
+
+    /// Add a body followed by the window.
+    void AddTrackedBody(std::shared_ptr<chrono::ChBody> body) { m_tracked.push_back(body); }
+
+    /// Set the margins added to the bounding box of the tracked bodies in x and y (default: 1).
+    void SetMargins(double margin_x, double margin_y) {
+        m_margin_x = margin_x;
+        m_margin_y = margin_y;
+    }
+
+    /// Set the edge length of the grid cells (default: 0.1).
+    /// The window moves in steps of one cell; a cell should span a few particle diameters.
+    void SetCellSize(double size) { m_cell_size = size; }
+
+    /// Set the width, in cells, of the ring of frozen but colliding particles around the window (default: 1).
+    void SetBufferCells(int num_cells) { m_buffer_cells = std::max(0, num_cells); }
+
+    /// Update the window from the current positions of the tracked bodies, freezing the particles
+    /// which left it and activating the particles it reached. Return true if the window moved.
+    bool Update() {
+        Rect window = ComputeWindow();
+        Rect buffer = window.Grow(m_buffer_cells);
+
+        if (!m_initialized) {
+            Initialize(window, buffer);
+            return true;
+        }
+
+        if (window == m_window)
+            return false;
+
+        // Freeze the active particles which left the window
+        const auto& bodies = m_sys->Get_bodylist();
+        size_t n = 0;
+        for (size_t k = 0; k < m_active.size(); k++) {
+            int i = m_active[k];
+            int cx, cy;
+            Cell(bodies[i]->GetPos(), cx, cy);
+            if (window.Contains(cx, cy)) {
+                m_active[n++] = i;
+                continue;
+            }
+            Freeze(i, buffer.Contains(cx, cy) ? BUFFER : FROZEN);
+            m_buckets[Key(cx, cy)].push_back(i);
+        }
+        m_active.resize(n);
+
+        // Cells leaving the buffer ring: stop collisions
+        for (int cy = m_buffer.y0; cy <= m_buffer.y1; cy++) {
+            for (int cx = m_buffer.x0; cx <= m_buffer.x1; cx++) {
+                if (!buffer.Contains(cx, cy))
+                    SetBucketState(cx, cy, FROZEN);
+            }
+        }
+
+        // Cells entering the window: activate; cells entering the buffer ring: start collisions
+        for (int cy = buffer.y0; cy <= buffer.y1; cy++) {
+            for (int cx = buffer.x0; cx <= buffer.x1; cx++) {
+                if (window.Contains(cx, cy)) {
+                    if (!m_window.Contains(cx, cy))
+                        ActivateBucket(cx, cy);
+                } else if (!m_buffer.Contains(cx, cy) || m_window.Contains(cx, cy)) {
+                    SetBucketState(cx, cy, BUFFER);
+                }
+            }
+        }
+
+        m_window = window;
+        m_buffer = buffer;
+        m_num_active = (int)m_active.size();
+
+        return true;
+    }
+
+    /// Return the number of active particles.
+    int GetNumActive() const { return m_num_active; }
+
+    /// Return the number of frozen particles (including the buffer ring).
+    int GetNumFrozen() const { return m_num_particles - m_num_active; }
+
+    /// Return the shape manager used to disable the shapes of frozen particles.
+    ShapeManager& GetShapeManager() { return m_shapes; }
+
+  private:
+    enum State : char { NONE, ACTIVE, BUFFER, FROZEN };
+
+    // Rectangle of cells (inclusive bounds).
+    struct Rect {
+        int x0, y0, x1, y1;
+
+        bool Contains(int cx, int cy) const { return cx >= x0 && cx <= x1 && cy >= y0 && cy <= y1; }
+        Rect Grow(int n) const { return {x0 - n, y0 - n, x1 + n, y1 + n}; }
+        bool operator==(const Rect& other) const {
+            return x0 == other.x0 && y0 == other.y0 && x1 == other.x1 && y1 == other.y1;
+        }
+    };
+
+    void Cell(const chrono::ChVector<>& pos, int& cx, int& cy) const {
+        cx = (int)std::floor(pos.x() / m_cell_size);
+        cy = (int)std::floor(pos.y() / m_cell_size);
+    }
+
+    static int64_t Key(int cx, int cy) { return ((int64_t)cx << 32) ^ (uint32_t)cy; }
+
+    Rect ComputeWindow() const {
+        double xmin = std::numeric_limits<double>::max();
+        double ymin = std::numeric_limits<double>::max();
+        double xmax = -std::numeric_limits<double>::max();
+        double ymax = -std::numeric_limits<double>::max();
+        for (const auto& body : m_tracked) {
+            const chrono::ChVector<>& p = body->GetPos();
+            xmin = std::min(xmin, p.x());
+            ymin = std::min(ymin, p.y());
+            xmax = std::max(xmax, p.x());
+            ymax = std::max(ymax, p.y());
+        }
+        if (m_tracked.empty())
+            xmin = ymin = xmax = ymax = 0;
+        Rect r;
+        Cell(chrono::ChVector<>(xmin - m_margin_x, ymin - m_margin_y, 0), r.x0, r.y0);
+        Cell(chrono::ChVector<>(xmax + m_margin_x, ymax + m_margin_y, 0), r.x1, r.y1);
+        return r;
+    }
+
+    // Bucket all granular particles outside the window and freeze them (single pass over all bodies).
+    void Initialize(const Rect& window, const Rect& buffer) {
+        const auto& bodies = m_sys->Get_bodylist();
+        m_state.assign(bodies.size(), NONE);
+        m_active.clear();
+        m_buckets.clear();
+        m_num_particles = 0;
+        for (int i = 0; i < (int)bodies.size(); i++) {
+            int id = bodies[i]->GetIdentifier();
+            if (id < m_min_id || id > m_max_id || bodies[i]->GetBodyFixed())
+                continue;
+            m_num_particles++;
+            int cx, cy;
+            Cell(bodies[i]->GetPos(), cx, cy);
+            if (window.Contains(cx, cy)) {
+                m_state[i] = ACTIVE;
+                m_active.push_back(i);
+            } else {
+                Freeze(i, buffer.Contains(cx, cy) ? BUFFER : FROZEN);
+                m_buckets[Key(cx, cy)].push_back(i);
+            }
+        }
+        m_window = window;
+        m_buffer = buffer;
+        m_num_active = (int)m_active.size();
+        m_initialized = true;
+    }
+
+    void Freeze(int i, State state) {
+        const auto& body = m_sys->Get_bodylist()[i];
+        body->SetBodyFixed(true);
+        body->SetPos_dt(chrono::ChVector<>(0, 0, 0));
+        body->SetWvel_loc(chrono::ChVector<>(0, 0, 0));
+        if (state == FROZEN)
+            m_shapes.DisableShapes(body.get());
+        m_state[i] = state;
+    }
+
+    void SetBucketState(int cx, int cy, State state) {
+        auto it = m_buckets.find(Key(cx, cy));
+        if (it == m_buckets.end())
+            return;
+        const auto& bodies = m_sys->Get_bodylist();
+        for (int i : it->second) {
+            if (m_state[i] != state) {
+                if (state == BUFFER)
+                    m_shapes.EnableShapes(bodies[i].get());
+                else
+                    m_shapes.DisableShapes(bodies[i].get());
+                m_state[i] = state;
+            }
+        }
+    }
+
+    void ActivateBucket(int cx, int cy) {
+        auto it = m_buckets.find(Key(cx, cy));
+        if (it == m_buckets.end())
+            return;
+        const auto& bodies = m_sys->Get_bodylist();
+        for (int i : it->second) {
+            if (m_state[i] == FROZEN)
+                m_shapes.EnableShapes(bodies[i].get());
+            bodies[i]->SetBodyFixed(false);
+            m_state[i] = ACTIVE;
+            m_active.push_back(i);
+        }
+        m_buckets.erase(it);
+    }
+
+    chrono::ChSystemMulticore* m_sys;  ///< associated system
+    ShapeManager m_shapes;             ///< disables the shapes of frozen particles
+    int m_min_id;                      ///< smallest identifier of a granular particle
+    int m_max_id;                      ///< largest identifier of a granular particle
+    double m_margin_x;                 ///< window margin in x
+    double m_margin_y;                 ///< window margin in y
+    double m_cell_size;                ///< edge length of the grid cells
+    int m_buffer_cells;                ///< width of the buffer ring (in cells)
+    bool m_initialized;                ///< were the particles bucketed?
+    int m_num_particles;               ///< number of granular particles
+    int m_num_active;                  ///< number of active particles
+
+    std::vector<std::shared_ptr<chrono::ChBody>> m_tracked;   ///< bodies followed by the window
+    Rect m_window;                                            ///< current window (cells)
+    Rect m_buffer;                                            ///< current window including the buffer ring (cells)
+    std::vector<char> m_state;                                ///< state of each body (indexed as the body list)
+    std::vector<int> m_active;                                ///< body list indices of the active particles
+    std::unordered_map<int64_t, std::vector<int>> m_buckets;  ///< frozen particles in each cell
+};
+
+#endif
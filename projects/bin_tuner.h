@@ -0,0 +1,304 @@
+#ifndef DEMOS_BIN_TUNER_H
+#define DEMOS_BIN_TUNER_H
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+
+#include "chrono_multicore/physics/ChSystemMulticore.h"
+
+#include "timeline.h"
+
+// =============================================================================
+// Run-time tuning of the number of broadphase bins of a Chrono::Multicore
+// system.
+//
+// The tuner measures the average collision detection time (broadphase plus
+// narrowphase) per step over a window of steps and searches for the total
+// number of bins minimizing it. Bins are distributed over the three axes in
+// proportion to the extents of the collision bounding box, so that elongated
+// domains get (roughly) cubic bins. The search starts from the current bins
+// (the first candidate reshapes them to the domain), then repeatedly scales the
+// total number of bins up or down by a factor, keeping a candidate only if it
+// improves the cost by more than a tolerance. When neither direction improves,
+// the factor is reduced; once it drops below a minimum, the best bins are kept.
+// Tuning restarts after a given number of steps, or earlier if the number of
+// bodies changes significantly, to follow changes in particle distribution.
+//
+// Decisions are printed (if verbose) and added as markers to an optional
+// timeline recorder, so they appear in its Chrome trace.
+//
+//   BinTuner tuner(sys);
+//   tuner.SetTimeline(&timeline);
+//   while (...) {
+//       sys->DoStepDynamics(time_step);
+//       timeline.Record(sys);
+//       tuner.Update();
+//   }
+
+class BinTuner {
+  public:
+    explicit BinTuner(chrono::ChSystemMulticore* sys, int window = 20)
+        : m_sys(sys),
+          m_timeline(nullptr),
+          m_verbose(false),
+          m_window(window),
+          m_initial_factor(2),
+          m_min_factor(1.1),
+          m_tolerance(0.02),
+          m_retune_interval(5000),
+          m_min_bins(1),
+          m_max_bins(1000),
+          m_state(INITIAL),
+          m_step(0),
+          m_restart_step(0),
+          m_skip(false),
+          m_num_decisions(0),
+          m_cost_sum(0),
+          m_cost_steps(0),
+          m_num_bodies(0),
+          m_best_bins(sys->GetSettings()->collision.bins_per_axis),
+          m_best_total(0),
+          m_best_cost(0),
+          m_total(0),
+          m_factor(2),
+          m_dir(0),
+          m_reshape(false),
+          m_extents(1, 1, 1) {
+        m_rejected[0] = m_rejected[1] = false;
+    }
+
+    /// Set the number of steps over which the cost of a candidate is averaged.
+    void SetWindow(int steps) { m_window = std::max(1, steps); }
+
+    /// Set the initial factor by which the total number of bins is scaled (default: 2).
+    void SetStepFactor(double factor) { m_initial_factor = std::max(factor, m_min_factor); }
+
+    /// Set the relative cost improvement required to accept a candidate (default: 0.02).
+    void SetTolerance(double tolerance) { m_tolerance = tolerance; }
+
+    /// Set the number of steps after which tuning restarts (default: 5000; 0: never).
+    void SetRetuneInterval(int steps) { m_retune_interval = steps; }
+
+    /// Set the minimum and maximum number of bins per axis (default: 1 and 1000).
+    void SetBinRange(int min_bins, int max_bins) {
+        m_min_bins = std::max(1, min_bins);
+        m_max_bins = std::max(m_min_bins, max_bins);
+    }
+
+    /// Add decisions as markers to the specified timeline recorder.
+    void SetTimeline(TimelineRecorder* timeline) { m_timeline = timeline; }
+
+    /// Print decisions.
+    void SetVerbose(bool verbose) { m_verbose = verbose; }
+
+    /// Update the tuner after a simulation step. Return true if the bins were changed.
+    bool Update() {
+        m_step++;
+
+        if (m_state == INITIAL)
+            return Restart("start");
+
+        if (m_state == CONVERGED) {
+            int num_bodies = (int)m_sys->data_manager->num_rigid_bodies;
+            if (std::abs(num_bodies - m_num_bodies) > 0.25 * m_num_bodies)
+                return Restart("bodies");
+            if (m_retune_interval > 0 && m_step - m_restart_step >= m_retune_interval)
+                return Restart("retune");
+            return false;
+        }
+
+        // Skip the first step after a change of the bins
+        if (m_skip) {
+            m_skip = false;
+            return false;
+        }
+
+        m_cost_sum += m_sys->GetTimerCollisionBroad() + m_sys->GetTimerCollisionNarrow();
+        if (++m_cost_steps < m_window)
+            return false;
+
+        double cost = m_cost_sum / m_cost_steps;
+        m_cost_sum = 0;
+        m_cost_steps = 0;
+
+        if (m_state == MEASURE) {
+            m_best_cost = cost;
+            Log("measure", GetBins(), cost);
+            return NextProbe();
+        }
+
+        // Evaluate the current candidate
+        chrono::vec3 bins = GetBins();
+        if (cost < (1 - m_tolerance) * m_best_cost) {
+            m_best_bins = bins;
+            m_best_total = m_total;
+            m_best_cost = cost;
+            Log("accept", bins, cost);
+            // Continue in the same direction; the opposite one cannot improve.
+            m_rejected[0] = m_rejected[1] = false;
+            if (m_dir != 0)
+                m_rejected[m_dir > 0 ? 0 : 1] = true;
+        } else {
+            Log("reject", bins, cost);
+            if (m_dir != 0)
+                m_rejected[m_dir > 0 ? 1 : 0] = true;
+        }
+
+        return NextProbe();
+    }
+
+    /// Return the current number of bins per axis.
+    chrono::vec3 GetBins() const { return m_sys->GetSettings()->collision.bins_per_axis; }
+
+    /// Return the best number of bins per axis found so far.
+    chrono::vec3 GetBestBins() const { return m_best_bins; }
+
+    /// Return the average collision detection time per step with the best bins.
+    double GetBestCost() const { return m_best_cost; }
+
+    /// Return true if the tuner settled on a number of bins.
+    bool IsConverged() const { return m_state == CONVERGED; }
+
+    /// Return the number of decisions (search starts, measurements, accepted and rejected candidates, convergences).
+    int GetNumDecisions() const { return m_num_decisions; }
+
+  private:
+    enum State { INITIAL, MEASURE, PROBE, CONVERGED };
+
+    // Start a new search from the current bins.
+    bool Restart(const char* reason) {
+        const auto& measures = m_sys->data_manager->measures.collision;
+        chrono::real3 ext = measures.max_bounding_point - measures.min_bounding_point;
+        double max_ext = std::max(std::max(ext.x, ext.y), ext.z);
+        if (max_ext > 0)
+            m_extents = chrono::real3(std::max(ext.x, 1e-3 * max_ext), std::max(ext.y, 1e-3 * max_ext),
+                                      std::max(ext.z, 1e-3 * max_ext));
+
+        m_num_bodies = (int)m_sys->data_manager->num_rigid_bodies;
+        m_restart_step = m_step;
+        m_best_bins = GetBins();
+        m_best_total = (double)m_best_bins.x * m_best_bins.y * m_best_bins.z;
+        m_total = m_best_total;
+        m_factor = m_initial_factor;
+        m_dir = 0;
+        m_reshape = true;
+        m_rejected[0] = m_rejected[1] = false;
+        m_cost_sum = 0;
+        m_cost_steps = 0;
+        m_skip = false;
+        m_state = MEASURE;
+        Log(reason, m_best_bins, 0);
+        return false;
+    }
+
+    // Apply the next candidate (or the best bins, if the search is done).
+    bool NextProbe() {
+        if (m_reshape) {
+            m_reshape = false;
+            m_dir = 0;
+            chrono::vec3 bins = ComputeBins(m_best_total);
+            if (!SameBins(bins, m_best_bins))
+                return Apply(bins, m_best_total);
+        }
+
+        while (true) {
+            if (m_rejected[0] && m_rejected[1]) {
+                m_factor = std::sqrt(m_factor);
+                m_rejected[0] = m_rejected[1] = false;
+                if (m_factor < m_min_factor)
+                    return Converge();
+            }
+            if (m_dir == 0 || m_rejected[m_dir > 0 ? 1 : 0])
+                m_dir = m_rejected[1] ? -1 : 1;
+            double total = (m_dir > 0) ? m_best_total * m_factor : m_best_total / m_factor;
+            chrono::vec3 bins = ComputeBins(total);
+            if (!SameBins(bins, m_best_bins))
+                return Apply(bins, total);
+            m_rejected[m_dir > 0 ? 1 : 0] = true;
+        }
+    }
+
+    bool Converge() {
+        bool changed = !SameBins(GetBins(), m_best_bins);
+        if (changed)
+            m_sys->GetSettings()->collision.bins_per_axis = m_best_bins;
+        m_total = m_best_total;
+        m_state = CONVERGED;
+        Log("converged", m_best_bins, m_best_cost);
+        return changed;
+    }
+
+    bool Apply(const chrono::vec3& bins, double total) {
+        m_sys->GetSettings()->collision.bins_per_axis = bins;
+        m_total = total;
+        m_skip = true;
+        m_state = PROBE;
+        return true;
+    }
+
+    // Distribute the given total number of bins in proportion to the domain extents.
+    chrono::vec3 ComputeBins(double total) const {
+        double volume = m_extents.x * m_extents.y * m_extents.z;
+        double size = std::cbrt(volume / std::max(total, 1.0));
+        return chrono::vec3(ClampBins(m_extents.x / size), ClampBins(m_extents.y / size),
+                            ClampBins(m_extents.z / size));
+    }
+
+    int ClampBins(double n) const { return std::min(std::max((int)std::round(n), m_min_bins), m_max_bins); }
+
+    static bool SameBins(const chrono::vec3& a, const chrono::vec3& b) {
+        return a.x == b.x && a.y == b.y && a.z == b.z;
+    }
+
+    void Log(const char* decision, const chrono::vec3& bins, double cost) {
+        m_num_decisions++;
+        if (m_verbose) {
+            std::cout << "Bin tuner (step " << m_step << "): " << decision << "  bins " << bins.x << " x " << bins.y
+                      << " x " << bins.z;
+            if (cost > 0)
+                std::cout << "  collision time " << 1e3 * cost << " ms";
+            std::cout << std::endl;
+        }
+        if (m_timeline) {
+            m_timeline->AddMarker(std::string("bins ") + decision, {{"bins_x", (double)bins.x},
+                                                                      {"bins_y", (double)bins.y},
+                                                                      {"bins_z", (double)bins.z},
+                                                                      {"collision_ms", 1e3 * cost}});
+        }
+    }
+
+    chrono::ChSystemMulticore* m_sys;  ///< associated system
+    TimelineRecorder* m_timeline;      ///< recorder for decision markers (may be null)
+    bool m_verbose;                    ///< print decisions?
+
+    int m_window;             ///< number of steps per cost measurement
+    double m_initial_factor;  ///< initial scaling factor for the total number of bins
+    double m_min_factor;      ///< scaling factor below which the search stops
+    double m_tolerance;       ///< relative improvement required to accept a candidate
+    int m_retune_interval;    ///< number of steps between searches (0: no re-tuning)
+    int m_min_bins;           ///< minimum number of bins per axis
+    int m_max_bins;           ///< maximum number of bins per axis
+
+    State m_state;       ///< current state of the search
+    int m_step;          ///< number of updates
+    int m_restart_step;  ///< update at which the current search started
+    bool m_skip;         ///< skip the next step (first step after a change)
+    int m_num_decisions; ///< number of decisions
+    double m_cost_sum;   ///< accumulated collision detection time
+    int m_cost_steps;    ///< number of accumulated steps
+    int m_num_bodies;    ///< number of bodies when the search started
+
+    chrono::vec3 m_best_bins;  ///< best bins found so far
+    double m_best_total;       ///< total number of bins (before rounding) of the best bins
+    double m_best_cost;        ///< average collision detection time with the best bins
+    double m_total;            ///< total number of bins (before rounding) of the current bins
+    double m_factor;           ///< current scaling factor
+    int m_dir;                 ///< direction of the current candidate (+1: more bins, -1: fewer, 0: reshape)
+    bool m_reshape;            ///< first candidate reshapes the bins to the domain?
+    bool m_rejected[2];        ///< directions (fewer, more) rejected at the current factor
+    chrono::real3 m_extents;   ///< extents of the collision bounding box
+};
+
+#endif
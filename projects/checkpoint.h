@@ -0,0 +1,628 @@
+#ifndef DEMOS_CHECKPOINT_H
+#define DEMOS_CHECKPOINT_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "chrono/physics/ChSystem.h"
+#include "chrono/physics/ChMaterialSurfaceNSC.h"
+#include "chrono/physics/ChMaterialSurfaceSMC.h"
+#include "chrono/utils/ChUtilsCreators.h"
+#include "chrono/utils/ChUtilsInputOutput.h"
+
+// =============================================================================
+// Binary checkpoint files.
+//
+// Store the same information as utils::WriteCheckpoint (body states, collision
+// shapes and their materials), but as flat arrays of fixed-size records. The
+// records are filled in parallel when writing and validated in parallel when
+// reading. Bodies are then constructed one at a time (creating Chrono objects
+// is not thread-safe) and added to the system in the order in which they were
+// written; each AddBody adds the collision shapes of its body to the collision
+// system, as with utils::ReadCheckpoint. There is no bulk path filling the
+// collision system data directly, so only parsing and validation are faster
+// than with text checkpoint files.
+//
+// File layout (little-endian, as in memory):
+//   char[4]   magic "CHKP"
+//   uint32    format version (1)
+//   uint32    contact method (0: NSC, 1: SMC)
+//   uint32    number of sections (3)
+// followed by the sections "BODY" (CheckpointBody records), "MATL"
+// (CheckpointMaterial records) and "SHPE" (CheckpointShape records), each
+// with the header
+//   char[4]   section tag
+//   uint32    size of one record
+//   uint64    number of records
+//   uint64    checksum of the section data
+//
+// Materials shared by several shapes are written once.
+
+struct CheckpointBody {
+    double mass;
+    double inertiaXX[3];
+    double inertiaXY[3];
+    double pos[3];
+    double rot[4];
+    double pos_dt[3];
+    double rot_dt[4];
+    uint64_t first_shape;  ///< index of first shape of this body
+    int32_t identifier;
+    uint32_t num_shapes;
+    int16_t family_group;
+    int16_t family_mask;
+    uint8_t fixed;
+    uint8_t collide;
+    uint8_t padding[2];
+};
+
+struct CheckpointMaterial {
+    double props[12];  ///< material properties (see CheckpointMaterialData)
+};
+
+struct CheckpointShape {
+    double pos[3];
+    double rot[4];
+    double dims[4];    ///< shape dimensions (as returned by ChCollisionModel::GetShapeDimensions)
+    int32_t type;      ///< shape type (ChCollisionShape::Type)
+    int32_t material;  ///< index of the shape material
+};
+
+// -----------------------------------------------------------------------------
+
+namespace checkpoint_impl {
+
+struct SectionHeader {
+    char tag[4];
+    uint32_t record_size;
+    uint64_t num_records;
+    uint64_t checksum;
+};
+
+// 64-bit checksum of a memory block. The block is split into 1 MB chunks, each
+// hashed in parallel with FNV-1a; the result does not depend on the number of threads.
+inline uint64_t Checksum(const void* data, size_t size) {
+    const size_t chunk = size_t(1) << 20;
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    int num_chunks = (int)((size + chunk - 1) / chunk);
+    std::vector<uint64_t> hashes(num_chunks);
+#pragma omp parallel for
+    for (int i = 0; i < num_chunks; i++) {
+        size_t end = std::min(size, (i + 1) * chunk);
+        uint64_t h = 14695981039346656037ULL;
+        for (size_t j = i * chunk; j < end; j++)
+            h = (h ^ bytes[j]) * 1099511628211ULL;
+        hashes[i] = h;
+    }
+    uint64_t h = 14695981039346656037ULL;
+    for (uint64_t x : hashes)
+        h = (h ^ x) * 1099511628211ULL;
+    return h ^ size;
+}
+
+inline void CopyVector(const chrono::ChVector<>& v, double* out) {
+    out[0] = v.x();
+    out[1] = v.y();
+    out[2] = v.z();
+}
+
+inline void CopyQuaternion(const chrono::ChQuaternion<>& q, double* out) {
+    out[0] = q.e0();
+    out[1] = q.e1();
+    out[2] = q.e2();
+    out[3] = q.e3();
+}
+
+inline chrono::ChVector<> ToVector(const double* v) {
+    return chrono::ChVector<>(v[0], v[1], v[2]);
+}
+
+inline chrono::ChQuaternion<> ToQuaternion(const double* q) {
+    return chrono::ChQuaternion<>(q[0], q[1], q[2], q[3]);
+}
+
+// Material properties, in the same order as in utils::WriteCheckpoint.
+inline void CheckpointMaterialData(const std::shared_ptr<chrono::ChMaterialSurface>& material,
+                                   chrono::ChContactMethod method,
+                                   CheckpointMaterial& out) {
+    std::memset(&out, 0, sizeof(out));
+    double* p = out.props;
+    if (method == chrono::ChContactMethod::NSC) {
+        auto mat = std::static_pointer_cast<chrono::ChMaterialSurfaceNSC>(material);
+        double values[] = {mat->static_friction, mat->sliding_friction, mat->rolling_friction,
+                           mat->spinning_friction, mat->restitution, mat->cohesion, mat->dampingf,
+                           mat->compliance, mat->complianceT, mat->complianceRoll, mat->complianceSpin};
+        std::memcpy(p, values, sizeof(values));
+    } else {
+        auto mat = std::static_pointer_cast<chrono::ChMaterialSurfaceSMC>(material);
+        double values[] = {mat->young_modulus, mat->poisson_ratio, mat->static_friction, mat->sliding_friction,
+                           mat->restitution, mat->constant_adhesion, mat->adhesionMultDMT,
+                           mat->kn, mat->gn, mat->kt, mat->gt};
+        std::memcpy(p, values, sizeof(values));
+    }
+}
+
+inline std::shared_ptr<chrono::ChMaterialSurface> CreateMaterial(const CheckpointMaterial& data,
+                                                                 chrono::ChContactMethod method) {
+    const double* p = data.props;
+    if (method == chrono::ChContactMethod::NSC) {
+        auto mat = chrono_types::make_shared<chrono::ChMaterialSurfaceNSC>();
+        mat->static_friction = (float)p[0];
+        mat->sliding_friction = (float)p[1];
+        mat->rolling_friction = (float)p[2];
+        mat->spinning_friction = (float)p[3];
+        mat->restitution = (float)p[4];
+        mat->cohesion = (float)p[5];
+        mat->dampingf = (float)p[6];
+        mat->compliance = (float)p[7];
+        mat->complianceT = (float)p[8];
+        mat->complianceRoll = (float)p[9];
+        mat->complianceSpin = (float)p[10];
+        return mat;
+    }
+    auto mat = chrono_types::make_shared<chrono::ChMaterialSurfaceSMC>();
+    mat->young_modulus = (float)p[0];
+    mat->poisson_ratio = (float)p[1];
+    mat->static_friction = (float)p[2];
+    mat->sliding_friction = (float)p[3];
+    mat->restitution = (float)p[4];
+    mat->constant_adhesion = (float)p[5];
+    mat->adhesionMultDMT = (float)p[6];
+    mat->kn = (float)p[7];
+    mat->gn = (float)p[8];
+    mat->kt = (float)p[9];
+    mat->gt = (float)p[10];
+    return mat;
+}
+
+// Add a collision shape (and its visualization asset) to the given body.
+inline bool IsSupportedShape(int32_t type) {
+    using chrono::collision::ChCollisionShape;
+    switch (type) {
+        case ChCollisionShape::Type::SPHERE:
+        case ChCollisionShape::Type::ELLIPSOID:
+        case ChCollisionShape::Type::BOX:
+        case ChCollisionShape::Type::CAPSULE:
+        case ChCollisionShape::Type::CYLINDER:
+        case ChCollisionShape::Type::CONE:
+        case ChCollisionShape::Type::ROUNDEDBOX:
+        case ChCollisionShape::Type::ROUNDEDCYL:
+            return true;
+        default:
+            return false;
+    }
+}
+
+inline bool AddShape(chrono::ChBody* body,
+                     const CheckpointShape& shape,
+                     const std::shared_ptr<chrono::ChMaterialSurface>& mat) {
+    using namespace chrono;
+    using namespace chrono::collision;
+    ChVector<> pos = ToVector(shape.pos);
+    ChQuaternion<> rot = ToQuaternion(shape.rot);
+    const double* d = shape.dims;
+    switch (shape.type) {
+        case ChCollisionShape::Type::SPHERE:
+            utils::AddSphereGeometry(body, mat, d[0], pos, rot);
+            return true;
+        case ChCollisionShape::Type::ELLIPSOID:
+            utils::AddEllipsoidGeometry(body, mat, ChVector<>(d[0], d[1], d[2]), pos, rot);
+            return true;
+        case ChCollisionShape::Type::BOX:
+            utils::AddBoxGeometry(body, mat, ChVector<>(d[0], d[1], d[2]), pos, rot);
+            return true;
+        case ChCollisionShape::Type::CAPSULE:
+            utils::AddCapsuleGeometry(body, mat, d[0], d[1], pos, rot);
+            return true;
+        case ChCollisionShape::Type::CYLINDER:
+            utils::AddCylinderGeometry(body, mat, d[0], d[2], pos, rot);
+            return true;
+        case ChCollisionShape::Type::CONE:
+            utils::AddConeGeometry(body, mat, d[0], d[2], pos, rot);
+            return true;
+        case ChCollisionShape::Type::ROUNDEDBOX:
+            utils::AddRoundedBoxGeometry(body, mat, ChVector<>(d[0], d[1], d[2]), d[3], pos, rot);
+            return true;
+        case ChCollisionShape::Type::ROUNDEDCYL:
+            utils::AddRoundedCylinderGeometry(body, mat, d[0], d[2], d[3], pos, rot);
+            return true;
+        default:
+            return false;
+    }
+}
+
+inline long long FileSize(FILE* fp) {
+#ifdef _WIN32
+    _fseeki64(fp, 0, SEEK_END);
+    long long size = _ftelli64(fp);
+    _fseeki64(fp, 0, SEEK_SET);
+#else
+    fseeko(fp, 0, SEEK_END);
+    long long size = (long long)ftello(fp);
+    fseeko(fp, 0, SEEK_SET);
+#endif
+    return size;
+}
+
+inline void WriteSection(FILE* fp, const char* tag, const void* data, uint32_t record_size, uint64_t num) {
+    SectionHeader header;
+    std::memcpy(header.tag, tag, 4);
+    header.record_size = record_size;
+    header.num_records = num;
+    header.checksum = Checksum(data, (size_t)(record_size * num));
+    std::fwrite(&header, sizeof(header), 1, fp);
+    std::fwrite(data, record_size, (size_t)num, fp);
+}
+
+// Locate and verify a section in the file buffer; return a pointer to its records (nullptr on error).
+inline const char* ReadSection(const std::vector<char>& buffer,
+                               size_t& offset,
+                               const char* tag,
+                               uint32_t record_size,
+                               uint64_t& num) {
+    SectionHeader header;
+    if (offset + sizeof(header) > buffer.size())
+        return nullptr;
+    std::memcpy(&header, &buffer[offset], sizeof(header));
+    offset += sizeof(header);
+    if (std::memcmp(header.tag, tag, 4) != 0 || header.record_size != record_size)
+        return nullptr;
+    if (header.num_records > (buffer.size() - offset) / record_size)
+        return nullptr;
+    size_t size = (size_t)(header.num_records * record_size);
+    const char* data = buffer.data() + offset;
+    if (Checksum(data, size) != header.checksum) {
+        std::cout << "ReadCheckpointBinary: checksum mismatch in section " << std::string(tag, 4) << std::endl;
+        return nullptr;
+    }
+    offset += size;
+    num = header.num_records;
+    return data;
+}
+
+}  // end namespace checkpoint_impl
+
+// -----------------------------------------------------------------------------
+
+/// Checkpoint records of all bodies in a system (see CaptureCheckpoint).
+struct CheckpointData {
+    chrono::ChContactMethod method;
+    std::vector<CheckpointBody> bodies;
+    std::vector<CheckpointMaterial> materials;
+    std::vector<CheckpointShape> shapes;
+};
+
+/// Fill the checkpoint records of all bodies in the given system.
+/// Return false if a collision shape of unsupported type is encountered.
+inline bool CaptureCheckpoint(chrono::ChSystem* system, CheckpointData& data) {
+    using namespace checkpoint_impl;
+    auto& bodies = system->Get_bodylist();
+    chrono::ChContactMethod method = system->GetContactMethod();
+    int num_bodies = (int)bodies.size();
+
+    // Assign shape ranges and collect the unique materials
+    std::vector<CheckpointBody>& body_data = data.bodies;
+    std::vector<CheckpointMaterial>& material_data = data.materials;
+    data.method = method;
+    body_data.resize(num_bodies);
+    material_data.clear();
+    std::unordered_map<const chrono::ChMaterialSurface*, int32_t> material_index;
+    std::vector<int32_t> shape_material;
+    uint64_t num_shapes = 0;
+    for (int i = 0; i < num_bodies; i++) {
+        auto model = bodies[i]->GetCollisionModel();
+        int n = model->GetNumShapes();
+        body_data[i].first_shape = num_shapes;
+        body_data[i].num_shapes = (uint32_t)n;
+        num_shapes += n;
+        for (int j = 0; j < n; j++) {
+            auto mat = model->GetShape(j)->GetMaterial();
+            auto found = material_index.find(mat.get());
+            if (found == material_index.end()) {
+                found = material_index.emplace(mat.get(), (int32_t)material_data.size()).first;
+                material_data.emplace_back();
+                CheckpointMaterialData(mat, method, material_data.back());
+            }
+            shape_material.push_back(found->second);
+        }
+    }
+
+    // Fill body and shape records
+    std::vector<CheckpointShape>& shape_data = data.shapes;
+    shape_data.resize((size_t)num_shapes);
+    int unsupported = 0;
+#pragma omp parallel for reduction(+ : unsupported)
+    for (int i = 0; i < num_bodies; i++) {
+        const auto& body = bodies[i];
+        auto model = body->GetCollisionModel();
+        CheckpointBody& b = body_data[i];
+        b.mass = body->GetMass();
+        CopyVector(body->GetInertiaXX(), b.inertiaXX);
+        CopyVector(body->GetInertiaXY(), b.inertiaXY);
+        CopyVector(body->GetPos(), b.pos);
+        CopyQuaternion(body->GetRot(), b.rot);
+        CopyVector(body->GetPos_dt(), b.pos_dt);
+        CopyQuaternion(body->GetRot_dt(), b.rot_dt);
+        b.identifier = body->GetIdentifier();
+        b.family_group = model->GetFamilyGroup();
+        b.family_mask = model->GetFamilyMask();
+        b.fixed = body->GetBodyFixed();
+        b.collide = body->GetCollide();
+        b.padding[0] = b.padding[1] = 0;
+
+        for (uint32_t j = 0; j < b.num_shapes; j++) {
+            CheckpointShape& s = shape_data[b.first_shape + j];
+            std::memset(&s, 0, sizeof(s));
+            chrono::ChCoordsys<> csys = model->GetShapePos(j);
+            CopyVector(csys.pos, s.pos);
+            CopyQuaternion(csys.rot, s.rot);
+            std::vector<double> dims = model->GetShapeDimensions(j);
+            if (dims.empty() || dims.size() > 4)
+                unsupported++;
+            for (size_t k = 0; k < dims.size() && k < 4; k++)
+                s.dims[k] = dims[k];
+            s.type = model->GetShape(j)->GetType();
+            s.material = shape_material[b.first_shape + j];
+        }
+    }
+    if (unsupported) {
+        std::cout << "WriteCheckpointBinary ERROR: unknown or not supported collision shape" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+/// Write a binary checkpoint file with the given checkpoint records.
+/// Return false if the file cannot be written.
+inline bool WriteCheckpointData(const CheckpointData& data, const std::string& filename) {
+    using namespace checkpoint_impl;
+    FILE* fp = std::fopen(filename.c_str(), "wb");
+    if (!fp)
+        return false;
+    const char magic[4] = {'C', 'H', 'K', 'P'};
+    uint32_t header[3] = {1, data.method == chrono::ChContactMethod::NSC ? 0u : 1u, 3};
+    std::fwrite(magic, 1, 4, fp);
+    std::fwrite(header, sizeof(header), 1, fp);
+    WriteSection(fp, "BODY", data.bodies.data(), sizeof(CheckpointBody), data.bodies.size());
+    WriteSection(fp, "MATL", data.materials.data(), sizeof(CheckpointMaterial), data.materials.size());
+    WriteSection(fp, "SHPE", data.shapes.data(), sizeof(CheckpointShape), data.shapes.size());
+    bool ok = !std::ferror(fp);
+    return (std::fclose(fp) == 0) && ok;
+}
+
+/// Write a binary checkpoint file with all bodies in the given system.
+/// Return false if a collision shape of unsupported type is encountered or the file cannot be written.
+inline bool WriteCheckpointBinary(chrono::ChSystem* system, const std::string& filename) {
+    CheckpointData data;
+    return CaptureCheckpoint(system, data) && WriteCheckpointData(data, filename);
+}
+
+// -----------------------------------------------------------------------------
+
+/// Background writer for binary checkpoint files.
+/// The body states are captured on the calling thread (so the system can be advanced
+/// right after Write returns) and written to file by a persistent writer thread. At most
+/// one checkpoint is kept waiting; the caller blocks only if a second one is requested
+/// before the writer catches up.
+class CheckpointWriter {
+  public:
+    CheckpointWriter() : m_pending(0), m_failed(0), m_stop(false) {}
+    ~CheckpointWriter() { Shutdown(); }
+
+    /// Capture the state of the given system and queue it for writing to the specified file.
+    /// Return false if the state cannot be captured (unsupported collision shape).
+    bool Write(chrono::ChSystem* system, const std::string& filename) {
+        std::unique_ptr<Job> job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (!m_thread.joinable()) {
+                m_stop = false;
+                m_thread = std::thread(&CheckpointWriter::Run, this);
+            }
+            m_space_cv.wait(lock, [&] { return m_pending < 2; });
+            m_pending++;
+            if (m_free)
+                job = std::move(m_free);
+        }
+        if (!job)
+            job.reset(new Job);
+
+        // Capture outside the lock (reuses the capacity of a recycled job)
+        job->filename = filename;
+        if (!CaptureCheckpoint(system, job->data)) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_pending--;
+            m_space_cv.notify_all();
+            return false;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_queue.push_back(std::move(job));
+        }
+        m_work_cv.notify_one();
+        return true;
+    }
+
+    /// Block until all queued checkpoints are written.
+    /// Return the number of checkpoint files which could not be written so far.
+    int Flush() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_space_cv.wait(lock, [&] { return m_pending == 0; });
+        return m_failed;
+    }
+
+    /// Write all queued checkpoints and stop the writer thread.
+    void Shutdown() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_work_cv.notify_one();
+        if (m_thread.joinable())
+            m_thread.join();
+    }
+
+  private:
+    struct Job {
+        std::string filename;
+        CheckpointData data;
+    };
+
+    void Run() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            m_work_cv.wait(lock, [&] { return m_stop || !m_queue.empty(); });
+            if (m_queue.empty())
+                break;
+            std::unique_ptr<Job> job = std::move(m_queue.front());
+            m_queue.pop_front();
+            lock.unlock();
+
+            bool ok = WriteCheckpointData(job->data, job->filename);
+            if (!ok)
+                std::cout << "CheckpointWriter ERROR: cannot write " << job->filename << std::endl;
+
+            lock.lock();
+            m_failed += !ok;
+            m_pending--;
+            m_free = std::move(job);
+            m_space_cv.notify_all();
+        }
+    }
+
+    int m_pending;                             ///< number of captured or queued checkpoints not yet written
+    int m_failed;                              ///< number of checkpoint files which could not be written
+    bool m_stop;                               ///< stop the writer thread when the queue is empty?
+    std::deque<std::unique_ptr<Job>> m_queue;  ///< checkpoints waiting to be written
+    std::unique_ptr<Job> m_free;               ///< recycled job (retains the record buffers)
+    std::mutex m_mutex;
+    std::condition_variable m_work_cv;
+    std::condition_variable m_space_cv;
+    std::thread m_thread;
+};
+
+/// Create bodies from a checkpoint file written by WriteCheckpointBinary and add them to the system.
+/// Text checkpoint files (written by utils::WriteCheckpoint) are passed on to utils::ReadCheckpoint.
+/// Return false if the file cannot be read, is corrupted or incompatible, or contains no bodies.
+inline bool ReadCheckpointBinary(chrono::ChSystem* system, const std::string& filename) {
+    using namespace checkpoint_impl;
+
+    FILE* fp = std::fopen(filename.c_str(), "rb");
+    if (!fp)
+        return false;
+    long long size = FileSize(fp);
+    char magic[4] = {0, 0, 0, 0};
+    if (size < 16 || std::fread(magic, 1, 4, fp) != 4 || std::memcmp(magic, "CHKP", 4) != 0) {
+        std::fclose(fp);
+        // utils::ReadCheckpoint does not report errors; check that it added bodies
+        size_t num_bodies = system->Get_bodylist().size();
+        chrono::utils::ReadCheckpoint(system, filename);
+        if (system->Get_bodylist().size() == num_bodies) {
+            std::cout << "ReadCheckpointBinary ERROR: no bodies read from " << filename << std::endl;
+            return false;
+        }
+        return true;
+    }
+    std::vector<char> buffer((size_t)size);
+    std::memcpy(buffer.data(), magic, 4);
+    bool read = std::fread(buffer.data() + 4, 1, buffer.size() - 4, fp) == buffer.size() - 4;
+    std::fclose(fp);
+    if (!read)
+        return false;
+
+    uint32_t header[3];
+    std::memcpy(header, &buffer[4], sizeof(header));
+    chrono::ChContactMethod method = header[1] == 0 ? chrono::ChContactMethod::NSC : chrono::ChContactMethod::SMC;
+    if (header[0] != 1 || header[2] != 3 || method != system->GetContactMethod()) {
+        std::cout << "ReadCheckpointBinary ERROR: incompatible checkpoint file " << filename << std::endl;
+        return false;
+    }
+
+    size_t offset = 16;
+    uint64_t num_bodies, num_materials, num_shapes;
+    const char* sections[3] = {nullptr, nullptr, nullptr};
+    sections[0] = ReadSection(buffer, offset, "BODY", sizeof(CheckpointBody), num_bodies);
+    if (sections[0])
+        sections[1] = ReadSection(buffer, offset, "MATL", sizeof(CheckpointMaterial), num_materials);
+    if (sections[1])
+        sections[2] = ReadSection(buffer, offset, "SHPE", sizeof(CheckpointShape), num_shapes);
+    auto body_data = reinterpret_cast<const CheckpointBody*>(sections[0]);
+    auto material_data = reinterpret_cast<const CheckpointMaterial*>(sections[1]);
+    auto shape_data = reinterpret_cast<const CheckpointShape*>(sections[2]);
+    if (!shape_data) {
+        std::cout << "ReadCheckpointBinary ERROR: corrupted checkpoint file " << filename << std::endl;
+        return false;
+    }
+
+    std::vector<std::shared_ptr<chrono::ChMaterialSurface>> materials((size_t)num_materials);
+    for (size_t i = 0; i < materials.size(); i++)
+        materials[i] = CreateMaterial(material_data[i], method);
+
+    // Validate the body and shape records in parallel, before any body is created
+    int invalid = 0;
+#pragma omp parallel for reduction(+ : invalid)
+    for (long long i = 0; i < (long long)num_bodies; i++) {
+        const CheckpointBody& b = body_data[i];
+        if (b.first_shape > num_shapes || b.num_shapes > num_shapes - b.first_shape) {
+            invalid++;
+            continue;
+        }
+        for (uint32_t j = 0; j < b.num_shapes; j++) {
+            const CheckpointShape& s = shape_data[b.first_shape + j];
+            if (s.material < 0 || (uint64_t)s.material >= num_materials || !IsSupportedShape(s.type))
+                invalid++;
+        }
+    }
+    if (invalid) {
+        std::cout << "ReadCheckpointBinary ERROR: invalid shape data in " << filename << std::endl;
+        return false;
+    }
+
+    // Construct the bodies serially (creating Chrono objects is not thread-safe)
+    std::vector<std::shared_ptr<chrono::ChBody>> bodies((size_t)num_bodies);
+    for (size_t i = 0; i < bodies.size(); i++) {
+        const CheckpointBody& b = body_data[i];
+        auto body = std::shared_ptr<chrono::ChBody>(system->NewBody());
+        body->SetIdentifier(b.identifier);
+        body->SetBodyFixed(b.fixed != 0);
+        body->SetCollide(b.collide != 0);
+        body->SetMass(b.mass);
+        body->SetInertiaXX(ToVector(b.inertiaXX));
+        body->SetInertiaXY(ToVector(b.inertiaXY));
+        body->SetPos(ToVector(b.pos));
+        body->SetRot(ToQuaternion(b.rot));
+        body->SetPos_dt(ToVector(b.pos_dt));
+        body->SetRot_dt(ToQuaternion(b.rot_dt));
+
+        auto model = body->GetCollisionModel();
+        model->ClearModel();
+        for (uint32_t j = 0; j < b.num_shapes; j++) {
+            const CheckpointShape& s = shape_data[b.first_shape + j];
+            AddShape(body.get(), s, materials[s.material]);
+        }
+        model->SetFamilyGroup(b.family_group);
+        model->SetFamilyMask(b.family_mask);
+        model->BuildModel();
+        bodies[i] = body;
+    }
+
+    for (auto& body : bodies)
+        system->AddBody(body);
+
+    return true;
+}
+
+#endif
@@ -4,7 +4,19 @@
 #include <sstream>
 #include <cstring>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <cstdint>
+#include <cstdio>
 #include <zlib.h>
+#if __cplusplus >= 201703L
+#include <charconv>
+#endif
+#ifdef CNFL_HAVE_ZSTD
+#include <zstd.h>
+#endif
 
 #include "chrono/assets/ChVisualization.h"
 #include "chrono/assets/ChSphereShape.h"
@@ -20,66 +32,179 @@
 
 #include "chrono_multicore/physics/ChSystemMulticore.h"
 
+#include "../snapshot.h"
+
 using namespace chrono;
 using namespace chrono::collision;
 using std::cout;
 using std::endl;
 
+// CSV output, written to disk (optionally compressed) in fixed-size chunks as
+// tokens are appended, so memory use does not depend on the size of the file.
+// Compressed files are plain gzip (or zstd) streams of the CSV text.
 class CSVGen {
 public:
+	enum Compression { NONE, GZIP, ZSTD };
+
 	CSVGen() {
-		delim = ",";
-		binary = false;
+		delim = ',';
+		compression = NONE;
+		file = 0;
 		gz_file = 0;
+#ifdef CNFL_HAVE_ZSTD
+		zstd_stream = 0;
+#endif
+		buffer.resize(1 << 16);
+		used = 0;
 	}
-	~CSVGen() {}
+	~CSVGen() { CloseFile(); }
+
+	void OpenFile(std::string filename, bool bin = false) { OpenFile(filename, bin ? GZIP : NONE); }
 
-	void OpenFile(std::string filename, bool bin = false) {
-		if (bin) {
-			binary = true;
+	// Open the output file with the given compression.
+	// ZSTD falls back to GZIP if zstd support is not available.
+	void OpenFile(std::string filename, Compression comp) {
+		CloseFile();
+#ifndef CNFL_HAVE_ZSTD
+		if (comp == ZSTD)
+			comp = GZIP;
+#endif
+		compression = comp;
+		if (compression == GZIP) {
 			gz_file = gzopen(filename.c_str(), "wb");
+			if (gz_file)
+				gzbuffer(gz_file, 1 << 17);
 		}
 		else {
-			ofile.open(filename.c_str(), std::ios::out);
+			file = fopen(filename.c_str(), "wb");
+#ifdef CNFL_HAVE_ZSTD
+			if (compression == ZSTD) {
+				zstd_stream = ZSTD_createCCtx();
+				ZSTD_CCtx_setParameter(zstd_stream, ZSTD_c_compressionLevel, 3);
+				zstd_out.resize(ZSTD_CStreamOutSize());
+			}
+#endif
 		}
 	}
 
 	void CloseFile() {
-		if (binary) {
-			unsigned long int file_size = sizeof(char) * ss.str().size();
-
-			gzwrite(gz_file, (void*)&file_size, sizeof(file_size));  // writing size of file
-			gzwrite(gz_file, (void*)(ss.str().data()), file_size);
+		Flush(true);
+		if (gz_file)
 			gzclose(gz_file);
-		}
-		else {
-			ofile << ss.str();
-			ofile.close();
-		}
+		if (file)
+			fclose(file);
+		gz_file = 0;
+		file = 0;
+#ifdef CNFL_HAVE_ZSTD
+		if (zstd_stream)
+			ZSTD_freeCCtx(zstd_stream);
+		zstd_stream = 0;
+#endif
 	}
 	template <class T>
 	void operator<<(const T& token) {
 		WriteToken(token);
 	}
-	void WriteToken(real token) { ss << token << delim; }
-	void WriteToken(real2 token) { ss << token.x << delim << token.y << delim; }
-	void WriteToken(real3 token) { ss << token.x << delim << token.y << delim << token.z << delim; }
-	void WriteToken(real4 token) { ss << token.x << delim << token.y << delim << token.z << delim << token.w << delim; }
+	void WriteToken(double token) { WriteNumber(token); }
+	void WriteToken(real2 token) {
+		WriteNumber(token.x);
+		WriteNumber(token.y);
+	}
+	void WriteToken(real3 token) {
+		WriteNumber(token.x);
+		WriteNumber(token.y);
+		WriteNumber(token.z);
+	}
+	void WriteToken(real4 token) {
+		WriteNumber(token.x);
+		WriteNumber(token.y);
+		WriteNumber(token.z);
+		WriteNumber(token.w);
+	}
 	void WriteToken(quaternion token) {
-		ss << token.w << delim << token.x << delim << token.y << delim << token.z << delim;
+		WriteNumber(token.w);
+		WriteNumber(token.x);
+		WriteNumber(token.y);
+		WriteNumber(token.z);
+	}
+	void WriteToken(ChVector<> token) {
+		WriteNumber(token.x());
+		WriteNumber(token.y());
+		WriteNumber(token.z());
 	}
-	void WriteToken(ChVector<> token) { ss << token.x() << delim << token.y() << delim << token.z() << delim; }
 	void WriteToken(ChQuaternion<> token) {
-		ss << token.e0() << delim << token.e1() << delim << token.e2() << delim << token.e3() << delim;
+		WriteNumber(token.e0());
+		WriteNumber(token.e1());
+		WriteNumber(token.e2());
+		WriteNumber(token.e3());
+	}
+	void WriteToken(const std::string& token) {
+		Reserve(token.size() + 1);
+		memcpy(&buffer[used], token.data(), token.size());
+		used += token.size();
+		buffer[used++] = delim;
 	}
-	void WriteToken(std::string token) { ss << token << delim; }
-	void endline() { ss << std::endl; }
+	void endline() {
+		Reserve(1);
+		buffer[used++] = '\n';
+	}
+
+	char delim;
 
-	std::string delim;
-	std::ofstream ofile;
-	std::stringstream ss;
+private:
+	// Format a number as iostream does by default (6 significant digits).
+	void WriteNumber(double value) {
+		Reserve(32);
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+		used = std::to_chars(&buffer[used], &buffer[used] + 31, value, std::chars_format::general, 6).ptr - &buffer[0];
+#else
+		used += snprintf(&buffer[used], 32, "%g", value);
+#endif
+		buffer[used++] = delim;
+	}
+
+	void Reserve(size_t size) {
+		if (used + size > buffer.size())
+			Flush(false);
+		if (size > buffer.size())
+			buffer.resize(size);
+	}
+
+	// Pass the buffered text to the output file (and finish the stream if requested).
+	void Flush(bool finish) {
+		if (gz_file) {
+			if (used)
+				gzwrite(gz_file, &buffer[0], (unsigned)used);
+		}
+#ifdef CNFL_HAVE_ZSTD
+		else if (zstd_stream) {
+			ZSTD_inBuffer in = {&buffer[0], used, 0};
+			ZSTD_EndDirective mode = finish ? ZSTD_e_end : ZSTD_e_continue;
+			size_t remaining;
+			do {
+				ZSTD_outBuffer out = {&zstd_out[0], zstd_out.size(), 0};
+				remaining = ZSTD_compressStream2(zstd_stream, &out, &in, mode);
+				fwrite(&zstd_out[0], 1, out.pos, file);
+				if (ZSTD_isError(remaining))
+					break;
+			} while (finish ? remaining != 0 : in.pos < in.size);
+		}
+#endif
+		else if (file) {
+			fwrite(&buffer[0], 1, used, file);
+		}
+		used = 0;
+	}
+
+	Compression compression;
+	FILE* file;
 	gzFile gz_file;
-	bool binary;
+#ifdef CNFL_HAVE_ZSTD
+	ZSTD_CCtx* zstd_stream;
+	std::vector<char> zstd_out;
+#endif
+	std::vector<char> buffer;  // pending text
+	size_t used;               // number of pending characters
 };
 
 
@@ -104,139 +229,320 @@ public:
 	std::ofstream bin_file;
 };
 
-static std::vector<std::thread> writethreads;
-
-void static WriteLocalData(const std::string&& filename,
-	const std::vector<real3>&& pos_particle,
-	const std::vector<real3>&& vel_particle,
-	const int&& num_particles) {
-	BinaryGen bin_output;
-	bin_output.OpenFile(filename.c_str());
-	bin_output.Write(pos_particle);
-	bin_output.Write(vel_particle);
-	bin_output.CloseFile();
-}
+// Background writer for fluid snapshots.
+// Snapshots are copied into buffers recycled from a small pool and queued for a
+// single persistent writer thread, so the simulation loop only pays for the copy.
+// The caller blocks only if the queued data exceeds the given memory limit.
+// By default each snapshot is written to its own file (see BinaryGen); if a
+// snapshot file is opened, all snapshots are instead appended to it as frames
+// (see snapshot.h).
+class FluidDataWriter {
+public:
+	FluidDataWriter(size_t max_pending_bytes = size_t(1) << 30, size_t max_pool_size = 2)
+		: max_pending_bytes(max_pending_bytes), max_pool_size(max_pool_size), pending_bytes(0), stop(false) {}
+	~FluidDataWriter() { Shutdown(); }
+
+	// Append all subsequent snapshots to the given snapshot file.
+	bool OpenSnapshotFile(const std::string& filename, bool single_precision = false) {
+		Flush();
+		std::lock_guard<std::mutex> lock(mutex);
+		SnapshotWriter::Precision precision = single_precision ? SnapshotWriter::FLOAT32 : SnapshotWriter::FLOAT64;
+		return snapshot_file.Open(filename, std::vector<std::string>{"pos", "vel"}, precision);
+	}
+
+	// Queue a snapshot of the given position and velocity data for writing.
+	template <typename V>
+	void Write(const std::string& filename, double time, const V& pos, const V& vel) {
+		size_t bytes = (pos.size() + vel.size()) * sizeof(real3);
+		std::unique_ptr<Snapshot> snapshot;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			if (!thread.joinable()) {
+				stop = false;
+				thread = std::thread(&FluidDataWriter::Run, this);
+			}
+			// Backpressure: wait for the writer only if the memory limit would be exceeded
+			space_cv.wait(lock, [&] { return pending_bytes == 0 || pending_bytes + bytes <= max_pending_bytes; });
+			pending_bytes += bytes;
+			if (!pool.empty()) {
+				snapshot = std::move(pool.back());
+				pool.pop_back();
+			}
+		}
+		if (!snapshot)
+			snapshot.reset(new Snapshot);
+
+		// Copy outside the lock (reuses the capacity of recycled buffers)
+		snapshot->filename = filename;
+		snapshot->time = time;
+		snapshot->bytes = bytes;
+		snapshot->pos.assign(pos.begin(), pos.end());
+		snapshot->vel.assign(vel.begin(), vel.end());
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			queue.push_back(std::move(snapshot));
+		}
+		work_cv.notify_one();
+	}
+
+	// Block until all queued snapshots are written.
+	void Flush() {
+		std::unique_lock<std::mutex> lock(mutex);
+		space_cv.wait(lock, [&] { return pending_bytes == 0; });
+	}
+
+	// Write all queued snapshots and stop the writer thread.
+	void Shutdown() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
+		}
+		work_cv.notify_one();
+		if (thread.joinable())
+			thread.join();
+		snapshot_file.Close();
+	}
+
+private:
+	struct Snapshot {
+		std::string filename;
+		double time;
+		std::vector<real3> pos;
+		std::vector<real3> vel;
+		size_t bytes;
+	};
+
+	void Run() {
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			work_cv.wait(lock, [&] { return stop || !queue.empty(); });
+			if (queue.empty())
+				break;
+			std::unique_ptr<Snapshot> snapshot = std::move(queue.front());
+			queue.pop_front();
+			lock.unlock();
+
+			// The snapshot file is only opened when no snapshots are pending
+			if (snapshot_file.IsOpen()) {
+				snapshot_file.BeginFrame(snapshot->time, std::min(snapshot->pos.size(), snapshot->vel.size()));
+				snapshot_file.WriteField(snapshot->pos.data());
+				snapshot_file.WriteField(snapshot->vel.data());
+			}
+			else {
+				BinaryGen bin_output;
+				bin_output.OpenFile(snapshot->filename.c_str());
+				bin_output.Write(snapshot->pos);
+				bin_output.Write(snapshot->vel);
+				bin_output.CloseFile();
+			}
+
+			lock.lock();
+			pending_bytes -= snapshot->bytes;
+			if (pool.size() < max_pool_size)
+				pool.push_back(std::move(snapshot));
+			space_cv.notify_all();
+		}
+	}
+
+	size_t max_pending_bytes;
+	size_t max_pool_size;
+	size_t pending_bytes;
+	bool stop;
+	std::deque<std::unique_ptr<Snapshot> > queue;
+	std::vector<std::unique_ptr<Snapshot> > pool;
+	std::mutex mutex;
+	std::condition_variable work_cv;
+	std::condition_variable space_cv;
+	std::thread thread;
+	SnapshotWriter snapshot_file;
+};
+
+static FluidDataWriter fluid_writer;
 
 void static DumpFluidData(chrono::ChSystemMulticoreNSC* system, std::string filename, bool binary = true) {
-	std::vector<real3> pos_particle;
-	std::vector<real3> vel_particle;
 	int num_particles = system->data_manager->num_fluid_bodies;
 	if (num_particles <= 0) {
 		std::cout << "No fluid to write!!\n";
 		return;
 	}
 
-	pos_particle = system->data_manager->host_data.pos_3dof;
-	vel_particle = system->data_manager->host_data.vel_3dof;
+	fluid_writer.Write(filename, system->GetChTime(), system->data_manager->host_data.pos_3dof, system->data_manager->host_data.vel_3dof);
+}
 
-	writethreads.push_back(std::thread(WriteLocalData, std::move(filename), std::move(pos_particle),
-		std::move(vel_particle), std::move(num_particles)));
-	if (writethreads.size() > 8) {
-		for (std::thread& t : writethreads) {
-			t.join();
-		}
-		writethreads.clear();
-	}
+// Wait for all pending fluid snapshots to be written to disk.
+void static FlushFluidData() {
+	fluid_writer.Flush();
 }
 
+// Write all pending fluid snapshots and close the snapshot file (if any).
+void static CloseFluidData() {
+	fluid_writer.Shutdown();
+}
 
-void static DumpAllObjectsWithGeometryPovray(ChSystem* mSys, std::string filename, bool binary = false) {
-	CSVGen csv_output;
-    csv_output.OpenFile(filename.c_str(), binary);
-
-    for (int i = 0; i < mSys->Get_bodylist().size(); i++) {
-        auto abody = mSys->Get_bodylist().at(i);  // Get body
-        const Vector pos = abody->GetFrame_REF_to_abs().GetPos();
-        const Vector vel = abody->GetPos_dt();  // Get velocity
-        Quaternion rot = abody->GetFrame_REF_to_abs().GetRot();
-        Vector pos_final, rad_final;
-        ChCollisionShape::Type type = ChCollisionShape::Type::SPHERE;
-        // Get each asset
-        for (int j = 0; j < abody->GetAssets().size(); j++) {
-            auto asset = abody->GetAssets().at(j);
-            if (!std::dynamic_pointer_cast<ChVisualization>(asset)) {
-                continue;
-            }
-            ChVisualization* visual_asset = ((ChVisualization*)(asset.get()));
-            Vector center = visual_asset->Pos;
-            center = rot.Rotate(center);
-            pos_final = pos + center;
-            Quaternion lrot = visual_asset->Rot.Get_A_quaternion();
-            lrot = rot * lrot;
-            lrot.Normalize();
-			if (std::dynamic_pointer_cast<ChSphereShape>(asset)) {
-				ChSphereShape* sphere_shape = ((ChSphereShape*)(asset.get()));
-				real radius = sphere_shape->GetSphereGeometry().rad;
-				rad_final.x() = radius;
-				rad_final.y() = radius;
-				rad_final.z() = radius;
-                type = ChCollisionShape::Type::SPHERE;
-			}
 
-			else if (std::dynamic_pointer_cast<ChEllipsoidShape>(asset)) {
-				ChEllipsoidShape* ellipsoid_shape = ((ChEllipsoidShape*)(asset.get()));
-				rad_final = ellipsoid_shape->GetEllipsoidGeometry().rad;
-                type = ChCollisionShape::Type::ELLIPSOID;
-			}
-			else if (std::dynamic_pointer_cast<ChBoxShape>(asset)) {
-				ChBoxShape* box_shape = ((ChBoxShape*)(asset.get()));
-				rad_final = box_shape->GetBoxGeometry().Size;
-                type = ChCollisionShape::Type::BOX;
-			}
-			else if (std::dynamic_pointer_cast<ChCylinderShape>(asset)) {
-				ChCylinderShape* cylinder_shape = ((ChCylinderShape*)(asset.get()));
-				double rad = cylinder_shape->GetCylinderGeometry().rad;
-				double height = cylinder_shape->GetCylinderGeometry().p1.y() - cylinder_shape->GetCylinderGeometry().p2.y();
-				rad_final.x() = rad;
-				rad_final.y() = height;
-				rad_final.z() = rad;
-                type = ChCollisionShape::Type::CYLINDER;
-			}
-			else if (std::dynamic_pointer_cast<ChConeShape>(asset)) {
-				ChConeShape* cone_shape = ((ChConeShape*)(asset.get()));
-				rad_final.x() = cone_shape->GetConeGeometry().rad.x();
-				rad_final.y() = cone_shape->GetConeGeometry().rad.y();
-				rad_final.z() = cone_shape->GetConeGeometry().rad.z();
-                type = ChCollisionShape::Type::CONE;
-			}
+// Exporter for the visualization shapes of all bodies in a system.
+// The shape type, local frame, and dimensions of every visualization asset are
+// collected once into a flat table; each frame then only gathers the body
+// states and transforms the shapes to the absolute frame (in parallel).
+// The table is rebuilt whenever its revision changes: the number of bodies or
+// assets, the identity of the assets of each body, or (for Chrono::Multicore
+// systems) the number of collision shapes, which changes when shapes are
+// added or removed. Call Invalidate after modifying an asset in place.
+class PovrayExporter {
+public:
+	PovrayExporter() : system(nullptr), num_assets(0), revision(0) {}
 
-			csv_output << pos_final;
-			csv_output << lrot;
-			csv_output << vel;
+	void Export(ChSystem* mSys, const std::string& filename, bool binary) {
+		auto& bodies = mSys->Get_bodylist();
+		size_t count = 0;
+		uint64_t rev = 14695981039346656037ULL;
+		for (auto& body : bodies) {
+			for (auto& asset : body->GetAssets())
+				rev = (rev ^ (uint64_t)(uintptr_t)asset.get()) * 1099511628211ULL;
+			count += body->GetAssets().size();
+			rev = (rev ^ (uint64_t)count) * 1099511628211ULL;
+		}
+		if (auto msys = dynamic_cast<ChSystemMulticore*>(mSys))
+			rev = (rev ^ (uint64_t)msys->data_manager->num_rigid_shapes) * 1099511628211ULL;
+		if (mSys != system || bodies.size() != body_pos.size() || count != num_assets || rev != revision) {
+			Build(mSys, count);
+			revision = rev;
+		}
 
-			if (std::dynamic_pointer_cast<ChSphereShape>(asset)) {
-				csv_output << type;
-				csv_output << rad_final.x();
-				csv_output.endline();
-			}
-			else if (std::dynamic_pointer_cast<ChEllipsoidShape>(asset)) {
-				csv_output << type;
-				csv_output << real3(rad_final.x(), rad_final.y(), rad_final.z());
-				csv_output.endline();
-			}
-			else if (std::dynamic_pointer_cast<ChBoxShape>(asset)) {
-				csv_output << type;
-				csv_output << real3(rad_final.x(), rad_final.y(), rad_final.z());
-				csv_output.endline();
-			}
-			else if (std::dynamic_pointer_cast<ChCylinderShape>(asset)) {
-				csv_output << type;
-				csv_output << real2(rad_final.x(), rad_final.y());
-				csv_output.endline();
-			}
-			else if (std::dynamic_pointer_cast<ChConeShape>(asset)) {
-				csv_output << type;
-				csv_output << real2(rad_final.x(), rad_final.y());
-				csv_output.endline();
+		int num_bodies = (int)bodies.size();
+#pragma omp parallel for
+		for (int i = 0; i < num_bodies; i++) {
+			const auto& frame = bodies[i]->GetFrame_REF_to_abs();
+			body_pos[i] = frame.GetPos();
+			body_rot[i] = frame.GetRot();
+			body_vel[i] = bodies[i]->GetPos_dt();
+		}
+
+		int num_shapes = (int)shapes.size();
+#pragma omp parallel for
+		for (int i = 0; i < num_shapes; i++) {
+			const Shape& shape = shapes[i];
+			const Quaternion& rot = body_rot[shape.body];
+			shape_pos[i] = body_pos[shape.body] + rot.Rotate(shape.pos);
+			shape_rot[i] = rot * shape.rot;
+			shape_rot[i].Normalize();
+		}
+
+		CSVGen csv_output;
+		csv_output.OpenFile(filename.c_str(), binary);
+		for (int i = 0; i < num_shapes; i++) {
+			const Shape& shape = shapes[i];
+			csv_output << shape_pos[i];
+			csv_output << shape_rot[i];
+			csv_output << body_vel[shape.body];
+			switch (shape.num_dims) {
+				case 1:
+					csv_output << shape.type;
+					csv_output << shape.dims.x;
+					break;
+				case 2:
+					csv_output << shape.type;
+					csv_output << real2(shape.dims.x, shape.dims.y);
+					break;
+				case 3:
+					csv_output << shape.type;
+					csv_output << shape.dims;
+					break;
+				default:
+					csv_output << -1;
+					break;
 			}
-			else {
-				csv_output << -1;
-				csv_output.endline();
+			csv_output.endline();
+		}
+		csv_output.CloseFile();
+	}
+
+	// Force a rebuild of the shape table at the next export.
+	void Invalidate() { system = nullptr; }
+
+private:
+	struct Shape {
+		int body;        // index of the body in the system
+		Vector pos;      // position relative to the body frame
+		Quaternion rot;  // rotation relative to the body frame
+		int type;        // ChCollisionShape::Type
+		int num_dims;    // number of dimensions written (0 for unsupported shapes)
+		real3 dims;      // shape dimensions
+	};
+
+	void Build(ChSystem* mSys, size_t count) {
+		auto& bodies = mSys->Get_bodylist();
+		system = mSys;
+		num_assets = count;
+		shapes.clear();
+		int type = ChCollisionShape::Type::SPHERE;
+		real3 dims(0, 0, 0);
+		for (int i = 0; i < (int)bodies.size(); i++) {
+			for (auto& asset : bodies[i]->GetAssets()) {
+				auto visual_asset = std::dynamic_pointer_cast<ChVisualization>(asset);
+				if (!visual_asset)
+					continue;
+				Shape shape;
+				shape.body = i;
+				shape.pos = visual_asset->Pos;
+				shape.rot = visual_asset->Rot.Get_A_quaternion();
+				shape.num_dims = 0;
+				if (auto sphere = std::dynamic_pointer_cast<ChSphereShape>(asset)) {
+					real radius = sphere->GetSphereGeometry().rad;
+					dims = real3(radius, radius, radius);
+					type = ChCollisionShape::Type::SPHERE;
+					shape.num_dims = 1;
+				}
+				else if (auto ellipsoid = std::dynamic_pointer_cast<ChEllipsoidShape>(asset)) {
+					const Vector& rad = ellipsoid->GetEllipsoidGeometry().rad;
+					dims = real3(rad.x(), rad.y(), rad.z());
+					type = ChCollisionShape::Type::ELLIPSOID;
+					shape.num_dims = 3;
+				}
+				else if (auto box = std::dynamic_pointer_cast<ChBoxShape>(asset)) {
+					const Vector& size = box->GetBoxGeometry().Size;
+					dims = real3(size.x(), size.y(), size.z());
+					type = ChCollisionShape::Type::BOX;
+					shape.num_dims = 3;
+				}
+				else if (auto cylinder = std::dynamic_pointer_cast<ChCylinderShape>(asset)) {
+					const auto& geometry = cylinder->GetCylinderGeometry();
+					dims = real3(geometry.rad, geometry.p1.y() - geometry.p2.y(), geometry.rad);
+					type = ChCollisionShape::Type::CYLINDER;
+					shape.num_dims = 2;
+				}
+				else if (auto cone = std::dynamic_pointer_cast<ChConeShape>(asset)) {
+					const Vector& rad = cone->GetConeGeometry().rad;
+					dims = real3(rad.x(), rad.y(), rad.z());
+					type = ChCollisionShape::Type::CONE;
+					shape.num_dims = 2;
+				}
+				shape.type = type;
+				shape.dims = dims;
+				shapes.push_back(shape);
 			}
 		}
+		body_pos.resize(bodies.size());
+		body_rot.resize(bodies.size());
+		body_vel.resize(bodies.size());
+		shape_pos.resize(shapes.size());
+		shape_rot.resize(shapes.size());
 	}
 
-	csv_output.CloseFile();
-}
+	ChSystem* system;
+	size_t num_assets;
+	uint64_t revision;
+	std::vector<Shape> shapes;
+	std::vector<Vector> body_pos;
+	std::vector<Quaternion> body_rot;
+	std::vector<Vector> body_vel;
+	std::vector<Vector> shape_pos;
+	std::vector<Quaternion> shape_rot;
+};
 
+static PovrayExporter povray_exporter;
 
+void static DumpAllObjectsWithGeometryPovray(ChSystem* mSys, std::string filename, bool binary = false) {
+	povray_exporter.Export(mSys, filename, binary);
+}
@@ -36,6 +36,7 @@
 #include "chrono_multicore/solver/ChSystemDescriptorMulticore.h"
 #include "chrono_vehicle/driver/ChPathFollowerDriver.h"
 #include "input_output.h"
+#include "../shape_manager.h"
 
 #undef CHRONO_OPENGL
 #ifdef CHRONO_OPENGL
@@ -122,8 +123,10 @@ std::string speed_controller_file("humvee_input/SpeedController.json");
 
 std::string data_output_path = "";
 
-#define ERASE_MACRO(x, y) x.erase(x.begin() + y);
-#define ERASE_MACRO_LEN(x, y, z) x.erase(x.begin() + y, x.begin() + y + z);
+// Fluid output: append all frames to a single indexed snapshot file (see snapshot.h)
+// instead of writing one data_<frame>.dat file per output frame
+bool fluid_snapshot_file = true;
+bool fluid_single_precision = true;
 
 double hdimX = 4;
 double hdimY = 1.5;
@@ -217,90 +220,6 @@ void static WriteVehicleData(hmmwv::HMMWV_Full& my_hmmwv,
     csv_output.CloseFile();
 }
 
-void RemoveCollisionModel(ChSystemMulticoreNSC* system, ChCollisionModel* model) {
-    ChMulticoreDataManager* data_manager = system->data_manager;
-#if 1
-    ChCollisionModelMulticore* pmodel = static_cast<ChCollisionModelMulticore*>(model);
-    int body_id = pmodel->GetBody()->GetId();
-    // loop over the models we nned to remove
-    // std::cout << "removing: " << pmodel->GetNObjects() << " objects" << std::endl;
-    for (int j = 0; j < pmodel->GetNumShapes(); j++) {
-        // find a model to remove
-        bool removed = false;
-        int index = -1;
-        for (int i = 0; i < data_manager->shape_data.id_rigid.size(); i++) {
-            if (data_manager->shape_data.id_rigid[i] == body_id) {
-                index = i;
-                data_manager->num_rigid_shapes--;
-
-                int start = data_manager->shape_data.start_rigid[index];
-                int length = data_manager->shape_data.length_rigid[index];
-                int type = data_manager->shape_data.typ_rigid[index];
-
-                // std::cout << "removing: type " << type << " " << start<< " " <<j << std::endl;
-
-                switch (type) {
-                    case ChCollisionShape::Type::SPHERE:
-                        ERASE_MACRO_LEN(data_manager->shape_data.sphere_rigid, start, length);
-                        break;
-                    case ChCollisionShape::Type::ELLIPSOID:
-                        ERASE_MACRO_LEN(data_manager->shape_data.box_like_rigid, start, length);
-                        break;
-                    case ChCollisionShape::Type::BOX:
-                        ERASE_MACRO_LEN(data_manager->shape_data.box_like_rigid, start, length);
-                        break;
-                    case ChCollisionShape::Type::CYLINDER:
-                        ERASE_MACRO_LEN(data_manager->shape_data.box_like_rigid, start, length);
-                        break;
-                    case ChCollisionShape::Type::CONE:
-                        ERASE_MACRO_LEN(data_manager->shape_data.box_like_rigid, start, length);
-                        break;
-                    case ChCollisionShape::Type::CAPSULE:
-                        ERASE_MACRO_LEN(data_manager->shape_data.capsule_rigid, start, length);
-                        break;
-                    case ChCollisionShape::Type::ROUNDEDBOX:
-                        ERASE_MACRO_LEN(data_manager->shape_data.rbox_like_rigid, start, length);
-                        break;
-                    case ChCollisionShape::Type::ROUNDEDCYL:
-                        ERASE_MACRO_LEN(data_manager->shape_data.rbox_like_rigid, start, length);
-                        break;
-                    case ChCollisionShape::Type::ROUNDEDCONE:
-                        ERASE_MACRO_LEN(data_manager->shape_data.rbox_like_rigid, start, length);
-                        break;
-                    case ChCollisionShape::Type::CONVEX:
-                        ERASE_MACRO_LEN(data_manager->shape_data.convex_rigid, start, length);
-                        break;
-                    case ChCollisionShape::Type::TRIANGLE:
-                        ERASE_MACRO_LEN(data_manager->shape_data.convex_rigid, start, 3);
-                        break;
-                }
-
-                ERASE_MACRO(data_manager->shape_data.ObA_rigid, index);
-                ERASE_MACRO(data_manager->shape_data.ObR_rigid, index);
-                ERASE_MACRO(data_manager->shape_data.start_rigid, index);
-                ERASE_MACRO(data_manager->shape_data.length_rigid, index);
-
-                ERASE_MACRO(data_manager->shape_data.fam_rigid, index);
-                ERASE_MACRO(data_manager->shape_data.typ_rigid, index);
-                ERASE_MACRO(data_manager->shape_data.id_rigid, index);
-                removed = true;
-                break;
-            }
-        }
-        // std::cout << "decrement start "<< std::endl;
-        if (removed) {
-            // we removed a model, all of the starts are off by one for indices past the index removed, decrement all
-            // starts before removing a second model
-            for (int i = index; i < data_manager->shape_data.start_rigid.size(); i++) {
-                if (data_manager->shape_data.start_rigid[i] != 0) {
-                    data_manager->shape_data.start_rigid[i] -= 1;
-                }
-            }
-        }
-    }
-#endif
-}
-
 ChFluidContainer* fluid_container;
 
 void CreateFluid(ChSystemMulticoreNSC* system) {
@@ -507,7 +426,9 @@ int main(int argc, char* argv[]) {
     my_hmmwv.SetWheelVisualizationType(wheel_vis_type);
     my_hmmwv.SetTireVisualizationType(tire_vis_type);
 
-    RemoveCollisionModel(system, my_hmmwv.GetChassisBody()->GetCollisionModel().get());
+    // Replace the chassis collision shapes
+    ShapeManager shapes(system);
+    shapes.RemoveShapes(my_hmmwv.GetChassisBody().get());
     my_hmmwv.GetChassisBody()->GetCollisionModel()->ClearModel();
     my_hmmwv.GetChassisBody()->GetAssets().clear();
 
@@ -576,6 +497,9 @@ int main(int argc, char* argv[]) {
 
     ChVector<> driver_pos = my_hmmwv.GetVehicle().GetChassis()->GetLocalDriverCoordsys().pos;
 
+    if (fluid_snapshot_file)
+        fluid_writer.OpenSnapshotFile(data_output_path + "fluid.snap", fluid_single_precision);
+
     while (time < time_end) {
         if (simulation_mode != GRAVEL) {
             bottom_plate->SetPos(ChVector<>(my_hmmwv.GetChassis()->GetBody()->GetPos().x(),
@@ -644,6 +568,8 @@ int main(int argc, char* argv[]) {
 
 #endif
     }
+    CloseFluidData();
+
     cout << "==================================" << endl;
     cout << "Simulation time:   " << exec_time << endl;
     return 0;
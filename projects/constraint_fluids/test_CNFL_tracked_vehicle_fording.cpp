@@ -98,6 +98,12 @@ std::vector<real3> torques;
 // Initial vehicle position and orientation
 
 std::string data_output_path = "m113_fording/";
+
+// Fluid output: append all frames to a single indexed snapshot file (see snapshot.h)
+// instead of writing one data_<frame>.dat file per output frame
+bool fluid_snapshot_file = true;
+bool fluid_single_precision = true;
+
 ChSpeedController m_speedPIDVehicle;
 
 // -----------------------------------------------------------------------------
@@ -323,6 +329,9 @@ int main(int argc, char* argv[]) {
 
     bool set_time = true;
 
+    if (fluid_snapshot_file)
+        fluid_writer.OpenSnapshotFile(data_output_path + "fluid.snap", fluid_single_precision);
+
     while (time < time_end) {
         // Driver inputs
         ChDriver::Inputs driver_inputs = {0, 0, 0};
@@ -424,6 +433,8 @@ int main(int argc, char* argv[]) {
 #endif
     }
 
+    CloseFluidData();
+
     // Final stats
     std::cout << "==================================" << std::endl;
     std::cout << "Simulation time:   " << exec_time << std::endl;
@@ -0,0 +1,96 @@
+#ifndef DEMOS_CONTACT_FORCES_H
+#define DEMOS_CONTACT_FORCES_H
+
+#include <algorithm>
+
+#include "chrono_multicore/constraints/ChConstraintUtils.h"
+#include "chrono_multicore/physics/ChSystemMulticore.h"
+
+// =============================================================================
+// Contact forces of the last step of a Chrono::Multicore system, read from the
+// solver data.
+//
+// NSC: the force of each contact is its impulse (normal and, unless the solver
+// mode is NORMAL, sliding components) divided by the step size.
+//
+// SMC: Chrono::Multicore does not keep the forces of individual contacts; it
+// only stores the total contact force on each body in contact (ct_force,
+// indexed through ct_body_map). Only body totals are available; the
+// penetration of each contact (which determines its normal force) is available
+// with both methods.
+//
+//   ContactForces forces(sys);
+//   if (forces.HasContactForces()) {
+//       for (int c = 0; c < forces.GetNumContacts(); c++)
+//           total += Length(forces.GetContactForce(c));
+//   }
+
+class ContactForces {
+  public:
+    explicit ContactForces(const chrono::ChSystemMulticore* sys)
+        : m_data_manager(sys->data_manager), m_num_contacts(0), m_per_contact(false), m_tangential(false) {
+        const auto& host = m_data_manager->host_data;
+        m_step = m_data_manager->settings.step_size;
+        m_num_contacts = (int)m_data_manager->num_rigid_contacts;
+        if (sys->GetContactMethod() == chrono::ChContactMethod::NSC) {
+            m_per_contact = host.gamma.size() >= (size_t)m_num_contacts && m_step > 0;
+            m_tangential = m_data_manager->settings.solver.solver_mode != chrono::SolverMode::NORMAL &&
+                           host.gamma.size() >= 3 * (size_t)m_num_contacts;
+        }
+    }
+
+    /// Return true if the forces of individual contacts are available (NSC systems).
+    bool HasContactForces() const { return m_per_contact; }
+
+    /// Return true if the total contact forces on bodies are available (SMC systems).
+    bool HasBodyForces() const {
+        const auto& host = m_data_manager->host_data;
+        return !m_per_contact && host.ct_body_map.size() >= m_data_manager->num_rigid_bodies;
+    }
+
+    /// Return true if the penetrations of individual contacts are available.
+    bool HasPenetrations() const {
+        return m_data_manager->host_data.dpth_rigid_rigid.size() >= (size_t)m_num_contacts;
+    }
+
+    /// Return the number of contacts of the last step.
+    int GetNumContacts() const { return m_num_contacts; }
+
+    /// Return the force exerted by the first body of the given contact on the second one (global frame).
+    /// Requires HasContactForces.
+    chrono::real3 GetContactForce(int c) const {
+        const auto& host = m_data_manager->host_data;
+        const chrono::real3& n = host.norm_rigid_rigid[c];
+        chrono::real3 f = host.gamma[c] * n;
+        if (m_tangential) {
+            chrono::real3 u, w;
+            chrono::Orthogonalize(n, u, w);
+            f += host.gamma[m_num_contacts + 2 * c] * u + host.gamma[m_num_contacts + 2 * c + 1] * w;
+        }
+        return f / m_step;
+    }
+
+    /// Return the penetration of the given contact (zero for separated shapes). Requires HasPenetrations.
+    double GetPenetration(int c) const {
+        return std::max(-(double)m_data_manager->host_data.dpth_rigid_rigid[c], 0.0);
+    }
+
+    /// Return the total contact force on the body with given index in the data arrays (global frame).
+    /// Requires HasBodyForces.
+    chrono::real3 GetBodyForce(int i) const {
+        const auto& host = m_data_manager->host_data;
+        int index = host.ct_body_map[i];
+        if (index < 0 || index >= (int)host.ct_force.size())
+            return chrono::real3(0, 0, 0);
+        return host.ct_force[index];
+    }
+
+  private:
+    const chrono::ChMulticoreDataManager* m_data_manager;  ///< data of the associated system
+    double m_step;                                         ///< step size
+    int m_num_contacts;                                    ///< number of contacts
+    bool m_per_contact;                                    ///< are per-contact forces available?
+    bool m_tangential;                                     ///< do the impulses include sliding components?
+};
+
+#endif
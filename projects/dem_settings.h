@@ -0,0 +1,325 @@
+#ifndef DEMOS_DEM_SETTINGS_H
+#define DEMOS_DEM_SETTINGS_H
+
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "chrono/physics/ChMaterialSurfaceNSC.h"
+#include "chrono/physics/ChMaterialSurfaceSMC.h"
+#include "chrono/physics/ChSystemSMC.h"
+#include "chrono_multicore/physics/ChSystemMulticore.h"
+
+// =============================================================================
+// Run-time settings for the Chrono::Multicore DEM programs.
+//
+// A program registers its global parameters by reference; their values can
+// then be changed on the command line ("--name value") or in a settings file
+// ("--config file", one "name = value" per line, '#' starts a comment).
+// Settings are applied in the order given, so later values override earlier
+// ones. "--help" lists all settings with their current values. Arguments not
+// starting with "--" are collected as positional arguments.
+//
+//   DEMSettings settings;
+//   settings.AddEnum("method", method, ContactMethodNames());
+//   settings.Add("time_step", time_step);
+//   if (!settings.Parse(argc, argv))
+//       return 1;
+//   if (!settings.IsSet("time_step"))
+//       time_step = (method == ChContactMethod::SMC) ? 1e-5 : 1e-4;
+
+class DEMSettings {
+  public:
+    void Add(const std::string& name, double& value) {
+        AddEntry(name, [&value](const std::string& s) { return ParseNumber(s, value); },
+                 [&value]() { return ToString(value); });
+    }
+    void Add(const std::string& name, float& value) {
+        AddEntry(name, [&value](const std::string& s) { return ParseNumber(s, value); },
+                 [&value]() { return ToString(value); });
+    }
+    void Add(const std::string& name, int& value) {
+        AddEntry(name, [&value](const std::string& s) { return ParseNumber(s, value); },
+                 [&value]() { return ToString(value); });
+    }
+    void Add(const std::string& name, bool& value) {
+        AddEntry(name,
+                 [&value](const std::string& s) {
+                     if (s == "true" || s == "1" || s == "on")
+                         value = true;
+                     else if (s == "false" || s == "0" || s == "off")
+                         value = false;
+                     else
+                         return false;
+                     return true;
+                 },
+                 [&value]() { return std::string(value ? "true" : "false"); });
+    }
+    void Add(const std::string& name, std::string& value) {
+        AddEntry(name,
+                 [&value](const std::string& s) {
+                     value = s;
+                     return true;
+                 },
+                 [&value]() { return value; });
+    }
+
+    /// Register a number of bins per axis, given either as "n" or as "nx,ny,nz".
+    void Add(const std::string& name, chrono::vec3& value) {
+        AddEntry(name,
+                 [&value](const std::string& s) {
+                     std::string t = s;
+                     for (auto& c : t)
+                         if (c == ',' || c == 'x')
+                             c = ' ';
+                     std::istringstream iss(t);
+                     int n[3];
+                     if (!(iss >> n[0]))
+                         return false;
+                     if (!(iss >> n[1] >> n[2]))
+                         n[1] = n[2] = n[0];
+                     value = chrono::vec3(n[0], n[1], n[2]);
+                     return true;
+                 },
+                 [&value]() { return ToString(value[0]) + "," + ToString(value[1]) + "," + ToString(value[2]); });
+    }
+
+    /// Register an enumeration, set by name.
+    template <typename E>
+    void AddEnum(const std::string& name, E& value, const std::vector<std::pair<std::string, E>>& names) {
+        AddEntry(name,
+                 [&value, names](const std::string& s) {
+                     for (const auto& n : names) {
+                         if (n.first == s) {
+                             value = n.second;
+                             return true;
+                         }
+                     }
+                     return false;
+                 },
+                 [&value, names]() {
+                     for (const auto& n : names) {
+                         if (n.second == value)
+                             return n.first;
+                     }
+                     return std::string("?");
+                 });
+    }
+
+    /// Set the named value. Return false if the name is unknown or the value is invalid.
+    bool Set(const std::string& name, const std::string& value) {
+        auto found = m_index.find(name);
+        if (found == m_index.end()) {
+            std::cout << "Unknown setting: " << name << std::endl;
+            return false;
+        }
+        Entry& entry = m_entries[found->second];
+        if (!entry.set(value)) {
+            std::cout << "Invalid value for " << name << ": " << value << std::endl;
+            return false;
+        }
+        entry.is_set = true;
+        return true;
+    }
+
+    /// Read settings from a file.
+    bool ReadFile(const std::string& filename) {
+        std::ifstream ifile(filename);
+        if (!ifile.is_open()) {
+            std::cout << "Cannot open settings file " << filename << std::endl;
+            return false;
+        }
+        std::string line;
+        while (std::getline(ifile, line)) {
+            line = line.substr(0, line.find('#'));
+            size_t eq = line.find('=');
+            if (eq == std::string::npos) {
+                if (Trim(line).empty())
+                    continue;
+                std::cout << "Invalid line in " << filename << ": " << line << std::endl;
+                return false;
+            }
+            if (!Set(Trim(line.substr(0, eq)), Trim(line.substr(eq + 1))))
+                return false;
+        }
+        return true;
+    }
+
+    /// Parse the command line. Return false on error or if help was requested.
+    bool Parse(int argc, char* argv[]) {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg == "--help" || arg == "-h") {
+                Print(std::cout);
+                return false;
+            }
+            if (arg.compare(0, 2, "--") != 0) {
+                m_positional.push_back(arg);
+                continue;
+            }
+            if (i + 1 >= argc) {
+                std::cout << "Missing value for " << arg << std::endl;
+                return false;
+            }
+            std::string value = argv[++i];
+            m_options.push_back(std::make_pair(arg, value));
+            bool ok = (arg == "--config") ? ReadFile(value) : Set(arg.substr(2), value);
+            if (!ok)
+                return false;
+        }
+        return true;
+    }
+
+    /// Return true if the named value was set at run time.
+    bool IsSet(const std::string& name) const {
+        auto found = m_index.find(name);
+        return found != m_index.end() && m_entries[found->second].is_set;
+    }
+
+    /// Return the command line arguments not starting with "--".
+    const std::vector<std::string>& GetPositional() const { return m_positional; }
+
+    /// Return the command line options (e.g. to pass them on to another process).
+    std::string GetOptions() const {
+        std::string options;
+        for (const auto& o : m_options)
+            options += " " + o.first + " \"" + o.second + "\"";
+        return options;
+    }
+
+    /// Print all settings with their current values.
+    void Print(std::ostream& os) const {
+        for (const auto& e : m_entries)
+            os << "  --" << e.name << " " << e.get() << (e.is_set ? "" : "  (default)") << "\n";
+    }
+
+  private:
+    struct Entry {
+        std::string name;
+        std::function<bool(const std::string&)> set;
+        std::function<std::string()> get;
+        bool is_set;
+    };
+
+    void AddEntry(const std::string& name,
+                  std::function<bool(const std::string&)> set,
+                  std::function<std::string()> get) {
+        m_index[name] = m_entries.size();
+        m_entries.push_back({name, set, get, false});
+    }
+
+    template <typename T>
+    static bool ParseNumber(const std::string& s, T& value) {
+        std::istringstream iss(s);
+        T v;
+        if (!(iss >> v) || !(iss >> std::ws).eof())
+            return false;
+        value = v;
+        return true;
+    }
+
+    template <typename T>
+    static std::string ToString(T value) {
+        std::ostringstream oss;
+        oss << value;
+        return oss.str();
+    }
+
+    static std::string Trim(const std::string& s) {
+        size_t first = s.find_first_not_of(" \t\r");
+        if (first == std::string::npos)
+            return "";
+        size_t last = s.find_last_not_of(" \t\r");
+        return s.substr(first, last - first + 1);
+    }
+
+    std::vector<Entry> m_entries;                               ///< registered settings
+    std::map<std::string, size_t> m_index;                      ///< setting name -> entry index
+    std::vector<std::string> m_positional;                      ///< positional arguments
+    std::vector<std::pair<std::string, std::string>> m_options; ///< command line options
+};
+
+// =============================================================================
+// Names of the enumerations used in the DEM programs.
+
+inline std::vector<std::pair<std::string, chrono::ChContactMethod>> ContactMethodNames() {
+    return {{"NSC", chrono::ChContactMethod::NSC}, {"SMC", chrono::ChContactMethod::SMC}};
+}
+
+inline std::vector<std::pair<std::string, chrono::SolverType>> SolverTypeNames() {
+    return {{"APGD", chrono::SolverType::APGD},
+            {"APGDREF", chrono::SolverType::APGDREF},
+            {"BB", chrono::SolverType::BB},
+            {"SPGQP", chrono::SolverType::SPGQP}};
+}
+
+inline std::vector<std::pair<std::string, chrono::collision::NarrowPhaseType>> NarrowPhaseNames() {
+    return {{"MPR", chrono::collision::NarrowPhaseType::NARROWPHASE_MPR},
+            {"R", chrono::collision::NarrowPhaseType::NARROWPHASE_R},
+            {"HYBRID_MPR", chrono::collision::NarrowPhaseType::NARROWPHASE_HYBRID_MPR}};
+}
+
+inline std::vector<std::pair<std::string, chrono::ChSystemSMC::ContactForceModel>> ContactForceModelNames() {
+    return {{"Hooke", chrono::ChSystemSMC::ContactForceModel::Hooke},
+            {"Hertz", chrono::ChSystemSMC::ContactForceModel::Hertz},
+            {"PlainCoulomb", chrono::ChSystemSMC::ContactForceModel::PlainCoulomb},
+            {"Flores", chrono::ChSystemSMC::ContactForceModel::Flores}};
+}
+
+inline std::vector<std::pair<std::string, chrono::ChSystemSMC::TangentialDisplacementModel>>
+TangentialDisplacementModelNames() {
+    return {{"None", chrono::ChSystemSMC::TangentialDisplacementModel::None},
+            {"OneStep", chrono::ChSystemSMC::TangentialDisplacementModel::OneStep},
+            {"MultiStep", chrono::ChSystemSMC::TangentialDisplacementModel::MultiStep}};
+}
+
+/// Return the name of a contact method ("NSC" or "SMC").
+inline std::string GetContactMethodName(chrono::ChContactMethod method) {
+    return method == chrono::ChContactMethod::SMC ? "SMC" : "NSC";
+}
+
+// =============================================================================
+// Creation of systems and materials for a contact method selected at run time.
+
+/// Create a Chrono::Multicore system for the specified contact method.
+inline chrono::ChSystemMulticore* CreateMulticoreSystem(chrono::ChContactMethod method) {
+    if (method == chrono::ChContactMethod::SMC) {
+        std::cout << "Create SMC system" << std::endl;
+        return new chrono::ChSystemMulticoreSMC();
+    }
+    std::cout << "Create NSC system" << std::endl;
+    return new chrono::ChSystemMulticoreNSC();
+}
+
+/// Create a contact material for the specified contact method.
+/// Young's modulus, Poisson ratio, and coefficient of restitution are only used
+/// with SMC (negative values leave the defaults unchanged).
+inline std::shared_ptr<chrono::ChMaterialSurface> CreateContactMaterial(chrono::ChContactMethod method,
+                                                                        float mu,
+                                                                        float Y = -1,
+                                                                        float cr = -1,
+                                                                        float nu = -1) {
+    if (method == chrono::ChContactMethod::SMC) {
+        auto mat = chrono_types::make_shared<chrono::ChMaterialSurfaceSMC>();
+        mat->SetFriction(mu);
+        if (Y >= 0)
+            mat->SetYoungModulus(Y);
+        if (cr >= 0)
+            mat->SetRestitution(cr);
+        if (nu >= 0)
+            mat->SetPoissonRatio(nu);
+        return mat;
+    }
+    auto mat = chrono_types::make_shared<chrono::ChMaterialSurfaceNSC>();
+    mat->SetFriction(mu);
+    return mat;
+}
+
+#endif
@@ -16,7 +16,8 @@
 //
 // The model simulated here consists of a spherical projectile dropped in a
 // bed of granular material, using either penalty or complementarity method for
-// frictional contact.
+// frictional contact. The contact method, problem type, and solver settings
+// can be changed at run time (see AddSettings; "--help" lists all settings).
 //
 // The global reference frame has Z up.
 // All units SI.
@@ -45,6 +46,11 @@
 #include "chrono_opengl/ChOpenGLWindow.h"
 #endif
 
+#include "../checkpoint.h"
+#include "../dem_settings.h"
+#include "../granular.h"
+#include "../settling.h"
+#include "../sphere_generator.h"
 #include "../utils.h"
 
 using namespace chrono;
@@ -58,8 +64,8 @@ using std::endl;
 // Problem definitions
 // -----------------------------------------------------------------------------
 
-// Comment the following line to use NSC contact
-#define USE_SMC
+// Contact method (NSC or SMC)
+ChContactMethod method = ChContactMethod::SMC;
 
 enum ProblemType { SETTLING, DROPPING };
 
@@ -79,38 +85,33 @@ double time_settling_min = 0.1;
 double time_settling_max = 0.8;
 double time_dropping = 0.06;
 
-#ifdef USE_SMC
-double time_step = 1e-5;
-int max_iteration = 20;
-#else
-double time_step = 1e-4;
+// Solver settings
+// (unless set at run time, the time step and narrowphase algorithm depend on the contact method)
+double time_step = 1e-5;  // NSC: 1e-4
 int max_iteration_normal = 0;
 int max_iteration_sliding = 50;
 int max_iteration_spinning = 0;
-float contact_recovery_speed = 0.1;
-#endif
+float contact_recovery_speed = 0.1f;
+SolverType solver_type = SolverType::APGDREF;
 
 double tolerance = 1.0;
 
-// Contact force model
-#ifdef USE_SMC
+// Collision detection settings
+NarrowPhaseType narrowphase = NarrowPhaseType::NARROWPHASE_R;  // NSC: NARROWPHASE_HYBRID_MPR
+vec3 bins_per_axis = vec3(20, 20, 20);
+
+// Contact force model (SMC only)
 ChSystemSMC::ContactForceModel contact_force_model = ChSystemSMC::ContactForceModel::Hooke;
 ChSystemSMC::TangentialDisplacementModel tangential_displ_mode = ChSystemSMC::TangentialDisplacementModel::MultiStep;
-#endif
 
-// Output
+// Output (directory names depend on the contact method, see SetOutputDirectories)
 bool povray_output = true;
 
-#ifdef USE_SMC
-const std::string out_dir = "../CRATER_SMC";
-#else
-const std::string out_dir = "../CRATER_NSC";
-#endif
-
-const std::string pov_dir = out_dir + "/POVRAY";
-const std::string height_file = out_dir + "/height.dat";
-const std::string stats_file = out_dir + "/stats.dat";
-const std::string checkpoint_file = out_dir + "/settled.dat";
+std::string out_dir;
+std::string pov_dir;
+std::string height_file;
+std::string stats_file;
+std::string checkpoint_file;
 
 int out_fps_settling = 120;
 int out_fps_dropping = 1200;
@@ -171,52 +172,30 @@ double h = 10e-2;
 // - a containing bin consisting of five boxes (no top)
 // -----------------------------------------------------------------------------
 int CreateObjects(ChSystemMulticore* system) {
-// Create the containing bin
-#ifdef USE_SMC
-    auto mat_c = chrono_types::make_shared<ChMaterialSurfaceSMC>();
-    mat_c->SetYoungModulus(Y_c);
-    mat_c->SetFriction(mu_c);
-    mat_c->SetRestitution(cr_c);
-
-    utils::CreateBoxContainer(system, binId, mat_c, ChVector<>(hDimX, hDimY, hDimZ), hThickness);
-#else
-    auto mat_c = chrono_types::make_shared<ChMaterialSurfaceNSC>();
-    mat_c->SetFriction(mu_c);
+    // Create the containing bin
+    auto mat_c = CreateContactMaterial(method, mu_c, Y_c, cr_c);
 
     utils::CreateBoxContainer(system, binId, mat_c, ChVector<>(hDimX, hDimY, hDimZ), hThickness);
-#endif
 
-// Create a material for the granular material
-#ifdef USE_SMC
-    auto mat_g = chrono_types::make_shared<ChMaterialSurfaceSMC>();
-    mat_g->SetYoungModulus(Y_g);
-    mat_g->SetFriction(mu_g);
-    mat_g->SetRestitution(cr_g);
-#else
-    auto mat_g = chrono_types::make_shared<ChMaterialSurfaceNSC>();
-    mat_g->SetFriction(mu_g);
-#endif
+    // Create a material for the granular material
+    auto mat_g = CreateContactMaterial(method, mu_g, Y_g, cr_g);
 
-    // Create a mixture entirely made out of spheres
-    utils::Generator gen(system);
+    // Create the generator of identical spheres
+    SphereGenerator gen(system, mat_g, r_g, rho_g);
 
-    std::shared_ptr<utils::MixtureIngredient> m1 = gen.AddMixtureIngredient(utils::MixtureType::SPHERE, 1.0);
-    m1->setDefaultMaterial(mat_g);
-    m1->setDefaultDensity(rho_g);
-    m1->setDefaultSize(r_g);
-
-    gen.setBodyIdentifier(Id_g);
+    gen.SetBodyIdentifier(Id_g);
 
     double r = 1.01 * r_g;
 
+    // Sample all layers at once, then create the bodies
     for (int i = 0; i < numLayers; i++) {
         double center = r + layerHeight / 2 + i * (2 * r + layerHeight);
-        gen.createObjectsBox(utils::SamplingType::POISSON_DISK, 2 * r, ChVector<>(0, 0, center),
-                             ChVector<>(hDimX - r, hDimY - r, layerHeight / 2));
-        cout << "Layer " << i << "  total bodies: " << gen.getTotalNumBodies() << endl;
+        gen.AddBox(ChVector<>(0, 0, center), ChVector<>(hDimX - r, hDimY - r, layerHeight / 2), 2 * r);
     }
+    gen.CreateBodies();
+    cout << "Layers: " << numLayers << "  total bodies: " << gen.GetTotalNumBodies() << endl;
 
-    return gen.getTotalNumBodies();
+    return gen.GetTotalNumBodies();
 }
 
 // -----------------------------------------------------------------------------
@@ -225,15 +204,7 @@ int CreateObjects(ChSystemMulticore* system) {
 // -----------------------------------------------------------------------------
 void CreateFallingBall(ChSystemMulticore* system, double z, double vz) {
     // Create a material for the falling ball
-#ifdef USE_SMC
-    auto mat_b = chrono_types::make_shared<ChMaterialSurfaceSMC>();
-    mat_b->SetYoungModulus(1e8f);
-    mat_b->SetFriction(0.4f);
-    mat_b->SetRestitution(0.1f);
-#else
-    auto mat_b = chrono_types::make_shared<ChMaterialSurfaceNSC>();
-    mat_b->SetFriction(mu_c);
-#endif
+    auto mat_b = CreateContactMaterial(method, method == ChContactMethod::SMC ? 0.4f : mu_c, 1e8f, 0.1f);
 
     // Create the falling ball
     auto ball = chrono_types::make_shared<ChBody>(chrono_types::make_shared<ChCollisionModelMulticore>());
@@ -255,56 +226,60 @@ void CreateFallingBall(ChSystemMulticore* system, double z, double vz) {
 }
 
 // -----------------------------------------------------------------------------
-// Find the height of the highest and lowest, respectively, sphere in the
-// granular mix, respectively.  We only look at bodies whith stricty positive
-// identifiers (to exclude the containing bin).
+// Register all parameters which can be set at run time.
 // -----------------------------------------------------------------------------
-double FindHighest(ChSystem* sys) {
-    double highest = 0;
-    for (auto body : sys->Get_bodylist()) {
-        if (body->GetIdentifier() > 0 && body->GetPos().z() > highest)
-            highest = body->GetPos().z();
-    }
-    return highest;
-}
-
-double FindLowest(ChSystem* sys) {
-    double lowest = 1000;
-    for (auto body : sys->Get_bodylist()) {
-        if (body->GetIdentifier() > 0 && body->GetPos().z() < lowest)
-            lowest = body->GetPos().z();
-    }
-    return lowest;
+void AddSettings(DEMSettings& settings) {
+    settings.AddEnum("method", method, ContactMethodNames());
+    settings.AddEnum("problem", problem, {{"SETTLING", SETTLING}, {"DROPPING", DROPPING}});
+    settings.Add("threads", threads);
+    settings.Add("time_step", time_step);
+    settings.Add("tolerance", tolerance);
+    settings.Add("max_iteration_normal", max_iteration_normal);
+    settings.Add("max_iteration_sliding", max_iteration_sliding);
+    settings.Add("max_iteration_spinning", max_iteration_spinning);
+    settings.Add("contact_recovery_speed", contact_recovery_speed);
+    settings.AddEnum("solver_type", solver_type, SolverTypeNames());
+    settings.AddEnum("narrowphase", narrowphase, NarrowPhaseNames());
+    settings.Add("bins_per_axis", bins_per_axis);
+    settings.AddEnum("contact_force_model", contact_force_model, ContactForceModelNames());
+    settings.AddEnum("tangential_displ_mode", tangential_displ_mode, TangentialDisplacementModelNames());
+    settings.Add("povray_output", povray_output);
 }
 
 // -----------------------------------------------------------------------------
-// Return true if all bodies in the granular mix have a linear velocity whose
-// magnitude is below the specified value.
+// Set the output directories for the selected contact method.
 // -----------------------------------------------------------------------------
-bool CheckSettled(ChSystem* sys, double threshold) {
-    double t2 = threshold * threshold;
-
-    for (auto body : sys->Get_bodylist()) {
-        if (body->GetIdentifier() > 0) {
-            double vel2 = body->GetPos_dt().Length2();
-            if (vel2 > t2)
-                return false;
-        }
-    }
-
-    return true;
+void SetOutputDirectories() {
+    out_dir = "../CRATER_" + GetContactMethodName(method);
+    pov_dir = out_dir + "/POVRAY";
+    height_file = out_dir + "/height.dat";
+    stats_file = out_dir + "/stats.dat";
+    checkpoint_file = out_dir + "/settled.dat";
 }
 
 // -----------------------------------------------------------------------------
 int main(int argc, char* argv[]) {
-// Create system
-#ifdef USE_SMC
-    cout << "Create SMC system" << endl;
-    ChSystemMulticoreSMC* msystem = new ChSystemMulticoreSMC();
-#else
-    cout << "Create NSC system" << endl;
-    ChSystemMulticoreNSC* msystem = new ChSystemMulticoreNSC();
-#endif
+    // Run-time settings ("--help" lists all settings)
+    DEMSettings settings;
+    AddSettings(settings);
+    if (!settings.Parse(argc, argv))
+        return 1;
+
+    // Defaults which depend on the contact method
+    if (method == ChContactMethod::NSC) {
+        if (!settings.IsSet("time_step"))
+            time_step = 1e-4;
+        if (!settings.IsSet("narrowphase"))
+            narrowphase = NarrowPhaseType::NARROWPHASE_HYBRID_MPR;
+    }
+
+    SetOutputDirectories();
+
+    // Create system
+    ChSystemMulticore* msystem = CreateMulticoreSystem(method);
+
+    // Analysis of the granular material (particle heights)
+    GranularAnalysis granular(msystem, Id_g);
 
     // Debug log messages.
     ////msystem->SetLoggingLevel(LOG_INFO, true);
@@ -324,24 +299,23 @@ int main(int argc, char* argv[]) {
     msystem->GetSettings()->solver.use_full_inertia_tensor = false;
     msystem->GetSettings()->solver.tolerance = tolerance;
 
-#ifdef USE_SMC
-    msystem->GetSettings()->collision.narrowphase_algorithm = NarrowPhaseType::NARROWPHASE_R;
-
-    msystem->GetSettings()->solver.contact_force_model = contact_force_model;
-    msystem->GetSettings()->solver.tangential_displ_mode = tangential_displ_mode;
-#else
-    msystem->GetSettings()->solver.solver_mode = SolverMode::SLIDING;
-    msystem->GetSettings()->solver.max_iteration_normal = max_iteration_normal;
-    msystem->GetSettings()->solver.max_iteration_sliding = max_iteration_sliding;
-    msystem->GetSettings()->solver.max_iteration_spinning = max_iteration_spinning;
-    msystem->GetSettings()->solver.alpha = 0;
-    msystem->GetSettings()->solver.contact_recovery_speed = contact_recovery_speed;
-    msystem->ChangeSolverType(SolverType::APGDREF);
-
-    msystem->GetSettings()->collision.collision_envelope = 0.05 * r_g;
-#endif
+    if (method == ChContactMethod::SMC) {
+        msystem->GetSettings()->solver.contact_force_model = contact_force_model;
+        msystem->GetSettings()->solver.tangential_displ_mode = tangential_displ_mode;
+    } else {
+        msystem->GetSettings()->solver.solver_mode = SolverMode::SLIDING;
+        msystem->GetSettings()->solver.max_iteration_normal = max_iteration_normal;
+        msystem->GetSettings()->solver.max_iteration_sliding = max_iteration_sliding;
+        msystem->GetSettings()->solver.max_iteration_spinning = max_iteration_spinning;
+        msystem->GetSettings()->solver.alpha = 0;
+        msystem->GetSettings()->solver.contact_recovery_speed = contact_recovery_speed;
+        static_cast<ChSystemMulticoreNSC*>(msystem)->ChangeSolverType(solver_type);
+
+        msystem->GetSettings()->collision.collision_envelope = 0.05 * r_g;
+    }
 
-    msystem->GetSettings()->collision.bins_per_axis = vec3(20, 20, 20);
+    msystem->GetSettings()->collision.narrowphase_algorithm = narrowphase;
+    msystem->GetSettings()->collision.bins_per_axis = bins_per_axis;
 
     // Depending on problem type:
     // - Select end simulation time
@@ -368,12 +342,12 @@ int main(int argc, char* argv[]) {
 
         // Create the granular material and the container from the checkpoint file.
         cout << "Read checkpoint data from " << checkpoint_file;
-        utils::ReadCheckpoint(msystem, checkpoint_file);
+        ReadCheckpointBinary(msystem, checkpoint_file);
         cout << "  done.  Read " << msystem->Get_bodylist().size() << " bodies." << endl;
 
         // Move the falling ball just above the granular material with a velocity
         // given by free fall from the specified height and starting at rest.
-        double z = FindHighest(msystem);
+        double z = granular.FindHighest();
         double vz = std::sqrt(2 * gravity * h);
         cout << "Move falling ball with center at " << z + R_b + r_g << " and velocity " << vz << endl;
         ball = msystem->Get_bodylist().at(0);
@@ -393,6 +367,12 @@ int main(int argc, char* argv[]) {
     // (fraction of a grain radius per second)
     double zero_v = 0.1 * r_g;
 
+    // Settling monitor (evaluated every settling_check_steps steps)
+    int settling_check_steps = 10;
+    SettlingMonitor monitor(settling_check_steps);
+    monitor.SetMinTime(time_settling_min);
+    monitor.SetMaxSpeed(zero_v);
+
     // Create output directories.
     if (!filesystem::create_directory(filesystem::path(out_dir))) {
         cout << "Error creating directory " << out_dir << endl;
@@ -413,6 +393,9 @@ int main(int argc, char* argv[]) {
     ChStreamOutAsciiFile sfile(stats_file.c_str());
     ChStreamOutAsciiFile hfile(height_file.c_str());
 
+    // Per-step timing recorder (exported at the end of the simulation)
+    TimelineRecorder timeline;
+
 #ifdef CHRONO_OPENGL
     opengl::ChOpenGLWindow& gl_window = opengl::ChOpenGLWindow::getInstance();
     gl_window.Initialize(1280, 720, "Crater Test", msystem);
@@ -426,7 +409,7 @@ int main(int argc, char* argv[]) {
             cout << "---- Frame:          " << out_frame << endl;
             cout << "     Sim frame:      " << sim_frame << endl;
             cout << "     Time:           " << time << endl;
-            cout << "     Lowest point:   " << FindLowest(msystem) << endl;
+            cout << "     Lowest point:   " << granular.FindLowest() << endl;
             cout << "     Avg. contacts:  " << num_contacts / out_steps << endl;
             cout << "     Execution time: " << exec_time << endl;
 
@@ -442,7 +425,7 @@ int main(int argc, char* argv[]) {
             // Create a checkpoint from the current state.
             if (problem == SETTLING) {
                 cout << "     Write checkpoint data " << flush;
-                utils::WriteCheckpoint(msystem, checkpoint_file);
+                WriteCheckpointBinary(msystem, checkpoint_file);
                 cout << msystem->Get_bodylist().size() << " bodies" << endl;
             }
 
@@ -457,7 +440,7 @@ int main(int argc, char* argv[]) {
             num_contacts = 0;
         }
 
-        if (problem == SETTLING && time > time_settling_min && CheckSettled(msystem, zero_v)) {
+        if (problem == SETTLING && monitor.Update(msystem)) {
             cout << "Granular material settled...  time = " << time << endl;
             break;
         }
@@ -474,7 +457,7 @@ int main(int argc, char* argv[]) {
 #endif
 
         ////progressbar(out_steps + sim_frame - next_out_frame + 1, out_steps);
-        TimingOutput(msystem);
+        timeline.Record(msystem);
 
         time += time_step;
         sim_frame++;
@@ -489,14 +472,18 @@ int main(int argc, char* argv[]) {
     // Create a checkpoint from the last state
     if (problem == SETTLING) {
         cout << "Write checkpoint data to " << checkpoint_file;
-        utils::WriteCheckpoint(msystem, checkpoint_file);
+        WriteCheckpointBinary(msystem, checkpoint_file);
         cout << "  done.  Wrote " << msystem->Get_bodylist().size() << " bodies." << endl;
     }
 
+    // Export per-step timing information
+    timeline.WriteBinary(out_dir + "/timeline.bin");
+    timeline.WriteChromeTrace(out_dir + "/timeline.json");
+
     // Final stats
     cout << "==================================" << endl;
     cout << "Number of bodies:  " << msystem->Get_bodylist().size() << endl;
-    cout << "Lowest position:   " << FindLowest(msystem) << endl;
+    cout << "Lowest position:   " << granular.FindLowest() << endl;
     cout << "Simulation time:   " << exec_time << endl;
     cout << "Number of threads: " << threads << endl;
 
@@ -16,7 +16,9 @@
 //
 // The model simulated here consists of a granular material that flows out of a
 // container and the mass of the collected material is measured over time, using
-// either penalty or complementarity method for frictional contact.
+// either penalty or complementarity method for frictional contact. The contact
+// method, problem type, and solver settings can be changed at run time (see
+// AddSettings; "--help" lists all settings).
 //
 // The global reference frame has Z up.
 // All units SI.
@@ -45,6 +47,13 @@
 #include "chrono_opengl/ChOpenGLWindow.h"
 #endif
 
+#include "../checkpoint.h"
+#include "../dem_settings.h"
+#include "../granular.h"
+#include "../region_sampler.h"
+#include "../settling.h"
+#include "../sphere_generator.h"
+
 using namespace chrono;
 using namespace chrono::collision;
 
@@ -56,8 +65,8 @@ using std::endl;
 // Problem definitions
 // -----------------------------------------------------------------------------
 
-// Comment the following line to use NSC contact
-#define USE_SMC
+// Contact method (NSC or SMC)
+ChContactMethod method = ChContactMethod::SMC;
 
 enum ProblemType { SETTLING, DROPPING };
 
@@ -77,32 +86,29 @@ double time_settling_min = 0.1;
 double time_settling_max = 1.0;
 double time_dropping_max = 6.0;
 
-#ifdef USE_SMC
-double time_step = 1e-5;
-int max_iteration = 20;
-#else
-double time_step = 1e-4;
+// Solver settings
+// (unless set at run time, the time step and narrowphase algorithm depend on the contact method)
+double time_step = 1e-5;  // NSC: 1e-4
 int max_iteration_normal = 0;
 int max_iteration_sliding = 50000;
 int max_iteration_spinning = 0;
-float contact_recovery_speed = 1.0e30;
-#endif
+float contact_recovery_speed = 1.0e30f;
+SolverType solver_type = SolverType::APGDREF;
 
 double tolerance = 500.0;
 
 int max_iteration_bilateral = 0;
 
-// Output
-#ifdef USE_SMC
-const std::string out_dir = "../MASSFLOW_SMC";
-#else
-const std::string out_dir = "../MASSFLOW_NSC";
-#endif
+// Collision detection settings
+NarrowPhaseType narrowphase = NarrowPhaseType::NARROWPHASE_R;  // NSC: NARROWPHASE_HYBRID_MPR
+vec3 bins_per_axis = vec3(10, 10, 10);
 
-const std::string pov_dir = out_dir + "/POVRAY";
-const std::string flow_file = out_dir + "/flow.dat";
-const std::string stats_file = out_dir + "/stats.dat";
-const std::string checkpoint_file = out_dir + "/settled.dat";
+// Output (directory names depend on the contact method, see SetOutputDirectories)
+std::string out_dir;
+std::string pov_dir;
+std::string flow_file;
+std::string stats_file;
+std::string checkpoint_file;
 
 int out_fps_settling = 200;
 int out_fps_dropping = 200;
@@ -151,15 +157,7 @@ double height_collector = 1.0e-2;  // height of collector walls
 // -----------------------------------------------------------------------------
 ChBody* CreateMechanism(ChSystemMulticore* system) {
     // Create the common material
-#ifdef USE_SMC
-    auto mat_b = chrono_types::make_shared<ChMaterialSurfaceSMC>();
-    mat_b->SetYoungModulus(Y_c);
-    mat_b->SetFriction(mu_c);
-    mat_b->SetRestitution(cr_c);
-#else
-    auto mat_b = chrono_types::make_shared<ChMaterialSurfaceNSC>();
-    mat_b->SetFriction(mu_c);
-#endif
+    auto mat_b = CreateContactMaterial(method, mu_c, Y_c, cr_c);
 
     // Angled insert
     auto insert = chrono_types::make_shared<ChBody>(chrono_types::make_shared<ChCollisionModelMulticore>());
@@ -215,16 +213,10 @@ ChBody* CreateMechanism(ChSystemMulticore* system) {
 
     system->AddBody(wall);
 
-// Containing bin
-#ifdef USE_SMC
+    // Containing bin
     utils::CreateBoxContainer(system, -3, mat_b,
                               ChVector<>(size_collector / 2, size_collector / 2, height_collector / 2), thickness / 2,
                               ChVector<>(0, 0, -pos_collector));
-#else
-    utils::CreateBoxContainer(system, -3, mat_b,
-                              ChVector<>(size_collector / 2, size_collector / 2, height_collector / 2), thickness / 2,
-                              ChVector<>(0, 0, -pos_collector));
-#endif
 
     // Return the angled insert body
     return insert.get();
@@ -234,38 +226,28 @@ ChBody* CreateMechanism(ChSystemMulticore* system) {
 // Create granular material
 // -----------------------------------------------------------------------------
 void CreateParticles(ChSystemMulticore* system) {
-// Create a material for the granular material
-#ifdef USE_SMC
-    auto mat_g = chrono_types::make_shared<ChMaterialSurfaceSMC>();
-    mat_g->SetYoungModulus(Y_g);
-    mat_g->SetFriction(mu_g);
-    mat_g->SetRestitution(cr_g);
-#else
-    auto mat_g = chrono_types::make_shared<ChMaterialSurfaceNSC>();
-    mat_g->SetFriction(mu_g);
-#endif
-
-    // Create a mixture entirely made out of spheres
-    utils::Generator gen(system);
+    // Create a material for the granular material
+    auto mat_g = CreateContactMaterial(method, mu_g, Y_g, cr_g);
 
-    std::shared_ptr<utils::MixtureIngredient> m1 = gen.AddMixtureIngredient(utils::MixtureType::SPHERE, 1.0);
-    m1->setDefaultMaterial(mat_g);
-    m1->setDefaultDensity(rho_g);
-    m1->setDefaultSize(r_g);
+    // Create the generator of identical spheres
+    SphereGenerator gen(system, mat_g, r_g, rho_g);
 
-    gen.setBodyIdentifier(1);
+    gen.SetBodyIdentifier(1);
 
     ChVector<> hdims(0.3 * height, 0.3 * width, 0);
     ChVector<> center(-0.4 * height, 0, 0.8 * height);
     ChVector<> vel(0, 0, 0);
     double r = 1.01 * r_g;
 
-    while (gen.getTotalNumBodies() < desired_num_particles) {
-        gen.createObjectsBox(utils::SamplingType::POISSON_DISK, 2 * r, center, hdims, vel);
+    // Sample layers until there are enough positions, then create all bodies at once
+    while (gen.GetNumSamples() < desired_num_particles) {
+        gen.AddBox(center, hdims, 2 * r, vel);
+        gen.Sample();
         center.z() += 2 * r;
     }
+    gen.CreateBodies();
 
-    std::cout << "Number of particles: " << gen.getTotalNumBodies() << std::endl;
+    std::cout << "Number of particles: " << gen.GetTotalNumBodies() << std::endl;
 }
 
 // -----------------------------------------------------------------------------
@@ -281,55 +263,62 @@ ChBody* FindBodyById(ChSystemMulticore* sys, int id) {
 }
 
 // -----------------------------------------------------------------------------
-// Find the number of particles whose height is below and above, respectively,
-// the specified value.
+// Register all parameters which can be set at run time.
 // -----------------------------------------------------------------------------
-int GetNumParticlesBelowHeight(ChSystemMulticore* sys, double value) {
-    int count = 0;
-    for (auto body : sys->Get_bodylist()) {
-        if (body->GetIdentifier() > 0 && body->GetPos().z() < value)
-            count++;
-    }
-    return count;
+void AddSettings(DEMSettings& settings) {
+    settings.AddEnum("method", method, ContactMethodNames());
+    settings.AddEnum("problem", problem, {{"SETTLING", SETTLING}, {"DROPPING", DROPPING}});
+    settings.Add("threads", threads);
+    settings.Add("time_step", time_step);
+    settings.Add("tolerance", tolerance);
+    settings.Add("max_iteration_normal", max_iteration_normal);
+    settings.Add("max_iteration_sliding", max_iteration_sliding);
+    settings.Add("max_iteration_spinning", max_iteration_spinning);
+    settings.Add("max_iteration_bilateral", max_iteration_bilateral);
+    settings.Add("contact_recovery_speed", contact_recovery_speed);
+    settings.AddEnum("solver_type", solver_type, SolverTypeNames());
+    settings.AddEnum("narrowphase", narrowphase, NarrowPhaseNames());
+    settings.Add("bins_per_axis", bins_per_axis);
 }
 
-int GetNumParticlesAboveHeight(ChSystemMulticore* sys, double value) {
-    int count = 0;
-    for (auto body : sys->Get_bodylist()) {
-        if (body->GetIdentifier() > 0 && body->GetPos().z() > value)
-            count++;
-    }
-    return count;
+// -----------------------------------------------------------------------------
+// Set the output directories for the selected contact method.
+// -----------------------------------------------------------------------------
+void SetOutputDirectories() {
+    out_dir = "../MASSFLOW_" + GetContactMethodName(method);
+    pov_dir = out_dir + "/POVRAY";
+    flow_file = out_dir + "/flow.dat";
+    stats_file = out_dir + "/stats.dat";
+    checkpoint_file = out_dir + "/settled.dat";
 }
 
 // -----------------------------------------------------------------------------
-// Return true if all bodies in the granular mix have a linear velocity whose
-// magnitude is below the specified value.
-// -----------------------------------------------------------------------------
-bool CheckSettled(ChSystemMulticore* sys, double threshold) {
-    double t2 = threshold * threshold;
+int main(int argc, char* argv[]) {
+    // Run-time settings ("--help" lists all settings)
+    DEMSettings settings;
+    AddSettings(settings);
+    if (!settings.Parse(argc, argv))
+        return 1;
 
-    for (auto body : sys->Get_bodylist()) {
-        if (body->GetIdentifier() > 0) {
-            double vel2 = body->GetPos_dt().Length2();
-            if (vel2 > t2)
-                return false;
-        }
+    // Defaults which depend on the contact method
+    if (method == ChContactMethod::NSC) {
+        if (!settings.IsSet("time_step"))
+            time_step = 1e-4;
+        if (!settings.IsSet("narrowphase"))
+            narrowphase = NarrowPhaseType::NARROWPHASE_HYBRID_MPR;
     }
 
-    return true;
-}
+    SetOutputDirectories();
 
-// -----------------------------------------------------------------------------
-int main(int argc, char* argv[]) {
-// Create system
-#ifdef USE_SMC
-    cout << "Create SMC system" << endl;
-    ChSystemMulticoreSMC* msystem = new ChSystemMulticoreSMC();
-#else
-    cout << "Create NSC system" << endl;
-    ChSystemMulticoreNSC* msystem = new ChSystemMulticoreNSC();
-#endif
+    // Create system
+    ChSystemMulticore* msystem = CreateMulticoreSystem(method);
+
+    // Analysis of the granular material (particle counts)
+    GranularAnalysis granular(msystem);
+
+    // Mass flow rate through the outlet plane (downwards)
+    RegionSampler regions(msystem);
+    int outlet = regions.AddPlane("outlet", ChVector<>(0, 0, 0), ChVector<>(0, 0, -1));
 
     // Set number of threads.
     int max_threads = omp_get_num_procs();
@@ -346,21 +335,20 @@ int main(int argc, char* argv[]) {
     msystem->GetSettings()->solver.tolerance = tolerance;
     msystem->GetSettings()->solver.use_full_inertia_tensor = false;
 
-#ifdef USE_SMC
-    msystem->GetSettings()->collision.narrowphase_algorithm = NarrowPhaseType::NARROWPHASE_R;
-#else
-    msystem->GetSettings()->solver.solver_mode = SolverMode::SLIDING;
-    msystem->GetSettings()->solver.max_iteration_normal = max_iteration_normal;
-    msystem->GetSettings()->solver.max_iteration_sliding = max_iteration_sliding;
-    msystem->GetSettings()->solver.max_iteration_spinning = max_iteration_spinning;
-    msystem->GetSettings()->solver.alpha = 0;
-    msystem->GetSettings()->solver.contact_recovery_speed = contact_recovery_speed;
-    msystem->ChangeSolverType(SolverType::APGDREF);
-
-    msystem->GetSettings()->collision.collision_envelope = 0.05 * r_g;
-#endif
+    if (method == ChContactMethod::NSC) {
+        msystem->GetSettings()->solver.solver_mode = SolverMode::SLIDING;
+        msystem->GetSettings()->solver.max_iteration_normal = max_iteration_normal;
+        msystem->GetSettings()->solver.max_iteration_sliding = max_iteration_sliding;
+        msystem->GetSettings()->solver.max_iteration_spinning = max_iteration_spinning;
+        msystem->GetSettings()->solver.alpha = 0;
+        msystem->GetSettings()->solver.contact_recovery_speed = contact_recovery_speed;
+        static_cast<ChSystemMulticoreNSC*>(msystem)->ChangeSolverType(solver_type);
+
+        msystem->GetSettings()->collision.collision_envelope = 0.05 * r_g;
+    }
 
-    msystem->GetSettings()->collision.bins_per_axis = vec3(10, 10, 10);
+    msystem->GetSettings()->collision.narrowphase_algorithm = narrowphase;
+    msystem->GetSettings()->collision.bins_per_axis = bins_per_axis;
 
     // Set simulation duration and create bodies (depending on problem type).
     double time_end;
@@ -378,7 +366,7 @@ int main(int argc, char* argv[]) {
         case DROPPING:
             time_end = time_dropping_max;
             out_fps = out_fps_dropping;
-            utils::ReadCheckpoint(msystem, checkpoint_file);
+            ReadCheckpointBinary(msystem, checkpoint_file);
             insert = FindBodyById(msystem, 0);
             break;
     }
@@ -390,6 +378,12 @@ int main(int argc, char* argv[]) {
     // Zero velocity level for settling check
     double zero_v = 2 * r_g;
 
+    // Settling monitor (evaluated every settling_check_steps steps)
+    int settling_check_steps = 10;
+    SettlingMonitor monitor(settling_check_steps);
+    monitor.SetMinTime(time_settling_min);
+    monitor.SetMaxSpeed(zero_v);
+
     // Create output directories.
     if (!filesystem::create_directory(filesystem::path(out_dir))) {
         cout << "Error creating directory " << out_dir << endl;
@@ -431,7 +425,7 @@ int main(int argc, char* argv[]) {
             cout << "             Execution time: " << exec_time << endl;
 
             double opening = insert->GetPos().x() + 0.5 * height + delta;
-            int count = GetNumParticlesBelowHeight(msystem, 0);
+            int count = granular.GetNumParticlesBelowHeight(0);
 
             cout << "             Gap:            " << -opening << endl;
             cout << "             Flow:           " << count << endl;
@@ -442,12 +436,14 @@ int main(int argc, char* argv[]) {
             switch (problem) {
                 case SETTLING:
                     // Create a checkpoint from the current state.
-                    utils::WriteCheckpoint(msystem, checkpoint_file);
+                    WriteCheckpointBinary(msystem, checkpoint_file);
                     cout << "             Checkpoint:     " << msystem->Get_bodylist().size() << " bodies" << endl;
                     break;
                 case DROPPING:
-                    // Save current gap opening and number of dropped particles.
-                    ffile << time << "  " << -opening << "  " << count << "\n";
+                    // Save current gap opening, number of dropped particles, and mass flow rate.
+                    regions.Sample();
+                    ffile << time << "  " << -opening << "  " << count << "  " << regions.GetSample(outlet).mass_flow
+                          << "\n";
                     ffile.GetFstream().sync();
                     break;
             }
@@ -458,14 +454,14 @@ int main(int argc, char* argv[]) {
         }
 
         // Check for early termination of settling phase.
-        if (problem == SETTLING && time > time_settling_min && CheckSettled(msystem, zero_v)) {
+        if (problem == SETTLING && monitor.Update(msystem)) {
             cout << "Granular material settled...  time = " << time << endl;
             break;
         }
 
         // Check for early termination of dropping phase.
         if (problem == DROPPING && time > time_opening &&
-            GetNumParticlesAboveHeight(msystem, -pos_collector / 2) == 0) {
+            granular.GetNumParticlesAboveHeight(-pos_collector / 2) == 0) {
             cout << "Granular material exhausted... time = " << time << endl;
             break;
         }
@@ -501,7 +497,7 @@ int main(int argc, char* argv[]) {
     // Create a checkpoint from the last state
     if (problem == SETTLING) {
         cout << "Write checkpoint data to " << checkpoint_file;
-        utils::WriteCheckpoint(msystem, checkpoint_file);
+        WriteCheckpointBinary(msystem, checkpoint_file);
         cout << "  done.  Wrote " << msystem->Get_bodylist().size() << " bodies." << endl;
     }
 
@@ -14,7 +14,8 @@
 //
 // Soft-sphere (SMC) or hard-sphere (NSC) direct shear box validation code.
 // Problem parameters correspond to the Hartl and Ooi (2008) direct shear tests
-// on glass beads.
+// on glass beads. The contact method and solver settings can be changed at run
+// time (see AddSettings; "--help" lists all settings).
 //
 // The global reference frame has Y up.
 // All units SI.
@@ -48,6 +49,7 @@
 #include "chrono_opengl/ChOpenGLWindow.h"
 #endif
 
+#include "../dem_settings.h"
 #include "../utils.h"
 
 using namespace chrono;
@@ -61,42 +63,36 @@ using std::endl;
 // Problem definitions
 // -----------------------------------------------------------------------------
 
-// Comment the following line to use NSC contact
-#define USE_SMC
+// Contact method (NSC or SMC)
+ChContactMethod method = ChContactMethod::SMC;
 
 // Desired number of OpenMP threads (will be clamped to maximum available)
 int threads = 20;
 
 // Solver settings
-#ifdef USE_SMC
-double time_step = 1e-5;
-double tolerance = 0.01;
-int max_iteration_bilateral = 100;
-#else
-double time_step = 1e-4;
-double tolerance = 0.1;
+// (unless set at run time, the time step and tolerance depend on the contact method)
+double time_step = 1e-5;  // NSC: 1e-4
+double tolerance = 0.01;  // NSC: 0.1
 int max_iteration_normal = 0;
 int max_iteration_sliding = 10000;
 int max_iteration_spinning = 0;
 int max_iteration_bilateral = 100;
 double contact_recovery_speed = 10e30;
-#endif
+SolverType solver_type = SolverType::APGD;
 
 bool clamp_bilaterals = false;
 double bilateral_clamp_speed = 0.1;
 
+// Collision detection settings
+NarrowPhaseType narrowphase = NarrowPhaseType::NARROWPHASE_HYBRID_MPR;
+vec3 bins_per_axis = vec3(10, 10, 10);
+
 // Simulation parameters
-#ifdef USE_SMC
+// (unless set at run time, the shearing times and speed depend on the contact method)
 double settling_time = 0.23;
-double begin_shear_time = 2.0;
-double end_simulation_time = 12.0;
-double shear_speed = 0.001;  // m/s
-#else
-double settling_time = 0.23;
-double begin_shear_time = 0.5;
-double end_simulation_time = 2.5;
-double shear_speed = 0.005;  // m/s
-#endif
+double begin_shear_time = 2.0;      // NSC: 0.5
+double end_simulation_time = 12.0;  // NSC: 2.5
+double shear_speed = 0.001;         // m/s  NSC: 0.005
 
 // Normal pressure (Pa)
 // double normal_pressure = 24.2e3;
@@ -104,17 +100,12 @@ double shear_speed = 0.005;  // m/s
 // double normal_pressure = 6.4e3;
 double normal_pressure = 3.1e3;
 
-// Output
-#ifdef USE_SMC
-const std::string out_dir = "../SHEAR_SMC";
-#else
-const std::string out_dir = "../SHEAR_NSC";
-#endif
-
-const std::string pov_dir = out_dir + "/POVRAY";
-const std::string shear_file = out_dir + "/shear_ratio.dat";
-const std::string force_file = out_dir + "/shear_force.dat";
-const std::string stats_file = out_dir + "/stats.dat";
+// Output (directory names depend on the contact method, see SetOutputDirectories)
+std::string out_dir;
+std::string pov_dir;
+std::string shear_file;
+std::string force_file;
+std::string stats_file;
 
 bool write_povray_data = true;
 
@@ -137,9 +128,68 @@ void AddWall(std::shared_ptr<ChBody>& body, std::shared_ptr<ChMaterialSurface> m
     }
 }
 
+// -----------------------------------------------------------------------------
+// Register all parameters which can be set at run time
+// -----------------------------------------------------------------------------
+void AddSettings(DEMSettings& settings) {
+    settings.AddEnum("method", method, ContactMethodNames());
+    settings.Add("threads", threads);
+    settings.Add("time_step", time_step);
+    settings.Add("tolerance", tolerance);
+    settings.Add("max_iteration_normal", max_iteration_normal);
+    settings.Add("max_iteration_sliding", max_iteration_sliding);
+    settings.Add("max_iteration_spinning", max_iteration_spinning);
+    settings.Add("max_iteration_bilateral", max_iteration_bilateral);
+    settings.Add("contact_recovery_speed", contact_recovery_speed);
+    settings.AddEnum("solver_type", solver_type, SolverTypeNames());
+    settings.AddEnum("narrowphase", narrowphase, NarrowPhaseNames());
+    settings.Add("bins_per_axis", bins_per_axis);
+    settings.Add("settling_time", settling_time);
+    settings.Add("begin_shear_time", begin_shear_time);
+    settings.Add("end_simulation_time", end_simulation_time);
+    settings.Add("shear_speed", shear_speed);
+    settings.Add("normal_pressure", normal_pressure);
+    settings.Add("write_povray_data", write_povray_data);
+}
+
+// -----------------------------------------------------------------------------
+// Set the output directories for the selected contact method
+// -----------------------------------------------------------------------------
+void SetOutputDirectories() {
+    out_dir = "../SHEAR_" + GetContactMethodName(method);
+    pov_dir = out_dir + "/POVRAY";
+    shear_file = out_dir + "/shear_ratio.dat";
+    force_file = out_dir + "/shear_force.dat";
+    stats_file = out_dir + "/stats.dat";
+}
+
 // -----------------------------------------------------------------------------
 // -----------------------------------------------------------------------------
 int main(int argc, char* argv[]) {
+    // Run-time settings ("--help" lists all settings)
+
+    DEMSettings settings;
+    AddSettings(settings);
+    if (!settings.Parse(argc, argv))
+        return 1;
+
+    // Defaults which depend on the contact method
+
+    if (method == ChContactMethod::NSC) {
+        if (!settings.IsSet("time_step"))
+            time_step = 1e-4;
+        if (!settings.IsSet("tolerance"))
+            tolerance = 0.1;
+        if (!settings.IsSet("begin_shear_time"))
+            begin_shear_time = 0.5;
+        if (!settings.IsSet("end_simulation_time"))
+            end_simulation_time = 2.5;
+        if (!settings.IsSet("shear_speed"))
+            shear_speed = 0.005;
+    }
+
+    SetOutputDirectories();
+
     // Create output directories
 
     if (!filesystem::create_directory(filesystem::path(out_dir))) {
@@ -205,17 +255,11 @@ int main(int argc, char* argv[]) {
     z2y.Q_from_AngAxis(-CH_C_PI / 2, ChVector<>(1, 0, 0));
     z2x.Q_from_AngAxis(CH_C_PI / 2, ChVector<>(0, 1, 0));
 
-// Create the system
+    // Create the system
 
-#ifdef USE_SMC
-    cout << "Create SMC system" << endl;
-    const std::string title = "soft-sphere (SMC) direct shear box test";
-    ChSystemMulticoreSMC* my_system = new ChSystemMulticoreSMC();
-#else
-    cout << "Create NSC system" << endl;
-    const std::string title = "hard-sphere (NSC) direct shear box test";
-    ChSystemMulticoreNSC* my_system = new ChSystemMulticoreNSC();
-#endif
+    ChSystemMulticore* my_system = CreateMulticoreSystem(method);
+    const std::string title = (method == ChContactMethod::SMC) ? "soft-sphere (SMC) direct shear box test"
+                                                               : "hard-sphere (NSC) direct shear box test";
 
     my_system->Set_G_acc(ChVector<>(0, -gravity, 0));
 
@@ -234,51 +278,33 @@ int main(int argc, char* argv[]) {
     my_system->GetSettings()->solver.clamp_bilaterals = clamp_bilaterals;
     my_system->GetSettings()->solver.bilateral_clamp_speed = bilateral_clamp_speed;
 
-#ifdef USE_SMC
-    my_system->GetSettings()->solver.contact_force_model = ChSystemSMC::ContactForceModel::Hertz;
-    my_system->GetSettings()->solver.tangential_displ_mode = ChSystemSMC::TangentialDisplacementModel::MultiStep;
-#else
-    my_system->GetSettings()->solver.solver_mode = SolverMode::SLIDING;
-    my_system->GetSettings()->solver.max_iteration_normal = max_iteration_normal;
-    my_system->GetSettings()->solver.max_iteration_sliding = max_iteration_sliding;
-    my_system->GetSettings()->solver.max_iteration_spinning = max_iteration_spinning;
-    my_system->GetSettings()->solver.alpha = 0;
-    my_system->GetSettings()->solver.contact_recovery_speed = contact_recovery_speed;
-    my_system->ChangeSolverType(SolverType::APGD);
-
-    my_system->GetSettings()->collision.collision_envelope = 0.05 * radius;
-#endif
+    if (method == ChContactMethod::SMC) {
+        my_system->GetSettings()->solver.contact_force_model = ChSystemSMC::ContactForceModel::Hertz;
+        my_system->GetSettings()->solver.tangential_displ_mode = ChSystemSMC::TangentialDisplacementModel::MultiStep;
+    } else {
+        my_system->GetSettings()->solver.solver_mode = SolverMode::SLIDING;
+        my_system->GetSettings()->solver.max_iteration_normal = max_iteration_normal;
+        my_system->GetSettings()->solver.max_iteration_sliding = max_iteration_sliding;
+        my_system->GetSettings()->solver.max_iteration_spinning = max_iteration_spinning;
+        my_system->GetSettings()->solver.alpha = 0;
+        my_system->GetSettings()->solver.contact_recovery_speed = contact_recovery_speed;
+        static_cast<ChSystemMulticoreNSC*>(my_system)->ChangeSolverType(solver_type);
+
+        my_system->GetSettings()->collision.collision_envelope = 0.05 * radius;
+    }
 
-    my_system->GetSettings()->collision.bins_per_axis = vec3(10, 10, 10);
-    my_system->GetSettings()->collision.narrowphase_algorithm = NarrowPhaseType::NARROWPHASE_HYBRID_MPR;
+    my_system->GetSettings()->collision.bins_per_axis = bins_per_axis;
+    my_system->GetSettings()->collision.narrowphase_algorithm = narrowphase;
 
-// Create a ball material (will be used by balls only)
+    // Create a ball material (will be used by balls only)
 
-#ifdef USE_SMC
-    auto material = chrono_types::make_shared<ChMaterialSurfaceSMC>();
-    material->SetYoungModulus(Y);
-    material->SetPoissonRatio(nu);
+    auto material = CreateContactMaterial(method, mu, Y, -1, nu);
     material->SetRestitution(COR);
-    material->SetFriction(mu);
-#else
-    auto material = chrono_types::make_shared<ChMaterialSurfaceNSC>();
-    material->SetRestitution(COR);
-    material->SetFriction(mu);
-#endif
 
-// Create a material for all objects other than balls
+    // Create a material for all objects other than balls
 
-#ifdef USE_SMC
-    auto mat_ext = chrono_types::make_shared<ChMaterialSurfaceSMC>();
-    mat_ext->SetYoungModulus(Y);
-    mat_ext->SetPoissonRatio(nu);
+    auto mat_ext = CreateContactMaterial(method, mu_ext, Y, -1, nu);
     mat_ext->SetRestitution(COR);
-    mat_ext->SetFriction(mu_ext);
-#else
-    auto mat_ext = chrono_types::make_shared<ChMaterialSurfaceNSC>();
-    mat_ext->SetRestitution(COR);
-    mat_ext->SetFriction(mu_ext);
-#endif
 
     // Create lower bin
 
@@ -476,9 +502,8 @@ int main(int argc, char* argv[]) {
         //  Output to files
 
         if (my_system->GetChTime() >= data_out_frame * data_out_step) {
-#ifndef USE_SMC
-            my_system->CalculateContactForces();
-#endif
+            if (method == ChContactMethod::NSC)
+                my_system->CalculateContactForces();
             force = my_system->GetBodyContactForce(0);
 
             forceStream << my_system->GetChTime() << "\t" << plate->GetPos().y() - bin->GetPos().y() << "\t"
@@ -20,16 +20,33 @@
 // the load body. During the shearing mode, the shear plate is translated in the
 // x-direction at a specified velocity.
 //
+// The contact method, problem type, and solver settings can be changed at run
+// time (see AddSettings; "--help" lists all settings). When invoked with a case
+// file, runs a parameter sweep of SHEARING cases starting from the PRESSED
+// checkpoint (see RunSweep).
+//
+// By default, each run performs a single stage (problem type) and stages hand
+// off through checkpoint files. With "--pipeline true", all stages from
+// SETTLING up to the selected problem run in one process, each modifying the
+// bodies and links of the previous stage in place; the SETTLED and PRESSED
+// checkpoints are still written (in the background) for later runs.
+//
 // The global reference frame has Z up.
 // All units SI (CGS, i.e., centimeter - gram - second)
 // =============================================================================
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
-#include <vector>
-#include <valarray>
-#include <string>
+#include <mutex>
 #include <sstream>
-#include <cmath>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
 
 #include "chrono/ChConfig.h"
 #include "chrono/core/ChStream.h"
@@ -37,6 +54,7 @@
 #include "chrono/utils/ChUtilsGenerators.h"
 #include "chrono/utils/ChUtilsInputOutput.h"
 
+#include "chrono_multicore/collision/ChCollisionSystemMulticore.h"
 #include "chrono_multicore/physics/ChSystemMulticore.h"
 #include "chrono_multicore/solver/ChSystemDescriptorMulticore.h"
 
@@ -50,7 +68,17 @@
 #include "chrono_opengl/ChOpenGLWindow.h"
 #endif
 
+#include "../bin_tuner.h"
+#include "../checkpoint.h"
+#include "../dem_settings.h"
+#include "../granular.h"
+#include "../region_sampler.h"
+#include "../settled_cache.h"
+#include "../settling.h"
+#include "../shape_manager.h"
+#include "../sphere_generator.h"
 #include "../utils.h"
+#include "../warm_start.h"
 
 using namespace chrono;
 using namespace chrono::collision;
@@ -63,13 +91,16 @@ using std::endl;
 // Problem definitions
 // -----------------------------------------------------------------------------
 
-// Comment the following line to use NSC contact
-//#define USE_SMC
+// Contact method (NSC or SMC)
+ChContactMethod method = ChContactMethod::NSC;
 
 enum ProblemType { SETTLING, PRESSING, SHEARING, TESTING };
 
 ProblemType problem = TESTING;
 
+// Run all stages up to the selected problem in one process (handing off the system in memory)?
+bool pipeline = false;
+
 // -----------------------------------------------------------------------------
 // Conversion factors
 // -----------------------------------------------------------------------------
@@ -91,6 +122,9 @@ bool use_actuator = true;
 // Save PovRay post-processing data?
 bool write_povray_data = true;
 
+// Enable run-time visualization (if available)?
+bool render = true;
+
 // Simulation times
 double time_settling_min = 0.1;
 double time_settling_max = 1.0;
@@ -106,40 +140,47 @@ double time_testing = 2;
 double settling_tol = 0.2;
 
 // Solver settings
-#ifdef USE_SMC
-double time_step = 1e-5;
-int max_iteration_bilateral = 100;
-#else
-double time_step = 1e-4;
+// (unless set at run time, the time step and narrowphase algorithm depend on the contact method)
+double time_step = 1e-4;  // SMC: 1e-5
 int max_iteration_normal = 0;
 int max_iteration_sliding = 10000;
 int max_iteration_spinning = 0;
 int max_iteration_bilateral = 100;
 double contact_recovery_speed = 10e30;
-#endif
+SolverType solver_type = SolverType::APGDREF;
+bool warm_start = false;  // NSC: start each solve from the contact impulses of the previous step?
 
 bool clamp_bilaterals = false;
 double bilateral_clamp_speed = 10e30;
 double tolerance = 1;
 
-// Contact force model
-#ifdef USE_SMC
+// Collision detection settings
+NarrowPhaseType narrowphase = NarrowPhaseType::NARROWPHASE_HYBRID_MPR;  // SMC: NARROWPHASE_R
+vec3 bins_per_axis = vec3(10, 10, 10);
+bool tune_bins = false;  // adjust the number of bins at run time (starting from bins_per_axis)?
+
+// Contact force model (SMC only)
 ChSystemSMC::ContactForceModel contact_force_model = ChSystemSMC::ContactForceModel::Hertz;
 ChSystemSMC::TangentialDisplacementModel tangential_displ_mode = ChSystemSMC::TangentialDisplacementModel::MultiStep;
-#endif
 
-// Output
-#ifdef USE_SMC
-const std::string out_dir = "../DIRECTSHEAR_SMC";
-#else
-const std::string out_dir = "../DIRECTSHEAR_NSC";
-#endif
+// Output (directory names depend on the contact method, see SetOutputDirectories)
+std::string out_dir;
+std::string settled_ckpnt_file;
+std::string pressed_ckpnt_file;
+
+// Output of the current run (redirected to a per-case directory in a parameter sweep)
+std::string run_dir;
+std::string pov_dir;
+std::string shear_file;
+std::string stress_file;
+std::string stats_file;
 
-const std::string pov_dir = out_dir + "/POVRAY";
-const std::string shear_file = out_dir + "/shear.dat";
-const std::string stats_file = out_dir + "/stats.dat";
-const std::string settled_ckpnt_file = out_dir + "/settled.dat";
-const std::string pressed_ckpnt_file = out_dir + "/pressed.dat";
+// Cache of settled beds, shared by all runs with the same settling parameters
+const std::string settled_cache_dir = "../SETTLED_CACHE";
+
+// Output of a parameter sweep (all contact methods)
+const std::string sweep_dir = "../DIRECTSHEAR_SWEEP";
+int sweep_case = -1;
 
 // Frequency for visualization output
 int out_fps_settling = 120;
@@ -200,6 +241,41 @@ int Id_ball = -4;
 double mass_ball = 200;            // [g] mass of testing ball
 double radius_ball = 0.9 * hdimX;  // [cm] radius of testing ball
 
+// =============================================================================
+// Load plate geometry.
+//
+// The X dimension of the load plate is increased to accommodate the shearing
+// phase (use 3 times as much as needed). The plate is always longer than the
+// bin, so its length does not affect the settled and pressed beds; it is sized
+// again for the current shearing velocity when shearing starts (see
+// ResizeLoadPlate).
+// =============================================================================
+
+double LoadPlateHalfLength() {
+    return hdimX + 3 * time_shearing * desiredVelocity;
+}
+
+void AddLoadPlateGeometry(ChBody* plate, std::shared_ptr<ChMaterialSurface> mat) {
+    plate->GetCollisionModel()->ClearModel();
+    utils::AddBoxGeometry(plate, mat, ChVector<>(LoadPlateHalfLength(), hdimY, hdimZ), ChVector<>(0, 0, hdimZ));
+    plate->GetCollisionModel()->SetFamily(plate_coll_fam);
+    plate->GetCollisionModel()->BuildModel();
+}
+
+// Replace the contact geometry of the load plate (already in the system) with one sized for the current shearing
+// velocity and duration.
+void ResizeLoadPlate(ChSystemMulticore* system, std::shared_ptr<ChBody> plate) {
+    auto mat_walls = CreateContactMaterial(method, mu_walls, Y_walls, cr_walls, nu_walls);
+
+    ShapeManager shapes(system);
+    shapes.RemoveShapes(plate.get());
+    plate->GetAssets().clear();
+    AddLoadPlateGeometry(plate.get(), mat_walls);
+
+    auto collision_system = std::static_pointer_cast<ChCollisionSystemMulticore>(system->GetCollisionSystem());
+    collision_system->Add(plate->GetCollisionModel().get());
+}
+
 // =============================================================================
 // Create the containing bin (the ground), the shear box, and the load plate.
 //
@@ -208,20 +284,11 @@ double radius_ball = 0.9 * hdimX;  // [cm] radius of testing ball
 // =============================================================================
 
 void CreateMechanismBodies(ChSystemMulticore* system) {
-// -------------------------------
-// Create a material for the walls
-// -------------------------------
-
-#ifdef USE_SMC
-    auto mat_walls = chrono_types::make_shared<ChMaterialSurfaceSMC>();
-    mat_walls->SetYoungModulus(Y_walls);
-    mat_walls->SetFriction(mu_walls);
-    mat_walls->SetRestitution(cr_walls);
-    mat_walls->SetPoissonRatio(nu_walls);
-#else
-    auto mat_walls = chrono_types::make_shared<ChMaterialSurfaceNSC>();
-    mat_walls->SetFriction(mu_walls);
-#endif
+    // -------------------------------
+    // Create a material for the walls
+    // -------------------------------
+
+    auto mat_walls = CreateContactMaterial(method, mu_walls, Y_walls, cr_walls, nu_walls);
 
     // ----------------------
     // Create the ground body -- always FIRST body in system
@@ -285,10 +352,6 @@ void CreateMechanismBodies(ChSystemMulticore* system) {
     // Initially, the load plate is fixed to ground.
     // It is released after the settling phase.
 
-    // Set plate dimensions, increasing the X dimension to accommodate the
-    // shearing phase (use 3 times as much as needed)
-    double hdimX_p = hdimX + 3 * time_shearing * desiredVelocity;
-
     // Estimate plate mass from desired applied normal pressure
     double area = 4 * hdimX * hdimY;
     double mass = normalPressure * area / gravity;
@@ -302,28 +365,29 @@ void CreateMechanismBodies(ChSystemMulticore* system) {
     plate->SetBodyFixed(true);
 
     // Add geometry of the load plate.
-    plate->GetCollisionModel()->ClearModel();
-    utils::AddBoxGeometry(plate.get(), mat_walls, ChVector<>(hdimX_p, hdimY, hdimZ), ChVector<>(0, 0, hdimZ));
-    plate->GetCollisionModel()->SetFamily(plate_coll_fam);
-    plate->GetCollisionModel()->BuildModel();
+    AddLoadPlateGeometry(plate.get(), mat_walls);
 
     system->AddBody(plate);
 }
 
 // =============================================================================
 // Connect the shear box to the containing bin (ground) through a translational
-// joint and create a linear actuator.
+// joint and create a linear actuator. Return handles to both links.
 // =============================================================================
 
-void ConnectShearBox(ChSystemMulticore* system, std::shared_ptr<ChBody> ground, std::shared_ptr<ChBody> box) {
-    auto prismatic = chrono_types::make_shared<ChLinkLockPrismatic>();
+void ConnectShearBox(ChSystemMulticore* system,
+                     std::shared_ptr<ChBody> ground,
+                     std::shared_ptr<ChBody> box,
+                     std::shared_ptr<ChLinkLockPrismatic>& prismatic,
+                     std::shared_ptr<ChLinkLinActuator>& actuator) {
+    prismatic = chrono_types::make_shared<ChLinkLockPrismatic>();
     prismatic->Initialize(ground, box, ChCoordsys<>(ChVector<>(0, 0, 2 * hdimZ), Q_from_AngY(CH_C_PI_2)));
     prismatic->SetName("prismatic_box_ground");
     system->AddLink(prismatic);
 
     auto actuator_fun = chrono_types::make_shared<ChFunction_Ramp>(0.0, desiredVelocity);
 
-    auto actuator = chrono_types::make_shared<ChLinkLinActuator>();
+    actuator = chrono_types::make_shared<ChLinkLinActuator>();
     ChVector<> pt1(0, 0, 2 * hdimZ);
     ChVector<> pt2(1, 0, 2 * hdimZ);
     actuator->Initialize(ground, box, false, ChCoordsys<>(pt1, QUNIT), ChCoordsys<>(pt2, QUNIT));
@@ -335,14 +399,17 @@ void ConnectShearBox(ChSystemMulticore* system, std::shared_ptr<ChBody> ground,
 
 // =============================================================================
 // Connect the load plate to the bin (ground) through a vertical translational
-// joint.
+// joint. Return a handle to the joint.
 // =============================================================================
 
-void ConnectLoadPlate(ChSystemMulticore* system, std::shared_ptr<ChBody> ground, std::shared_ptr<ChBody> plate) {
+std::shared_ptr<ChLinkLockPrismatic> ConnectLoadPlate(ChSystemMulticore* system,
+                                                      std::shared_ptr<ChBody> ground,
+                                                      std::shared_ptr<ChBody> plate) {
     auto prismatic = chrono_types::make_shared<ChLinkLockPrismatic>();
     prismatic->Initialize(ground, plate, ChCoordsys<>(ChVector<>(0, 0, 2 * hdimZ), QUNIT));
     prismatic->SetName("prismatic_plate_ground");
     system->AddLink(prismatic);
+    return prismatic;
 }
 
 // =============================================================================
@@ -355,35 +422,21 @@ void ConnectLoadPlate(ChSystemMulticore* system, std::shared_ptr<ChBody> ground,
 // =============================================================================
 
 int CreateGranularMaterial(ChSystemMulticore* system) {
-// -------------------------------------------
-// Create a material for the granular material
-// -------------------------------------------
-
-#ifdef USE_SMC
-    auto mat_g = chrono_types::make_shared<ChMaterialSurfaceSMC>();
-    mat_g->SetYoungModulus(Y_g);
-    mat_g->SetFriction(mu_g);
-    mat_g->SetRestitution(cr_g);
-    mat_g->SetPoissonRatio(nu_g);
-#else
-    auto mat_g = chrono_types::make_shared<ChMaterialSurfaceNSC>();
-    mat_g->SetFriction(mu_g);
-#endif
+    // -------------------------------------------
+    // Create a material for the granular material
+    // -------------------------------------------
 
-    // ---------------------------------------------
-    // Create a mixture entirely made out of spheres
-    // ---------------------------------------------
+    auto mat_g = CreateContactMaterial(method, mu_g, Y_g, cr_g, nu_g);
 
-    // Create the particle generator with a mixture of 100% spheres
-    utils::Generator gen(system);
+    // ---------------------------------------
+    // Create a generator of identical spheres
+    // ---------------------------------------
 
-    std::shared_ptr<utils::MixtureIngredient> m1 = gen.AddMixtureIngredient(utils::MixtureType::SPHERE, 1.0);
-    m1->setDefaultMaterial(mat_g);
-    m1->setDefaultDensity(rho_g);
-    m1->setDefaultSize(r_g);
+    // Create the particle generator for spheres
+    SphereGenerator gen(system, mat_g, r_g, rho_g);
 
     // Ensure that all generated particle bodies will have positive IDs.
-    gen.setBodyIdentifier(Id_g);
+    gen.SetBodyIdentifier(Id_g);
 
     // ----------------------
     // Generate the particles
@@ -394,12 +447,13 @@ int CreateGranularMaterial(ChSystemMulticore* system) {
     ChVector<> center(0, 0, 2 * r);
 
     while (center.z() < 2 * h_scaling * hdimZ) {
-        gen.createObjectsBox(utils::SamplingType::POISSON_DISK, 2 * r, center, hdims);
+        gen.AddBox(center, hdims, 2 * r);
         center.z() += 2 * r;
     }
+    gen.CreateBodies();
 
     // Return the number of generated particles.
-    return gen.getTotalNumBodies();
+    return gen.GetTotalNumBodies();
 }
 
 // =============================================================================
@@ -407,20 +461,11 @@ int CreateGranularMaterial(ChSystemMulticore* system) {
 // =============================================================================
 
 void CreateBall(ChSystemMulticore* system) {
-// ------------------------------
-// Create a material for the ball
-// ------------------------------
-
-#ifdef USE_SMC
-    auto mat_g = chrono_types::make_shared<ChMaterialSurfaceSMC>();
-    mat_g->SetYoungModulus(Y_g);
-    mat_g->SetFriction(mu_g);
-    mat_g->SetRestitution(cr_g);
-    mat_g->SetPoissonRatio(nu_g);
-#else
-    auto mat_g = chrono_types::make_shared<ChMaterialSurfaceNSC>();
-    mat_g->SetFriction(mu_g);
-#endif
+    // ------------------------------
+    // Create a material for the ball
+    // ------------------------------
+
+    auto mat_g = CreateContactMaterial(method, mu_g, Y_g, cr_g, nu_g);
 
     // ---------------
     // Create the ball
@@ -442,22 +487,19 @@ void CreateBall(ChSystemMulticore* system) {
 }
 
 // =============================================================================
-// Find the height of the highest and lowest sphere in the granular mix. We only
-// look at bodies whith positive identifiers (to exclude all other bodies).
+// Create the bodies of a previous stage from a checkpoint file. Print an error
+// message and return false if the file cannot be read or does not contain the
+// mechanism bodies (ground, shear box, load plate) followed by granular material.
 // =============================================================================
 
-void FindHeightRange(ChSystemMulticore* sys, double& lowest, double& highest) {
-    highest = -1000;
-    lowest = 1000;
-    for (auto body : sys->Get_bodylist()) {
-        if (body->GetIdentifier() <= 0)
-            continue;
-        double h = body->GetPos().z();
-        if (h < lowest)
-            lowest = h;
-        else if (h > highest)
-            highest = h;
+bool ReadStageCheckpoint(ChSystemMulticore* system, const std::string& filename) {
+    cout << "Read checkpoint data from " << filename;
+    if (!ReadCheckpointBinary(system, filename) || system->Get_bodylist().size() <= 3) {
+        cout << endl << "Error: cannot read the bodies of the previous stage from " << filename << endl;
+        return false;
     }
+    cout << "  done.  Read " << system->Get_bodylist().size() << " bodies." << endl;
+    return true;
 }
 
 // =============================================================================
@@ -466,19 +508,15 @@ void FindHeightRange(ChSystemMulticore* sys, double& lowest, double& highest) {
 //
 // =============================================================================
 
-void setBulkDensity(ChSystem* sys, double bulkDensity) {
+void setBulkDensity(ChSystem* sys, GranularAnalysis& granular, double bulkDensity) {
     double vol_g = (4.0 / 3) * CH_C_PI * r_g * r_g * r_g;
 
     double normalPlateHeight = sys->Get_bodylist().at(1)->GetPos().z() - hdimZ;
     double bottomHeight = 0;
     double boxVolume = hdimX * 2 * hdimX * 2 * (normalPlateHeight - bottomHeight);
-    double granularVolume = (sys->Get_bodylist().size() - 3) * vol_g;
+    double granularVolume = granular.GetNumParticles() * vol_g;
     double reqDensity = bulkDensity * boxVolume / granularVolume;
-    for (auto body : sys->Get_bodylist()) {
-        if (body->GetIdentifier() > 1) {
-            body->SetMass(reqDensity * vol_g);
-        }
-    }
+    granular.SetParticleMass(reqDensity * vol_g);
 
     cout << "N Bodies: " << sys->Get_bodylist().size() << endl;
     cout << "Box Volume: " << boxVolume << endl;
@@ -486,30 +524,376 @@ void setBulkDensity(ChSystem* sys, double bulkDensity) {
     cout << "Desired bulk density = " << bulkDensity << ", Required Body Density = " << reqDensity << endl;
 }
 
+// =============================================================================
+// Register all parameters which affect the settled granular bed
+// =============================================================================
+
+void SetSettledCacheParameters(SettledBedCache& cache) {
+    cache.AddParameter("test", std::string("directShear"));
+    cache.AddParameter("contact_method", GetContactMethodName(method));
+    if (method == ChContactMethod::SMC) {
+        cache.AddParameter("contact_force_model", (int)contact_force_model);
+        cache.AddParameter("tangential_displ_mode", (int)tangential_displ_mode);
+    } else {
+        cache.AddParameter("max_iteration_normal", max_iteration_normal);
+        cache.AddParameter("max_iteration_sliding", max_iteration_sliding);
+        cache.AddParameter("max_iteration_spinning", max_iteration_spinning);
+        cache.AddParameter("contact_recovery_speed", (double)contact_recovery_speed);
+        cache.AddParameter("solver_type", (int)solver_type);
+        cache.AddParameter("warm_start", (int)warm_start);
+    }
+    cache.AddParameter("time_step", time_step);
+    cache.AddParameter("tolerance", tolerance);
+    cache.AddParameter("max_iteration_bilateral", max_iteration_bilateral);
+    cache.AddParameter("gravity", gravity);
+    cache.AddParameter("time_settling_min", time_settling_min);
+    cache.AddParameter("time_settling_max", time_settling_max);
+    cache.AddParameter("settling_tol", settling_tol);
+    cache.AddParameter("hdimX", hdimX);
+    cache.AddParameter("hdimY", hdimY);
+    cache.AddParameter("hdimZ", hdimZ);
+    cache.AddParameter("hthick", hthick);
+    cache.AddParameter("h_scaling", h_scaling);
+    cache.AddParameter("Y_walls", Y_walls);
+    cache.AddParameter("cr_walls", cr_walls);
+    cache.AddParameter("nu_walls", nu_walls);
+    cache.AddParameter("mu_walls", mu_walls);
+    cache.AddParameter("r_g", r_g);
+    cache.AddParameter("rho_g", rho_g);
+    cache.AddParameter("Y_g", Y_g);
+    cache.AddParameter("cr_g", cr_g);
+    cache.AddParameter("nu_g", nu_g);
+    cache.AddParameter("mu_g", mu_g);
+}
+
+// =============================================================================
+// Set the friction coefficient of the granular material (used for SHEARING,
+// where the materials are loaded from the checkpoint file)
+// =============================================================================
+
+void SetGranularFriction(ChSystemMulticore* system, float mu) {
+    std::unordered_set<ChMaterialSurface*> materials;
+    for (auto body : system->Get_bodylist()) {
+        if (body->GetIdentifier() < Id_g)
+            continue;
+        auto model = body->GetCollisionModel();
+        for (int j = 0; j < model->GetNumShapes(); j++) {
+            auto mat = model->GetShape(j)->GetMaterial();
+            if (materials.insert(mat.get()).second)
+                mat->SetFriction(mu);
+        }
+    }
+}
+
+// =============================================================================
+// Register all parameters which can be set at run time
+// =============================================================================
+
+void AddSettings(DEMSettings& settings) {
+    settings.AddEnum("method", method, ContactMethodNames());
+    settings.AddEnum("problem", problem,
+                     {{"SETTLING", SETTLING}, {"PRESSING", PRESSING}, {"SHEARING", SHEARING}, {"TESTING", TESTING}});
+    settings.Add("pipeline", pipeline);
+    settings.Add("threads", threads);
+    settings.Add("time_step", time_step);
+    settings.Add("tolerance", tolerance);
+    settings.Add("max_iteration_normal", max_iteration_normal);
+    settings.Add("max_iteration_sliding", max_iteration_sliding);
+    settings.Add("max_iteration_spinning", max_iteration_spinning);
+    settings.Add("max_iteration_bilateral", max_iteration_bilateral);
+    settings.Add("contact_recovery_speed", contact_recovery_speed);
+    settings.AddEnum("solver_type", solver_type, SolverTypeNames());
+    settings.Add("warm_start", warm_start);
+    settings.AddEnum("narrowphase", narrowphase, NarrowPhaseNames());
+    settings.Add("bins_per_axis", bins_per_axis);
+    settings.Add("tune_bins", tune_bins);
+    settings.AddEnum("contact_force_model", contact_force_model, ContactForceModelNames());
+    settings.AddEnum("tangential_displ_mode", tangential_displ_mode, TangentialDisplacementModelNames());
+    settings.Add("use_actuator", use_actuator);
+    settings.Add("write_povray_data", write_povray_data);
+    settings.Add("render", render);
+    settings.Add("normalPressure", normalPressure);
+    settings.Add("desiredVelocity", desiredVelocity);
+    settings.Add("mu_g", mu_g);
+    settings.Add("case", sweep_case);
+}
+
+// =============================================================================
+// Set the output directories for the selected contact method
+// =============================================================================
+
+void SetRunDirectory(const std::string& dir) {
+    run_dir = dir;
+    pov_dir = run_dir + "/POVRAY";
+    shear_file = run_dir + "/shear.dat";
+    stress_file = run_dir + "/stress.dat";
+    stats_file = run_dir + "/stats.dat";
+}
+
+void SetOutputDirectories() {
+    out_dir = "../DIRECTSHEAR_" + GetContactMethodName(method);
+    settled_ckpnt_file = out_dir + "/settled.dat";
+    pressed_ckpnt_file = out_dir + "/pressed.dat";
+    SetRunDirectory(out_dir);
+}
+
+// =============================================================================
+// Parameter sweep over SHEARING cases
+//
+// Each line of the case file specifies the contact method (NSC or SMC), the
+// applied normal pressure [Pa], the shearing velocity [cm/s], and the friction
+// coefficient of the granular material:
+//
+//   # method  pressure  velocity  friction
+//   NSC       3.1e3     0.166     0.18
+//   SMC       3.1e3     0.166     0.18
+//
+// All cases with the same contact method start from the same PRESSED
+// checkpoint; the load plate is resized for the velocity of each case when
+// shearing starts, and a case fails if the shear box travels beyond it. The
+// runner launches one process per case (this program, invoked
+// with "--method <method> --case <k>" and any other options given to the
+// runner), with up to 'num_concurrent' cases running at a time, each using an
+// equal share of the available cores. Per-case output is written to
+// sweep_dir/case_<k>. When all cases are done, the shear stress vs.
+// displacement results are collected in sweep_dir/shear_sweep.dat and the peak
+// shear stress of each case in sweep_dir/shear_peak.dat.
+// =============================================================================
+
+struct ShearCase {
+    std::string method;  ///< contact method (NSC or SMC)
+    double pressure;     ///< applied normal pressure [Pa]
+    double velocity;     ///< shearing velocity [cm/s]
+    double friction;     ///< friction coefficient of the granular material
+};
+
+std::vector<ShearCase> ReadShearCases(const std::string& filename) {
+    std::vector<ShearCase> cases;
+    std::ifstream ifile(filename);
+    std::string line;
+    while (std::getline(ifile, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream iss(line);
+        ShearCase c;
+        if (iss >> c.method >> c.pressure >> c.velocity >> c.friction)
+            cases.push_back(c);
+    }
+    return cases;
+}
+
+std::string SweepCaseDirectory(int k) {
+    char buf[32];
+    sprintf(buf, "/case_%03d", k);
+    return sweep_dir + buf;
+}
+
+// Set up the global problem definitions for the specified case of a sweep.
+bool SetupSweepCase(const std::string& cases_file, int k) {
+    std::vector<ShearCase> cases = ReadShearCases(cases_file);
+    if (k < 0 || k >= (int)cases.size()) {
+        cout << "Invalid case " << k << " (" << cases.size() << " cases in " << cases_file << ")" << endl;
+        return false;
+    }
+    const ShearCase& c = cases[k];
+    if (c.method != GetContactMethodName(method)) {
+        cout << "Case " << k << " requires contact method " << c.method << endl;
+        return false;
+    }
+    if (c.pressure <= 0 || c.velocity <= 0 || c.friction < 0) {
+        cout << "Case " << k << ": invalid pressure, velocity, or friction" << endl;
+        return false;
+    }
+
+    problem = SHEARING;
+    normalPressure = Pa2cgs * c.pressure;
+    desiredVelocity = c.velocity;
+    mu_g = (float)c.friction;
+    write_povray_data = false;
+    render = false;
+    SetRunDirectory(SweepCaseDirectory(k));
+
+    return true;
+}
+
+// Collect the results of all cases in a single shear stress vs. displacement data set.
+void CollectSweepResults(const std::vector<ShearCase>& cases, const std::vector<int>& status) {
+    double area = 4 * hdimX * hdimY;
+
+    std::ofstream sweep_file(sweep_dir + "/shear_sweep.dat");
+    std::ofstream peak_file(sweep_dir + "/shear_peak.dat");
+    sweep_file << "# case  method  pressure[Pa]  velocity[cm/s]  friction  time[s]  displacement[cm]  "
+                  "shear_stress[Pa]\n";
+    peak_file << "# case  method  pressure[Pa]  velocity[cm/s]  friction  peak_shear_stress[Pa]\n";
+
+    for (int k = 0; k < (int)cases.size(); k++) {
+        if (status[k] != 0)
+            continue;
+        const ShearCase& c = cases[k];
+        std::ifstream ifile(SweepCaseDirectory(k) + "/shear.dat");
+        double time, x, fx, fy, fz, tx, ty, tz;
+        double x0 = 0;
+        double peak = 0;
+        bool first = true;
+        while (ifile >> time >> x >> fx >> fy >> fz >> tx >> ty >> tz) {
+            if (first) {
+                x0 = x;
+                first = false;
+            }
+            // Shear stress from the actuator reaction force (converted from CGS to Pa)
+            double stress = std::abs(fx) / area / Pa2cgs;
+            peak = std::max(peak, stress);
+            sweep_file << k << "  " << c.method << "  " << c.pressure << "  " << c.velocity << "  " << c.friction
+                       << "  " << time << "  " << x - x0 << "  " << stress << "\n";
+        }
+        peak_file << k << "  " << c.method << "  " << c.pressure << "  " << c.velocity << "  " << c.friction << "  "
+                  << peak << "\n";
+    }
+}
+
+// Run all cases in the specified file (at most 'num_concurrent' at a time).
+// Return non-zero if any case failed or was skipped.
+int RunSweep(const std::string& program,
+             const std::string& options,
+             const std::string& cases_file,
+             int num_concurrent) {
+    std::vector<ShearCase> cases = ReadShearCases(cases_file);
+    if (cases.empty()) {
+        cout << "No cases found in " << cases_file << endl;
+        return 1;
+    }
+
+    // Check the PRESSED checkpoints for all contact methods in the sweep.
+    std::vector<int> status(cases.size(), -1);
+    std::vector<bool> valid(cases.size(), false);
+    for (int k = 0; k < (int)cases.size(); k++) {
+        std::string pressed_file = "../DIRECTSHEAR_" + cases[k].method + "/pressed.dat";
+        valid[k] = (cases[k].method == "NSC" || cases[k].method == "SMC") && filesystem::path(pressed_file).exists();
+        if (!valid[k])
+            cout << "Case " << k << ": skipped (missing PRESSED checkpoint " << pressed_file << ")" << endl;
+    }
+
+    if (!filesystem::create_directory(filesystem::path(sweep_dir))) {
+        cout << "Error creating directory " << sweep_dir << endl;
+        return 1;
+    }
+
+    // Split the available cores among the concurrent cases.
+    int num_procs = omp_get_num_procs();
+    if (num_concurrent <= 0)
+        num_concurrent = std::max(1, num_procs / threads);
+    num_concurrent = std::min(num_concurrent, (int)cases.size());
+    int case_threads = std::max(1, num_procs / num_concurrent);
+
+    cout << "Run " << cases.size() << " cases (" << num_concurrent << " concurrent, " << case_threads
+         << " threads each)" << endl;
+
+    std::atomic<int> next_case(0);
+    std::mutex out_mutex;
+
+    auto worker = [&]() {
+        int k;
+        while ((k = next_case++) < (int)cases.size()) {
+            if (!valid[k])
+                continue;
+
+            std::string dir = SweepCaseDirectory(k);
+            std::string cmd = "\"" + program + "\"" + options + " --method " + cases[k].method + " --case " +
+                              std::to_string(k) + " --threads " + std::to_string(case_threads) + " \"" + cases_file +
+                              "\" > \"" + dir + ".log\" 2>&1";
+            {
+                std::lock_guard<std::mutex> lock(out_mutex);
+                cout << "Case " << k << ": started" << endl;
+            }
+            status[k] = std::system(cmd.c_str());
+            {
+                std::lock_guard<std::mutex> lock(out_mutex);
+                cout << "Case " << k << ": " << (status[k] == 0 ? "done" : "FAILED") << endl;
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < num_concurrent; i++)
+        workers.emplace_back(worker);
+    for (auto& w : workers)
+        w.join();
+
+    CollectSweepResults(cases, status);
+    cout << "Results collected in " << sweep_dir << endl;
+
+    // Skipped cases count as failed
+    int num_failed = (int)std::count_if(status.begin(), status.end(), [](int s) { return s != 0; });
+    if (num_failed > 0) {
+        cout << num_failed << " of " << cases.size() << " cases failed or were skipped" << endl;
+        return 1;
+    }
+
+    return 0;
+}
+
 // =============================================================================
 
 int main(int argc, char* argv[]) {
+    // Run-time settings:
+    //   test_VDEM_directShear [--config <file>] [--<name> <value> ...] [<case file> [num_concurrent]]
+    DEMSettings settings;
+    AddSettings(settings);
+    if (!settings.Parse(argc, argv))
+        return 1;
+
+    // Defaults which depend on the contact method
+    if (!settings.IsSet("time_step"))
+        time_step = (method == ChContactMethod::SMC) ? 1e-5 : 1e-4;
+    if (!settings.IsSet("narrowphase"))
+        narrowphase = (method == ChContactMethod::SMC) ? NarrowPhaseType::NARROWPHASE_R
+                                                       : NarrowPhaseType::NARROWPHASE_HYBRID_MPR;
+
+    SetOutputDirectories();
+
+    // Parameter sweep over SHEARING cases (see RunSweep)
+    const auto& args = settings.GetPositional();
+    if (!args.empty()) {
+        if (sweep_case < 0)
+            return RunSweep(argv[0], settings.GetOptions(), args[0], args.size() > 1 ? std::atoi(args[1].c_str()) : 0);
+        if (!SetupSweepCase(args[0], sweep_case))
+            return 1;
+    }
+
     // Create output directories.
     if (!filesystem::create_directory(filesystem::path(out_dir))) {
         cout << "Error creating directory " << out_dir << endl;
         return 1;
     }
+    if (!filesystem::create_directory(filesystem::path(run_dir))) {
+        cout << "Error creating directory " << run_dir << endl;
+        return 1;
+    }
     if (!filesystem::create_directory(filesystem::path(pov_dir))) {
         cout << "Error creating directory " << pov_dir << endl;
         return 1;
     }
 
-// -------------
-// Create system
-// -------------
+    // -------------
+    // Create system
+    // -------------
 
-#ifdef USE_SMC
-    cout << "Create SMC system" << endl;
-    ChSystemMulticoreSMC* msystem = new ChSystemMulticoreSMC();
-#else
-    cout << "Create NSC system" << endl;
-    ChSystemMulticoreNSC* msystem = new ChSystemMulticoreNSC();
-#endif
+    ChSystemMulticore* msystem = CreateMulticoreSystem(method);
+
+    // Contact impulses of the previous step (NSC with warm starting)
+    ContactCache* warm_start_cache = nullptr;
+
+    // Analysis of the granular material (particle heights)
+    GranularAnalysis granular(msystem, Id_g);
+
+    // Stress and packing in the shear zone, and force transmitted across the shear plane
+    RegionSampler regions(msystem, Id_g);
+    regions.SetParticleDensity(rho_g);
+    int shear_zone = regions.AddBox("shear zone", ChVector<>(0, 0, 2 * hdimZ), ChVector<>(hdimX, hdimY, 2 * r_g));
+    int shear_plane = regions.AddPlane("shear plane", ChVector<>(0, 0, 2 * hdimZ), ChVector<>(0, 0, 1));
+    if (!regions.HasForces())
+        cout << "Error: contact stresses require per-contact forces (NSC only); " << stress_file << " not written"
+             << endl;
 
     msystem->Set_G_acc(ChVector<>(0, 0, -gravity));
 
@@ -527,37 +911,45 @@ int main(int argc, char* argv[]) {
     msystem->GetSettings()->solver.clamp_bilaterals = clamp_bilaterals;
     msystem->GetSettings()->solver.bilateral_clamp_speed = bilateral_clamp_speed;
 
-#ifdef USE_SMC
-    msystem->GetSettings()->collision.narrowphase_algorithm = NarrowPhaseType::NARROWPHASE_R;
-    msystem->GetSettings()->solver.contact_force_model = contact_force_model;
-    msystem->GetSettings()->solver.tangential_displ_mode = tangential_displ_mode;
-#else
-    msystem->GetSettings()->solver.solver_mode = SolverMode::SLIDING;
-    msystem->GetSettings()->solver.max_iteration_normal = max_iteration_normal;
-    msystem->GetSettings()->solver.max_iteration_sliding = max_iteration_sliding;
-    msystem->GetSettings()->solver.max_iteration_spinning = max_iteration_spinning;
-    msystem->GetSettings()->solver.alpha = 0;
-    msystem->GetSettings()->solver.contact_recovery_speed = contact_recovery_speed;
-    msystem->SetMaxPenetrationRecoverySpeed(contact_recovery_speed);
-    msystem->ChangeSolverType(SolverType::APGDREF);
-
-    msystem->GetSettings()->collision.collision_envelope = 0.05 * r_g;
-#endif
+    if (method == ChContactMethod::SMC) {
+        msystem->GetSettings()->solver.contact_force_model = contact_force_model;
+        msystem->GetSettings()->solver.tangential_displ_mode = tangential_displ_mode;
+    } else {
+        msystem->GetSettings()->solver.solver_mode = SolverMode::SLIDING;
+        msystem->GetSettings()->solver.max_iteration_normal = max_iteration_normal;
+        msystem->GetSettings()->solver.max_iteration_sliding = max_iteration_sliding;
+        msystem->GetSettings()->solver.max_iteration_spinning = max_iteration_spinning;
+        msystem->GetSettings()->solver.alpha = 0;
+        msystem->GetSettings()->solver.contact_recovery_speed = contact_recovery_speed;
+        msystem->SetMaxPenetrationRecoverySpeed(contact_recovery_speed);
+        static_cast<ChSystemMulticoreNSC*>(msystem)->ChangeSolverType(solver_type);
+        if (warm_start) {
+            warm_start_cache = EnableWarmStart(static_cast<ChSystemMulticoreNSC*>(msystem));
+            if (!warm_start_cache)
+                cout << "Warm starting not supported for the selected solver type" << endl;
+        }
+
+        msystem->GetSettings()->collision.collision_envelope = 0.05 * r_g;
+    }
 
-    msystem->GetSettings()->collision.bins_per_axis = vec3(10, 10, 10);
+    msystem->GetSettings()->collision.narrowphase_algorithm = narrowphase;
+    msystem->GetSettings()->collision.bins_per_axis = bins_per_axis;
 
     // --------------
     // Problem set up
     // --------------
 
-    // Depending on problem type:
-    // - Select end simulation time
-    // - Select output FPS
-    // - Create / load objects
+    // Stages to run: the selected problem only or, for a pipeline, all stages from SETTLING up to the
+    // selected problem, with the system handed off from one stage to the next in memory.
+    std::vector<ProblemType> stages;
+    if (pipeline && problem != TESTING) {
+        for (int s = SETTLING; s <= problem; s++)
+            stages.push_back((ProblemType)s);
+    } else {
+        stages.push_back(problem);
+    }
+    const char* stage_names[] = {"SETTLING", "PRESSING", "SHEARING", "TESTING"};
 
-    double time_min = 0;
-    double time_end;
-    int out_fps;
     std::shared_ptr<ChBody> ground;
     std::shared_ptr<ChBody> shearBox;
     std::shared_ptr<ChBody> loadPlate;
@@ -565,360 +957,472 @@ int main(int argc, char* argv[]) {
     std::shared_ptr<ChLinkLockPrismatic> prismatic_plate_ground;
     std::shared_ptr<ChLinkLinActuator> actuator;
 
-    switch (problem) {
-        case SETTLING: {
-            time_min = time_settling_min;
-            time_end = time_settling_max;
-            out_fps = out_fps_settling;
+    // Settled beds are reused across runs with the same settling parameters
+    SettledBedCache cache(settled_cache_dir);
+    SetSettledCacheParameters(cache);
 
-            // Create the mechanism bodies (all fixed).
-            CreateMechanismBodies(msystem);
+    // Create output files
+    ChStreamOutAsciiFile statsStream(stats_file.c_str());
+    ChStreamOutAsciiFile shearStream(shear_file.c_str());
+    ChStreamOutAsciiFile stressStream(stress_file.c_str());
 
-            // Grab handles to mechanism bodies (must increase ref counts)
-            ground = msystem->Get_bodylist().at(0);
-            shearBox = msystem->Get_bodylist().at(1);
-            loadPlate = msystem->Get_bodylist().at(2);
+    shearStream.SetNumFormat("%16.4e");
+    stressStream.SetNumFormat("%16.4e");
 
-            // Create granular material.
-            int num_particles = CreateGranularMaterial(msystem);
-            cout << "Granular material:  " << num_particles << " particles" << endl;
+    // Per-step timing recorder (exported at the end of the simulation)
+    TimelineRecorder timeline;
 
-            break;
-        }
+    // Broadphase bin tuning (decisions are added to the timeline)
+    BinTuner bin_tuner(msystem);
+    bin_tuner.SetTimeline(&timeline);
+    bin_tuner.SetVerbose(true);
 
-        case PRESSING: {
-            time_min = time_pressing_min;
-            time_end = time_pressing_max;
-            out_fps = out_fps_pressing;
+    // Checkpoints are written in the background while the simulation proceeds
+    CheckpointWriter ckpnt_writer;
 
-            // Create bodies from checkpoint file.
-            cout << "Read checkpoint data from " << settled_ckpnt_file;
-            utils::ReadCheckpoint(msystem, settled_ckpnt_file);
-            cout << "  done.  Read " << msystem->Get_bodylist().size() << " bodies." << endl;
+#ifdef CHRONO_OPENGL
+    opengl::ChOpenGLWindow& gl_window = opengl::ChOpenGLWindow::getInstance();
+    if (render) {
+        gl_window.Initialize(1280, 720, "Direct Shear Test", msystem);
+        gl_window.SetCamera(ChVector<>(0, -10 * hdimY, hdimZ), ChVector<>(0, 0, hdimZ), ChVector<>(0, 0, 1));
+        gl_window.SetRenderMode(opengl::WIREFRAME);
+    }
+#endif
 
-            // Grab handles to mechanism bodies (must increase ref counts)
-            ground = msystem->Get_bodylist().at(0);
-            shearBox = msystem->Get_bodylist().at(1);
-            loadPlate = msystem->Get_bodylist().at(2);
+    // Counters over all stages
+    int out_frame = 0;
+    double exec_time = 0;
 
-            // Move the load plate just above the granular material.
-            double highest, lowest;
-            FindHeightRange(msystem, lowest, highest);
-            ChVector<> pos = loadPlate->GetPos();
-            double z_new = highest + 2 * r_g;
-            loadPlate->SetPos(ChVector<>(pos.x(), pos.y(), z_new));
+    // Shear box travel covered by the load plate (set when shearing starts)
+    double plate_travel = 0;
+
+    for (ProblemType stage : stages) {
+        problem = stage;
+
+        // Bodies and links are left in place by the previous stage of a pipeline
+        bool in_memory = (stage != stages.front());
+
+        // Each stage starts at time 0 (as when loaded from a checkpoint), since the
+        // shear box actuator function is defined from the start of the stage.
+        if (in_memory)
+            msystem->SetChTime(0);
+
+        // The contact set changes discontinuously between stages (new links, or bodies loaded from a checkpoint)
+        if (warm_start_cache)
+            warm_start_cache->Clear();
+
+        // Depending on problem type:
+        // - Select end simulation time
+        // - Select output FPS
+        // - Create / load objects (or modify the objects of the previous stage)
+
+        double time_min = 0;
+        double time_end;
+        int out_fps;
+
+        switch (problem) {
+            case SETTLING: {
+                if (cache.Contains()) {
+                    cout << "Settled bed found in cache: " << cache.GetFilename() << endl;
+                    if (stages.size() == 1)
+                        return 0;
+
+                    // Continue the pipeline from the cached settled bed.
+                    if (!ReadStageCheckpoint(msystem, cache.GetFilename()))
+                        return 1;
+                    ground = msystem->Get_bodylist().at(0);
+                    shearBox = msystem->Get_bodylist().at(1);
+                    loadPlate = msystem->Get_bodylist().at(2);
+                    break;
+                }
 
-            // Connect the load plate to the shear box.
-            ConnectLoadPlate(msystem, ground, loadPlate);
-            prismatic_plate_ground = std::static_pointer_cast<ChLinkLockPrismatic>(msystem->SearchLink("prismatic_plate_ground"));
+                time_min = time_settling_min;
+                time_end = time_settling_max;
+                out_fps = out_fps_settling;
 
-            // Release the load plate.
-            loadPlate->SetBodyFixed(false);
+                // Create the mechanism bodies (all fixed).
+                CreateMechanismBodies(msystem);
 
-            // Set plate mass from desired applied normal pressure
-            double area = 4 * hdimX * hdimY;
-            double mass = normalPressure * area / gravity;
-            loadPlate->SetMass(mass);
+                // Grab handles to mechanism bodies (must increase ref counts)
+                ground = msystem->Get_bodylist().at(0);
+                shearBox = msystem->Get_bodylist().at(1);
+                loadPlate = msystem->Get_bodylist().at(2);
 
-            break;
-        }
+                // Create granular material.
+                int num_particles = CreateGranularMaterial(msystem);
+                cout << "Granular material:  " << num_particles << " particles" << endl;
 
-        case SHEARING: {
-            time_end = time_shearing;
-            out_fps = out_fps_shearing;
-
-            // Create bodies from checkpoint file.
-            cout << "Read checkpoint data from " << pressed_ckpnt_file;
-            utils::ReadCheckpoint(msystem, pressed_ckpnt_file);
-            cout << "  done.  Read " << msystem->Get_bodylist().size() << " bodies." << endl;
-
-            // Grab handles to mechanism bodies (must increase ref counts)
-            ground = msystem->Get_bodylist().at(0);
-            shearBox = msystem->Get_bodylist().at(1);
-            loadPlate = msystem->Get_bodylist().at(2);
-
-            // If using an actuator, connect the shear box and get a handle to the actuator.
-            if (use_actuator) {
-                ConnectShearBox(msystem, ground, shearBox);
-                prismatic_box_ground = std::static_pointer_cast<ChLinkLockPrismatic>(msystem->SearchLink("prismatic_box_ground"));
-                actuator = std::static_pointer_cast<ChLinkLinActuator>(msystem->SearchLink("actuator"));
+                break;
             }
 
-            // Release the shear box when using an actuator.
-            shearBox->SetBodyFixed(!use_actuator);
+            case PRESSING: {
+                time_min = time_pressing_min;
+                time_end = time_pressing_max;
+                out_fps = out_fps_pressing;
+
+                if (!in_memory) {
+                    // Create bodies from the cached settled bed (or the checkpoint file of the last settling run).
+                    std::string settled_file = cache.Contains() ? cache.GetFilename() : settled_ckpnt_file;
+                    if (!ReadStageCheckpoint(msystem, settled_file))
+                        return 1;
+
+                    // Grab handles to mechanism bodies (must increase ref counts)
+                    ground = msystem->Get_bodylist().at(0);
+                    shearBox = msystem->Get_bodylist().at(1);
+                    loadPlate = msystem->Get_bodylist().at(2);
+                }
 
-            // Connect the load plate to the shear box.
-            ConnectLoadPlate(msystem, ground, loadPlate);
-            prismatic_plate_ground = std::static_pointer_cast<ChLinkLockPrismatic>(msystem->SearchLink("prismatic_plate_ground"));
+                // Move the load plate just above the granular material.
+                double highest, lowest;
+                granular.FindHeightRange(lowest, highest);
+                ChVector<> pos = loadPlate->GetPos();
+                double z_new = highest + 2 * r_g;
+                loadPlate->SetPos(ChVector<>(pos.x(), pos.y(), z_new));
 
-            // Release the load plate.
-            loadPlate->SetBodyFixed(false);
+                // Connect the load plate to the shear box.
+                prismatic_plate_ground = ConnectLoadPlate(msystem, ground, loadPlate);
 
-            // setBulkDensity(msystem, desiredBulkDensity);
+                // Release the load plate.
+                loadPlate->SetBodyFixed(false);
 
-            // Set plate mass from desired applied normal pressure
-            double area = 4 * hdimX * hdimY;
-            double mass = normalPressure * area / gravity;
-            loadPlate->SetMass(mass);
+                // Set plate mass from desired applied normal pressure
+                double area = 4 * hdimX * hdimY;
+                double mass = normalPressure * area / gravity;
+                loadPlate->SetMass(mass);
 
-            break;
-        }
+                break;
+            }
 
-        case TESTING: {
-            time_end = time_testing;
-            out_fps = out_fps_testing;
+            case SHEARING: {
+                time_end = time_shearing;
+                out_fps = out_fps_shearing;
 
-            // For TESTING only, increase shearing velocity.
-            desiredVelocity = 0.5;
+                if (!in_memory) {
+                    // Create bodies from checkpoint file.
+                    if (!ReadStageCheckpoint(msystem, pressed_ckpnt_file))
+                        return 1;
 
-            // Create the mechanism bodies (all fixed).
-            CreateMechanismBodies(msystem);
+                    // Grab handles to mechanism bodies (must increase ref counts)
+                    ground = msystem->Get_bodylist().at(0);
+                    shearBox = msystem->Get_bodylist().at(1);
+                    loadPlate = msystem->Get_bodylist().at(2);
+                }
 
-            // Create the test ball.
-            CreateBall(msystem);
+                // If using an actuator, connect the shear box to the ground.
+                if (use_actuator)
+                    ConnectShearBox(msystem, ground, shearBox, prismatic_box_ground, actuator);
 
-            // Grab handles to mechanism bodies (must increase ref counts)
-            ground = msystem->Get_bodylist().at(0);
-            shearBox = msystem->Get_bodylist().at(1);
-            loadPlate = msystem->Get_bodylist().at(2);
+                // Release the shear box when using an actuator.
+                shearBox->SetBodyFixed(!use_actuator);
 
-            // Move the load plate just above the test ball.
-            ChVector<> pos = loadPlate->GetPos();
-            double z_new = 2.1 * radius_ball;
-            loadPlate->SetPos(ChVector<>(pos.x(), pos.y(), z_new));
+                // Size the load plate for the shearing travel.
+                ResizeLoadPlate(msystem, loadPlate);
+                plate_travel = LoadPlateHalfLength() - hdimX;
 
-            // If using an actuator, connect the shear box and get a handle to the actuator.
-            if (use_actuator) {
-                ConnectShearBox(msystem, ground, shearBox);
-                prismatic_box_ground = std::static_pointer_cast<ChLinkLockPrismatic>(msystem->SearchLink("prismatic_box_ground"));
-                actuator = std::static_pointer_cast<ChLinkLinActuator>(msystem->SearchLink("actuator"));
-            }
+                // Connect the load plate to the shear box (unless already connected while pressing).
+                if (!prismatic_plate_ground)
+                    prismatic_plate_ground = ConnectLoadPlate(msystem, ground, loadPlate);
 
-            // Release the shear box when using an actuator.
-            shearBox->SetBodyFixed(!use_actuator);
+                // Release the load plate.
+                loadPlate->SetBodyFixed(false);
 
-            // Connect the load plate to the shear box.
-            ConnectLoadPlate(msystem, ground, loadPlate);
-            prismatic_plate_ground = std::static_pointer_cast<ChLinkLockPrismatic>(msystem->SearchLink("prismatic_plate_ground"));
+                // Set friction of the granular material.
+                SetGranularFriction(msystem, mu_g);
 
-            // Release the load plate.
-            loadPlate->SetBodyFixed(false);
+                // setBulkDensity(msystem, granular, desiredBulkDensity);
 
-            // Set plate mass from desired applied normal pressure
-            double area = 4 * hdimX * hdimY;
-            double mass = normalPressure * area / gravity;
-            loadPlate->SetMass(mass);
+                // Set plate mass from desired applied normal pressure
+                double area = 4 * hdimX * hdimY;
+                double mass = normalPressure * area / gravity;
+                loadPlate->SetMass(mass);
 
-            break;
-        }
-    }
+                break;
+            }
 
-    // ----------------------
-    // Perform the simulation
-    // ----------------------
+            case TESTING: {
+                time_end = time_testing;
+                out_fps = out_fps_testing;
 
-    // Set number of simulation steps and steps between successive output
-    int num_steps = (int)std::ceil(time_end / time_step);
-    int out_steps = (int)std::ceil((1.0 / time_step) / out_fps);
-    int write_steps = (int)std::ceil((1.0 / time_step) / write_fps);
+                // For TESTING only, increase shearing velocity.
+                desiredVelocity = 0.5;
 
-    // Initialize counters
-    double time = 0;
-    int sim_frame = 0;
-    int out_frame = 0;
-    int next_out_frame = 0;
-    double exec_time = 0;
-    int num_contacts = 0;
-    double max_cnstr_viol[3] = {0, 0, 0};
+                // Create the mechanism bodies (all fixed).
+                CreateMechanismBodies(msystem);
 
-    // Circular buffer with highest particle location
-    // (only used for SETTLING or PRESSING)
-    int buffer_size = (int)std::ceil(time_min / time_step);
-    std::valarray<double> hdata(0.0, buffer_size);
+                // Create the test ball.
+                CreateBall(msystem);
 
-    // Create output files
-    ChStreamOutAsciiFile statsStream(stats_file.c_str());
-    ChStreamOutAsciiFile shearStream(shear_file.c_str());
+                // Grab handles to mechanism bodies (must increase ref counts)
+                ground = msystem->Get_bodylist().at(0);
+                shearBox = msystem->Get_bodylist().at(1);
+                loadPlate = msystem->Get_bodylist().at(2);
 
-    shearStream.SetNumFormat("%16.4e");
+                // Move the load plate just above the test ball.
+                ChVector<> pos = loadPlate->GetPos();
+                double z_new = 2.1 * radius_ball;
+                loadPlate->SetPos(ChVector<>(pos.x(), pos.y(), z_new));
 
-#ifdef CHRONO_OPENGL
-    opengl::ChOpenGLWindow& gl_window = opengl::ChOpenGLWindow::getInstance();
-    gl_window.Initialize(1280, 720, "Direct Shear Test", msystem);
-    gl_window.SetCamera(ChVector<>(0, -10 * hdimY, hdimZ), ChVector<>(0, 0, hdimZ), ChVector<>(0, 0, 1));
-    gl_window.SetRenderMode(opengl::WIREFRAME);
-#endif
+                // If using an actuator, connect the shear box to the ground.
+                if (use_actuator)
+                    ConnectShearBox(msystem, ground, shearBox, prismatic_box_ground, actuator);
 
-    // Loop until reaching the end time...
-    while (time < time_end) {
-        // Current position and velocity of the shear box
-        ChVector<> pos_old = shearBox->GetPos();
-        ChVector<> vel_old = shearBox->GetPos_dt();
-
-        // Calculate minimum and maximum particle heights
-        double highest, lowest;
-        FindHeightRange(msystem, lowest, highest);
-
-        // If at an output frame, write PovRay file and print info
-        if (sim_frame == next_out_frame) {
-            cout << "------------ Output frame:     " << out_frame + 1 << endl;
-            cout << "             Sim frame:        " << sim_frame << endl;
-            cout << "             Time:             " << time << endl;
-            cout << "             Shear box pos:    " << pos_old.x() << endl;
-            cout << "                       vel:    " << vel_old.x() << endl;
-            cout << "             Particle lowest:  " << lowest << endl;
-            cout << "                      highest: " << highest << endl;
-            cout << "             Execution time:   " << exec_time << endl;
-
-            // Save PovRay post-processing data.
-            if (write_povray_data) {
-                char filename[100];
-                sprintf(filename, "%s/data_%03d.dat", pov_dir.c_str(), out_frame + 1);
-                utils::WriteShapesPovray(msystem, filename, false);
-            }
+                // Release the shear box when using an actuator.
+                shearBox->SetBodyFixed(!use_actuator);
 
-            // Create a checkpoint from the current state.
-            if (problem == SETTLING || problem == PRESSING) {
-                cout << "             Write checkpoint data " << flush;
-                if (problem == SETTLING)
-                    utils::WriteCheckpoint(msystem, settled_ckpnt_file);
-                else
-                    utils::WriteCheckpoint(msystem, pressed_ckpnt_file);
-                cout << msystem->Get_bodylist().size() << " bodies" << endl;
+                // Connect the load plate to the shear box.
+                prismatic_plate_ground = ConnectLoadPlate(msystem, ground, loadPlate);
+
+                // Release the load plate.
+                loadPlate->SetBodyFixed(false);
+
+                // Set plate mass from desired applied normal pressure
+                double area = 4 * hdimX * hdimY;
+                double mass = normalPressure * area / gravity;
+                loadPlate->SetMass(mass);
+
+                break;
             }
+        }
 
-            // Increment counters
-            out_frame++;
-            next_out_frame += out_steps;
+        // Nothing to simulate if the settled bed was loaded from the cache
+        if (problem == SETTLING && cache.Contains())
+            continue;
+
+        if (stages.size() > 1) {
+            cout << "==================================" << endl;
+            cout << "Stage " << stage_names[problem] << endl;
+            timeline.AddMarker(std::string("stage ") + stage_names[problem]);
         }
 
-        // Check for early termination of a settling phase.
-        if (problem == SETTLING || problem == PRESSING) {
-            // Store maximum particle height in circular buffer
-            hdata[sim_frame % buffer_size] = highest;
-
-            // Check variance of data in circular buffer
-            if (time > time_min) {
-                double mean_height = hdata.sum() / buffer_size;
-                std::valarray<double> x = hdata - mean_height;
-                double var = std::sqrt((x * x).sum() / buffer_size);
-
-                // Consider the material settled when the variance is below the
-                // specified fraction of a particle radius
-                if (var < settling_tol * r_g) {
+        // ----------------------
+        // Perform the simulation
+        // ----------------------
+
+        // Set number of simulation steps and steps between successive output
+        int out_steps = (int)std::ceil((1.0 / time_step) / out_fps);
+        int write_steps = (int)std::ceil((1.0 / time_step) / write_fps);
+
+        // Initialize counters
+        double time = 0;
+        int sim_frame = 0;
+        int next_out_frame = 0;
+        int num_contacts = 0;
+        double max_cnstr_viol[3] = {0, 0, 0};
+
+        // Monitor the variation of the highest particle location, sampled every
+        // settling_check_steps steps over the last time_min seconds
+        // (only used for SETTLING or PRESSING)
+        int settling_check_steps = 10;
+        SettlingMonitor monitor(settling_check_steps);
+        monitor.SetFirstBody(3);  // skip the mechanism bodies (ground, shear box, load plate)
+        monitor.SetMinTime(time_min);
+        monitor.SetHeightVariation(settling_tol * r_g, (int)std::ceil(time_min / (settling_check_steps * time_step)));
+
+        // Loop until reaching the end time...
+        while (time < time_end) {
+            // Current position and velocity of the shear box
+            ChVector<> pos_old = shearBox->GetPos();
+            ChVector<> vel_old = shearBox->GetPos_dt();
+
+            // Calculate minimum and maximum particle heights
+            double highest, lowest;
+            granular.FindHeightRange(lowest, highest);
+
+            // If at an output frame, write PovRay file and print info
+            if (sim_frame == next_out_frame) {
+                cout << "------------ Output frame:     " << out_frame + 1 << endl;
+                cout << "             Sim frame:        " << sim_frame << endl;
+                cout << "             Time:             " << time << endl;
+                cout << "             Shear box pos:    " << pos_old.x() << endl;
+                cout << "                       vel:    " << vel_old.x() << endl;
+                cout << "             Particle lowest:  " << lowest << endl;
+                cout << "                      highest: " << highest << endl;
+                cout << "             Execution time:   " << exec_time << endl;
+
+                // Save PovRay post-processing data.
+                if (write_povray_data) {
+                    char filename[100];
+                    sprintf(filename, "%s/data_%03d.dat", pov_dir.c_str(), out_frame + 1);
+                    utils::WriteShapesPovray(msystem, filename, false);
+                }
+
+                // Create a checkpoint from the current state (written in the background).
+                if (problem == SETTLING || problem == PRESSING) {
+                    cout << "             Write checkpoint data " << flush;
+                    if (problem == SETTLING)
+                        ckpnt_writer.Write(msystem, settled_ckpnt_file);
+                    else
+                        ckpnt_writer.Write(msystem, pressed_ckpnt_file);
+                    cout << msystem->Get_bodylist().size() << " bodies" << endl;
+                }
+
+                // Increment counters
+                out_frame++;
+                next_out_frame += out_steps;
+            }
+
+            // Check for early termination of a settling phase.
+            if (problem == SETTLING || problem == PRESSING) {
+                // Consider the material settled when the variation of the highest
+                // particle location is below the specified fraction of a particle radius
+                if (monitor.Update(msystem)) {
                     cout << "Granular material settled...  time = " << time << endl;
                     break;
                 }
             }
-        }
 
 // Advance simulation by one step
 #ifdef CHRONO_OPENGL
-        if (gl_window.Active()) {
-            gl_window.DoStepDynamics(time_step);
-            gl_window.Render();
-        } else
-            break;
+            if (!render) {
+                msystem->DoStepDynamics(time_step);
+            } else if (gl_window.Active()) {
+                gl_window.DoStepDynamics(time_step);
+                gl_window.Render();
+            } else
+                break;
 #else
-        msystem->DoStepDynamics(time_step);
+            msystem->DoStepDynamics(time_step);
 #endif
 
-        ////progressbar(out_steps + sim_frame - next_out_frame + 1, out_steps);
-        TimingOutput(msystem);
-
-        // Record stats about the simulation
-        if (sim_frame % write_steps == 0) {
-            // write stat info
-            size_t numIters = msystem->data_manager->measures.solver.maxd_hist.size();
-            double residual = 0;
-            if (numIters != 0)
-                residual = msystem->data_manager->measures.solver.residual;
-            statsStream << time << ", " << exec_time << ", " << num_contacts / write_steps << ", " << numIters << ", "
-                        << residual << ", " << max_cnstr_viol[0] << ", " << max_cnstr_viol[1] << ", "
-                        << max_cnstr_viol[2] << ", \n";
-            statsStream.GetFstream().flush();
-
-            num_contacts = 0;
-            max_cnstr_viol[0] = 0;
-            max_cnstr_viol[1] = 0;
-            max_cnstr_viol[2] = 0;
-        }
+            ////progressbar(out_steps + sim_frame - next_out_frame + 1, out_steps);
+            timeline.Record(msystem);
+            if (tune_bins)
+                bin_tuner.Update();
+
+            // Record stats about the simulation
+            if (sim_frame % write_steps == 0) {
+                // write stat info
+                size_t numIters = msystem->data_manager->measures.solver.maxd_hist.size();
+                double residual = 0;
+                if (numIters != 0)
+                    residual = msystem->data_manager->measures.solver.residual;
+                statsStream << time << ", " << exec_time << ", " << num_contacts / write_steps << ", " << numIters
+                            << ", " << residual << ", " << max_cnstr_viol[0] << ", " << max_cnstr_viol[1] << ", "
+                            << max_cnstr_viol[2] << ", \n";
+                statsStream.GetFstream().flush();
+
+                num_contacts = 0;
+                max_cnstr_viol[0] = 0;
+                max_cnstr_viol[1] = 0;
+                max_cnstr_viol[2] = 0;
+            }
 
-        if (problem == SHEARING || problem == TESTING) {
-            // Get the current reaction force or impose shear box position
-            ChVector<> rforcePbg(0, 0, 0);
-            ChVector<> rtorquePbg(0, 0, 0);
+            // Stop if the load plate no longer covers the shear box (results would be invalid)
+            if (problem == SHEARING && std::abs(shearBox->GetPos().x()) > plate_travel) {
+                cout << "ERROR: shear box travel " << shearBox->GetPos().x() << " exceeds the load plate length"
+                     << endl;
+                return 1;
+            }
+
+            if (problem == SHEARING || problem == TESTING) {
+                // Get the current reaction force or impose shear box position
+                ChVector<> rforcePbg(0, 0, 0);
+                ChVector<> rtorquePbg(0, 0, 0);
 
-            ChVector<> rforcePpb(0, 0, 0);
-            ChVector<> rtorquePpb(0, 0, 0);
+                ChVector<> rforcePpb(0, 0, 0);
+                ChVector<> rtorquePpb(0, 0, 0);
 
-            ChVector<> rforceA(0, 0, 0);
-            ChVector<> rtorqueA(0, 0, 0);
+                ChVector<> rforceA(0, 0, 0);
+                ChVector<> rtorqueA(0, 0, 0);
 
-            if (use_actuator) {
-                rforcePbg = prismatic_box_ground->Get_react_force();
-                rtorquePbg = prismatic_box_ground->Get_react_torque();
+                if (use_actuator) {
+                    rforcePbg = prismatic_box_ground->Get_react_force();
+                    rtorquePbg = prismatic_box_ground->Get_react_torque();
 
-                rforcePpb = prismatic_plate_ground->Get_react_force();
-                rtorquePpb = prismatic_plate_ground->Get_react_torque();
+                    rforcePpb = prismatic_plate_ground->Get_react_force();
+                    rtorquePpb = prismatic_plate_ground->Get_react_torque();
+
+                    rforceA = actuator->Get_react_force();
+                    rtorqueA = actuator->Get_react_torque();
+                } else {
+                    double xpos_new = pos_old.x() + desiredVelocity * time_step;
+                    shearBox->SetPos(ChVector<>(xpos_new, pos_old.y(), pos_old.z()));
+                    shearBox->SetPos_dt(ChVector<>(desiredVelocity, 0, 0));
+                }
 
-                rforceA = actuator->Get_react_force();
-                rtorqueA = actuator->Get_react_torque();
-            } else {
-                double xpos_new = pos_old.x() + desiredVelocity * time_step;
-                shearBox->SetPos(ChVector<>(xpos_new, pos_old.y(), pos_old.z()));
-                shearBox->SetPos_dt(ChVector<>(desiredVelocity, 0, 0));
+                if (sim_frame % write_steps == 0) {
+                    ////cout << "X pos: " << xpos_new << " X react: " << cnstr_force << endl;
+                    shearStream << time << "  " << shearBox->GetPos().x() << "     ";
+                    shearStream << rforceA.x() << "  " << rforceA.y() << "  " << rforceA.z() << "     ";
+                    shearStream << rtorqueA.x() << "  " << rtorqueA.y() << "  " << rtorqueA.z() << "\n";
+                    shearStream.GetFstream().flush();
+
+                    // Shear and normal stress in the shear zone and on the shear plane
+                    if (regions.HasForces()) {
+                        regions.Sample();
+                        const RegionSample& zone = regions.GetSample(shear_zone);
+                        const RegionSample& plane = regions.GetSample(shear_plane);
+                        double area = 4 * hdimX * hdimY;
+                        stressStream << time << "  " << shearBox->GetPos().x() << "     ";
+                        stressStream << zone.stress[0][2] << "  " << zone.stress[2][2] << "  "
+                                     << zone.packing_fraction << "  " << zone.coordination << "     ";
+                        stressStream << plane.force.x() / area << "  " << plane.force.z() / area << "\n";
+                        stressStream.GetFstream().flush();
+                    }
+                }
             }
 
-            if (sim_frame % write_steps == 0) {
-                ////cout << "X pos: " << xpos_new << " X react: " << cnstr_force << endl;
-                shearStream << time << "  " << shearBox->GetPos().x() << "     ";
-                shearStream << rforceA.x() << "  " << rforceA.y() << "  " << rforceA.z() << "     ";
-                shearStream << rtorqueA.x() << "  " << rtorqueA.y() << "  " << rtorqueA.z() << "\n";
-                shearStream.GetFstream().flush();
+            // Find maximum constraint violation
+            if (prismatic_box_ground) {
+                ChVectorDynamic<> C = prismatic_box_ground->GetC();
+                for (int i = 0; i < 5; i++)
+                    max_cnstr_viol[0] = std::max(max_cnstr_viol[0], std::abs(C(i)));
+            }
+            if (prismatic_plate_ground) {
+                ChVectorDynamic<> C = prismatic_plate_ground->GetC();
+                for (int i = 0; i < 5; i++)
+                    max_cnstr_viol[1] = std::max(max_cnstr_viol[1], std::abs(C(i)));
+            }
+            if (actuator) {
+                ChVectorDynamic<> C = actuator->GetC();
+                max_cnstr_viol[2] = std::max(max_cnstr_viol[2], std::abs(C(0)));
             }
-        }
 
-        // Find maximum constraint violation
-        if (prismatic_box_ground) {
-            ChVectorDynamic<> C = prismatic_box_ground->GetC();
-            for (int i = 0; i < 5; i++)
-                max_cnstr_viol[0] = std::max(max_cnstr_viol[0], std::abs(C(i)));
-        }
-        if (prismatic_plate_ground) {
-            ChVectorDynamic<> C = prismatic_plate_ground->GetC();
-            for (int i = 0; i < 5; i++)
-                max_cnstr_viol[1] = std::max(max_cnstr_viol[1], std::abs(C(i)));
-        }
-        if (actuator) {
-            ChVectorDynamic<> C = actuator->GetC();
-            max_cnstr_viol[2] = std::max(max_cnstr_viol[2], std::abs(C(0)));
+            // Increment counters
+            time += time_step;
+            sim_frame++;
+            exec_time += msystem->GetTimerStep();
+            num_contacts += msystem->GetNcontacts();
+
+            // If requested, output detailed timing information for this step
+            if (sim_frame == timing_frame)
+                msystem->PrintStepStats();
         }
 
-        // Increment counters
-        time += time_step;
-        sim_frame++;
-        exec_time += msystem->GetTimerStep();
-        num_contacts += msystem->GetNcontacts();
+#ifdef CHRONO_OPENGL
+        // Do not start the next stage if the visualization window was closed
+        if (render && !gl_window.Active())
+            break;
+#endif
+
+        // Create a checkpoint from the last state
+        if (problem == SETTLING || problem == PRESSING) {
+            cout << "             Write checkpoint data " << flush;
+            if (problem == SETTLING)
+                ckpnt_writer.Write(msystem, settled_ckpnt_file);
+            else
+                ckpnt_writer.Write(msystem, pressed_ckpnt_file);
+            cout << msystem->Get_bodylist().size() << " bodies" << endl;
+        }
 
-        // If requested, output detailed timing information for this step
-        if (sim_frame == timing_frame)
-            msystem->PrintStepStats();
+        // Add the settled bed to the cache
+        if (problem == SETTLING) {
+            if (cache.Store(msystem))
+                cout << "Settled bed cached in " << cache.GetFilename() << endl;
+        }
     }
 
     // ----------------
     // Final processing
     // ----------------
 
-    // Create a checkpoint from the last state
-    if (problem == SETTLING || problem == PRESSING) {
-        cout << "             Write checkpoint data " << flush;
-        if (problem == SETTLING)
-            utils::WriteCheckpoint(msystem, settled_ckpnt_file);
-        else
-            utils::WriteCheckpoint(msystem, pressed_ckpnt_file);
-        cout << msystem->Get_bodylist().size() << " bodies" << endl;
-    }
+    // Wait for pending checkpoints
+    if (ckpnt_writer.Flush() > 0)
+        cout << "Error writing checkpoint data" << endl;
+
+    // Export per-step timing information
+    timeline.WriteBinary(run_dir + "/timeline.bin");
+    timeline.WriteChromeTrace(run_dir + "/timeline.json");
 
     // Final stats
     cout << "==================================" << endl;
@@ -14,6 +14,9 @@
 //
 // Chrono::Multicore demo program for pressure-sinkage studies.
 //
+// The contact method, problem type, and solver settings can be changed at run
+// time (see AddSettings; "--help" lists all settings).
+//
 // The global reference frame has Z up.
 // All units SI (CGS, i.e., centimeter - gram - second)
 //
@@ -23,7 +26,6 @@
 
 #include <iostream>
 #include <vector>
-#include <valarray>
 #include <string>
 #include <sstream>
 #include <cmath>
@@ -47,6 +49,12 @@
 #include "chrono_opengl/ChOpenGLWindow.h"
 #endif
 
+#include "../checkpoint.h"
+#include "../dem_settings.h"
+#include "../granular.h"
+#include "../settled_cache.h"
+#include "../settling.h"
+#include "../sphere_generator.h"
 #include "../utils.h"
 
 using namespace chrono;
@@ -60,8 +68,8 @@ using std::endl;
 // Problem definitions
 // -----------------------------------------------------------------------------
 
-// Comment the following line to use NSC contact
-//#define USE_SMC
+// Contact method (NSC or SMC)
+ChContactMethod method = ChContactMethod::NSC;
 
 enum ProblemType { SETTLING, PRESSING, TESTING };
 
@@ -101,40 +109,38 @@ double time_testing = 2;
 double settling_tol = 0.2;
 
 // Solver settings
-#ifdef USE_SMC
-double time_step = 1e-5;
-int max_iteration_bilateral = 100;
-#else
-double time_step = 1e-3;
+// (unless set at run time, the time step, number of bilateral iterations, and
+// narrowphase algorithm depend on the contact method)
+double time_step = 1e-3;  // SMC: 1e-5
 int max_iteration_normal = 0;
 int max_iteration_sliding = 10000;
 int max_iteration_spinning = 0;
-int max_iteration_bilateral = 0;
+int max_iteration_bilateral = 0;  // SMC: 100
 float contact_recovery_speed = 10e20f;
-#endif
+SolverType solver_type = SolverType::APGDREF;
 
 bool clamp_bilaterals = false;
 double bilateral_clamp_speed = 10e30;
 double tolerance = 1;
 
-// Contact force model
-#ifdef USE_SMC
+// Collision detection settings
+NarrowPhaseType narrowphase = NarrowPhaseType::NARROWPHASE_HYBRID_MPR;  // SMC: NARROWPHASE_R
+vec3 bins_per_axis = vec3(10, 10, 10);
+
+// Contact force model (SMC only)
 ChSystemSMC::ContactForceModel contact_force_model = ChSystemSMC::ContactForceModel::Hertz;
 ChSystemSMC::TangentialDisplacementModel tangential_displ_mode = ChSystemSMC::TangentialDisplacementModel::MultiStep;
-#endif
 
-// Output
-#ifdef USE_SMC
-const std::string out_dir = "../PRESSURESINKAGE_SMC";
-#else
-const std::string out_dir = "../PRESSURESINKAGE_NSC";
-#endif
+// Output (directory names depend on the contact method, see SetOutputDirectories)
+std::string out_dir;
+std::string pov_dir;
+std::string sinkage_file;
+std::string stats_file;
+std::string settled_ckpnt_file;
+std::string pressed_ckpnt_file;
 
-const std::string pov_dir = out_dir + "/POVRAY";
-const std::string sinkage_file = out_dir + "/sinkage.dat";
-const std::string stats_file = out_dir + "/stats.dat";
-const std::string settled_ckpnt_file = out_dir + "/settled.dat";
-const std::string pressed_ckpnt_file = out_dir + "/pressed.dat";
+// Cache of settled beds, shared by all runs with the same settling parameters
+const std::string settled_cache_dir = "../SETTLED_CACHE";
 
 // Frequency for visualization output
 int out_fps_settling = 120;
@@ -195,19 +201,11 @@ double radius_ball = 0.9 * hdimY;  // [cm] radius of testing ball
 // =============================================================================
 
 void CreateMechanismBodies(ChSystemMulticore* system) {
-// -------------------------------
-// Create a material for the walls
-// -------------------------------
-
-#ifdef USE_SMC
-    auto mat_walls = chrono_types::make_shared<ChMaterialSurfaceSMC>();
-    mat_walls->SetYoungModulus(Y_walls);
-    mat_walls->SetFriction(mu_walls);
-    mat_walls->SetRestitution(cr_walls);
-#else
-    auto mat_walls = chrono_types::make_shared<ChMaterialSurfaceNSC>();
-    mat_walls->SetFriction(mu_walls);
-#endif
+    // -------------------------------
+    // Create a material for the walls
+    // -------------------------------
+
+    auto mat_walls = CreateContactMaterial(method, mu_walls, Y_walls, cr_walls);
 
     // ----------------------
     // Create the ground body -- always FIRST body in system
@@ -281,34 +279,21 @@ void ConnectLoadPlate(ChSystemMulticore* system, std::shared_ptr<ChBody> ground,
 // =============================================================================
 
 int CreateGranularMaterial(ChSystemMulticore* system) {
-// -------------------------------------------
-// Create a material for the granular material
-// -------------------------------------------
-
-#ifdef USE_SMC
-    auto mat_g = chrono_types::make_shared<ChMaterialSurfaceSMC>();
-    mat_g->SetYoungModulus(Y_g);
-    mat_g->SetFriction(mu_g);
-    mat_g->SetRestitution(cr_g);
-#else
-    auto mat_g = chrono_types::make_shared<ChMaterialSurfaceNSC>();
-    mat_g->SetFriction(mu_g);
-#endif
+    // -------------------------------------------
+    // Create a material for the granular material
+    // -------------------------------------------
 
-    // ---------------------------------------------
-    // Create a mixture entirely made out of spheres
-    // ---------------------------------------------
+    auto mat_g = CreateContactMaterial(method, mu_g, Y_g, cr_g);
 
-    // Create the particle generator with a mixture of 100% spheres
-    utils::Generator gen(system);
+    // ---------------------------------------
+    // Create a generator of identical spheres
+    // ---------------------------------------
 
-    std::shared_ptr<utils::MixtureIngredient> m1 = gen.AddMixtureIngredient(utils::MixtureType::SPHERE, 1.0);
-    m1->setDefaultMaterial(mat_g);
-    m1->setDefaultDensity(rho_g);
-    m1->setDefaultSize(r_g);
+    // Create the particle generator for spheres
+    SphereGenerator gen(system, mat_g, r_g, rho_g);
 
     // Ensure that all generated particle bodies will have positive IDs.
-    gen.setBodyIdentifier(Id_g);
+    gen.SetBodyIdentifier(Id_g);
 
     // ----------------------
     // Generate the particles
@@ -319,12 +304,13 @@ int CreateGranularMaterial(ChSystemMulticore* system) {
     ChVector<> center(0, 0, 2 * r);
 
     while (center.z() < 2 * hdimZ) {
-        gen.createObjectsBox(utils::SamplingType::POISSON_DISK, 2 * r, center, hdims);
+        gen.AddBox(center, hdims, 2 * r);
         center.z() += 2 * r;
     }
+    gen.CreateBodies();
 
     // Return the number of generated particles.
-    return gen.getTotalNumBodies();
+    return gen.GetTotalNumBodies();
 }
 
 // =============================================================================
@@ -332,19 +318,11 @@ int CreateGranularMaterial(ChSystemMulticore* system) {
 // =============================================================================
 
 void CreateBall(ChSystemMulticore* system) {
-// ------------------------------
-// Create a material for the ball
-// ------------------------------
-
-#ifdef USE_SMC
-    auto mat_g = chrono_types::make_shared<ChMaterialSurfaceSMC>();
-    mat_g->SetYoungModulus(Y_g);
-    mat_g->SetFriction(mu_g);
-    mat_g->SetRestitution(cr_g);
-#else
-    auto mat_g = chrono_types::make_shared<ChMaterialSurfaceNSC>();
-    mat_g->SetFriction(mu_g);
-#endif
+    // ------------------------------
+    // Create a material for the ball
+    // ------------------------------
+
+    auto mat_g = CreateContactMaterial(method, mu_g, Y_g, cr_g);
 
     // ---------------
     // Create the ball
@@ -365,47 +343,21 @@ void CreateBall(ChSystemMulticore* system) {
     system->AddBody(ball);
 }
 
-// =============================================================================
-// Find the height of the highest and lowest sphere in the granular mix. We only
-// look at bodies whith positive identifiers (to exclude all other bodies).
-// =============================================================================
-
-void FindHeightRange(ChSystemMulticore* sys, double& lowest, double& highest) {
-    highest = -1000;
-    lowest = 1000;
-    for (auto body : sys->Get_bodylist()) {
-        if (body->GetIdentifier() <= 0)
-            continue;
-
-        if (fabs(body->GetPos().x()) <= hdimX_p && fabs(body->GetPos().y()) <= hdimY_p) {
-            double h = body->GetPos().z();
-            if (h < lowest)
-                lowest = h;
-            else if (h > highest)
-                highest = h;
-        }
-    }
-}
-
 // =============================================================================
 //
 //// TODO:  cannot do this with SMC!!!!!
 //
 // =============================================================================
 
-void setBulkDensity(ChSystem* sys, double bulkDensity) {
+void setBulkDensity(ChSystem* sys, GranularAnalysis& granular, double bulkDensity) {
     double vol_g = (4.0 / 3) * CH_C_PI * r_g * r_g * r_g;
 
     double normalPlateHeight = sys->Get_bodylist().at(1)->GetPos().z() - hdimZ;
     double bottomHeight = 0;
     double boxVolume = hdimX * 2 * hdimX * 2 * (normalPlateHeight - bottomHeight);
-    double granularVolume = (sys->Get_bodylist().size() - 3) * vol_g;
+    double granularVolume = granular.GetNumParticles() * vol_g;
     double reqDensity = bulkDensity * boxVolume / granularVolume;
-    for (auto body : sys->Get_bodylist()) {
-        if (body->GetIdentifier() > 1) {
-            body->SetMass(reqDensity * vol_g);
-        }
-    }
+    granular.SetParticleMass(reqDensity * vol_g);
 
     cout << "N Bodies: " << sys->Get_bodylist().size() << endl;
     cout << "Box Volume: " << boxVolume << endl;
@@ -413,9 +365,105 @@ void setBulkDensity(ChSystem* sys, double bulkDensity) {
     cout << "Desired bulk density = " << bulkDensity << ", Required Body Density = " << reqDensity << endl;
 }
 
+// =============================================================================
+// Register all parameters which affect the settled granular bed
+// =============================================================================
+
+void SetSettledCacheParameters(SettledBedCache& cache) {
+    cache.AddParameter("test", std::string("pressureSinkage"));
+    cache.AddParameter("contact_method", GetContactMethodName(method));
+    if (method == ChContactMethod::SMC) {
+        cache.AddParameter("contact_force_model", (int)contact_force_model);
+        cache.AddParameter("tangential_displ_mode", (int)tangential_displ_mode);
+    } else {
+        cache.AddParameter("max_iteration_normal", max_iteration_normal);
+        cache.AddParameter("max_iteration_sliding", max_iteration_sliding);
+        cache.AddParameter("max_iteration_spinning", max_iteration_spinning);
+        cache.AddParameter("contact_recovery_speed", (double)contact_recovery_speed);
+        cache.AddParameter("solver_type", (int)solver_type);
+    }
+    cache.AddParameter("time_step", time_step);
+    cache.AddParameter("tolerance", tolerance);
+    cache.AddParameter("max_iteration_bilateral", max_iteration_bilateral);
+    cache.AddParameter("gravity", gravity);
+    cache.AddParameter("time_settling_min", time_settling_min);
+    cache.AddParameter("time_settling_max", time_settling_max);
+    cache.AddParameter("settling_tol", settling_tol);
+    cache.AddParameter("hdimX", hdimX);
+    cache.AddParameter("hdimY", hdimY);
+    cache.AddParameter("hdimZ", hdimZ);
+    cache.AddParameter("hthick", hthick);
+    cache.AddParameter("hdimX_p", hdimX_p);
+    cache.AddParameter("hdimY_p", hdimY_p);
+    cache.AddParameter("hdimZ_p", hdimZ_p);
+    cache.AddParameter("Y_walls", Y_walls);
+    cache.AddParameter("cr_walls", cr_walls);
+    cache.AddParameter("mu_walls", mu_walls);
+    cache.AddParameter("r_g", r_g);
+    cache.AddParameter("rho_g", rho_g);
+    cache.AddParameter("Y_g", Y_g);
+    cache.AddParameter("cr_g", cr_g);
+    cache.AddParameter("mu_g", mu_g);
+}
+
+// =============================================================================
+// Register all parameters which can be set at run time
+// =============================================================================
+
+void AddSettings(DEMSettings& settings) {
+    settings.AddEnum("method", method, ContactMethodNames());
+    settings.AddEnum("problem", problem, {{"SETTLING", SETTLING}, {"PRESSING", PRESSING}, {"TESTING", TESTING}});
+    settings.Add("threads", threads);
+    settings.Add("time_step", time_step);
+    settings.Add("tolerance", tolerance);
+    settings.Add("max_iteration_normal", max_iteration_normal);
+    settings.Add("max_iteration_sliding", max_iteration_sliding);
+    settings.Add("max_iteration_spinning", max_iteration_spinning);
+    settings.Add("max_iteration_bilateral", max_iteration_bilateral);
+    settings.Add("contact_recovery_speed", contact_recovery_speed);
+    settings.AddEnum("solver_type", solver_type, SolverTypeNames());
+    settings.AddEnum("narrowphase", narrowphase, NarrowPhaseNames());
+    settings.Add("bins_per_axis", bins_per_axis);
+    settings.AddEnum("contact_force_model", contact_force_model, ContactForceModelNames());
+    settings.AddEnum("tangential_displ_mode", tangential_displ_mode, TangentialDisplacementModelNames());
+    settings.Add("use_actuator", use_actuator);
+    settings.Add("write_povray_data", write_povray_data);
+}
+
+// =============================================================================
+// Set the output directories for the selected contact method
+// =============================================================================
+
+void SetOutputDirectories() {
+    out_dir = "../PRESSURESINKAGE_" + GetContactMethodName(method);
+    pov_dir = out_dir + "/POVRAY";
+    sinkage_file = out_dir + "/sinkage.dat";
+    stats_file = out_dir + "/stats.dat";
+    settled_ckpnt_file = out_dir + "/settled.dat";
+    pressed_ckpnt_file = out_dir + "/pressed.dat";
+}
+
 // =============================================================================
 
 int main(int argc, char* argv[]) {
+    // Run-time settings ("--help" lists all settings)
+    DEMSettings settings;
+    AddSettings(settings);
+    if (!settings.Parse(argc, argv))
+        return 1;
+
+    // Defaults which depend on the contact method
+    if (method == ChContactMethod::SMC) {
+        if (!settings.IsSet("time_step"))
+            time_step = 1e-5;
+        if (!settings.IsSet("max_iteration_bilateral"))
+            max_iteration_bilateral = 100;
+        if (!settings.IsSet("narrowphase"))
+            narrowphase = NarrowPhaseType::NARROWPHASE_R;
+    }
+
+    SetOutputDirectories();
+
     // Create output directories.
     if (!filesystem::create_directory(filesystem::path(out_dir))) {
         cout << "Error creating directory " << out_dir << endl;
@@ -426,17 +474,15 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-// -------------
-// Create system
-// -------------
+    // -------------
+    // Create system
+    // -------------
 
-#ifdef USE_SMC
-    cout << "Create SMC system" << endl;
-    ChSystemMulticoreSMC* msystem = new ChSystemMulticoreSMC();
-#else
-    cout << "Create NSC system" << endl;
-    ChSystemMulticoreNSC* msystem = new ChSystemMulticoreNSC();
-#endif
+    ChSystemMulticore* msystem = CreateMulticoreSystem(method);
+
+    // Analysis of the granular material (particle heights below the load plate)
+    GranularAnalysis granular(msystem, Id_g);
+    granular.SetRegion(hdimX_p, hdimY_p);
 
     msystem->Set_G_acc(ChVector<>(0, 0, -gravity));
 
@@ -454,38 +500,29 @@ int main(int argc, char* argv[]) {
     msystem->GetSettings()->solver.clamp_bilaterals = clamp_bilaterals;
     msystem->GetSettings()->solver.bilateral_clamp_speed = bilateral_clamp_speed;
 
-#ifdef USE_SMC
-    msystem->GetSettings()->collision.narrowphase_algorithm = NarrowPhaseType::NARROWPHASE_R;
-    msystem->GetSettings()->solver.contact_force_model = contact_force_model;
-    msystem->GetSettings()->solver.tangential_displ_mode = tangential_displ_mode;
-#else
-    msystem->GetSettings()->solver.solver_mode = SolverMode::SLIDING;
-    msystem->GetSettings()->solver.max_iteration_normal = max_iteration_normal;
-    msystem->GetSettings()->solver.max_iteration_sliding = max_iteration_sliding;
-    msystem->GetSettings()->solver.max_iteration_spinning = max_iteration_spinning;
-    msystem->GetSettings()->solver.alpha = 0;
-    msystem->GetSettings()->solver.contact_recovery_speed = contact_recovery_speed;
-    msystem->SetMaxPenetrationRecoverySpeed(contact_recovery_speed);
-    msystem->ChangeSolverType(SolverType::APGDREF);
-
-    msystem->GetSettings()->collision.collision_envelope = 0.05 * r_g;
-#endif
+    if (method == ChContactMethod::SMC) {
+        msystem->GetSettings()->solver.contact_force_model = contact_force_model;
+        msystem->GetSettings()->solver.tangential_displ_mode = tangential_displ_mode;
+    } else {
+        msystem->GetSettings()->solver.solver_mode = SolverMode::SLIDING;
+        msystem->GetSettings()->solver.max_iteration_normal = max_iteration_normal;
+        msystem->GetSettings()->solver.max_iteration_sliding = max_iteration_sliding;
+        msystem->GetSettings()->solver.max_iteration_spinning = max_iteration_spinning;
+        msystem->GetSettings()->solver.alpha = 0;
+        msystem->GetSettings()->solver.contact_recovery_speed = contact_recovery_speed;
+        msystem->SetMaxPenetrationRecoverySpeed(contact_recovery_speed);
+        static_cast<ChSystemMulticoreNSC*>(msystem)->ChangeSolverType(solver_type);
+
+        msystem->GetSettings()->collision.collision_envelope = 0.05 * r_g;
+    }
 
-    msystem->GetSettings()->collision.bins_per_axis = vec3(10, 10, 10);
+    msystem->GetSettings()->collision.narrowphase_algorithm = narrowphase;
+    msystem->GetSettings()->collision.bins_per_axis = bins_per_axis;
 
     // --------------
     // Problem set up
     // --------------
-
-#ifdef USE_SMC
-    auto mat_plate = chrono_types::make_shared<ChMaterialSurfaceSMC>();
-    mat_plate->SetYoungModulus(Y_walls);
-    mat_plate->SetFriction(mu_walls);
-    mat_plate->SetRestitution(cr_walls);
-#else
-    auto mat_plate = chrono_types::make_shared<ChMaterialSurfaceNSC>();
-    mat_plate->SetFriction(mu_walls);
-#endif
+    auto mat_plate = CreateContactMaterial(method, mu_walls, Y_walls, cr_walls);
 
     // Depending on problem type:
     // - Select end simulation time
@@ -500,8 +537,17 @@ int main(int argc, char* argv[]) {
     std::shared_ptr<ChLinkLockPrismatic> prismatic;
     std::shared_ptr<ChLinkLinActuator> actuator;
 
+    // Settled beds are reused across runs with the same settling parameters
+    SettledBedCache cache(settled_cache_dir);
+    SetSettledCacheParameters(cache);
+
     switch (problem) {
         case SETTLING: {
+            if (cache.Contains()) {
+                cout << "Settled bed found in cache: " << cache.GetFilename() << endl;
+                return 0;
+            }
+
             time_min = time_settling_min;
             time_end = time_settling_max;
             out_fps = out_fps_settling;
@@ -525,9 +571,10 @@ int main(int argc, char* argv[]) {
             time_end = time_pressing_max;
             out_fps = out_fps_pressing;
 
-            // Create bodies from checkpoint file.
-            cout << "Read checkpoint data from " << settled_ckpnt_file;
-            utils::ReadCheckpoint(msystem, settled_ckpnt_file);
+            // Create bodies from the cached settled bed (or the checkpoint file of the last settling run).
+            std::string settled_file = cache.Contains() ? cache.GetFilename() : settled_ckpnt_file;
+            cout << "Read checkpoint data from " << settled_file;
+            ReadCheckpointBinary(msystem, settled_file);
             cout << "  done.  Read " << msystem->Get_bodylist().size() << " bodies." << endl;
 
             // Grab handles to mechanism bodies (must increase ref counts)
@@ -536,7 +583,7 @@ int main(int argc, char* argv[]) {
 
             // Move the load plate just above the granular material.
             double highest, lowest;
-            FindHeightRange(msystem, lowest, highest);
+            granular.FindHeightRange(lowest, highest);
             ChVector<> pos = loadPlate->GetPos();
             double z_new = highest + 1.01 * r_g;
             loadPlate->SetPos(ChVector<>(pos.x(), pos.y(), z_new));
@@ -619,16 +666,23 @@ int main(int argc, char* argv[]) {
     int num_contacts = 0;
     double max_cnstr_viol[2] = {0, 0};
 
-    // Circular buffer with highest particle location
+    // Monitor the variation of the highest particle location, sampled every
+    // settling_check_steps steps over the last time_min seconds
     // (only used for SETTLING or PRESSING)
-    int buffer_size = (int)std::ceil(time_min / time_step);
-    std::valarray<double> hdata(0.0, buffer_size);
+    int settling_check_steps = 10;
+    SettlingMonitor monitor(settling_check_steps);
+    monitor.SetFirstBody(2);  // skip the mechanism bodies (ground, load plate)
+    monitor.SetMinTime(time_min);
+    monitor.SetHeightVariation(settling_tol * r_g, (int)std::ceil(time_min / (settling_check_steps * time_step)));
 
     // Create output files
     ChStreamOutAsciiFile statsStream(stats_file.c_str());
     ChStreamOutAsciiFile sinkageStream(sinkage_file.c_str());
     sinkageStream.SetNumFormat("%16.4e");
 
+    // Per-step timing recorder (exported at the end of the simulation)
+    TimelineRecorder timeline;
+
 #ifdef CHRONO_OPENGL
     opengl::ChOpenGLWindow& gl_window = opengl::ChOpenGLWindow::getInstance();
     gl_window.Initialize(1280, 720, "Pressure Sinkage Test", msystem);
@@ -644,7 +698,7 @@ int main(int argc, char* argv[]) {
 
         // Calculate minimum and maximum particle heights
         double highest, lowest;
-        FindHeightRange(msystem, lowest, highest);
+        granular.FindHeightRange(lowest, highest);
 
         // If at an output frame, write PovRay file and print info
         if (sim_frame == next_out_frame) {
@@ -667,9 +721,9 @@ int main(int argc, char* argv[]) {
             if (problem == SETTLING || problem == PRESSING) {
                 cout << "             Write checkpoint data " << flush;
                 if (problem == SETTLING)
-                    utils::WriteCheckpoint(msystem, settled_ckpnt_file);
+                    WriteCheckpointBinary(msystem, settled_ckpnt_file);
                 else
-                    utils::WriteCheckpoint(msystem, pressed_ckpnt_file);
+                    WriteCheckpointBinary(msystem, pressed_ckpnt_file);
                 cout << msystem->Get_bodylist().size() << " bodies" << endl;
             }
 
@@ -680,21 +734,11 @@ int main(int argc, char* argv[]) {
 
         // Check for early termination of a settling phase.
         if (problem == SETTLING) {
-            // Store maximum particle height in circular buffer
-            hdata[sim_frame % buffer_size] = highest;
-
-            // Check variance of data in circular buffer
-            if (time > time_min) {
-                double mean_height = hdata.sum() / buffer_size;
-                std::valarray<double> x = hdata - mean_height;
-                double var = std::sqrt((x * x).sum() / buffer_size);
-
-                // Consider the material settled when the variance is below the
-                // specified fraction of a particle radius
-                if (var < settling_tol * r_g) {
-                    cout << "Granular material settled...  time = " << time << endl;
-                    break;
-                }
+            // Consider the material settled when the variation of the highest
+            // particle location is below the specified fraction of a particle radius
+            if (monitor.Update(msystem)) {
+                cout << "Granular material settled...  time = " << time << endl;
+                break;
             }
         }
 
@@ -709,7 +753,7 @@ int main(int argc, char* argv[]) {
         msystem->DoStepDynamics(time_step);
 #endif
 
-        TimingOutput(msystem);
+        timeline.Record(msystem);
 
         // Record stats about the simulation
         if (sim_frame % write_steps == 0) {
@@ -775,12 +819,22 @@ int main(int argc, char* argv[]) {
     if (problem == SETTLING || problem == PRESSING) {
         cout << "             Write checkpoint data " << flush;
         if (problem == SETTLING)
-            utils::WriteCheckpoint(msystem, settled_ckpnt_file);
+            WriteCheckpointBinary(msystem, settled_ckpnt_file);
         else
-            utils::WriteCheckpoint(msystem, pressed_ckpnt_file);
+            WriteCheckpointBinary(msystem, pressed_ckpnt_file);
         cout << msystem->Get_bodylist().size() << " bodies" << endl;
     }
 
+    // Add the settled bed to the cache
+    if (problem == SETTLING) {
+        if (cache.Store(msystem))
+            cout << "Settled bed cached in " << cache.GetFilename() << endl;
+    }
+
+    // Export per-step timing information
+    timeline.WriteBinary(out_dir + "/timeline.bin");
+    timeline.WriteChromeTrace(out_dir + "/timeline.json");
+
     // Final stats
     cout << "==================================" << endl;
     cout << "Number of bodies:  " << msystem->Get_bodylist().size() << endl;
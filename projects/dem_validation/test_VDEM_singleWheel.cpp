@@ -20,6 +20,15 @@
 // rolling mode, the wheel is translated and rotated in the x-direction at a
 // specified slip.
 //
+// The contact method, problem type, and solver settings can be changed at run
+// time (see AddSettings; "--help" lists all settings).
+//
+// By default, each run performs a single stage (problem type) and stages hand
+// off through checkpoint files. With "--pipeline true", all stages from
+// SETTLING up to the selected problem run in one process, each modifying the
+// bodies and links of the previous stage in place; the SETTLED and PRESSED
+// checkpoints are still written (in the background) for later runs.
+//
 // The global reference frame has Z up.
 // All units SI (CGS, i.e., centimeter - gram - second)
 //
@@ -27,7 +36,6 @@
 
 #include <iostream>
 #include <vector>
-#include <valarray>
 #include <string>
 #include <sstream>
 #include <cmath>
@@ -52,6 +60,13 @@
 #include "chrono_opengl/ChOpenGLWindow.h"
 #endif
 
+#include "../checkpoint.h"
+#include "../dem_settings.h"
+#include "../granular.h"
+#include "../settled_cache.h"
+#include "../settling.h"
+#include "../sphere_generator.h"
+
 using namespace chrono;
 using namespace chrono::collision;
 
@@ -63,13 +78,16 @@ using std::endl;
 // Problem definitions
 // -----------------------------------------------------------------------------
 
-// Comment the following line to use NSC contact
-//#define USE_SMC
+// Contact method (NSC or SMC)
+ChContactMethod method = ChContactMethod::NSC;
 
 enum ProblemType { SETTLING, PRESSING, ROLLING, TESTING };
 
 ProblemType problem = SETTLING;
 
+// Run all stages up to the selected problem in one process (handing off the system in memory)?
+bool pipeline = false;
+
 // -----------------------------------------------------------------------------
 // Conversion factors
 // -----------------------------------------------------------------------------
@@ -111,34 +129,34 @@ double time_testing = 2;
 double settling_tol = 0.2;
 
 // Solver settings
-#ifdef USE_SMC
-double time_step = 1e-5;
-int max_iteration_bilateral = 100;
-#else
-double time_step = 1e-3;
+// (unless set at run time, the time step, number of bilateral iterations, and
+// narrowphase algorithm depend on the contact method)
+double time_step = 1e-3;  // SMC: 1e-5
 int max_iteration_normal = 0;
 int max_iteration_sliding = 10000;
 int max_iteration_spinning = 0;
-int max_iteration_bilateral = 0;
+int max_iteration_bilateral = 0;  // SMC: 100
 double contact_recovery_speed = 10e30;
-#endif
+SolverType solver_type = SolverType::APGDREF;
 
 bool clamp_bilaterals = false;
 double bilateral_clamp_speed = 10e30;
 double tolerance = 1;
 
-// Output
-#ifdef USE_SMC
-const std::string out_dir = "../SINGLEWHEEL_SMC";
-#else
-const std::string out_dir = "../SINGLEWHEEL_NSC";
-#endif
+// Collision detection settings
+NarrowPhaseType narrowphase = NarrowPhaseType::NARROWPHASE_HYBRID_MPR;  // SMC: NARROWPHASE_R
+vec3 bins_per_axis = vec3(10, 10, 10);
 
-const std::string pov_dir = out_dir + "/POVRAY";
-const std::string roll_file = out_dir + "/roll.dat";
-const std::string stats_file = out_dir + "/stats.dat";
-const std::string settled_ckpnt_file = out_dir + "/settled.dat";
-const std::string pressed_ckpnt_file = out_dir + "/pressed.dat";
+// Output (directory names depend on the contact method, see SetOutputDirectories)
+std::string out_dir;
+std::string pov_dir;
+std::string roll_file;
+std::string stats_file;
+std::string settled_ckpnt_file;
+std::string pressed_ckpnt_file;
+
+// Cache of settled beds, shared by all runs with the same settling parameters
+const std::string settled_cache_dir = "../SETTLED_CACHE";
 
 // Frequency for visualization output
 int out_fps_settling = 120;
@@ -202,15 +220,7 @@ void CreateMechanismBodies(ChSystemMulticore* system) {
     // -------------------------------
     // Create a material for the walls
     // -------------------------------
-
-#ifdef USE_SMC
-    auto mat_walls = chrono_types::make_shared<ChMaterialSurfaceSMC>();
-    mat_walls->SetYoungModulus(Y_walls);
-    mat_walls->SetFriction(mu_walls);
-#else
-    auto mat_walls = chrono_types::make_shared<ChMaterialSurfaceNSC>();
-    mat_walls->SetFriction(mu_walls);
-#endif
+    auto mat_walls = CreateContactMaterial(method, mu_walls, Y_walls);
 
     // ----------------------
     // Create the ground body -- always FIRST body in system
@@ -306,11 +316,15 @@ void CreateMechanismBodies(ChSystemMulticore* system) {
 
 // =============================================================================
 // Connect the chassis to the containing bin (ground) through a translational
-// joint and create a linear actuator.
+// joint and create a linear actuator. Return handles to both links.
 // =============================================================================
 
-void ConnectChassisToGround(ChSystemMulticore* system, std::shared_ptr<ChBody> ground, std::shared_ptr<ChBody> chassis) {
-    auto prismatic = chrono_types::make_shared<ChLinkLockPrismatic>();
+void ConnectChassisToGround(ChSystemMulticore* system,
+                            std::shared_ptr<ChBody> ground,
+                            std::shared_ptr<ChBody> chassis,
+                            std::shared_ptr<ChLinkLockPrismatic>& prismatic,
+                            std::shared_ptr<ChLinkLinActuator>& actuator) {
+    prismatic = chrono_types::make_shared<ChLinkLockPrismatic>();
     prismatic->Initialize(ground, chassis, ChCoordsys<>(chassis->GetPos(), Q_from_AngY(CH_C_PI_2)));
     prismatic->SetName("prismatic_chassis_ground");
     system->AddLink(prismatic);
@@ -318,7 +332,7 @@ void ConnectChassisToGround(ChSystemMulticore* system, std::shared_ptr<ChBody> g
     velocity = angVel * wheelRadius * (1.0 - wheelSlip);
     auto actuator_fun = chrono_types::make_shared<ChFunction_Ramp>(0.0, velocity);
 
-    auto actuator = chrono_types::make_shared<ChLinkLinActuator>();
+    actuator = chrono_types::make_shared<ChLinkLinActuator>();
     actuator->Initialize(ground, chassis, false, ChCoordsys<>(chassis->GetPos(), QUNIT),
                          ChCoordsys<>(chassis->GetPos() + ChVector<>(1, 0, 0), QUNIT));
     actuator->SetName("actuator");
@@ -329,26 +343,34 @@ void ConnectChassisToGround(ChSystemMulticore* system, std::shared_ptr<ChBody> g
 
 // =============================================================================
 // Connect the axle to the chassis through a vertical translational
-// joint.
+// joint. Return a handle to the joint.
 // =============================================================================
 
-void ConnectChassisToAxle(ChSystemMulticore* system, std::shared_ptr<ChBody> chassis, std::shared_ptr<ChBody> axle) {
+std::shared_ptr<ChLinkLockPrismatic> ConnectChassisToAxle(ChSystemMulticore* system,
+                                                          std::shared_ptr<ChBody> chassis,
+                                                          std::shared_ptr<ChBody> axle) {
     auto prismatic = chrono_types::make_shared<ChLinkLockPrismatic>();
     prismatic->Initialize(chassis, axle, ChCoordsys<>(chassis->GetPos(), QUNIT));
     prismatic->SetName("prismatic_axle_chassis");
     system->AddLink(prismatic);
+    return prismatic;
 }
 
 // =============================================================================
-// Connect the wheel to the axle through a engine joint.
+// Connect the wheel to the axle through a engine joint rotating the wheel at
+// the specified angular velocity. Return a handle to the joint.
 // =============================================================================
 
-void ConnectWheelToAxle(ChSystemMulticore* system, std::shared_ptr<ChBody> wheel, std::shared_ptr<ChBody> axle) {
+std::shared_ptr<ChLinkMotorRotationAngle> ConnectWheelToAxle(ChSystemMulticore* system,
+                                                             std::shared_ptr<ChBody> wheel,
+                                                             std::shared_ptr<ChBody> axle,
+                                                             double ang_vel) {
     auto motor = chrono_types::make_shared<ChLinkMotorRotationAngle>();
     motor->SetName("engine_wheel_axle");
     motor->Initialize(wheel, axle, ChFrame<>(wheel->GetPos(), chrono::Q_from_AngAxis(CH_C_PI / 2.0, VECT_X)));
-    motor->SetAngleFunction(chrono_types::make_shared<ChFunction_Ramp>(0, -angVel));
+    motor->SetAngleFunction(chrono_types::make_shared<ChFunction_Ramp>(0, -ang_vel));
     system->AddLink(motor);
+    return motor;
 }
 
 // =============================================================================
@@ -361,33 +383,21 @@ void ConnectWheelToAxle(ChSystemMulticore* system, std::shared_ptr<ChBody> wheel
 // =============================================================================
 
 int CreateGranularMaterial(ChSystemMulticore* system) {
-// -------------------------------------------
-// Create a material for the granular material
-// -------------------------------------------
-
-#ifdef USE_SMC
-    auto mat_g = chrono_types::make_shared<ChMaterialSurfaceSMC>();
-    mat_g->SetYoungModulus(Y_g);
-    mat_g->SetFriction(mu_g);
-#else
-    auto mat_g = chrono_types::make_shared<ChMaterialSurfaceNSC>();
-    mat_g->SetFriction(mu_g);
-#endif
+    // -------------------------------------------
+    // Create a material for the granular material
+    // -------------------------------------------
 
-    // ---------------------------------------------
-    // Create a mixture entirely made out of spheres
-    // ---------------------------------------------
+    auto mat_g = CreateContactMaterial(method, mu_g, Y_g);
 
-    // Create the particle generator with a mixture of 100% spheres
-    utils::Generator gen(system);
+    // ---------------------------------------
+    // Create a generator of identical spheres
+    // ---------------------------------------
 
-    std::shared_ptr<utils::MixtureIngredient> m1 = gen.AddMixtureIngredient(utils::MixtureType::SPHERE, 1.0);
-    m1->setDefaultMaterial(mat_g);
-    m1->setDefaultDensity(rho_g);
-    m1->setDefaultSize(r_g);
+    // Create the particle generator for spheres
+    SphereGenerator gen(system, mat_g, r_g, rho_g);
 
     // Ensure that all generated particle bodies will have positive IDs.
-    gen.setBodyIdentifier(Id_g);
+    gen.SetBodyIdentifier(Id_g);
 
     // ----------------------
     // Generate the particles
@@ -398,12 +408,13 @@ int CreateGranularMaterial(ChSystemMulticore* system) {
     ChVector<> center(0, 0, 2 * r);
 
     while (center.z() < 2 * hdimZ) {
-        gen.createObjectsBox(utils::SamplingType::POISSON_DISK, 2 * r, center, hdims);
+        gen.AddBox(center, hdims, 2 * r);
         center.z() += 2 * r;
     }
+    gen.CreateBodies();
 
     // Return the number of generated particles.
-    return gen.getTotalNumBodies();
+    return gen.GetTotalNumBodies();
 }
 
 // =============================================================================
@@ -414,15 +425,7 @@ void CreateBall(ChSystemMulticore* system) {
     // ------------------------------
     // Create a material for the ball
     // ------------------------------
-
-#ifdef USE_SMC
-    auto mat_g = chrono_types::make_shared<ChMaterialSurfaceSMC>();
-    mat_g->SetYoungModulus(Y_g);
-    mat_g->SetFriction(mu_g);
-#else
-    auto mat_g = chrono_types::make_shared<ChMaterialSurfaceNSC>();
-    mat_g->SetFriction(mu_g);
-#endif
+    auto mat_g = CreateContactMaterial(method, mu_g, Y_g);
 
     // ---------------
     // Create the ball
@@ -444,22 +447,19 @@ void CreateBall(ChSystemMulticore* system) {
 }
 
 // =============================================================================
-// Find the height of the highest and lowest sphere in the granular mix. We only
-// look at bodies with positive identifiers (to exclude all other bodies).
+// Create the bodies of a previous stage from a checkpoint file. Print an error
+// message and return false if the file cannot be read or does not contain the
+// mechanism bodies (ground, wheel, chassis, axle) followed by granular material.
 // =============================================================================
 
-void FindHeightRange(ChSystemMulticore* sys, double& lowest, double& highest) {
-    highest = -1000;
-    lowest = 1000;
-    for (auto body : sys->Get_bodylist()) {
-        if (body->GetIdentifier() <= 0)
-            continue;
-        double h = body->GetPos().z();
-        if (h < lowest)
-            lowest = h;
-        else if (h > highest)
-            highest = h;
+bool ReadStageCheckpoint(ChSystemMulticore* system, const std::string& filename) {
+    cout << "Read checkpoint data from " << filename;
+    if (!ReadCheckpointBinary(system, filename) || system->Get_bodylist().size() <= 4) {
+        cout << endl << "Error: cannot read the bodies of the previous stage from " << filename << endl;
+        return false;
     }
+    cout << "  done.  Read " << system->Get_bodylist().size() << " bodies." << endl;
+    return true;
 }
 
 // =============================================================================
@@ -468,19 +468,15 @@ void FindHeightRange(ChSystemMulticore* sys, double& lowest, double& highest) {
 //
 // =============================================================================
 
-void setBulkDensity(ChSystem* sys, double bulkDensity) {
+void setBulkDensity(ChSystem* sys, GranularAnalysis& granular, double bulkDensity) {
     double vol_g = (4.0 / 3) * CH_C_PI * r_g * r_g * r_g;
 
     double normalPlateHeight = sys->Get_bodylist().at(1)->GetPos().z() - hdimZ;
     double bottomHeight = 0;
     double boxVolume = hdimX * 2 * hdimX * 2 * (normalPlateHeight - bottomHeight);
-    double granularVolume = (sys->Get_bodylist().size() - 3) * vol_g;
+    double granularVolume = granular.GetNumParticles() * vol_g;
     double reqDensity = bulkDensity * boxVolume / granularVolume;
-    for (auto body : sys->Get_bodylist()) {
-        if (body->GetIdentifier() > 1) {
-            body->SetMass(reqDensity * vol_g);
-        }
-    }
+    granular.SetParticleMass(reqDensity * vol_g);
 
     cout << "N Bodies: " << sys->Get_bodylist().size() << endl;
     cout << "Box Volume: " << boxVolume << endl;
@@ -488,9 +484,98 @@ void setBulkDensity(ChSystem* sys, double bulkDensity) {
     cout << "Desired bulk density = " << bulkDensity << ", Required Body Density = " << reqDensity << endl;
 }
 
+// =============================================================================
+// Register all parameters which affect the settled granular bed
+// =============================================================================
+
+void SetSettledCacheParameters(SettledBedCache& cache) {
+    cache.AddParameter("test", std::string("singleWheel"));
+    cache.AddParameter("contact_method", GetContactMethodName(method));
+    if (method == ChContactMethod::NSC) {
+        cache.AddParameter("max_iteration_normal", max_iteration_normal);
+        cache.AddParameter("max_iteration_sliding", max_iteration_sliding);
+        cache.AddParameter("max_iteration_spinning", max_iteration_spinning);
+        cache.AddParameter("contact_recovery_speed", (double)contact_recovery_speed);
+        cache.AddParameter("solver_type", (int)solver_type);
+    }
+    cache.AddParameter("time_step", time_step);
+    cache.AddParameter("tolerance", tolerance);
+    cache.AddParameter("max_iteration_bilateral", max_iteration_bilateral);
+    cache.AddParameter("gravity", gravity);
+    cache.AddParameter("time_settling_min", time_settling_min);
+    cache.AddParameter("time_settling_max", time_settling_max);
+    cache.AddParameter("settling_tol", settling_tol);
+    cache.AddParameter("hdimX", hdimX);
+    cache.AddParameter("hdimY", hdimY);
+    cache.AddParameter("hdimZ", hdimZ);
+    cache.AddParameter("hthick", hthick);
+    cache.AddParameter("wheelRadius", wheelRadius);
+    cache.AddParameter("wheelWidth", wheelWidth);
+    cache.AddParameter("Y_walls", Y_walls);
+    cache.AddParameter("mu_walls", mu_walls);
+    cache.AddParameter("r_g", r_g);
+    cache.AddParameter("rho_g", rho_g);
+    cache.AddParameter("Y_g", Y_g);
+    cache.AddParameter("mu_g", mu_g);
+}
+
+// =============================================================================
+// Register all parameters which can be set at run time
+// =============================================================================
+
+void AddSettings(DEMSettings& settings) {
+    settings.AddEnum("method", method, ContactMethodNames());
+    settings.AddEnum("problem", problem,
+                     {{"SETTLING", SETTLING}, {"PRESSING", PRESSING}, {"ROLLING", ROLLING}, {"TESTING", TESTING}});
+    settings.Add("pipeline", pipeline);
+    settings.Add("threads", threads);
+    settings.Add("time_step", time_step);
+    settings.Add("tolerance", tolerance);
+    settings.Add("max_iteration_normal", max_iteration_normal);
+    settings.Add("max_iteration_sliding", max_iteration_sliding);
+    settings.Add("max_iteration_spinning", max_iteration_spinning);
+    settings.Add("max_iteration_bilateral", max_iteration_bilateral);
+    settings.Add("contact_recovery_speed", contact_recovery_speed);
+    settings.AddEnum("solver_type", solver_type, SolverTypeNames());
+    settings.AddEnum("narrowphase", narrowphase, NarrowPhaseNames());
+    settings.Add("bins_per_axis", bins_per_axis);
+    settings.Add("write_povray_data", write_povray_data);
+}
+
+// =============================================================================
+// Set the output directories for the selected contact method
+// =============================================================================
+
+void SetOutputDirectories() {
+    out_dir = "../SINGLEWHEEL_" + GetContactMethodName(method);
+    pov_dir = out_dir + "/POVRAY";
+    roll_file = out_dir + "/roll.dat";
+    stats_file = out_dir + "/stats.dat";
+    settled_ckpnt_file = out_dir + "/settled.dat";
+    pressed_ckpnt_file = out_dir + "/pressed.dat";
+}
+
 // =============================================================================
 
 int main(int argc, char* argv[]) {
+    // Run-time settings ("--help" lists all settings)
+    DEMSettings settings;
+    AddSettings(settings);
+    if (!settings.Parse(argc, argv))
+        return 1;
+
+    // Defaults which depend on the contact method
+    if (method == ChContactMethod::SMC) {
+        if (!settings.IsSet("time_step"))
+            time_step = 1e-5;
+        if (!settings.IsSet("max_iteration_bilateral"))
+            max_iteration_bilateral = 100;
+        if (!settings.IsSet("narrowphase"))
+            narrowphase = NarrowPhaseType::NARROWPHASE_R;
+    }
+
+    SetOutputDirectories();
+
     // Create output directories.
     if (!filesystem::create_directory(filesystem::path(out_dir))) {
         cout << "Error creating directory " << out_dir << endl;
@@ -501,17 +586,14 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-// -------------
-// Create system
-// -------------
+    // -------------
+    // Create system
+    // -------------
 
-#ifdef USE_SMC
-    cout << "Create SMC system" << endl;
-    ChSystemMulticoreSMC* msystem = new ChSystemMulticoreSMC();
-#else
-    cout << "Create NSC system" << endl;
-    ChSystemMulticoreNSC* msystem = new ChSystemMulticoreNSC();
-#endif
+    ChSystemMulticore* msystem = CreateMulticoreSystem(method);
+
+    // Analysis of the granular material (particle heights)
+    GranularAnalysis granular(msystem, Id_g);
 
     msystem->Set_G_acc(ChVector<>(0, 0, -gravity));
 
@@ -528,35 +610,37 @@ int main(int argc, char* argv[]) {
     msystem->GetSettings()->solver.clamp_bilaterals = clamp_bilaterals;
     msystem->GetSettings()->solver.bilateral_clamp_speed = bilateral_clamp_speed;
 
-#ifdef USE_SMC
-    msystem->GetSettings()->collision.narrowphase_algorithm = NarrowPhaseType::NARROWPHASE_R;
-#else
-    msystem->GetSettings()->solver.solver_mode = SolverMode::SLIDING;
-    msystem->GetSettings()->solver.max_iteration_normal = max_iteration_normal;
-    msystem->GetSettings()->solver.max_iteration_sliding = max_iteration_sliding;
-    msystem->GetSettings()->solver.max_iteration_spinning = max_iteration_spinning;
-    msystem->GetSettings()->solver.alpha = 0;
-    msystem->GetSettings()->solver.contact_recovery_speed = contact_recovery_speed;
-    msystem->SetMaxPenetrationRecoverySpeed(contact_recovery_speed);
-    msystem->ChangeSolverType(SolverType::APGDREF);
-
-    msystem->GetSettings()->collision.collision_envelope = 0.05 * r_g;
-#endif
+    if (method == ChContactMethod::NSC) {
+        msystem->GetSettings()->solver.solver_mode = SolverMode::SLIDING;
+        msystem->GetSettings()->solver.max_iteration_normal = max_iteration_normal;
+        msystem->GetSettings()->solver.max_iteration_sliding = max_iteration_sliding;
+        msystem->GetSettings()->solver.max_iteration_spinning = max_iteration_spinning;
+        msystem->GetSettings()->solver.alpha = 0;
+        msystem->GetSettings()->solver.contact_recovery_speed = contact_recovery_speed;
+        msystem->SetMaxPenetrationRecoverySpeed(contact_recovery_speed);
+        static_cast<ChSystemMulticoreNSC*>(msystem)->ChangeSolverType(solver_type);
+
+        msystem->GetSettings()->collision.collision_envelope = 0.05 * r_g;
+    }
 
-    msystem->GetSettings()->collision.bins_per_axis = vec3(10, 10, 10);
+    msystem->GetSettings()->collision.narrowphase_algorithm = narrowphase;
+    msystem->GetSettings()->collision.bins_per_axis = bins_per_axis;
 
     // --------------
     // Problem set up
     // --------------
 
-    // Depending on problem type:
-    // - Select end simulation time
-    // - Select output FPS
-    // - Create / load objects
+    // Stages to run: the selected problem only or, for a pipeline, all stages from SETTLING up to the
+    // selected problem, with the system handed off from one stage to the next in memory.
+    std::vector<ProblemType> stages;
+    if (pipeline && problem != TESTING) {
+        for (int s = SETTLING; s <= problem; s++)
+            stages.push_back((ProblemType)s);
+    } else {
+        stages.push_back(problem);
+    }
+    const char* stage_names[] = {"SETTLING", "PRESSING", "ROLLING", "TESTING"};
 
-    double time_min = 0;
-    double time_end;
-    int out_fps;
     std::shared_ptr<ChBody> ground;
     std::shared_ptr<ChBody> wheel;
     std::shared_ptr<ChBody> chassis;
@@ -566,355 +650,418 @@ int main(int argc, char* argv[]) {
     std::shared_ptr<ChLinkLinActuator> actuator;
     std::shared_ptr<ChLinkMotorRotationAngle> engine_wheel_axle;
 
-    switch (problem) {
-        case SETTLING: {
-            time_min = time_settling_min;
-            time_end = time_settling_max;
-            out_fps = out_fps_settling;
+    // Settled beds are reused across runs with the same settling parameters
+    SettledBedCache cache(settled_cache_dir);
+    SetSettledCacheParameters(cache);
 
-            // Create the mechanism bodies (all fixed).
-            CreateMechanismBodies(msystem);
+    // Create output files
+    ChStreamOutAsciiFile statsStream(stats_file.c_str());
+    ChStreamOutAsciiFile rollStream(roll_file.c_str());
 
-            // Grab handles to mechanism bodies (must increase ref counts)
-            ground = msystem->Get_bodylist().at(0);
-            wheel = msystem->Get_bodylist().at(1);
-            chassis = msystem->Get_bodylist().at(2);
-            axle = msystem->Get_bodylist().at(3);
+    rollStream.SetNumFormat("%16.4e");
+    statsStream.SetNumFormat("%16.4e");
 
-            // Create granular material.
-            int num_particles = CreateGranularMaterial(msystem);
-            cout << "Granular material:  " << num_particles << " particles" << endl;
+    // Checkpoints are written in the background while the simulation proceeds
+    CheckpointWriter ckpnt_writer;
 
-            break;
-        }
+#ifdef CHRONO_OPENGL
+    opengl::ChOpenGLWindow& gl_window = opengl::ChOpenGLWindow::getInstance();
+    gl_window.Initialize(1280, 720, "Single Wheel Test", msystem);
+    gl_window.SetCamera(ChVector<>(0, -10 * hdimY, hdimZ), ChVector<>(0, 0, hdimZ), ChVector<>(0, 0, 1));
+    gl_window.SetRenderMode(opengl::WIREFRAME);
+#endif
+
+    // Counters over all stages
+    int out_frame = 0;
+    double exec_time = 0;
 
-        case PRESSING: {
-            time_min = time_pressing_min;
-            time_end = time_pressing_max;
-            out_fps = out_fps_pressing;
+    for (ProblemType stage : stages) {
+        problem = stage;
+
+        // Bodies and links are left in place by the previous stage of a pipeline
+        bool in_memory = (stage != stages.front());
+
+        // Each stage starts at time 0 (as when loaded from a checkpoint), since the
+        // actuator and motor functions are defined from the start of their stage.
+        if (in_memory)
+            msystem->SetChTime(0);
+
+        // Depending on problem type:
+        // - Select end simulation time
+        // - Select output FPS
+        // - Create / load objects (or modify the objects of the previous stage)
+
+        double time_min = 0;
+        double time_end;
+        int out_fps;
+
+        switch (problem) {
+            case SETTLING: {
+                if (cache.Contains()) {
+                    cout << "Settled bed found in cache: " << cache.GetFilename() << endl;
+                    if (stages.size() == 1)
+                        return 0;
+
+                    // Continue the pipeline from the cached settled bed.
+                    if (!ReadStageCheckpoint(msystem, cache.GetFilename()))
+                        return 1;
+                    ground = msystem->Get_bodylist().at(0);
+                    wheel = msystem->Get_bodylist().at(1);
+                    chassis = msystem->Get_bodylist().at(2);
+                    axle = msystem->Get_bodylist().at(3);
+                    break;
+                }
 
-            // Create bodies from checkpoint file.
-            cout << "Read checkpoint data from " << settled_ckpnt_file;
-            utils::ReadCheckpoint(msystem, settled_ckpnt_file);
-            cout << "  done.  Read " << msystem->Get_bodylist().size() << " bodies." << endl;
+                time_min = time_settling_min;
+                time_end = time_settling_max;
+                out_fps = out_fps_settling;
 
-            // Grab handles to mechanism bodies (must increase ref counts)
-            ground = msystem->Get_bodylist().at(0);
-            wheel = msystem->Get_bodylist().at(1);
-            chassis = msystem->Get_bodylist().at(2);
-            axle = msystem->Get_bodylist().at(3);
+                // Create the mechanism bodies (all fixed).
+                CreateMechanismBodies(msystem);
 
-            // Move the load plate just above the granular material.
-            double highest, lowest;
-            FindHeightRange(msystem, lowest, highest);
-            ChVector<> pos = wheel->GetPos();
-            double z_new = highest + 1.01 * r_g + wheelRadius;
-            wheel->SetPos(ChVector<>(pos.x(), pos.y(), z_new));
-            chassis->SetPos(wheel->GetPos());
-            axle->SetPos(wheel->GetPos());
+                // Grab handles to mechanism bodies (must increase ref counts)
+                ground = msystem->Get_bodylist().at(0);
+                wheel = msystem->Get_bodylist().at(1);
+                chassis = msystem->Get_bodylist().at(2);
+                axle = msystem->Get_bodylist().at(3);
 
-            // Connect the chassis to the axle.
-            ConnectChassisToAxle(msystem, chassis, axle);
-            prismatic_axle_chassis = std::static_pointer_cast<ChLinkLockPrismatic>(msystem->SearchLink("prismatic_axle_chassis"));
+                // Create granular material.
+                int num_particles = CreateGranularMaterial(msystem);
+                cout << "Granular material:  " << num_particles << " particles" << endl;
 
-            // Release the axle.
-            axle->SetBodyFixed(false);
+                break;
+            }
 
-            // Set axle mass from desired applied normal load
-            axle->SetMass(wheelWeight / gravity);
+            case PRESSING: {
+                time_min = time_pressing_min;
+                time_end = time_pressing_max;
+                out_fps = out_fps_pressing;
+
+                if (!in_memory) {
+                    // Create bodies from the cached settled bed (or the checkpoint file of the last settling run).
+                    std::string settled_file = cache.Contains() ? cache.GetFilename() : settled_ckpnt_file;
+                    if (!ReadStageCheckpoint(msystem, settled_file))
+                        return 1;
+
+                    // Grab handles to mechanism bodies (must increase ref counts)
+                    ground = msystem->Get_bodylist().at(0);
+                    wheel = msystem->Get_bodylist().at(1);
+                    chassis = msystem->Get_bodylist().at(2);
+                    axle = msystem->Get_bodylist().at(3);
+                }
 
-            // Connect the axle to the chassis.
-            angVel = 0.0;  // Don't rotate the wheel in this stage
-            ConnectWheelToAxle(msystem, wheel, axle);
-            engine_wheel_axle = std::static_pointer_cast<ChLinkMotorRotationAngle>(msystem->SearchLink("engine_wheel_axle"));
+                // Move the load plate just above the granular material.
+                double highest, lowest;
+                granular.FindHeightRange(lowest, highest);
+                ChVector<> pos = wheel->GetPos();
+                double z_new = highest + 1.01 * r_g + wheelRadius;
+                wheel->SetPos(ChVector<>(pos.x(), pos.y(), z_new));
+                chassis->SetPos(wheel->GetPos());
+                axle->SetPos(wheel->GetPos());
 
-            // Release the axle.
-            wheel->SetBodyFixed(false);
+                // Connect the chassis to the axle.
+                prismatic_axle_chassis = ConnectChassisToAxle(msystem, chassis, axle);
 
-            break;
-        }
+                // Release the axle.
+                axle->SetBodyFixed(false);
 
-        case ROLLING: {
-            time_end = time_rolling;
-            out_fps = out_fps_rolling;
+                // Set axle mass from desired applied normal load
+                axle->SetMass(wheelWeight / gravity);
 
-            // Create bodies from checkpoint file.
-            cout << "Read checkpoint data from " << pressed_ckpnt_file;
-            utils::ReadCheckpoint(msystem, pressed_ckpnt_file);
-            cout << "  done.  Read " << msystem->Get_bodylist().size() << " bodies." << endl;
+                // Connect the axle to the chassis (don't rotate the wheel in this stage).
+                engine_wheel_axle = ConnectWheelToAxle(msystem, wheel, axle, 0.0);
 
-            // Grab handles to mechanism bodies (must increase ref counts)
-            ground = msystem->Get_bodylist().at(0);
-            wheel = msystem->Get_bodylist().at(1);
-            chassis = msystem->Get_bodylist().at(2);
-            axle = msystem->Get_bodylist().at(3);
+                // Release the axle.
+                wheel->SetBodyFixed(false);
 
-            // Connect the chassis and get a handle to the actuator.
-            ConnectChassisToGround(msystem, ground, chassis);
-            prismatic_chassis_ground = std::static_pointer_cast<ChLinkLockPrismatic>(msystem->SearchLink("prismatic_chassis_ground"));
-            actuator = std::static_pointer_cast<ChLinkLinActuator>(msystem->SearchLink("actuator"));
+                break;
+            }
 
-            // Release the load plate.
-            chassis->SetBodyFixed(false);
+            case ROLLING: {
+                time_end = time_rolling;
+                out_fps = out_fps_rolling;
 
-            // Connect the load plate to the shear box.
-            ConnectChassisToAxle(msystem, chassis, axle);
-            prismatic_axle_chassis = std::static_pointer_cast<ChLinkLockPrismatic>(msystem->SearchLink("prismatic_axle_chassis"));
+                if (!in_memory) {
+                    // Create bodies from checkpoint file.
+                    if (!ReadStageCheckpoint(msystem, pressed_ckpnt_file))
+                        return 1;
 
-            // Release the axle.
-            axle->SetBodyFixed(false);
+                    // Grab handles to mechanism bodies (must increase ref counts)
+                    ground = msystem->Get_bodylist().at(0);
+                    wheel = msystem->Get_bodylist().at(1);
+                    chassis = msystem->Get_bodylist().at(2);
+                    axle = msystem->Get_bodylist().at(3);
+                }
 
-            // Set axle mass from desired applied normal load
-            axle->SetMass(wheelWeight / gravity);
+                // Connect the chassis to the ground through the actuator.
+                ConnectChassisToGround(msystem, ground, chassis, prismatic_chassis_ground, actuator);
 
-            // Connect the axle to the chassis.
-            ConnectWheelToAxle(msystem, wheel, axle);
-            engine_wheel_axle = std::static_pointer_cast<ChLinkMotorRotationAngle>(msystem->SearchLink("engine_wheel_axle"));
+                // Release the load plate.
+                chassis->SetBodyFixed(false);
 
-            // Release the axle.
-            wheel->SetBodyFixed(false);
+                // Connect the load plate to the shear box (unless already connected while pressing).
+                if (!prismatic_axle_chassis)
+                    prismatic_axle_chassis = ConnectChassisToAxle(msystem, chassis, axle);
 
-            // setBulkDensity(msystem, desiredBulkDensity);
+                // Release the axle.
+                axle->SetBodyFixed(false);
 
-            break;
-        }
+                // Set axle mass from desired applied normal load
+                axle->SetMass(wheelWeight / gravity);
 
-        case TESTING: {
-            time_end = time_testing;
-            out_fps = out_fps_testing;
-            angVel = 10 * CH_C_PI;
+                // Connect the axle to the chassis (or start rotating the wheel, if already connected while pressing).
+                if (!engine_wheel_axle)
+                    engine_wheel_axle = ConnectWheelToAxle(msystem, wheel, axle, angVel);
+                else
+                    engine_wheel_axle->SetAngleFunction(chrono_types::make_shared<ChFunction_Ramp>(0, -angVel));
 
-            // Create the mechanism bodies (all fixed).
-            CreateMechanismBodies(msystem);
+                // Release the axle.
+                wheel->SetBodyFixed(false);
 
-            // Create the test ball.
-            CreateBall(msystem);
+                // setBulkDensity(msystem, granular, desiredBulkDensity);
 
-            // Grab handles to mechanism bodies (must increase ref counts)
-            ground = msystem->Get_bodylist().at(0);
-            wheel = msystem->Get_bodylist().at(1);
-            chassis = msystem->Get_bodylist().at(2);
-            axle = msystem->Get_bodylist().at(3);
+                break;
+            }
 
-            // Move the wheel just above the ground.
-            ChVector<> pos = wheel->GetPos();
-            double z_new = wheelRadius;
-            axle->SetPos(ChVector<>(pos.x(), pos.y(), z_new));
-            wheel->SetPos(ChVector<>(pos.x(), pos.y(), z_new));
+            case TESTING: {
+                time_end = time_testing;
+                out_fps = out_fps_testing;
+                angVel = 10 * CH_C_PI;
 
-            // Connect the chassis and get a handle to the actuator.
-            ConnectChassisToGround(msystem, ground, chassis);
-            prismatic_chassis_ground = std::static_pointer_cast<ChLinkLockPrismatic>(msystem->SearchLink("prismatic_chassis_ground"));
-            actuator = std::static_pointer_cast<ChLinkLinActuator>(msystem->SearchLink("actuator"));
+                // Create the mechanism bodies (all fixed).
+                CreateMechanismBodies(msystem);
 
-            chassis->SetBodyFixed(false);
+                // Create the test ball.
+                CreateBall(msystem);
 
-            // Connect the axle to the chassis.
-            ConnectChassisToAxle(msystem, chassis, axle);
-            prismatic_axle_chassis = std::static_pointer_cast<ChLinkLockPrismatic>(msystem->SearchLink("prismatic_axle_chassis"));
+                // Grab handles to mechanism bodies (must increase ref counts)
+                ground = msystem->Get_bodylist().at(0);
+                wheel = msystem->Get_bodylist().at(1);
+                chassis = msystem->Get_bodylist().at(2);
+                axle = msystem->Get_bodylist().at(3);
 
-            // Release the axle.
-            axle->SetBodyFixed(false);
+                // Move the wheel just above the ground.
+                ChVector<> pos = wheel->GetPos();
+                double z_new = wheelRadius;
+                axle->SetPos(ChVector<>(pos.x(), pos.y(), z_new));
+                wheel->SetPos(ChVector<>(pos.x(), pos.y(), z_new));
 
-            // Set axle mass from desired applied normal load
-            axle->SetMass(wheelWeight / gravity);
+                // Connect the chassis to the ground through the actuator.
+                ConnectChassisToGround(msystem, ground, chassis, prismatic_chassis_ground, actuator);
 
-            // Connect the axle to the chassis.
-            ConnectWheelToAxle(msystem, wheel, axle);
-            engine_wheel_axle = std::static_pointer_cast<ChLinkMotorRotationAngle>(msystem->SearchLink("engine_wheel_axle"));
+                chassis->SetBodyFixed(false);
 
-            // Release the axle.
-            wheel->SetBodyFixed(false);
+                // Connect the axle to the chassis.
+                prismatic_axle_chassis = ConnectChassisToAxle(msystem, chassis, axle);
 
-            break;
-        }
-    }
+                // Release the axle.
+                axle->SetBodyFixed(false);
 
-    // ----------------------
-    // Perform the simulation
-    // ----------------------
+                // Set axle mass from desired applied normal load
+                axle->SetMass(wheelWeight / gravity);
 
-    // Set number of simulation steps and steps between successive output
-    int num_steps = (int)std::ceil(time_end / time_step);
-    int out_steps = (int)std::ceil((1.0 / time_step) / out_fps);
-    int write_steps = (int)std::ceil((1.0 / time_step) / write_fps);
+                // Connect the axle to the chassis.
+                engine_wheel_axle = ConnectWheelToAxle(msystem, wheel, axle, angVel);
 
-    // Initialize counters
-    double time = 0;
-    int sim_frame = 0;
-    int out_frame = 0;
-    int next_out_frame = 0;
-    double exec_time = 0;
-    int num_contacts = 0;
-    double max_cnstr_viol[3] = {0, 0, 0};
+                // Release the axle.
+                wheel->SetBodyFixed(false);
 
-    // Circular buffer with highest particle location
-    // (only used for SETTLING or PRESSING)
-    int buffer_size = (int)std::ceil(time_min / time_step);
-    std::valarray<double> hdata(0.0, buffer_size);
+                break;
+            }
+        }
 
-    // Create output files
-    ChStreamOutAsciiFile statsStream(stats_file.c_str());
-    ChStreamOutAsciiFile rollStream(roll_file.c_str());
+        // Nothing to simulate if the settled bed was loaded from the cache
+        if (problem == SETTLING && cache.Contains())
+            continue;
 
-    rollStream.SetNumFormat("%16.4e");
-    statsStream.SetNumFormat("%16.4e");
+        if (stages.size() > 1) {
+            cout << "==================================" << endl;
+            cout << "Stage " << stage_names[problem] << endl;
+        }
 
-#ifdef CHRONO_OPENGL
-    opengl::ChOpenGLWindow& gl_window = opengl::ChOpenGLWindow::getInstance();
-    gl_window.Initialize(1280, 720, "Single Wheel Test", msystem);
-    gl_window.SetCamera(ChVector<>(0, -10 * hdimY, hdimZ), ChVector<>(0, 0, hdimZ), ChVector<>(0, 0, 1));
-    gl_window.SetRenderMode(opengl::WIREFRAME);
-#endif
+        // ----------------------
+        // Perform the simulation
+        // ----------------------
+
+        // Set number of simulation steps and steps between successive output
+        int out_steps = (int)std::ceil((1.0 / time_step) / out_fps);
+        int write_steps = (int)std::ceil((1.0 / time_step) / write_fps);
+
+        // Initialize counters
+        double time = 0;
+        int sim_frame = 0;
+        int next_out_frame = 0;
+        int num_contacts = 0;
+
+        // Monitor the variation of the highest particle location, sampled every
+        // settling_check_steps steps over the last time_min seconds
+        // (only used for SETTLING or PRESSING)
+        int settling_check_steps = 10;
+        SettlingMonitor monitor(settling_check_steps);
+        monitor.SetFirstBody(4);  // skip the mechanism bodies (ground, wheel, chassis, axle)
+        monitor.SetMinTime(time_min);
+        monitor.SetHeightVariation(settling_tol * r_g, (int)std::ceil(time_min / (settling_check_steps * time_step)));
+
+        // Loop until reaching the end time...
+        while (time < time_end) {
+            // Current position and velocity of the wheel
+            ChVector<> pos_old = wheel->GetPos();
+            ChVector<> vel_old = wheel->GetPos_dt();
+
+            // Calculate minimum and maximum particle heights
+            double highest, lowest;
+            granular.FindHeightRange(lowest, highest);
+
+            // If at an output frame, write PovRay file and print info
+            if (sim_frame == next_out_frame) {
+                cout << "------------ Output frame:     " << out_frame + 1 << endl;
+                cout << "             Sim frame:        " << sim_frame << endl;
+                cout << "             Time:             " << time << endl;
+                cout << "             Wheel pos:        " << pos_old.x() << endl;
+                cout << "                   vel:        " << vel_old.x() << endl;
+                cout << "             Particle lowest:  " << lowest << endl;
+                cout << "                      highest: " << highest << endl;
+                cout << "             Execution time:   " << exec_time << endl;
+
+                // Save PovRay post-processing data.
+                if (write_povray_data) {
+                    char filename[100];
+                    sprintf(filename, "%s/data_%03d.dat", pov_dir.c_str(), out_frame + 1);
+                    utils::WriteShapesPovray(msystem, filename, false);
+                }
 
-    // Loop until reaching the end time...
-    while (time < time_end) {
-        // Current position and velocity of the wheel
-        ChVector<> pos_old = wheel->GetPos();
-        ChVector<> vel_old = wheel->GetPos_dt();
-
-        // Calculate minimum and maximum particle heights
-        double highest, lowest;
-        FindHeightRange(msystem, lowest, highest);
-
-        // If at an output frame, write PovRay file and print info
-        if (sim_frame == next_out_frame) {
-            cout << "------------ Output frame:     " << out_frame + 1 << endl;
-            cout << "             Sim frame:        " << sim_frame << endl;
-            cout << "             Time:             " << time << endl;
-            cout << "             Wheel pos:        " << pos_old.x() << endl;
-            cout << "                   vel:        " << vel_old.x() << endl;
-            cout << "             Particle lowest:  " << lowest << endl;
-            cout << "                      highest: " << highest << endl;
-            cout << "             Execution time:   " << exec_time << endl;
-
-            // Save PovRay post-processing data.
-            if (write_povray_data) {
-                char filename[100];
-                sprintf(filename, "%s/data_%03d.dat", pov_dir.c_str(), out_frame + 1);
-                utils::WriteShapesPovray(msystem, filename, false);
-            }
+                // Create a checkpoint from the current state (written in the background).
+                if (problem == SETTLING || problem == PRESSING) {
+                    cout << "             Write checkpoint data " << flush;
+                    if (problem == SETTLING)
+                        ckpnt_writer.Write(msystem, settled_ckpnt_file);
+                    else
+                        ckpnt_writer.Write(msystem, pressed_ckpnt_file);
+                    cout << msystem->Get_bodylist().size() << " bodies" << endl;
+                }
 
-            // Create a checkpoint from the current state.
-            if (problem == SETTLING || problem == PRESSING) {
-                cout << "             Write checkpoint data " << flush;
-                if (problem == SETTLING)
-                    utils::WriteCheckpoint(msystem, settled_ckpnt_file);
-                else
-                    utils::WriteCheckpoint(msystem, pressed_ckpnt_file);
-                cout << msystem->Get_bodylist().size() << " bodies" << endl;
+                // Increment counters
+                out_frame++;
+                next_out_frame += out_steps;
             }
 
-            // Increment counters
-            out_frame++;
-            next_out_frame += out_steps;
-        }
-
-        // Check for early termination of a settling phase.
-        if (problem == SETTLING || problem == PRESSING) {
-            // Store maximum particle height in circular buffer
-            hdata[sim_frame % buffer_size] = highest;
-
-            // Check variance of data in circular buffer
-            if (time > time_min) {
-                double mean_height = hdata.sum() / buffer_size;
-                std::valarray<double> x = hdata - mean_height;
-                double var = std::sqrt((x * x).sum() / buffer_size);
-
-                // Consider the material settled when the variance is below the
-                // specified fraction of a particle radius
-                if (var < settling_tol * r_g) {
+            // Check for early termination of a settling phase.
+            if (problem == SETTLING || problem == PRESSING) {
+                // Consider the material settled when the variation of the highest
+                // particle location is below the specified fraction of a particle radius
+                if (monitor.Update(msystem)) {
                     cout << "Granular material settled...  time = " << time << endl;
                     break;
                 }
             }
-        }
 
 // Advance simulation by one step
 #ifdef CHRONO_OPENGL
-        if (gl_window.Active()) {
-            gl_window.DoStepDynamics(time_step);
-            gl_window.Render();
-        } else
-            break;
+            if (gl_window.Active()) {
+                gl_window.DoStepDynamics(time_step);
+                gl_window.Render();
+            } else
+                break;
 #else
-        msystem->DoStepDynamics(time_step);
+            msystem->DoStepDynamics(time_step);
 #endif
 
-        // Record stats about the simulation
-        if (sim_frame % write_steps == 0) {
-            // write stat info
-            size_t numIters = msystem->data_manager->measures.solver.maxd_hist.size();
-            double residual = 0;
-            if (numIters != 0)
-                residual = msystem->data_manager->measures.solver.residual;
-            statsStream << time << ", " << exec_time << ", " << num_contacts / write_steps << ", " << numIters << ", "
-                        << residual << ", \n";
-            statsStream.GetFstream().flush();
-
-            num_contacts = 0;
-        }
+            // Record stats about the simulation
+            if (sim_frame % write_steps == 0) {
+                // write stat info
+                size_t numIters = msystem->data_manager->measures.solver.maxd_hist.size();
+                double residual = 0;
+                if (numIters != 0)
+                    residual = msystem->data_manager->measures.solver.residual;
+                statsStream << time << ", " << exec_time << ", " << num_contacts / write_steps << ", " << numIters
+                            << ", " << residual << ", \n";
+                statsStream.GetFstream().flush();
+
+                num_contacts = 0;
+            }
 
-        if (problem == ROLLING || problem == TESTING) {
-            // Get the current reaction force or impose shear box position
-            ChVector<> rforce_chassis(0, 0, 0);
-            ChVector<> rtorque_chassis(0, 0, 0);
+            if (problem == ROLLING || problem == TESTING) {
+                // Get the current reaction force or impose shear box position
+                ChVector<> rforce_chassis(0, 0, 0);
+                ChVector<> rtorque_chassis(0, 0, 0);
 
-            ChVector<> rforce_actuator(0, 0, 0);
-            ChVector<> rtorque_actuator(0, 0, 0);
+                ChVector<> rforce_actuator(0, 0, 0);
+                ChVector<> rtorque_actuator(0, 0, 0);
 
-            ChVector<> rforce_wheel(0, 0, 0);
-            ChVector<> rtorque_wheel(0, 0, 0);
+                ChVector<> rforce_wheel(0, 0, 0);
+                ChVector<> rtorque_wheel(0, 0, 0);
 
-            rforce_chassis = prismatic_chassis_ground->Get_react_force();
-            rtorque_chassis = prismatic_chassis_ground->Get_react_torque();
+                rforce_chassis = prismatic_chassis_ground->Get_react_force();
+                rtorque_chassis = prismatic_chassis_ground->Get_react_torque();
 
-            rforce_actuator = actuator->Get_react_force();
-            rtorque_actuator = actuator->Get_react_torque();
+                rforce_actuator = actuator->Get_react_force();
+                rtorque_actuator = actuator->Get_react_torque();
 
-            rforce_wheel = engine_wheel_axle->Get_react_force();
-            rtorque_wheel = engine_wheel_axle->Get_react_torque();
+                rforce_wheel = engine_wheel_axle->Get_react_force();
+                rtorque_wheel = engine_wheel_axle->Get_react_torque();
 
-            if (sim_frame % write_steps == 0) {
-                ////cout << "X pos: " << xpos_new << " X react: " << cnstr_force << endl;
-                rollStream << time << ", " << wheel->GetPos().z() << ", ";
+                if (sim_frame % write_steps == 0) {
+                    ////cout << "X pos: " << xpos_new << " X react: " << cnstr_force << endl;
+                    rollStream << time << ", " << wheel->GetPos().z() << ", ";
 
-                rollStream << rforce_chassis.x() << ", " << rforce_chassis.y() << ", " << rforce_chassis.z() << ", ";
-                rollStream << rforce_actuator.x() << ", " << rforce_actuator.y() << ", " << rforce_actuator.z() << ", ";
-                rollStream << rforce_wheel.x() << ", " << rforce_wheel.y() << ", " << rforce_wheel.z() << ", ";
+                    rollStream << rforce_chassis.x() << ", " << rforce_chassis.y() << ", " << rforce_chassis.z()
+                               << ", ";
+                    rollStream << rforce_actuator.x() << ", " << rforce_actuator.y() << ", " << rforce_actuator.z()
+                               << ", ";
+                    rollStream << rforce_wheel.x() << ", " << rforce_wheel.y() << ", " << rforce_wheel.z() << ", ";
 
-                rollStream << rtorque_chassis.x() << ", " << rtorque_chassis.y() << ", " << rtorque_chassis.z() << ", ";
-                rollStream << rtorque_actuator.x() << ", " << rtorque_actuator.y() << ", " << rtorque_actuator.z() << ", ";
-                rollStream << rtorque_wheel.x() << ", " << rtorque_wheel.y() << ", " << rtorque_wheel.z() << ", \n";
+                    rollStream << rtorque_chassis.x() << ", " << rtorque_chassis.y() << ", " << rtorque_chassis.z()
+                               << ", ";
+                    rollStream << rtorque_actuator.x() << ", " << rtorque_actuator.y() << ", "
+                               << rtorque_actuator.z() << ", ";
+                    rollStream << rtorque_wheel.x() << ", " << rtorque_wheel.y() << ", " << rtorque_wheel.z()
+                               << ", \n";
 
-                rollStream.GetFstream().flush();
+                    rollStream.GetFstream().flush();
+                }
             }
+
+            // Increment counters
+            time += time_step;
+            sim_frame++;
+            exec_time += msystem->GetTimerStep();
+            num_contacts += msystem->GetNcontacts();
+
+            // If requested, output detailed timing information for this step
+            if (sim_frame == timing_frame)
+                msystem->PrintStepStats();
         }
 
-        // Increment counters
-        time += time_step;
-        sim_frame++;
-        exec_time += msystem->GetTimerStep();
-        num_contacts += msystem->GetNcontacts();
+#ifdef CHRONO_OPENGL
+        // Do not start the next stage if the visualization window was closed
+        if (!gl_window.Active())
+            break;
+#endif
+
+        // Create a checkpoint from the last state
+        if (problem == SETTLING || problem == PRESSING) {
+            cout << "             Write checkpoint data " << flush;
+            if (problem == SETTLING)
+                ckpnt_writer.Write(msystem, settled_ckpnt_file);
+            else
+                ckpnt_writer.Write(msystem, pressed_ckpnt_file);
+            cout << msystem->Get_bodylist().size() << " bodies" << endl;
+        }
 
-        // If requested, output detailed timing information for this step
-        if (sim_frame == timing_frame)
-            msystem->PrintStepStats();
+        // Add the settled bed to the cache
+        if (problem == SETTLING) {
+            if (cache.Store(msystem))
+                cout << "Settled bed cached in " << cache.GetFilename() << endl;
+        }
     }
 
     // ----------------
     // Final processing
     // ----------------
 
-    // Create a checkpoint from the last state
-    if (problem == SETTLING || problem == PRESSING) {
-        cout << "             Write checkpoint data " << flush;
-        if (problem == SETTLING)
-            utils::WriteCheckpoint(msystem, settled_ckpnt_file);
-        else
-            utils::WriteCheckpoint(msystem, pressed_ckpnt_file);
-        cout << msystem->Get_bodylist().size() << " bodies" << endl;
-    }
+    // Wait for pending checkpoints
+    if (ckpnt_writer.Flush() > 0)
+        cout << "Error writing checkpoint data" << endl;
 
     // Final stats
     cout << "==================================" << endl;
@@ -0,0 +1,187 @@
+#ifndef DEMOS_GRANULAR_H
+#define DEMOS_GRANULAR_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "chrono_multicore/physics/ChSystemMulticore.h"
+
+// =============================================================================
+// Analysis of the granular material in a Chrono::Multicore system.
+//
+// The granular bodies are selected by identifier range (by default, all bodies
+// with strictly positive identifiers). Their indices in the Chrono::Multicore
+// data arrays are collected once and refreshed only when the number of bodies
+// changes; all queries are parallel reductions over the body positions in
+// data_manager->host_data.pos_rigid.
+//
+// Chrono::Multicore fills the data arrays during a step. Before the first step
+// (e.g. right after reading a checkpoint), positions are read from the bodies.
+//
+//   GranularAnalysis granular(sys);
+//   double lowest, highest;
+//   granular.FindHeightRange(lowest, highest);
+
+class GranularAnalysis {
+  public:
+    GranularAnalysis(chrono::ChSystemMulticore* sys, int min_id = 1, int max_id = std::numeric_limits<int>::max())
+        : m_sys(sys),
+          m_min_id(min_id),
+          m_max_id(max_id),
+          m_region(false),
+          m_hdimX(0),
+          m_hdimY(0),
+          m_num_bodies(-1) {}
+
+    /// Only consider bodies with identifier in [min_id, max_id].
+    void SetIdentifierRange(int min_id, int max_id) {
+        m_min_id = min_id;
+        m_max_id = max_id;
+        m_num_bodies = -1;
+    }
+
+    /// Only consider bodies with |x| <= hdimX and |y| <= hdimY.
+    void SetRegion(double hdimX, double hdimY) {
+        m_region = true;
+        m_hdimX = hdimX;
+        m_hdimY = hdimY;
+    }
+
+    /// Consider bodies anywhere in the horizontal plane (default).
+    void ClearRegion() { m_region = false; }
+
+    /// Return the number of bodies in the identifier range.
+    int GetNumParticles() {
+        Refresh();
+        return (int)m_indices.size();
+    }
+
+    /// Find the heights of the lowest and highest body (0 if there are none).
+    void FindHeightRange(double& lowest, double& highest) {
+        Reduction r = Reduce(0);
+        lowest = r.count ? r.min_h : 0;
+        highest = r.count ? r.max_h : 0;
+    }
+
+    /// Find the height of the highest body (0 if there are none).
+    double FindHighest() {
+        Reduction r = Reduce(0);
+        return r.count ? r.max_h : 0;
+    }
+
+    /// Find the height of the lowest body (0 if there are none).
+    double FindLowest() {
+        Reduction r = Reduce(0);
+        return r.count ? r.min_h : 0;
+    }
+
+    /// Find the mean height of the bodies (0 if there are none).
+    double FindMeanHeight() {
+        Reduction r = Reduce(0);
+        return r.count ? r.sum_h / r.count : 0;
+    }
+
+    /// Return the number of bodies with height below the specified value.
+    int GetNumParticlesBelowHeight(double value) { return Reduce(value).below; }
+
+    /// Return the number of bodies with height above the specified value.
+    int GetNumParticlesAboveHeight(double value) { return Reduce(value).above; }
+
+    /// Set the mass of all bodies in the identifier range.
+    void SetParticleMass(double mass) {
+        Refresh();
+        const auto& bodies = m_sys->Get_bodylist();
+        int num = (int)m_indices.size();
+#pragma omp parallel for
+        for (int k = 0; k < num; k++)
+            bodies[m_indices[k]]->SetMass(mass);
+    }
+
+  private:
+    struct Reduction {
+        int count;
+        int below;
+        int above;
+        double min_h;
+        double max_h;
+        double sum_h;
+    };
+
+    // Collect the data array indices of all bodies in the identifier range.
+    void Refresh() {
+        int num_bodies = (int)m_sys->data_manager->num_rigid_bodies;
+        if (num_bodies == m_num_bodies)
+            return;
+        const auto& bodies = m_sys->Get_bodylist();
+        m_indices.clear();
+        for (int i = 0; i < num_bodies; i++) {
+            int id = bodies[i]->GetIdentifier();
+            if (id >= m_min_id && id <= m_max_id)
+                m_indices.push_back(i);
+        }
+        m_num_bodies = num_bodies;
+    }
+
+    // Single parallel pass computing all height statistics (counts relative to 'value').
+    Reduction Reduce(double value) {
+        Refresh();
+        const auto& pos = m_sys->data_manager->host_data.pos_rigid;
+        const auto& bodies = m_sys->Get_bodylist();
+        bool from_bodies = (m_sys->GetChTime() == 0);
+        int num = (int)m_indices.size();
+
+        Reduction r = {0, 0, 0, std::numeric_limits<double>::max(), -std::numeric_limits<double>::max(), 0};
+
+#pragma omp parallel
+        {
+            Reduction t = {0, 0, 0, std::numeric_limits<double>::max(), -std::numeric_limits<double>::max(), 0};
+#pragma omp for nowait
+            for (int k = 0; k < num; k++) {
+                int i = m_indices[k];
+                double x, y, z;
+                if (from_bodies) {
+                    const chrono::ChVector<>& p = bodies[i]->GetPos();
+                    x = p.x();
+                    y = p.y();
+                    z = p.z();
+                } else {
+                    x = pos[i].x;
+                    y = pos[i].y;
+                    z = pos[i].z;
+                }
+                if (m_region && (std::abs(x) > m_hdimX || std::abs(y) > m_hdimY))
+                    continue;
+                t.count++;
+                t.below += (z < value);
+                t.above += (z > value);
+                t.min_h = std::min(t.min_h, z);
+                t.max_h = std::max(t.max_h, z);
+                t.sum_h += z;
+            }
+#pragma omp critical
+            {
+                r.count += t.count;
+                r.below += t.below;
+                r.above += t.above;
+                r.min_h = std::min(r.min_h, t.min_h);
+                r.max_h = std::max(r.max_h, t.max_h);
+                r.sum_h += t.sum_h;
+            }
+        }
+
+        return r;
+    }
+
+    chrono::ChSystemMulticore* m_sys;  ///< associated system
+    int m_min_id;                      ///< smallest identifier of a granular body
+    int m_max_id;                      ///< largest identifier of a granular body
+    bool m_region;                     ///< restrict to a horizontal region?
+    double m_hdimX;                    ///< half-length of the region in x
+    double m_hdimY;                    ///< half-length of the region in y
+    int m_num_bodies;                  ///< number of bodies when the indices were collected
+    std::vector<int> m_indices;        ///< data array indices of the granular bodies
+};
+
+#endif
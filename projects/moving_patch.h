@@ -0,0 +1,240 @@
+#ifndef DEMOS_MOVING_PATCH_H
+#define DEMOS_MOVING_PATCH_H
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "chrono/physics/ChBody.h"
+#include "chrono_multicore/physics/ChSystemMulticore.h"
+
+#include "shape_manager.h"
+
+// =============================================================================
+// Conveyor-style granular terrain of fixed size following a vehicle.
+//
+// The granular bed lies in a container bounded in x by a rear and a front
+// wall. When the tracked body (e.g. a vehicle chassis) is more than the
+// specified distance ahead of the rear wall, the terrain moves forward by one
+// stride:
+// - the particles behind the new position of the rear wall are taken out of
+//   the simulation (released to a ShapeManager free list);
+// - the next tile of the tile library is inserted ahead of the front wall,
+//   reusing the released particles;
+// - the container body (carrying the walls and the bottom) moves forward.
+// The number of particles therefore stays constant, and the cost of the
+// simulation does not depend on the distance traveled.
+//
+// A tile is a set of settled particle positions, with x relative to the tile
+// origin in [0, L] (L is the tile length) and absolute y and z. Tiles must have
+// been settled against a front wall at x = L, so that the front face of a tile
+// is flat, while its rear face may be rough. A tile is inserted at one particle
+// radius ahead of the front wall, which then moves forward by the stride
+// L + radius; neighboring tiles never overlap. CaptureTile builds the library
+// from the front strip of the settled bed and its mirror image in y.
+//
+// Tile positions are filled bottom-up; if there are not enough released
+// particles (the rear strip contained fewer particles than the tile), the top
+// positions are left empty. Surplus particles stay parked, out of the
+// simulation, below the bed.
+//
+// Granular particles are selected by identifier range (by default, all bodies
+// with strictly positive identifiers). Recycled particles are teleported, so
+// a MovingPatch cannot be combined with an ActiveWindow.
+//
+//   MovingPatch patch(sys, Id_g);
+//   patch.SetContainer(ground, -hdimX, hdimX);
+//   patch.SetTrackedBody(vehicle->GetChassisBody());
+//   patch.SetRadius(r_g);
+//   patch.SetTileLength(0.5);
+//   patch.SetDistanceBehind(3.0);
+//   ...                           // settle the bed (e.g. until SettlingMonitor reports it settled)
+//   patch.CaptureTile();
+//   while (...) {
+//       patch.Update();
+//       sys->DoStepDynamics(time_step);
+//   }
+
+class MovingPatch {
+  public:
+    MovingPatch(chrono::ChSystemMulticore* sys, int min_id = 1, int max_id = std::numeric_limits<int>::max())
+        : m_sys(sys),
+          m_shapes(sys),
+          m_min_id(min_id),
+          m_max_id(max_id),
+          m_rear(0),
+          m_front(0),
+          m_radius(0),
+          m_tile_length(0.5),
+          m_behind(1),
+          m_park_height(-1),
+          m_next_tile(0),
+          m_num_moves(0),
+          m_num_recycled(0),
+          m_num_missing(0) {}
+
+    /// Set the container body, moved with the terrain, and the current x positions of its rear and front walls.
+    void SetContainer(std::shared_ptr<chrono::ChBody> container, double rear, double front) {
+        m_container = container;
+        m_rear = rear;
+        m_front = front;
+    }
+
+    /// Set the body followed by the terrain.
+    void SetTrackedBody(std::shared_ptr<chrono::ChBody> body) { m_tracked = body; }
+
+    /// Set the radius of the granular particles.
+    void SetRadius(double radius) { m_radius = radius; }
+
+    /// Set the length of the tiles captured by CaptureTile (default: 0.5).
+    void SetTileLength(double length) { m_tile_length = length; }
+
+    /// Set the length of terrain kept behind the tracked body (default: 1).
+    void SetDistanceBehind(double distance) { m_behind = distance; }
+
+    /// Set the height at which released particles are parked (default: -1).
+    void SetParkingHeight(double height) { m_park_height = height; }
+
+    /// Add a tile to the library (positions relative to the tile origin in x; see above).
+    void AddTile(const std::vector<chrono::ChVector<>>& positions) {
+        m_tiles.push_back(positions);
+        auto& tile = m_tiles.back();
+        std::sort(tile.begin(), tile.end(),
+                  [](const chrono::ChVector<>& a, const chrono::ChVector<>& b) { return a.z() < b.z(); });
+    }
+
+    /// Add the front strip of the current (settled) bed, of the tile length, and its mirror image in y
+    /// to the tile library. Return the number of particles in the tile.
+    /// Call only once the bed settled; tiles captured from a moving bed are not consistent with their neighbors.
+    int CaptureTile() {
+        double x0 = m_front - m_tile_length;
+        double ymin = std::numeric_limits<double>::max();
+        double ymax = -std::numeric_limits<double>::max();
+        std::vector<chrono::ChVector<>> tile;
+        for (const auto& body : m_sys->Get_bodylist()) {
+            if (!IsParticle(body.get()))
+                continue;
+            const chrono::ChVector<>& p = body->GetPos();
+            if (p.x() < x0)
+                continue;
+            tile.push_back(chrono::ChVector<>(p.x() - x0, p.y(), p.z()));
+            ymin = std::min(ymin, p.y());
+            ymax = std::max(ymax, p.y());
+        }
+
+        std::vector<chrono::ChVector<>> mirror(tile);
+        for (auto& p : mirror)
+            p.y() = ymin + ymax - p.y();
+
+        AddTile(tile);
+        AddTile(mirror);
+
+        return (int)tile.size();
+    }
+
+    /// Move the terrain forward as long as the tracked body is too far ahead of the rear wall.
+    /// Return true if the terrain moved.
+    bool Update() {
+        if (!m_tracked || m_tiles.empty())
+            return false;
+
+        bool moved = false;
+        while (m_tracked->GetPos().x() - m_rear > m_behind + GetStride()) {
+            Move();
+            moved = true;
+        }
+        return moved;
+    }
+
+    /// Return the distance the terrain moves at each step (tile length plus one particle radius).
+    double GetStride() const { return m_tile_length + m_radius; }
+
+    /// Return the current x position of the rear wall.
+    double GetRear() const { return m_rear; }
+
+    /// Return the current x position of the front wall.
+    double GetFront() const { return m_front; }
+
+    /// Return the number of times the terrain moved.
+    int GetNumMoves() const { return m_num_moves; }
+
+    /// Return the total number of particles moved from behind the vehicle to ahead of it.
+    int GetNumRecycled() const { return m_num_recycled; }
+
+    /// Return the number of parked particles (out of the simulation).
+    int GetNumParked() const { return m_shapes.GetNumFreeBodies(); }
+
+    /// Return the total number of tile positions left empty for lack of parked particles.
+    int GetNumMissing() const { return m_num_missing; }
+
+  private:
+    bool IsParticle(chrono::ChBody* body) const {
+        int id = body->GetIdentifier();
+        return id >= m_min_id && id <= m_max_id && !body->GetBodyFixed();
+    }
+
+    // Move the terrain forward by one stride.
+    void Move() {
+        double stride = GetStride();
+        double rear = m_rear + stride;
+
+        // Release the particles behind the new rear wall
+        int num_released = 0;
+        for (const auto& body : m_sys->Get_bodylist()) {
+            if (!IsParticle(body.get()))
+                continue;
+            const chrono::ChVector<>& p = body->GetPos();
+            if (p.x() >= rear + m_radius)
+                continue;
+            m_shapes.ReleaseBody(body);
+            body->SetPos(chrono::ChVector<>(p.x(), p.y(), m_park_height));
+            num_released++;
+        }
+
+        // Insert the next tile ahead of the front wall
+        const auto& tile = m_tiles[m_next_tile];
+        m_next_tile = (m_next_tile + 1) % m_tiles.size();
+        double origin = m_front + m_radius;
+        int num_inserted = 0;
+        for (const auto& p : tile) {
+            auto body = m_shapes.AcquireBody();
+            if (!body)
+                break;
+            body->SetPos(chrono::ChVector<>(origin + p.x(), p.y(), p.z()));
+            body->SetRot(chrono::QUNIT);
+            num_inserted++;
+        }
+        m_num_missing += (int)tile.size() - num_inserted;
+        m_num_recycled += std::min(num_released, num_inserted);
+
+        // Move the container walls and bottom
+        if (m_container)
+            m_container->SetPos(m_container->GetPos() + chrono::ChVector<>(stride, 0, 0));
+
+        m_rear = rear;
+        m_front += stride;
+        m_num_moves++;
+    }
+
+    chrono::ChSystemMulticore* m_sys;  ///< associated system
+    ShapeManager m_shapes;             ///< free list of released particles
+    int m_min_id;                      ///< smallest identifier of a granular particle
+    int m_max_id;                      ///< largest identifier of a granular particle
+    double m_rear;                     ///< x position of the rear wall
+    double m_front;                    ///< x position of the front wall
+    double m_radius;                   ///< particle radius
+    double m_tile_length;              ///< length of captured tiles
+    double m_behind;                   ///< length of terrain kept behind the tracked body
+    double m_park_height;              ///< height of parked particles
+    size_t m_next_tile;                ///< index of the next tile to insert
+    int m_num_moves;                   ///< number of terrain moves
+    int m_num_recycled;                ///< number of recycled particles
+    int m_num_missing;                 ///< number of tile positions left empty
+
+    std::shared_ptr<chrono::ChBody> m_container;           ///< container body (walls and bottom)
+    std::shared_ptr<chrono::ChBody> m_tracked;             ///< body followed by the terrain
+    std::vector<std::vector<chrono::ChVector<>>> m_tiles;  ///< tile library (sorted by height)
+};
+
+#endif
@@ -44,6 +44,8 @@
 #include "chrono_opengl/ChOpenGLWindow.h"
 #endif
 
+#include "../checkpoint.h"
+
 using namespace chrono;
 using namespace chrono::collision;
 
@@ -472,7 +474,7 @@ int main(int argc, char* argv[]) {
 
             // Create the granular material and the container from the checkpoint file.
             cout << "Read checkpoint data from " << checkpoint_file;
-            utils::ReadCheckpoint(msystem, checkpoint_file);
+            ReadCheckpointBinary(msystem, checkpoint_file);
             cout << "  done.  Read " << msystem->Get_bodylist().size() << " bodies." << endl;
 
             // Create the mechanism with the wheel just above the granular material.
@@ -545,7 +547,7 @@ int main(int argc, char* argv[]) {
             // Create a checkpoint from the current state.
             if (problem == SETTLING) {
                 cout << "             Write checkpoint data " << flush;
-                utils::WriteCheckpoint(msystem, checkpoint_file);
+                WriteCheckpointBinary(msystem, checkpoint_file);
                 cout << msystem->Get_bodylist().size() << " bodies" << endl;
             }
 
@@ -581,7 +583,7 @@ int main(int argc, char* argv[]) {
     // Create a checkpoint from the last state
     if (problem == SETTLING) {
         cout << "Write checkpoint data to " << checkpoint_file;
-        utils::WriteCheckpoint(msystem, checkpoint_file);
+        WriteCheckpointBinary(msystem, checkpoint_file);
         cout << "  done.  Wrote " << msystem->Get_bodylist().size() << " bodies." << endl;
     }
 
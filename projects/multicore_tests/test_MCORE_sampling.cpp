@@ -0,0 +1,219 @@
+// =============================================================================
+// PROJECT CHRONO - http://projectchrono.org
+//
+// Copyright (c) 2014 projectchrono.org
+// All right reserved.
+//
+// Use of this source code is governed by a BSD-style license that can be found
+// in the LICENSE file at the top level of the distribution and at
+// http://projectchrono.org/license-chrono.txt.
+//
+// =============================================================================
+//
+// Benchmark of Poisson-disk samplers for large granular domains.
+//
+// Compares the Chrono Poisson-disk sampler (utils::PDSampler) with the serial
+// and tiled parallel versions of PoissonDiskSampler on a box and a Z cylinder
+// sized for 1e5, 1e6, and 1e7 points. For each run, reports the number of
+// points, the sampling throughput, the minimum distance between points, and
+// the number of point pairs closer than the requested separation.
+//
+// Usage: test_MCORE_sampling [num_threads [max_points [max_reference_points]]]
+//   The (serial) Chrono and serial samplers are only run up to
+//   max_reference_points (default: 1e6).
+//
+// =============================================================================
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <omp.h>
+
+#include "chrono/core/ChTimer.h"
+#include "chrono/utils/ChUtilsSamplers.h"
+
+#include "../sampling.h"
+
+using namespace chrono;
+
+// Number of points per unit volume (in units of separation^3) generated by Bridson's algorithm in 3D
+const double point_density = 0.59;
+
+const double separation = 1.0;
+const std::string out_file = "../sampling_benchmark.csv";
+
+// -----------------------------------------------------------------------------
+// Return the minimum distance between the given points and the number of pairs
+// closer than the separation (uses a cell list with cells of the separation size).
+// -----------------------------------------------------------------------------
+void CheckDistances(const std::vector<ChVector<>>& points, double& min_dist, size_t& num_violations) {
+    min_dist = std::numeric_limits<double>::max();
+    num_violations = 0;
+    if (points.size() < 2)
+        return;
+
+    ChVector<> lo = points[0];
+    ChVector<> hi = points[0];
+    for (const auto& p : points) {
+        for (int i = 0; i < 3; i++) {
+            lo[i] = std::min(lo[i], p[i]);
+            hi[i] = std::max(hi[i], p[i]);
+        }
+    }
+
+    int n[3];
+    for (int i = 0; i < 3; i++)
+        n[i] = (int)std::floor((hi[i] - lo[i]) / separation) + 1;
+    auto cell_index = [&](int x, int y, int z) { return ((size_t)z * n[1] + y) * n[0] + x; };
+
+    // Sort point indices by cell
+    size_t num_cells = (size_t)n[0] * n[1] * n[2];
+    std::vector<size_t> start(num_cells + 1, 0);
+    std::vector<size_t> cells(points.size());
+    for (size_t k = 0; k < points.size(); k++) {
+        ChVector<> c = (points[k] - lo) / separation;
+        cells[k] = cell_index((int)c.x(), (int)c.y(), (int)c.z());
+        start[cells[k] + 1]++;
+    }
+    for (size_t c = 0; c < num_cells; c++)
+        start[c + 1] += start[c];
+    std::vector<size_t> sorted(points.size());
+    std::vector<size_t> fill(start.begin(), start.end() - 1);
+    for (size_t k = 0; k < points.size(); k++)
+        sorted[fill[cells[k]]++] = k;
+
+    // Check all pairs in neighboring cells
+    double min_dist2 = min_dist;
+    double sep2 = separation * separation * (1 - 1e-12);
+    long long num_points = (long long)points.size();
+
+#pragma omp parallel for reduction(min : min_dist2) reduction(+ : num_violations)
+    for (long long k = 0; k < num_points; k++) {
+        ChVector<> c = (points[k] - lo) / separation;
+        int cx = (int)c.x(), cy = (int)c.y(), cz = (int)c.z();
+        for (int z = std::max(0, cz - 1); z <= std::min(n[2] - 1, cz + 1); z++) {
+            for (int y = std::max(0, cy - 1); y <= std::min(n[1] - 1, cy + 1); y++) {
+                for (int x = std::max(0, cx - 1); x <= std::min(n[0] - 1, cx + 1); x++) {
+                    size_t cell = cell_index(x, y, z);
+                    for (size_t s = start[cell]; s < start[cell + 1]; s++) {
+                        size_t j = sorted[s];
+                        if ((long long)j <= k)
+                            continue;
+                        double d2 = (points[k] - points[j]).Length2();
+                        min_dist2 = std::min(min_dist2, d2);
+                        if (d2 < sep2)
+                            num_violations++;
+                    }
+                }
+            }
+        }
+    }
+
+    min_dist = std::sqrt(min_dist2);
+}
+
+// -----------------------------------------------------------------------------
+// Time one sampler run and report results.
+// -----------------------------------------------------------------------------
+void Run(const std::string& domain,
+         const std::string& sampler,
+         size_t target,
+         std::function<std::vector<ChVector<>>()> sample,
+         std::ofstream& csv) {
+    ChTimer<> timer;
+    timer.start();
+    std::vector<ChVector<>> points = sample();
+    timer.stop();
+
+    double min_dist;
+    size_t num_violations;
+    CheckDistances(points, min_dist, num_violations);
+
+    double rate = points.size() / timer();
+    printf("%-8s  %-8s  %9zu  %9zu  %9.3f  %11.0f  %9.6f  %10zu\n", domain.c_str(), sampler.c_str(), target,
+           points.size(), timer(), rate, min_dist, num_violations);
+    csv << domain << "," << sampler << "," << target << "," << points.size() << "," << timer() << "," << rate << ","
+        << min_dist << "," << num_violations << std::endl;
+}
+
+// -----------------------------------------------------------------------------
+
+int main(int argc, char* argv[]) {
+    int num_threads = omp_get_num_procs();
+    size_t max_points = 10000000;
+    size_t max_ref_points = 1000000;
+
+    if (argc > 1)
+        num_threads = std::stoi(argv[1]);
+    if (argc > 2)
+        max_points = (size_t)std::stod(argv[2]);
+    if (argc > 3)
+        max_ref_points = (size_t)std::stod(argv[3]);
+
+    omp_set_num_threads(num_threads);
+    printf("Number of threads: %d\n\n", num_threads);
+
+    std::ofstream csv(out_file);
+    csv << "domain,sampler,target,points,time,points_per_second,min_distance,violations" << std::endl;
+
+    printf("%-8s  %-8s  %9s  %9s  %9s  %11s  %9s  %10s\n", "DOMAIN", "SAMPLER", "TARGET", "POINTS", "TIME [s]",
+           "POINTS/S", "MIN DIST", "VIOLATIONS");
+
+    ChVector<> center(0, 0, 0);
+
+    for (size_t target = 100000; target <= max_points; target *= 10) {
+        double volume = target / point_density * separation * separation * separation;
+
+        // Cube
+        double hdim = 0.5 * std::cbrt(volume);
+        ChVector<> hdims(hdim, hdim, hdim);
+
+        if (target <= max_ref_points) {
+            Run("box", "chrono", target,
+                [&]() {
+                    utils::PDSampler<double> sampler(separation);
+                    return sampler.SampleBox(center, hdims);
+                },
+                csv);
+            Run("box", "serial", target,
+                [&]() {
+                    PoissonDiskSampler sampler(separation);
+                    sampler.SetTileSize(0);
+                    return sampler.SampleBox(center, hdims);
+                },
+                csv);
+        }
+        Run("box", "tiled", target, [&]() { return PoissonDiskSampler(separation).SampleBox(center, hdims); }, csv);
+
+        // Cylinder with height equal to its diameter
+        double radius = std::cbrt(volume / (2 * CH_C_PI));
+
+        if (target <= max_ref_points) {
+            Run("cylinder", "chrono", target,
+                [&]() {
+                    utils::PDSampler<double> sampler(separation);
+                    return sampler.SampleCylinderZ(center, radius, radius);
+                },
+                csv);
+            Run("cylinder", "serial", target,
+                [&]() {
+                    PoissonDiskSampler sampler(separation);
+                    sampler.SetTileSize(0);
+                    return sampler.SampleCylinderZ(center, radius, radius);
+                },
+                csv);
+        }
+        Run("cylinder", "tiled", target,
+            [&]() { return PoissonDiskSampler(separation).SampleCylinderZ(center, radius, radius); }, csv);
+    }
+
+    printf("\nResults written to %s\n", out_file.c_str());
+
+    return 0;
+}
@@ -40,6 +40,9 @@
 #include "chrono_opengl/ChOpenGLWindow.h"
 #endif
 
+#include "../bin_tuner.h"
+#include "../sphere_generator.h"
+
 using namespace chrono;
 
 // --------------------------------------------------------------------------
@@ -83,6 +86,7 @@ int main(int argc, char** argv) {
     bool use_mat_properties = true;
     bool render = false;
     bool track_granule = false;
+    bool tune_bins = true;
 
     // Get number of threads from arguments (if specified)
     if (argc > 1) {
@@ -123,6 +127,7 @@ int main(int argc, char** argv) {
     float coh_force_terrain = (float)(CH_C_PI * radius_g * radius_g) * coh_pressure_terrain;
 
     // Estimates for number of bins for broad-phase
+    // (initial values if tuning the number of bins at run time)
     int factor = 2;
     int binsX = (int)std::ceil(hdimX / radius_g) / factor;
     int binsY = (int)std::ceil(hdimY / radius_g) / factor;
@@ -243,15 +248,11 @@ int main(int argc, char** argv) {
     // Create particles
     // ----------------
 
-    // Create a particle generator and a mixture entirely made out of spheres
-    utils::Generator gen(system);
-    std::shared_ptr<utils::MixtureIngredient> m1 = gen.AddMixtureIngredient(utils::MixtureType::SPHERE, 1.0);
-    m1->setDefaultMaterial(material_terrain);
-    m1->setDefaultDensity(rho_g);
-    m1->setDefaultSize(radius_g);
+    // Create a generator of identical spheres
+    SphereGenerator gen(system, material_terrain, radius_g, rho_g);
 
     // Set starting value for body identifiers
-    gen.setBodyIdentifier(Id_g);
+    gen.SetBodyIdentifier(Id_g);
 
     // Create particles in layers until reaching the desired number of particles
     double r = 1.01 * radius_g;
@@ -259,11 +260,12 @@ int main(int argc, char** argv) {
     ChVector<> center(0, 0, 2 * r);
 
     for (int il = 0; il < num_layers; il++) {
-        gen.createObjectsBox(utils::SamplingType::POISSON_DISK, 2 * r, center, hdims);
+        gen.AddBox(center, hdims, 2 * r);
         center.z() += 2 * r;
     }
+    gen.CreateBodies();
 
-    unsigned int num_particles = gen.getTotalNumBodies();
+    unsigned int num_particles = gen.GetTotalNumBodies();
     std::cout << "Generated particles:  " << num_particles << std::endl;
 
     // If tracking a granule (roughly in the "middle of the pack"),
@@ -311,12 +313,21 @@ int main(int argc, char** argv) {
     double cum_solver_time = 0;
     double cum_update_time = 0;
 
+    // Per-step timing recorder and broadphase bin tuning
+    TimelineRecorder timeline;
+    BinTuner bin_tuner(system);
+    bin_tuner.SetTimeline(&timeline);
+    bin_tuner.SetVerbose(true);
+
     TimingHeader();
 
     while (system->GetChTime() < time_end) {
         system->DoStepDynamics(time_step);
 
         TimingOutput(system);
+        timeline.Record(system);
+        if (tune_bins)
+            bin_tuner.Update();
 
         cum_sim_time += system->GetTimerStep();
         cum_broad_time += system->GetTimerCollisionBroad();
@@ -356,5 +367,7 @@ int main(int argc, char** argv) {
     std::cout << "    Update:      " << cum_update_time << std::endl;
     std::cout << std::endl;
 
+    timeline.WriteChromeTrace("../settling_timeline.json");
+
     return 0;
 }
\ No newline at end of file
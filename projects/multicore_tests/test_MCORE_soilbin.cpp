@@ -34,6 +34,12 @@
 
 #include "chrono_thirdparty/filesystem/path.h"
 
+#include "../bin_tuner.h"
+#include "../checkpoint.h"
+#include "../granular.h"
+#include "../sleep_manager.h"
+#include "../sphere_generator.h"
+
 using namespace chrono;
 using namespace chrono::collision;
 
@@ -69,6 +75,9 @@ bool thread_tuning = true;
 double time_settling = 5;
 double time_dropping = 2;
 
+// Put resting particles to sleep during the dropping phase (see SleepManager)?
+bool use_sleeping = false;
+
 // Solver parameters
 #ifdef USE_SMC
 double time_step = 1e-4;
@@ -156,27 +165,24 @@ void CreateParticles(ChSystemMulticore* system) {
     mat_g->SetFriction(0.4f);
 #endif
 
-    // Create a mixture entirely made out of spheres.
-    utils::Generator gen(system);
+    // Create a generator of identical spheres.
+    SphereGenerator gen(system, mat_g, r_g, rho_g);
 
-    std::shared_ptr<utils::MixtureIngredient> m1 = gen.AddMixtureIngredient(utils::MixtureType::SPHERE, 1.0);
-    m1->setDefaultMaterial(mat_g);
-    m1->setDefaultDensity(rho_g);
-    m1->setDefaultSize(r_g);
-
-    // Create particles, one layer at a time, until the desired number is reached.
-    gen.setBodyIdentifier(1);
+    // Sample layers (each with parallel tiles) until the desired number is reached, then create the particles.
+    gen.SetBodyIdentifier(1);
 
     double r = 1.01 * r_g;
     ChVector<> hdims(hDimX - r, hDimY - r, 0);
     ChVector<> center(0, 0, 2 * r);
 
-    while (gen.getTotalNumBodies() < desired_num_particles) {
-        gen.createObjectsBox(utils::SamplingType::POISSON_DISK, 2 * r, center, hdims);
+    while (gen.GetNumSamples() < desired_num_particles) {
+        gen.AddBox(center, hdims, 2 * r);
+        gen.Sample();
         center.z() += 2 * r;
     }
+    gen.CreateBodies();
 
-    cout << "Number of particles: " << gen.getTotalNumBodies() << endl;
+    cout << "Number of particles: " << gen.GetTotalNumBodies() << endl;
 }
 
 // =============================================================================
@@ -289,29 +295,6 @@ void CreateObject(ChSystemMulticore* system, double z) {
     system->AddBody(obj);
 }
 
-// =============================================================================
-// Find the height of the highest and lowest, respectively, sphere in the
-// granular mix, respectively.  We only look at bodies whith stricty positive
-// identifiers (to exclude the containing bin).
-// =============================================================================
-double FindHighest(ChSystem* sys) {
-    double highest = 0;
-    for (auto body : sys->Get_bodylist()) {
-        if (body->GetIdentifier() > 0 && body->GetPos().z() > highest)
-            highest = body->GetPos().z();
-    }
-    return highest;
-}
-
-double FindLowest(ChSystem* sys) {
-    double lowest = 1000;
-    for (auto body : sys->Get_bodylist()) {
-        if (body->GetIdentifier() > 0 && body->GetPos().z() < lowest)
-            lowest = body->GetPos().z();
-    }
-    return lowest;
-}
-
 // =============================================================================
 // =============================================================================
 int main(int argc, char* argv[]) {
@@ -340,6 +323,9 @@ int main(int argc, char* argv[]) {
     ChSystemMulticoreNSC* msystem = new ChSystemMulticoreNSC();
 #endif
 
+    // Analysis of the granular material (particle heights)
+    GranularAnalysis granular(msystem);
+
     msystem->Set_G_acc(ChVector<>(0, 0, -9.81));
 
     // ----------------------
@@ -397,11 +383,11 @@ int main(int argc, char* argv[]) {
 
         // Create the granular material and the container from the checkpoint file.
         cout << "Read checkpoint data from " << checkpoint_file;
-        utils::ReadCheckpoint(msystem, checkpoint_file);
+        ReadCheckpointBinary(msystem, checkpoint_file);
         cout << "  done.  Read " << msystem->Get_bodylist().size() << " bodies." << endl;
 
         // Create the falling object just above the granular material.
-        double z = FindHighest(msystem);
+        double z = granular.FindHighest();
         cout << "Create falling object above height" << z + r_g << endl;
         CreateObject(msystem, z + r_g);
     }
@@ -421,6 +407,19 @@ int main(int argc, char* argv[]) {
     int num_contacts = 0;
     ChStreamOutAsciiFile sfile(stats_file.c_str());
 
+    // Per-step timing recorder and broadphase bin tuning (the bin is elongated in x)
+    TimelineRecorder timeline;
+    BinTuner bin_tuner(msystem);
+    bin_tuner.SetTimeline(&timeline);
+    bin_tuner.SetVerbose(true);
+
+    // Sleeping of resting particles (islands restricted to columns of 10 grain radii)
+    bool sleep_enabled = use_sleeping && problem == DROPPING;
+    SleepManager sleeping(msystem);
+    sleeping.SetMaxSpeed(0.1 * r_g);
+    sleeping.SetMaxAngularSpeed(0.1);
+    sleeping.SetIslandCellSize(10 * r_g);
+
     while (time < time_end) {
         if (sim_frame == next_out_frame) {
             char filename[100];
@@ -430,16 +429,19 @@ int main(int argc, char* argv[]) {
             cout << "------------ Output frame:   " << out_frame << endl;
             cout << "             Sim frame:      " << sim_frame << endl;
             cout << "             Time:           " << time << endl;
-            cout << "             Lowest point:   " << FindLowest(msystem) << endl;
+            cout << "             Lowest point:   " << granular.FindLowest() << endl;
             cout << "             Avg. contacts:  " << num_contacts / out_steps << endl;
             cout << "             Execution time: " << exec_time << endl;
+            if (sleep_enabled)
+                cout << "             Awake/asleep:   " << sleeping.GetNumAwake() << " / " << sleeping.GetNumSleeping()
+                     << endl;
 
             sfile << time << "  " << exec_time << "  " << num_contacts / out_steps << "\n";
 
             // Create a checkpoint from the current state.
             if (problem == SETTLING) {
                 cout << "             Write checkpoint data " << flush;
-                utils::WriteCheckpoint(msystem, checkpoint_file);
+                WriteCheckpointBinary(msystem, checkpoint_file);
                 cout << msystem->Get_bodylist().size() << " bodies" << endl;
             }
 
@@ -450,6 +452,10 @@ int main(int argc, char* argv[]) {
 
         // Advance dynamics.
         msystem->DoStepDynamics(time_step);
+        timeline.Record(msystem);
+        bin_tuner.Update();
+        if (sleep_enabled)
+            sleeping.Update();
 
         time += time_step;
         sim_frame++;
@@ -460,16 +466,18 @@ int main(int argc, char* argv[]) {
     // Create a checkpoint from the last state
     if (problem == SETTLING) {
         cout << "Write checkpoint data to " << checkpoint_file;
-        utils::WriteCheckpoint(msystem, checkpoint_file);
+        WriteCheckpointBinary(msystem, checkpoint_file);
         cout << "  done.  Wrote " << msystem->Get_bodylist().size() << " bodies." << endl;
     }
 
     // Final stats
     cout << "==================================" << endl;
     cout << "Number of bodies:  " << msystem->Get_bodylist().size() << endl;
-    cout << "Lowest position:   " << FindLowest(msystem) << endl;
+    cout << "Lowest position:   " << granular.FindLowest() << endl;
     cout << "Simulation time:   " << exec_time << endl;
     cout << "Number of threads: " << threads << endl;
 
+    timeline.WriteChromeTrace(out_dir + "/timeline.json");
+
     return 0;
 }
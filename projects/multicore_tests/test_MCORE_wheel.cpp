@@ -32,6 +32,10 @@
 
 #include "chrono_thirdparty/filesystem/path.h"
 
+#include "../checkpoint.h"
+#include "../granular.h"
+#include "../settling.h"
+#include "../sleep_manager.h"
 #include "../utils.h"
 
 using namespace chrono;
@@ -59,6 +63,9 @@ double time_settling_min = 0.1;
 double time_settling_max = 5;
 double time_simulation = 10;
 
+// Put resting particles to sleep during the simulation phase (see SleepManager)?
+bool use_sleeping = false;
+
 double time_step_penalty = 1e-4;
 double time_step_complementarity = 1e-3;
 
@@ -239,46 +246,6 @@ std::shared_ptr<ChBody> CreateWheel(ChSystemMulticore* system, double z) {
     return wheel;
 }
 
-// ========================================================================
-// This utility function returns true if all bodies in the granular mix
-// have a linear velocity whose magnitude is below the specified value.
-
-bool CheckSettled(ChSystem* sys, double threshold) {
-    double t2 = threshold * threshold;
-    for (auto body : sys->Get_bodylist()) {
-        if (body->GetIdentifier() >= Id_g) {
-            double vel2 = body->GetPos_dt().Length2();
-            if (vel2 > t2)
-                return false;
-        }
-    }
-
-    return true;
-}
-
-// ========================================================================
-// These utility functions find the height of the highest or lowest sphere
-// in the granular mix, respectively.  We only look at bodies whith
-// identifiers larger than Id_g.
-
-double FindHighest(ChSystem* sys) {
-    double highest = 0;
-    for (auto body : sys->Get_bodylist()) {
-        if (body->GetIdentifier() >= Id_g && body->GetPos().z() > highest)
-            highest = body->GetPos().z();
-    }
-    return highest;
-}
-
-double FindLowest(ChSystem* sys) {
-    double lowest = DBL_MAX;
-    for (auto body : sys->Get_bodylist()) {
-        if (body->GetIdentifier() >= Id_g && body->GetPos().z() < lowest)
-            lowest = body->GetPos().z();
-    }
-    return lowest;
-}
-
 // ========================================================================
 int main(int argc, char* argv[]) {
     // Set path to Chrono data
@@ -313,6 +280,9 @@ int main(int argc, char* argv[]) {
         }
     }
 
+    // Analysis of the granular material (particle heights)
+    GranularAnalysis granular(system, Id_g);
+
     // Set method-independent solver settings
     system->Set_G_acc(ChVector<>(0, 0, -gravity));
     system->GetSettings()->solver.use_full_inertia_tensor = false;
@@ -357,11 +327,11 @@ int main(int argc, char* argv[]) {
 
             // Create the granular material bodies and the container from the checkpoint file.
             cout << "Read checkpoint data from " << checkpoint_file;
-            utils::ReadCheckpoint(system, checkpoint_file);
+            ReadCheckpointBinary(system, checkpoint_file);
             cout << "  done.  Read " << system->Get_bodylist().size() << " bodies." << endl;
 
             // Create the wheel.
-            double z = FindHighest(system);
+            double z = granular.FindHighest();
             wheel = CreateWheel(system, z + r_g + 0.4);
 
             break;
@@ -386,6 +356,18 @@ int main(int argc, char* argv[]) {
     // Zero velocity level for settling check (fraction of a grain radius per second)
     double zero_v = 0.9 * r_g;
 
+    // Settling monitor (evaluated at output frames)
+    SettlingMonitor monitor;
+    monitor.SetMinTime(time_settling_min);
+    monitor.SetMaxSpeed(zero_v);
+
+    // Sleeping of resting particles (islands restricted to columns of 5 grain radii)
+    bool sleep_enabled = use_sleeping && problem == SIMULATION;
+    SleepManager sleeping(system, Id_g);
+    sleeping.SetMaxSpeed(0.1 * r_g);
+    sleeping.SetMaxAngularSpeed(0.1);
+    sleeping.SetIslandCellSize(5 * r_g);
+
     // Perform the simulation
     double time = 0;
     int sim_frame = 0;
@@ -404,16 +386,19 @@ int main(int argc, char* argv[]) {
             cout << "                                   Sim frame:      " << sim_frame << endl;
             cout << "                                   Time:           " << time << endl;
             cout << "                                   Execution time: " << exec_time << endl;
+            if (sleep_enabled)
+                cout << "                                   Awake/asleep:   " << sleeping.GetNumAwake() << " / "
+                     << sleeping.GetNumSleeping() << endl;
 
             // Check if already settled.
-            if (problem == SETTLING && time > time_settling_min && CheckSettled(system, zero_v)) {
+            if (problem == SETTLING && time > time_settling_min && monitor.Evaluate(system)) {
                 cout << "Granular material settled...  time = " << time << endl;
                 break;
             }
 
             // Save checkpoint during settling phase.
             if (problem == SETTLING) {
-                utils::WriteCheckpoint(system, checkpoint_file);
+                WriteCheckpointBinary(system, checkpoint_file);
             }
 
             out_frame++;
@@ -422,6 +407,8 @@ int main(int argc, char* argv[]) {
 
         //TimingOutput(msystem);
         system->DoStepDynamics(time_step);
+        if (sleep_enabled)
+            sleeping.Update();
 
         time += time_step;
         sim_frame++;
@@ -430,7 +417,7 @@ int main(int argc, char* argv[]) {
 
     // Create a checkpoint from the last state
     if (problem == SETTLING)
-        utils::WriteCheckpoint(system, checkpoint_file);
+        WriteCheckpointBinary(system, checkpoint_file);
 
     // Final stats
     cout << "==================================" << endl;
@@ -0,0 +1,390 @@
+#ifndef DEMOS_REGION_SAMPLER_H
+#define DEMOS_REGION_SAMPLER_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "chrono_multicore/physics/ChSystemMulticore.h"
+
+#include "contact_forces.h"
+
+// =============================================================================
+// Granular mechanics quantities in one region, from the last call to
+// RegionSampler::Sample.
+//
+// Box regions: particles are assigned by the location of their center,
+// contacts by the location of their contact point. The stress tensor is the
+// average (Love-Weber) stress of the particles in the box,
+//   sigma_ij = -1/V sum_p sum_c (x_c - x_p)_i f_j,
+// with f the contact force on particle p, so that compressive stresses are
+// positive (soil mechanics convention).
+//
+// Plane regions: the force is the contact force exerted across the plane by the
+// particles on the negative side on the particles on the positive side (along
+// the plane normal); the mass flow is the mass of particles which crossed the
+// plane since the previous sample (positive along the plane normal).
+//
+// Forces and stresses require the forces of individual contacts, which are
+// only available for NSC systems; for SMC systems they are zero and
+// RegionSampler::HasForces returns false.
+
+struct RegionSample {
+    int num_particles;         ///< number of particles (box)
+    double mass;               ///< mass of the particles (box)
+    double packing_fraction;   ///< solid volume fraction (box; requires the particle density)
+    int num_contacts;          ///< number of contacts (box) or of contacts across the plane (plane)
+    double coordination;       ///< average number of contacts per particle (box)
+    chrono::ChVector<> force;  ///< contact force on non-granular bodies (box) or across the plane (plane; NSC only)
+    double stress[3][3];       ///< average stress tensor (box; NSC only)
+    double mass_flow;          ///< mass crossing the plane per unit time (plane)
+    double mass_crossed;       ///< total mass crossing the plane since it was added (plane)
+};
+
+// =============================================================================
+// Force, stress, packing, and mass flux sampling in user-defined regions of a
+// granular material in a Chrono::Multicore system.
+//
+// Regions (axis-aligned boxes, stacks of box slices, and planes) are registered
+// once. Each call to Sample computes the quantities of all regions in one
+// parallel pass over the granular bodies and one parallel pass over the
+// contact list, with per-thread partial sums for all regions. Contact forces
+// are read from the solver data (see ContactForces), so Sample must be called
+// after a step.
+//
+// Granular bodies are selected by identifier range, as in GranularAnalysis.
+//
+//   RegionSampler sampler(sys);
+//   sampler.SetParticleDensity(rho_g);
+//   int zone = sampler.AddBox("shear zone", ChVector<>(0, 0, z), ChVector<>(hx, hy, 2 * r));
+//   int outlet = sampler.AddPlane("outlet", ChVector<>(0, 0, 0), ChVector<>(0, 0, -1));
+//   while (...) {
+//       sys->DoStepDynamics(time_step);
+//       if (sample_frame)
+//           sampler.Sample();
+//       double shear = sampler.GetSample(zone).stress[0][2];
+//   }
+
+class RegionSampler {
+  public:
+    RegionSampler(chrono::ChSystemMulticore* sys, int min_id = 1, int max_id = std::numeric_limits<int>::max())
+        : m_sys(sys), m_min_id(min_id), m_max_id(max_id), m_density(0), m_time(0), m_sampled(false), m_num_bodies(-1) {}
+
+    /// Only consider bodies with identifier in [min_id, max_id] as granular material.
+    void SetIdentifierRange(int min_id, int max_id) {
+        m_min_id = min_id;
+        m_max_id = max_id;
+        m_num_bodies = -1;
+    }
+
+    /// Set the density of the particles (used for the packing fraction).
+    void SetParticleDensity(double density) { m_density = density; }
+
+    /// Add an axis-aligned box with given center and half-dimensions. Return the region index.
+    int AddBox(const std::string& name, const chrono::ChVector<>& center, const chrono::ChVector<>& hdims) {
+        Region r;
+        r.name = name;
+        r.type = BOX;
+        r.center = center;
+        r.hdims = hdims;
+        m_regions.push_back(r);
+        return (int)m_regions.size() - 1;
+    }
+
+    /// Split the box with given center and half-dimensions in the specified number of slices of
+    /// equal thickness along the given axis (0: x, 1: y, 2: z), from low to high coordinate.
+    /// Return the index of the first slice (the slices have consecutive indices).
+    int AddSlices(const std::string& name,
+                  const chrono::ChVector<>& center,
+                  const chrono::ChVector<>& hdims,
+                  int axis,
+                  int num_slices) {
+        int first = (int)m_regions.size();
+        chrono::ChVector<> slice_hdims = hdims;
+        slice_hdims[axis] = hdims[axis] / num_slices;
+        for (int i = 0; i < num_slices; i++) {
+            chrono::ChVector<> slice_center = center;
+            slice_center[axis] += (2 * i + 1 - num_slices) * slice_hdims[axis];
+            AddBox(name + " " + std::to_string(i), slice_center, slice_hdims);
+        }
+        return first;
+    }
+
+    /// Add a plane through the given point with the given normal. Return the region index.
+    int AddPlane(const std::string& name, const chrono::ChVector<>& point, const chrono::ChVector<>& normal) {
+        Region r;
+        r.name = name;
+        r.type = PLANE;
+        r.center = point;
+        r.normal = normal.GetNormalized();
+        m_regions.push_back(r);
+        return (int)m_regions.size() - 1;
+    }
+
+    /// Return true if contact forces and stresses are available (NSC systems only).
+    bool HasForces() const { return m_sys->GetContactMethod() == chrono::ChContactMethod::NSC; }
+
+    /// Return the number of regions.
+    int GetNumRegions() const { return (int)m_regions.size(); }
+
+    /// Return the name of the specified region.
+    const std::string& GetName(int region) const { return m_regions[region].name; }
+
+    /// Return the quantities of the specified region from the last sample.
+    const RegionSample& GetSample(int region) const { return m_regions[region].sample; }
+
+    /// Compute the quantities of all regions from the current state of the system.
+    void Sample() {
+        Refresh();
+
+        int num_regions = (int)m_regions.size();
+        double time = m_sys->GetChTime();
+        double elapsed = m_sampled ? time - m_time : 0;
+
+        std::vector<Partial> total(num_regions);
+        SampleBodies(total);
+        SampleContacts(total);
+
+        for (int r = 0; r < num_regions; r++) {
+            Region& region = m_regions[r];
+            const Partial& p = total[r];
+            RegionSample& s = region.sample;
+            s.num_particles = p.num_particles;
+            s.mass = p.mass;
+            s.num_contacts = p.num_contacts;
+            s.coordination = p.num_particles ? (double)p.particle_contacts / p.num_particles : 0;
+            s.force = chrono::ChVector<>(p.force[0], p.force[1], p.force[2]);
+            if (region.type == BOX) {
+                double volume = 8 * region.hdims.x() * region.hdims.y() * region.hdims.z();
+                s.packing_fraction = (m_density > 0 && volume > 0) ? p.mass / (m_density * volume) : 0;
+                for (int i = 0; i < 3; i++) {
+                    for (int j = 0; j < 3; j++)
+                        s.stress[i][j] = volume > 0 ? -p.stress[3 * i + j] / volume : 0;
+                }
+                s.mass_flow = 0;
+                s.mass_crossed = 0;
+            } else {
+                s.packing_fraction = 0;
+                for (int i = 0; i < 3; i++) {
+                    for (int j = 0; j < 3; j++)
+                        s.stress[i][j] = 0;
+                }
+                s.mass_flow = elapsed > 0 ? p.mass_crossed / elapsed : 0;
+                s.mass_crossed += p.mass_crossed;
+            }
+        }
+
+        m_time = time;
+        m_sampled = true;
+    }
+
+  private:
+    enum RegionType { BOX, PLANE };
+
+    struct Region {
+        Region() : type(BOX), sample() {}
+
+        std::string name;           ///< region name
+        RegionType type;            ///< box or plane
+        chrono::ChVector<> center;  ///< box center or point on the plane
+        chrono::ChVector<> hdims;   ///< box half-dimensions
+        chrono::ChVector<> normal;  ///< plane normal
+        std::vector<char> side;     ///< side of the plane of each granular body (-1: unknown, 0: negative, 1: positive)
+        RegionSample sample;        ///< quantities from the last sample
+    };
+
+    // Partial sums for one region.
+    struct Partial {
+        Partial() : num_particles(0), mass(0), mass_crossed(0), num_contacts(0), particle_contacts(0) {
+            std::fill(force, force + 3, 0.0);
+            std::fill(stress, stress + 9, 0.0);
+        }
+
+        void Add(const Partial& other) {
+            num_particles += other.num_particles;
+            mass += other.mass;
+            mass_crossed += other.mass_crossed;
+            num_contacts += other.num_contacts;
+            particle_contacts += other.particle_contacts;
+            for (int k = 0; k < 3; k++)
+                force[k] += other.force[k];
+            for (int k = 0; k < 9; k++)
+                stress[k] += other.stress[k];
+        }
+
+        int num_particles;
+        double mass;
+        double mass_crossed;
+        int num_contacts;
+        int particle_contacts;
+        double force[3];
+        double stress[9];
+    };
+
+    bool InBox(const Region& r, const chrono::real3& p) const {
+        return std::abs(p.x - r.center.x()) <= r.hdims.x() && std::abs(p.y - r.center.y()) <= r.hdims.y() &&
+               std::abs(p.z - r.center.z()) <= r.hdims.z();
+    }
+
+    bool Above(const Region& r, const chrono::real3& p) const {
+        double d = (p.x - r.center.x()) * r.normal.x() + (p.y - r.center.y()) * r.normal.y() +
+                   (p.z - r.center.z()) * r.normal.z();
+        return d >= 0;
+    }
+
+    // Collect the data array indices of all granular bodies (and reset the plane sides).
+    void Refresh() {
+        int num_bodies = (int)m_sys->data_manager->num_rigid_bodies;
+        bool reset = (num_bodies != m_num_bodies);
+        if (reset) {
+            const auto& bodies = m_sys->Get_bodylist();
+            m_indices.clear();
+            m_granular.assign(num_bodies, 0);
+            for (int i = 0; i < num_bodies; i++) {
+                int id = bodies[i]->GetIdentifier();
+                if (id >= m_min_id && id <= m_max_id) {
+                    m_indices.push_back(i);
+                    m_granular[i] = 1;
+                }
+            }
+            m_num_bodies = num_bodies;
+        }
+        for (auto& r : m_regions) {
+            if (r.type == PLANE && (reset || r.side.size() != m_indices.size()))
+                r.side.assign(m_indices.size(), -1);
+        }
+    }
+
+    // Particle counts, mass, and plane crossings (one parallel pass over the granular bodies).
+    void SampleBodies(std::vector<Partial>& total) {
+        const auto& host = m_sys->data_manager->host_data;
+        int num_regions = (int)m_regions.size();
+        int num = (int)m_indices.size();
+
+#pragma omp parallel
+        {
+            std::vector<Partial> partial(num_regions);
+#pragma omp for nowait
+            for (int k = 0; k < num; k++) {
+                int i = m_indices[k];
+                const chrono::real3& p = host.pos_rigid[i];
+                double mass = host.mass_rigid[i];
+                for (int r = 0; r < num_regions; r++) {
+                    Region& region = m_regions[r];
+                    if (region.type == BOX) {
+                        if (InBox(region, p)) {
+                            partial[r].num_particles++;
+                            partial[r].mass += mass;
+                        }
+                    } else {
+                        char side = Above(region, p) ? 1 : 0;
+                        if (region.side[k] >= 0 && region.side[k] != side)
+                            partial[r].mass_crossed += side ? mass : -mass;
+                        region.side[k] = side;
+                    }
+                }
+            }
+#pragma omp critical
+            {
+                for (int r = 0; r < num_regions; r++)
+                    total[r].Add(partial[r]);
+            }
+        }
+    }
+
+    // Contact forces, stresses, and coordination (one parallel pass over the contact list).
+    void SampleContacts(std::vector<Partial>& total) {
+        const auto& data_manager = m_sys->data_manager;
+        const auto& host = data_manager->host_data;
+        int num_regions = (int)m_regions.size();
+        int num_contacts = (int)data_manager->num_rigid_contacts;
+        int num_bodies = (int)m_granular.size();
+
+        // Without per-contact forces (SMC), only count the contacts
+        ContactForces forces(m_sys);
+        bool has_forces = forces.HasContactForces();
+
+#pragma omp parallel
+        {
+            std::vector<Partial> partial(num_regions);
+#pragma omp for nowait
+            for (int c = 0; c < num_contacts; c++) {
+                int a = host.bids_rigid_rigid[c].x;
+                int b = host.bids_rigid_rigid[c].y;
+                bool ga = a < num_bodies && m_granular[a];
+                bool gb = b < num_bodies && m_granular[b];
+                if (!ga && !gb)
+                    continue;
+
+                // Contact force on body b (global frame)
+                chrono::real3 f = has_forces ? forces.GetContactForce(c) : chrono::real3(0, 0, 0);
+
+                chrono::real3 pc = 0.5 * (host.cpta_rigid_rigid[c] + host.cptb_rigid_rigid[c]);
+                const chrono::real3& pa = host.pos_rigid[a];
+                const chrono::real3& pb = host.pos_rigid[b];
+
+                for (int r = 0; r < num_regions; r++) {
+                    const Region& region = m_regions[r];
+                    Partial& t = partial[r];
+                    if (region.type == BOX) {
+                        if (InBox(region, pc)) {
+                            t.num_contacts++;
+                            // Force exerted by a particle on a non-granular body
+                            chrono::real3 fw = ga && !gb ? f : (gb && !ga ? -f : chrono::real3(0, 0, 0));
+                            t.force[0] += fw.x;
+                            t.force[1] += fw.y;
+                            t.force[2] += fw.z;
+                        }
+                        if (ga && InBox(region, pa)) {
+                            AddStress(t, pc - pa, -f);
+                            t.particle_contacts++;
+                        }
+                        if (gb && InBox(region, pb)) {
+                            AddStress(t, pc - pb, f);
+                            t.particle_contacts++;
+                        }
+                    } else if (ga && gb) {
+                        bool sa = Above(region, pa);
+                        bool sb = Above(region, pb);
+                        if (sa != sb) {
+                            chrono::real3 fp = sb ? f : -f;
+                            t.num_contacts++;
+                            t.force[0] += fp.x;
+                            t.force[1] += fp.y;
+                            t.force[2] += fp.z;
+                        }
+                    }
+                }
+            }
+#pragma omp critical
+            {
+                for (int r = 0; r < num_regions; r++)
+                    total[r].Add(partial[r]);
+            }
+        }
+    }
+
+    static void AddStress(Partial& t, const chrono::real3& branch, const chrono::real3& f) {
+        double l[3] = {branch.x, branch.y, branch.z};
+        double g[3] = {f.x, f.y, f.z};
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++)
+                t.stress[3 * i + j] += l[i] * g[j];
+        }
+    }
+
+    chrono::ChSystemMulticore* m_sys;  ///< associated system
+    int m_min_id;                      ///< smallest identifier of a granular body
+    int m_max_id;                      ///< largest identifier of a granular body
+    double m_density;                  ///< particle density (0: unknown)
+    double m_time;                     ///< time of the last sample
+    bool m_sampled;                    ///< was the system sampled before?
+    int m_num_bodies;                  ///< number of bodies when the indices were collected
+    std::vector<int> m_indices;        ///< data array indices of the granular bodies
+    std::vector<char> m_granular;      ///< granular flag for each body
+    std::vector<Region> m_regions;     ///< registered regions
+};
+
+#endif
@@ -0,0 +1,232 @@
+#ifndef DEMOS_SAMPLING_H
+#define DEMOS_SAMPLING_H
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "chrono/core/ChVector.h"
+
+// =============================================================================
+// Tiled parallel Poisson-disk sampler (Bridson's algorithm).
+//
+// Returns points inside a box, sphere, or cylinder such that no two points are
+// closer than the specified separation. Domain dimensions which are zero are
+// ignored (e.g. a box with zero height is sampled as a 2D layer).
+//
+// The bounding box of the domain is covered by a background grid (at most one
+// point per cell) which is split into tiles of whole cells. Each tile is
+// sampled with Bridson's algorithm, considering the points already placed in
+// neighboring tiles, so that the separation also holds across tile seams.
+// Tiles are processed in 2^d phases (by the parity of their indices along each
+// axis); within a phase, tiles are at least one tile apart and are sampled in
+// parallel. Each tile has its own random number generator, seeded from the
+// sampler seed and the tile index, so the result does not depend on the number
+// of threads.
+//
+//   PoissonDiskSampler sampler(2 * r);
+//   auto points = sampler.SampleBox(center, hdims);
+
+class PoissonDiskSampler {
+  public:
+    PoissonDiskSampler(double separation, unsigned int seed = 0)
+        : m_separation(separation), m_seed(seed), m_tile_size(10 * separation), m_attempts(30) {}
+
+    /// Set the (approximate) tile edge length (default: 10 x separation).
+    /// A non-positive value results in a single tile, i.e. serial sampling.
+    void SetTileSize(double size) { m_tile_size = size; }
+
+    /// Set the number of candidates tried around a point before it is retired (default: 30).
+    void SetAttempts(int attempts) { m_attempts = std::max(1, attempts); }
+
+    /// Set the seed of the random number generators.
+    void SetSeed(unsigned int seed) { m_seed = seed; }
+
+    /// Return points in the box with given center and half-dimensions.
+    std::vector<chrono::ChVector<>> SampleBox(const chrono::ChVector<>& center, const chrono::ChVector<>& hdims) {
+        return Sample(center, hdims, [](const chrono::ChVector<>&) { return true; });
+    }
+
+    /// Return points in the sphere with given center and radius.
+    std::vector<chrono::ChVector<>> SampleSphere(const chrono::ChVector<>& center, double radius) {
+        double r2 = radius * radius;
+        return Sample(center, chrono::ChVector<>(radius, radius, radius),
+                      [r2](const chrono::ChVector<>& d) { return d.Length2() <= r2; });
+    }
+
+    /// Return points in the cylinder with given center, radius, and half-height, aligned with the Z axis.
+    std::vector<chrono::ChVector<>> SampleCylinderZ(const chrono::ChVector<>& center,
+                                                    double radius,
+                                                    double halfHeight) {
+        double r2 = radius * radius;
+        return Sample(center, chrono::ChVector<>(radius, radius, halfHeight),
+                      [r2](const chrono::ChVector<>& d) { return d.x() * d.x() + d.y() * d.y() <= r2; });
+    }
+
+  private:
+    // Sample the box with given center and half-dimensions, keeping points for which the
+    // 'inside' predicate (called with the position relative to the center) is true.
+    template <typename Inside>
+    std::vector<chrono::ChVector<>> Sample(const chrono::ChVector<>& center,
+                                           const chrono::ChVector<>& hdims,
+                                           Inside inside) {
+        // Active axes
+        bool active[3];
+        int num_active = 0;
+        for (int i = 0; i < 3; i++) {
+            active[i] = hdims[i] > 0;
+            num_active += active[i];
+        }
+        if (num_active == 0)
+            return std::vector<chrono::ChVector<>>(1, center);
+
+        // Background grid and tiles (tiles are at least 2 cells wide, so that the neighborhood
+        // checked around a point never reaches into another tile of the same phase)
+        double cell = m_separation / std::sqrt((double)num_active);
+        chrono::ChVector<> lo = center - hdims;
+        int n[3];  // number of cells
+        int k[3];  // number of cells per tile
+        int t[3];  // number of tiles
+        for (int i = 0; i < 3; i++) {
+            n[i] = active[i] ? std::max(1, (int)std::ceil(2 * hdims[i] / cell)) : 1;
+            k[i] = m_tile_size > 0 ? std::max(2, (int)std::round(m_tile_size / cell)) : n[i];
+            k[i] = std::min(k[i], n[i]);
+            t[i] = (n[i] + k[i] - 1) / k[i];
+        }
+        int num_tiles = t[0] * t[1] * t[2];
+
+        std::vector<int> grid((size_t)n[0] * n[1] * n[2], -1);           // point index in the owning tile
+        std::vector<std::vector<chrono::ChVector<>>> points(num_tiles);  // points in each tile
+
+        auto cell_index = [&](const int c[3]) { return ((size_t)c[2] * n[1] + c[1]) * n[0] + c[0]; };
+        auto tile_index = [&](const int c[3]) { return ((c[2] / k[2]) * t[1] + c[1] / k[1]) * t[0] + c[0] / k[0]; };
+        auto cell_coords = [&](const chrono::ChVector<>& p, int c[3]) {
+            for (int i = 0; i < 3; i++)
+                c[i] = active[i] ? std::min(n[i] - 1, std::max(0, (int)((p[i] - lo[i]) / cell))) : 0;
+        };
+
+        // Check that no other point is closer than the separation
+        double sep2 = m_separation * m_separation;
+        auto fits = [&](const chrono::ChVector<>& p, const int c[3]) {
+            int lo_c[3], hi_c[3];
+            for (int i = 0; i < 3; i++) {
+                lo_c[i] = std::max(0, c[i] - 2);
+                hi_c[i] = std::min(n[i] - 1, c[i] + 2);
+            }
+            int j[3];
+            for (j[2] = lo_c[2]; j[2] <= hi_c[2]; j[2]++) {
+                for (j[1] = lo_c[1]; j[1] <= hi_c[1]; j[1]++) {
+                    for (j[0] = lo_c[0]; j[0] <= hi_c[0]; j[0]++) {
+                        int idx = grid[cell_index(j)];
+                        if (idx >= 0 && (p - points[tile_index(j)][idx]).Length2() < sep2)
+                            return false;
+                    }
+                }
+            }
+            return true;
+        };
+
+        // Sample one tile
+        auto sample_tile = [&](int tile) {
+            int tc[3] = {tile % t[0], (tile / t[0]) % t[1], tile / (t[0] * t[1])};
+            chrono::ChVector<> tile_lo, tile_hi;
+            for (int i = 0; i < 3; i++) {
+                tile_lo[i] = active[i] ? lo[i] + tc[i] * k[i] * cell : center[i];
+                tile_hi[i] = active[i] ? std::min(lo[i] + (tc[i] + 1) * k[i] * cell, center[i] + hdims[i]) : center[i];
+            }
+
+            std::seed_seq seq{m_seed, (unsigned int)tile};
+            std::mt19937 gen(seq);
+            std::uniform_real_distribution<double> uniform(0.0, 1.0);
+            std::vector<chrono::ChVector<>>& tile_points = points[tile];
+            std::vector<int> active_list;
+
+            // Add the candidate if it is in this tile, in the domain, and far enough from all points
+            auto try_add = [&](const chrono::ChVector<>& p) {
+                for (int i = 0; i < 3; i++) {
+                    if (p[i] < tile_lo[i] || p[i] > tile_hi[i])
+                        return false;
+                }
+                int c[3];
+                cell_coords(p, c);
+                if (tile_index(c) != tile || !inside(p - center) || !fits(p, c))
+                    return false;
+                grid[cell_index(c)] = (int)tile_points.size();
+                active_list.push_back((int)tile_points.size());
+                tile_points.push_back(p);
+                return true;
+            };
+
+            // Seed the tile with random points until enough consecutive seeds fail (this also fills
+            // pockets left between the points of neighboring tiles), growing from each new seed by
+            // trying candidates in the annulus [separation, 2 * separation] around active points.
+            for (int failed = 0; failed < m_attempts;) {
+                chrono::ChVector<> seed_point;
+                for (int i = 0; i < 3; i++)
+                    seed_point[i] = tile_lo[i] + (tile_hi[i] - tile_lo[i]) * uniform(gen);
+                if (!try_add(seed_point)) {
+                    failed++;
+                    continue;
+                }
+                failed = 0;
+
+                while (!active_list.empty()) {
+                    size_t a = (size_t)(uniform(gen) * active_list.size()) % active_list.size();
+                    chrono::ChVector<> base = tile_points[active_list[a]];
+                    bool found = false;
+                    for (int attempt = 0; attempt < m_attempts && !found; attempt++) {
+                        chrono::ChVector<> d(0, 0, 0);
+                        double r2;
+                        do {
+                            for (int i = 0; i < 3; i++) {
+                                if (active[i])
+                                    d[i] = (4 * uniform(gen) - 2) * m_separation;
+                            }
+                            r2 = d.Length2();
+                        } while (r2 < sep2 || r2 > 4 * sep2);
+                        found = try_add(base + d);
+                    }
+                    if (!found) {
+                        active_list[a] = active_list.back();
+                        active_list.pop_back();
+                    }
+                }
+            }
+        };
+
+        // Process the tiles in phases of equal index parity
+        for (int phase = 0; phase < 8; phase++) {
+            std::vector<int> tiles;
+            for (int tile = 0; tile < num_tiles; tile++) {
+                int tc[3] = {tile % t[0], (tile / t[0]) % t[1], tile / (t[0] * t[1])};
+                if ((tc[0] % 2) == (phase & 1) && (tc[1] % 2) == ((phase >> 1) & 1) && (tc[2] % 2) == (phase >> 2))
+                    tiles.push_back(tile);
+            }
+
+            int num_phase_tiles = (int)tiles.size();
+#pragma omp parallel for schedule(dynamic)
+            for (int i = 0; i < num_phase_tiles; i++)
+                sample_tile(tiles[i]);
+        }
+
+        // Collect the points of all tiles
+        size_t num_points = 0;
+        for (const auto& tile_points : points)
+            num_points += tile_points.size();
+
+        std::vector<chrono::ChVector<>> all_points;
+        all_points.reserve(num_points);
+        for (const auto& tile_points : points)
+            all_points.insert(all_points.end(), tile_points.begin(), tile_points.end());
+
+        return all_points;
+    }
+
+    double m_separation;  ///< minimum distance between points
+    unsigned int m_seed;  ///< seed of the random number generators
+    double m_tile_size;   ///< approximate tile edge length
+    int m_attempts;       ///< number of candidates tried around a point
+};
+
+#endif
@@ -0,0 +1,143 @@
+#ifndef DEMOS_SETTLED_CACHE_H
+#define DEMOS_SETTLED_CACHE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "chrono/physics/ChSystem.h"
+#include "chrono_thirdparty/filesystem/path.h"
+
+#include "checkpoint.h"
+
+// =============================================================================
+// Cache of settled granular beds.
+//
+// A settled bed depends only on the parameters used to create and settle it
+// (container geometry, particle size and material, contact method, solver
+// settings, settling criteria). Programs register these parameters and the
+// cache maps them to a checkpoint file named after a hash of their values:
+//
+//   SettledBedCache cache("../SETTLED_CACHE");
+//   cache.AddParameter("r_g", r_g);
+//   ...
+//   if (!cache.Load(system)) {
+//       // create and settle the bed
+//       cache.Store(system);
+//   }
+//
+// Each entry consists of a binary checkpoint (see checkpoint.h) and a text
+// file listing the parameter values it was created with. Entries are written
+// to a temporary file with a name unique to the writer (process identifier and
+// random suffix) and renamed, so concurrent runs never see partial files.
+
+class SettledBedCache {
+  public:
+    explicit SettledBedCache(const std::string& dir) : m_dir(dir) {}
+
+    /// Register a parameter which affects the settled bed.
+    void AddParameter(const std::string& name, double value) {
+        char buf[64];
+        std::snprintf(buf, sizeof(buf), "%.17g", value);
+        m_params.push_back(std::make_pair(name, std::string(buf)));
+    }
+    void AddParameter(const std::string& name, int value) { m_params.push_back(std::make_pair(name, std::to_string(value))); }
+    void AddParameter(const std::string& name, const std::string& value) {
+        m_params.push_back(std::make_pair(name, value));
+    }
+
+    /// Return the cache key (hash of all registered parameters, independent of registration order).
+    std::string GetKey() const {
+        uint64_t h = 14695981039346656037ULL;
+        std::string text = GetDescription();
+        for (unsigned char c : text)
+            h = (h ^ c) * 1099511628211ULL;
+        char buf[17];
+        std::snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)h);
+        return std::string(buf);
+    }
+
+    /// Return the name of the checkpoint file for the current parameters.
+    std::string GetFilename() const { return m_dir + "/settled_" + GetKey() + ".dat"; }
+
+    /// Return true if a settled bed exists for the current parameters.
+    bool Contains() const { return filesystem::path(GetFilename()).exists(); }
+
+    /// Load the settled bed for the current parameters into the system (if it exists).
+    bool Load(chrono::ChSystem* system) const {
+        if (!Contains())
+            return false;
+        return ReadCheckpointBinary(system, GetFilename());
+    }
+
+    /// Store the current state of the system as the settled bed for the current parameters.
+    bool Store(chrono::ChSystem* system) const {
+        filesystem::create_directory(filesystem::path(m_dir));
+        std::string filename = GetFilename();
+        std::string tmp_filename = TemporaryName(filename);
+        if (!WriteCheckpointBinary(system, tmp_filename) || !Replace(tmp_filename, filename)) {
+            std::remove(tmp_filename.c_str());
+            return false;
+        }
+
+        std::string info_filename = m_dir + "/settled_" + GetKey() + ".txt";
+        std::string tmp_info_filename = TemporaryName(info_filename);
+        {
+            std::ofstream info(tmp_info_filename);
+            info << GetDescription();
+        }
+        if (!Replace(tmp_info_filename, info_filename))
+            std::remove(tmp_info_filename.c_str());
+        return true;
+    }
+
+  private:
+    // Name of a temporary file in the same directory as the given file, unique to this writer.
+    static std::string TemporaryName(const std::string& filename) {
+        static std::atomic<unsigned int> counter(0);
+        static const unsigned int seed = std::random_device()();
+#ifdef _WIN32
+        int pid = _getpid();
+#else
+        int pid = (int)getpid();
+#endif
+        char buf[64];
+        std::snprintf(buf, sizeof(buf), ".%d.%08x.%u.tmp", pid, seed, counter++);
+        return filename + buf;
+    }
+
+    // Rename the temporary file to the given file (atomically replacing it, except on Windows).
+    static bool Replace(const std::string& tmp_filename, const std::string& filename) {
+#ifdef _WIN32
+        std::remove(filename.c_str());
+#endif
+        return std::rename(tmp_filename.c_str(), filename.c_str()) == 0;
+    }
+
+    // Parameters as "name = value" lines, sorted by name.
+    std::string GetDescription() const {
+        std::vector<std::pair<std::string, std::string>> params = m_params;
+        std::sort(params.begin(), params.end());
+        std::string text;
+        for (const auto& p : params)
+            text += p.first + " = " + p.second + "\n";
+        return text;
+    }
+
+    std::string m_dir;                                          ///< cache directory
+    std::vector<std::pair<std::string, std::string>> m_params;  ///< registered parameters
+};
+
+#endif
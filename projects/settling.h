@@ -0,0 +1,221 @@
+#ifndef DEMOS_SETTLING_H
+#define DEMOS_SETTLING_H
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <functional>
+#include <limits>
+
+#include "chrono_multicore/physics/ChSystemMulticore.h"
+
+// =============================================================================
+// Statistics of the granular material used to detect settling.
+// Only active (i.e. not fixed) bodies with index at least 'first_body' in the
+// Chrono::Multicore data arrays are considered. Before the first step, the
+// state arrays are not filled and no bodies are considered.
+
+struct SettlingStats {
+    double time;            ///< simulation time
+    int num_bodies;         ///< number of bodies considered
+    double kinetic_energy;  ///< total translational kinetic energy
+    double max_speed;       ///< maximum body speed
+    double min_height;      ///< lowest body center
+    double max_height;      ///< highest body center
+    double mean_height;     ///< mean height of body centers
+
+    /// Compute the statistics in a single parallel pass over the data arrays of the given system.
+    static SettlingStats Compute(chrono::ChSystemMulticore* sys, int first_body = 0) {
+        const auto& host = sys->data_manager->host_data;
+        int num = (int)sys->data_manager->num_rigid_bodies;
+
+        // No state before the first step
+        if (host.v.size() < 6 * (size_t)num || host.mass_rigid.size() < (size_t)num ||
+            host.pos_rigid.size() < (size_t)num || host.active_rigid.size() < (size_t)num)
+            num = 0;
+
+        double ke = 0;
+        double max_v2 = 0;
+        double min_h = std::numeric_limits<double>::max();
+        double max_h = -std::numeric_limits<double>::max();
+        double sum_h = 0;
+        int count = 0;
+
+#pragma omp parallel
+        {
+            double t_ke = 0;
+            double t_max_v2 = 0;
+            double t_min_h = std::numeric_limits<double>::max();
+            double t_max_h = -std::numeric_limits<double>::max();
+            double t_sum_h = 0;
+            int t_count = 0;
+#pragma omp for nowait
+            for (int i = first_body; i < num; i++) {
+                if (!host.active_rigid[i])
+                    continue;
+                double vx = host.v[i * 6 + 0];
+                double vy = host.v[i * 6 + 1];
+                double vz = host.v[i * 6 + 2];
+                double v2 = vx * vx + vy * vy + vz * vz;
+                double h = host.pos_rigid[i].z;
+                t_ke += 0.5 * host.mass_rigid[i] * v2;
+                t_max_v2 = std::max(t_max_v2, v2);
+                t_min_h = std::min(t_min_h, h);
+                t_max_h = std::max(t_max_h, h);
+                t_sum_h += h;
+                t_count++;
+            }
+#pragma omp critical
+            {
+                ke += t_ke;
+                max_v2 = std::max(max_v2, t_max_v2);
+                min_h = std::min(min_h, t_min_h);
+                max_h = std::max(max_h, t_max_h);
+                sum_h += t_sum_h;
+                count += t_count;
+            }
+        }
+
+        SettlingStats stats;
+        stats.time = sys->GetChTime();
+        stats.num_bodies = count;
+        stats.kinetic_energy = ke;
+        stats.max_speed = std::sqrt(max_v2);
+        stats.min_height = count ? min_h : 0;
+        stats.max_height = count ? max_h : 0;
+        stats.mean_height = count ? sum_h / count : 0;
+        return stats;
+    }
+};
+
+// =============================================================================
+// Settling monitor.
+//
+// Evaluates SettlingStats every 'interval' steps and reports when the
+// granular material is settled. By default, the material is considered
+// settled (after the minimum time) when all enabled criteria are met:
+// - the kinetic energy per body is below a tolerance,
+// - the maximum body speed is below a tolerance,
+// - the standard deviation of the highest body position over the last
+//   'window' evaluations is below a tolerance.
+// A different criterion can be provided with SetCriterion.
+//
+//   SettlingMonitor monitor(100);
+//   monitor.SetMinTime(time_settling_min);
+//   monitor.SetMaxSpeed(0.1 * r_g);
+//   while (time < time_settling_max) {
+//       sys->DoStepDynamics(time_step);
+//       if (monitor.Update(sys))
+//           break;
+//   }
+
+class SettlingMonitor {
+  public:
+    typedef std::function<bool(const SettlingMonitor&)> Criterion;
+
+    explicit SettlingMonitor(int interval = 100)
+        : m_interval(std::max(interval, 1)),
+          m_steps(0),
+          m_first_body(0),
+          m_min_time(0),
+          m_ke_tol(-1),
+          m_speed_tol(-1),
+          m_height_tol(-1),
+          m_window(0),
+          m_settled(false) {}
+
+    /// Set the number of steps between evaluations.
+    void SetInterval(int interval) { m_interval = std::max(interval, 1); }
+
+    /// Only consider bodies with index at least 'first_body' (e.g. to skip mechanism bodies).
+    void SetFirstBody(int first_body) { m_first_body = first_body; }
+
+    /// Set the minimum simulation time before the material can be considered settled.
+    void SetMinTime(double time) { m_min_time = time; }
+
+    /// Enable the criterion on the kinetic energy per body.
+    void SetKineticEnergy(double tol) { m_ke_tol = tol; }
+
+    /// Enable the criterion on the maximum body speed.
+    void SetMaxSpeed(double tol) { m_speed_tol = tol; }
+
+    /// Enable the criterion on the variation of the highest body position over the last 'window' evaluations.
+    void SetHeightVariation(double tol, int window) {
+        m_height_tol = tol;
+        m_window = std::max(window, 2);
+    }
+
+    /// Replace the default criterion.
+    void SetCriterion(Criterion criterion) { m_criterion = criterion; }
+
+    /// Call after each step. Return true if the material is settled.
+    bool Update(chrono::ChSystemMulticore* sys) {
+        if (++m_steps % m_interval != 0)
+            return m_settled;
+        Evaluate(sys);
+        return m_settled;
+    }
+
+    /// Evaluate the statistics and the settling criterion for the current state.
+    bool Evaluate(chrono::ChSystemMulticore* sys) {
+        m_stats = SettlingStats::Compute(sys, m_first_body);
+        if (m_stats.num_bodies > 0)
+            m_heights.push_back(m_stats.max_height);
+        while ((int)m_heights.size() > std::max(m_window, 1))
+            m_heights.pop_front();
+        if (m_stats.time < m_min_time)
+            m_settled = false;
+        else
+            m_settled = m_criterion ? m_criterion(*this) : DefaultCriterion();
+        return m_settled;
+    }
+
+    /// Return the statistics at the last evaluation.
+    const SettlingStats& GetStats() const { return m_stats; }
+
+    /// Return the standard deviation of the highest body position over the last evaluations
+    /// (infinity until 'window' evaluations are available).
+    double GetHeightVariation() const {
+        if ((int)m_heights.size() < m_window || m_heights.size() < 2)
+            return std::numeric_limits<double>::infinity();
+        double mean = 0;
+        for (double h : m_heights)
+            mean += h;
+        mean /= m_heights.size();
+        double var = 0;
+        for (double h : m_heights)
+            var += (h - mean) * (h - mean);
+        return std::sqrt(var / m_heights.size());
+    }
+
+    /// Return true if the material was settled at the last evaluation.
+    bool IsSettled() const { return m_settled; }
+
+  private:
+    bool DefaultCriterion() const {
+        if (m_stats.num_bodies == 0)
+            return false;
+        if (m_ke_tol >= 0 && m_stats.kinetic_energy / m_stats.num_bodies > m_ke_tol)
+            return false;
+        if (m_speed_tol >= 0 && m_stats.max_speed > m_speed_tol)
+            return false;
+        if (m_height_tol >= 0 && GetHeightVariation() > m_height_tol)
+            return false;
+        return true;
+    }
+
+    int m_interval;                ///< number of steps between evaluations
+    long long m_steps;             ///< number of steps so far
+    int m_first_body;              ///< index of first body considered
+    double m_min_time;             ///< minimum settling time
+    double m_ke_tol;               ///< tolerance on kinetic energy per body (disabled if negative)
+    double m_speed_tol;            ///< tolerance on maximum speed (disabled if negative)
+    double m_height_tol;           ///< tolerance on highest position variation (disabled if negative)
+    int m_window;                  ///< number of evaluations for the height variation
+    bool m_settled;                ///< settled at last evaluation?
+    SettlingStats m_stats;         ///< statistics at last evaluation
+    std::deque<double> m_heights;  ///< highest body position at the last evaluations
+    Criterion m_criterion;         ///< user-provided criterion
+};
+
+#endif
@@ -0,0 +1,301 @@
+#ifndef DEMOS_SHAPE_MANAGER_H
+#define DEMOS_SHAPE_MANAGER_H
+
+#include <algorithm>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "chrono/collision/ChCollisionShape.h"
+#include "chrono/physics/ChBody.h"
+#include "chrono_multicore/physics/ChSystemMulticore.h"
+
+// =============================================================================
+// Removal and reuse of bodies and collision shapes in a Chrono::Multicore
+// system.
+//
+// Chrono::Multicore stores the collision shapes of all bodies in parallel
+// arrays of the data manager (shape_data): per-shape arrays (type, body,
+// family, position, rotation, start and length of the shape data) and one data
+// array per shape kind (sphere_rigid, box_like_rigid, ...). Erasing a shape
+// from these arrays shifts all later entries and requires patching all later
+// start offsets, i.e. O(n) per shape.
+//
+// Instead, removed shapes are tombstoned: their collision family mask is
+// cleared, so that they never collide, and their slots are erased in a single
+// O(n) compaction pass once the fraction of tombstones exceeds a threshold, so
+// that removing K shapes costs O(K) amortized. The shapes of each body are
+// found through an index which is extended incrementally when shapes are
+// appended (e.g. by ChCollisionSystemMulticore::Add) and rebuilt after a
+// compaction.
+//
+// Bodies cannot be removed from the Chrono::Multicore body arrays. Instead, a
+// released body is taken out of the simulation (fixed, all its shapes
+// tombstoned but kept) and put on a free list; a later insertion of a body with
+// the same collision shapes (e.g. gravel or debris particles) reuses it with
+// AcquireBody, which only restores the family masks. Collision stays enabled on
+// parked bodies: ChBody::SetCollide(true) adds the collision model to the
+// system again, i.e. it appends a second copy of all shapes of the body. The
+// same mechanism (DisableShapes / EnableShapes) temporarily excludes bodies
+// which stay in the simulation from collision detection.
+//
+//   ShapeManager shapes(sys);
+//   shapes.RemoveShapes(body.get());      // before rebuilding the collision model
+//   shapes.ReleaseBody(particle);         // take a particle out of the simulation
+//   shapes.DisableShapes(body.get());     // exclude a body from collision detection
+//   shapes.EnableShapes(body.get());      // ... and include it again
+//   auto p = shapes.AcquireBody();        // reuse a released particle (or null)
+//   if (p) {
+//       p->SetPos(pos);
+//       p->SetPos_dt(vel);
+//   }
+
+class ShapeManager {
+  public:
+    explicit ShapeManager(chrono::ChSystemMulticore* sys) : m_sys(sys), m_num_dead(0), m_threshold(0.25) {}
+
+    /// Set the fraction of tombstoned shapes above which the shape arrays are compacted (default: 0.25).
+    /// A value of 1 or more disables automatic compaction.
+    void SetCompactionThreshold(double fraction) { m_threshold = fraction; }
+
+    /// Remove all collision shapes of the specified body from the data manager.
+    /// Shapes added later for the same body (e.g. after rebuilding its collision model) are not affected.
+    /// Return the number of removed shapes.
+    int RemoveShapes(chrono::ChBody* body) {
+        Sync();
+        auto it = m_body_shapes.find(body->GetId());
+        if (it == m_body_shapes.end())
+            return 0;
+
+        int num = 0;
+        for (int index : it->second) {
+            if (m_state[index] == DEAD)
+                continue;
+            if (m_state[index] == ALIVE)
+                Tombstone(index);
+            m_state[index] = DEAD;
+            m_num_dead++;
+            num++;
+        }
+        m_body_shapes.erase(it);
+
+        if ((double)m_num_dead > m_threshold * m_state.size())
+            Compact();
+
+        return num;
+    }
+
+    /// Exclude all collision shapes of the specified body from collision detection, without removing them.
+    /// Unlike ChBody::SetCollide(false), this can be undone with EnableShapes without duplicating the shapes.
+    void DisableShapes(chrono::ChBody* body) {
+        Sync();
+        auto it = m_body_shapes.find(body->GetId());
+        if (it == m_body_shapes.end())
+            return;
+        for (int index : it->second) {
+            if (m_state[index] == ALIVE) {
+                Tombstone(index);
+                m_state[index] = PARKED;
+            }
+        }
+    }
+
+    /// Restore the collision shapes of the specified body disabled with DisableShapes.
+    void EnableShapes(chrono::ChBody* body) {
+        Sync();
+        auto it = m_body_shapes.find(body->GetId());
+        if (it == m_body_shapes.end())
+            return;
+        auto& fam = m_sys->data_manager->shape_data.fam_rigid;
+        for (int index : it->second) {
+            if (m_state[index] == PARKED) {
+                fam[index] = m_saved_fam[index];
+                m_state[index] = ALIVE;
+            }
+        }
+    }
+
+    /// Take the specified body out of the simulation (fixed, shapes disabled) and put it on the free list.
+    /// Do not disable collision on released bodies; see the class description.
+    void ReleaseBody(std::shared_ptr<chrono::ChBody> body) {
+        body->SetBodyFixed(true);
+        body->SetPos_dt(chrono::ChVector<>(0, 0, 0));
+        body->SetWvel_loc(chrono::ChVector<>(0, 0, 0));
+        DisableShapes(body.get());
+        m_free.push_back(body);
+    }
+
+    /// Return a released body (with its collision shapes restored, free to move), or null if there is none.
+    /// The caller is responsible for setting its position and velocity.
+    std::shared_ptr<chrono::ChBody> AcquireBody() {
+        if (m_free.empty())
+            return nullptr;
+        auto body = m_free.back();
+        m_free.pop_back();
+        EnableShapes(body.get());
+        body->SetBodyFixed(false);
+        return body;
+    }
+
+    /// Return the number of released bodies available for reuse.
+    int GetNumFreeBodies() const { return (int)m_free.size(); }
+
+    /// Return the number of tombstoned shapes waiting for compaction.
+    int GetNumRemovedShapes() const { return m_num_dead; }
+
+    /// Erase all removed shapes from the data manager arrays (single pass over all shapes).
+    /// Disabled shapes (including those of released bodies) are kept.
+    void Compact() {
+        Sync();
+        if (m_num_dead == 0)
+            return;
+
+        auto& shapes = m_sys->data_manager->shape_data;
+        int num_shapes = (int)m_state.size();
+
+        // Write cursors for the shape data arrays
+        int cursor[NUM_ARRAYS] = {0};
+
+        int w = 0;
+        for (int i = 0; i < num_shapes; i++) {
+            if (m_state[i] == DEAD)
+                continue;
+
+            // Move the shape data (segments keep their order, so the copy never overwrites live data)
+            int type = shapes.typ_rigid[i];
+            int array = DataArray(type);
+            int start = shapes.start_rigid[i];
+            int length = DataLength(type, shapes.length_rigid[i]);
+            if (array >= 0) {
+                MoveData(array, start, cursor[array], length);
+                shapes.start_rigid[i] = cursor[array];
+                cursor[array] += length;
+            }
+
+            if (w != i) {
+                shapes.ObA_rigid[w] = shapes.ObA_rigid[i];
+                shapes.ObR_rigid[w] = shapes.ObR_rigid[i];
+                shapes.start_rigid[w] = shapes.start_rigid[i];
+                shapes.length_rigid[w] = shapes.length_rigid[i];
+                shapes.fam_rigid[w] = shapes.fam_rigid[i];
+                shapes.typ_rigid[w] = shapes.typ_rigid[i];
+                shapes.id_rigid[w] = shapes.id_rigid[i];
+                m_state[w] = m_state[i];
+                m_saved_fam[w] = m_saved_fam[i];
+            }
+            w++;
+        }
+
+        shapes.ObA_rigid.resize(w);
+        shapes.ObR_rigid.resize(w);
+        shapes.start_rigid.resize(w);
+        shapes.length_rigid.resize(w);
+        shapes.fam_rigid.resize(w);
+        shapes.typ_rigid.resize(w);
+        shapes.id_rigid.resize(w);
+        shapes.sphere_rigid.resize(cursor[SPHERE]);
+        shapes.box_like_rigid.resize(cursor[BOX_LIKE]);
+        shapes.capsule_rigid.resize(cursor[CAPSULE]);
+        shapes.rbox_like_rigid.resize(cursor[RBOX_LIKE]);
+        shapes.convex_rigid.resize(cursor[CONVEX]);
+        m_sys->data_manager->num_rigid_shapes = w;
+
+        m_state.resize(w);
+        m_saved_fam.resize(w);
+        m_num_dead = 0;
+
+        // Shape indices changed; rebuild the index
+        m_body_shapes.clear();
+        for (int i = 0; i < w; i++)
+            m_body_shapes[shapes.id_rigid[i]].push_back(i);
+    }
+
+  private:
+    enum State : char { ALIVE, DEAD, PARKED };
+    enum DataArrayType { SPHERE, BOX_LIKE, CAPSULE, RBOX_LIKE, CONVEX, NUM_ARRAYS };
+
+    // Index the shapes appended to the data manager since the last call.
+    void Sync() {
+        const auto& shapes = m_sys->data_manager->shape_data;
+        int num_shapes = (int)shapes.id_rigid.size();
+        for (int i = (int)m_state.size(); i < num_shapes; i++) {
+            m_body_shapes[shapes.id_rigid[i]].push_back(i);
+            m_state.push_back(ALIVE);
+            m_saved_fam.push_back(shapes.fam_rigid[i]);
+        }
+    }
+
+    // Clear the collision family mask of the specified shape (saving it for reuse).
+    void Tombstone(int index) {
+        auto& fam = m_sys->data_manager->shape_data.fam_rigid;
+        m_saved_fam[index] = fam[index];
+        fam[index].x = 0;
+        fam[index].y = 0;
+    }
+
+    // Data array holding the data of the given shape type.
+    static int DataArray(int type) {
+        switch (type) {
+            case chrono::collision::ChCollisionShape::Type::SPHERE:
+                return SPHERE;
+            case chrono::collision::ChCollisionShape::Type::ELLIPSOID:
+            case chrono::collision::ChCollisionShape::Type::BOX:
+            case chrono::collision::ChCollisionShape::Type::CYLINDER:
+            case chrono::collision::ChCollisionShape::Type::CONE:
+                return BOX_LIKE;
+            case chrono::collision::ChCollisionShape::Type::CAPSULE:
+                return CAPSULE;
+            case chrono::collision::ChCollisionShape::Type::ROUNDEDBOX:
+            case chrono::collision::ChCollisionShape::Type::ROUNDEDCYL:
+            case chrono::collision::ChCollisionShape::Type::ROUNDEDCONE:
+                return RBOX_LIKE;
+            case chrono::collision::ChCollisionShape::Type::CONVEX:
+            case chrono::collision::ChCollisionShape::Type::TRIANGLE:
+                return CONVEX;
+            default:
+                return -1;
+        }
+    }
+
+    // Number of data entries of a shape (triangles always use 3 vertices).
+    static int DataLength(int type, int length) {
+        return type == chrono::collision::ChCollisionShape::Type::TRIANGLE ? 3 : length;
+    }
+
+    template <typename T>
+    static void MoveSegment(T& data, int from, int to, int length) {
+        if (from != to)
+            std::copy(data.begin() + from, data.begin() + from + length, data.begin() + to);
+    }
+
+    void MoveData(int array, int from, int to, int length) {
+        auto& shapes = m_sys->data_manager->shape_data;
+        switch (array) {
+            case SPHERE:
+                MoveSegment(shapes.sphere_rigid, from, to, length);
+                break;
+            case BOX_LIKE:
+                MoveSegment(shapes.box_like_rigid, from, to, length);
+                break;
+            case CAPSULE:
+                MoveSegment(shapes.capsule_rigid, from, to, length);
+                break;
+            case RBOX_LIKE:
+                MoveSegment(shapes.rbox_like_rigid, from, to, length);
+                break;
+            case CONVEX:
+                MoveSegment(shapes.convex_rigid, from, to, length);
+                break;
+        }
+    }
+
+    chrono::ChSystemMulticore* m_sys;                         ///< associated system
+    int m_num_dead;                                           ///< number of tombstoned shapes
+    double m_threshold;                                       ///< tombstone fraction triggering a compaction
+    std::vector<char> m_state;                                ///< state of each shape (alive, dead, parked)
+    std::vector<chrono::short2> m_saved_fam;                  ///< collision family of each shape before tombstoning
+    std::unordered_map<int, std::vector<int>> m_body_shapes;  ///< shape indices of each body
+    std::vector<std::shared_ptr<chrono::ChBody>> m_free;      ///< released bodies
+};
+
+#endif
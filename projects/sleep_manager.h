@@ -0,0 +1,395 @@
+#ifndef DEMOS_SLEEP_MANAGER_H
+#define DEMOS_SLEEP_MANAGER_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "chrono/physics/ChBody.h"
+#include "chrono_multicore/physics/ChSystemMulticore.h"
+
+#include "contact_forces.h"
+
+// =============================================================================
+// Island-based sleeping of resting bodies in a Chrono::Multicore system (SMC
+// or NSC), the equivalent of ChSystem::SetUseSleeping for the multicore path.
+//
+// A body is quiet when its linear and angular speeds and its unbalanced
+// acceleration (contact forces plus gravity, divided by the mass) are below the
+// specified thresholds. Quiet bodies connected through contacts form islands;
+// an island falls asleep once all its bodies have been quiet for a number of
+// consecutive evaluations and none of them touches a moving body. Sleeping
+// bodies are fixed, so that they are excluded from the solver and contacts
+// between two sleeping bodies are not generated; they keep colliding with
+// awake bodies, like a rigid wall.
+//
+// A settled granular bed is typically one large island. To let a local
+// disturbance (e.g. a wheel or a penetrometer) wake only part of the bed,
+// islands can be restricted to vertical columns of a horizontal grid (see
+// SetIslandCellSize).
+//
+// A sleeping island wakes up as soon as one of its bodies receives, from
+// awake bodies, a contact force larger than a multiple of its resting force.
+// Contact forces are read from the solver data (see ContactForces), so Update
+// must be called after each step:
+// - NSC: the unbalanced acceleration is the sum of the contact forces; a
+//   sleeping body wakes on a single contact force larger than a multiple of
+//   the largest contact force it carried when it fell asleep (at least its
+//   weight);
+// - SMC: only the total contact force on each body is available, which for a
+//   body at rest is its weight, however large the load it carries. Instead, a
+//   sleeping body wakes when the penetration of a contact with an awake body
+//   (which determines the normal contact force) exceeds a multiple of the
+//   largest contact penetration it had when it fell asleep. Awake bodies
+//   resting against a sleeping island therefore do not wake it, while the
+//   material around a woken island does not wake in cascade.
+// Each update makes one pass over the contact list; sleep candidates are
+// evaluated every few steps.
+//
+// Managed bodies are selected by identifier range (by default, all bodies with
+// strictly positive identifiers) among the bodies that are not fixed when they
+// are first seen. Sleeping bodies are fixed; call WakeAll before writing a
+// checkpoint.
+//
+//   SleepManager sleeping(sys, Id_g);
+//   sleeping.SetMaxSpeed(0.1 * r_g);
+//   sleeping.SetIslandCellSize(10 * r_g);
+//   while (...) {
+//       sys->DoStepDynamics(time_step);
+//       sleeping.Update();
+//   }
+//   cout << sleeping.GetNumAwake() << " awake, " << sleeping.GetNumSleeping() << " sleeping" << endl;
+
+class SleepManager {
+  public:
+    SleepManager(chrono::ChSystemMulticore* sys, int min_id = 1, int max_id = std::numeric_limits<int>::max())
+        : m_sys(sys),
+          m_min_id(min_id),
+          m_max_id(max_id),
+          m_interval(10),
+          m_quiet_evals(3),
+          m_max_speed(1e-2),
+          m_max_ang_speed(1e-1),
+          m_max_accel(0.1),
+          m_wake_ratio(2),
+          m_cell_size(0),
+          m_num_steps(0),
+          m_num_managed(0),
+          m_num_sleeping(0),
+          m_num_wakeups(0) {}
+
+    /// Set the number of steps between two evaluations of the sleep candidates (default: 10).
+    void SetInterval(int interval) { m_interval = std::max(interval, 1); }
+
+    /// Set the number of consecutive quiet evaluations before an island falls asleep (default: 3).
+    void SetQuietEvaluations(int num) { m_quiet_evals = std::max(num, 1); }
+
+    /// Set the maximum linear speed of a quiet body (default: 1e-2).
+    void SetMaxSpeed(double speed) { m_max_speed = speed; }
+
+    /// Set the maximum angular speed of a quiet body (default: 1e-1).
+    void SetMaxAngularSpeed(double speed) { m_max_ang_speed = speed; }
+
+    /// Set the maximum unbalanced acceleration of a quiet body, as a fraction of gravity (default: 0.1).
+    void SetMaxAcceleration(double fraction) { m_max_accel = fraction; }
+
+    /// Set the ratio of an incoming contact force to the resting contact force which wakes an island (default: 2).
+    /// With SMC, the ratio applies to contact penetrations (see above).
+    void SetWakeRatio(double ratio) { m_wake_ratio = ratio; }
+
+    /// Restrict islands to vertical columns of a horizontal grid with the given cell size (default: 0, no grid).
+    void SetIslandCellSize(double size) { m_cell_size = size; }
+
+    /// Process the contacts of the last step: wake the islands hit by awake bodies and, every few steps,
+    /// put the quiet islands to sleep. Return true if any body changed state.
+    bool Update() {
+        Resize();
+        bool evaluate = (++m_num_steps % m_interval == 0);
+        ProcessContacts(evaluate);
+        bool changed = WakeIslands();
+        if (evaluate)
+            changed = Evaluate() || changed;
+        return changed;
+    }
+
+    /// Wake all sleeping bodies.
+    void WakeAll() {
+        for (size_t k = 0; k < m_islands.size(); k++) {
+            if (!m_islands[k].empty())
+                m_wake.push_back((int)k);
+        }
+        WakeIslands();
+    }
+
+    /// Return the number of awake managed bodies.
+    int GetNumAwake() const { return m_num_managed - m_num_sleeping; }
+
+    /// Return the number of sleeping bodies.
+    int GetNumSleeping() const { return m_num_sleeping; }
+
+    /// Return the number of sleeping islands.
+    int GetNumIslands() const { return (int)(m_islands.size() - m_free_islands.size()); }
+
+    /// Return the total number of island wakeups.
+    int GetNumWakeups() const { return m_num_wakeups; }
+
+  private:
+    enum State : char { UNMANAGED, AWAKE, SLEEPING };
+
+    // Register the bodies added since the last update.
+    void Resize() {
+        const auto& bodies = m_sys->Get_bodylist();
+        int num_bodies = (int)bodies.size();
+        for (int i = (int)m_state.size(); i < num_bodies; i++) {
+            int id = bodies[i]->GetIdentifier();
+            bool managed = id >= m_min_id && id <= m_max_id && !bodies[i]->GetBodyFixed();
+            m_state.push_back(managed ? AWAKE : UNMANAGED);
+            m_quiet.push_back(0);
+            m_island.push_back(-1);
+            m_rest_force.push_back(0);
+            m_rest_depth.push_back(0);
+            if (managed)
+                m_num_managed++;
+        }
+    }
+
+    // Flag the sleeping islands hit by awake bodies; on evaluation steps, also accumulate the contact forces
+    // on awake bodies and collect the contacts between them (one pass over the contact list).
+    void ProcessContacts(bool evaluate) {
+        const auto& data_manager = m_sys->data_manager;
+        const auto& host = data_manager->host_data;
+        const auto& bodies = m_sys->Get_bodylist();
+        int num_contacts = (int)data_manager->num_rigid_contacts;
+        int num_bodies = (int)m_state.size();
+
+        // Per-contact forces (NSC) or total contact forces on bodies (SMC)
+        ContactForces forces(m_sys);
+        bool per_contact = forces.HasContactForces();
+        bool per_body = forces.HasBodyForces();
+        bool depths = !per_contact && forces.HasPenetrations();
+
+        if (evaluate) {
+            m_force.assign(num_bodies, chrono::real3(0, 0, 0));
+            m_max_force.assign(num_bodies, 0);
+            m_max_depth.assign(num_bodies, 0);
+            m_pairs.clear();
+            if (per_body) {
+                int num_mapped = std::min(num_bodies, (int)host.ct_body_map.size());
+                for (int i = 0; i < num_mapped; i++)
+                    m_force[i] = forces.GetBodyForce(i);
+            }
+        } else if (m_num_sleeping == 0) {
+            return;
+        }
+
+        for (int c = 0; c < num_contacts; c++) {
+            int a = host.bids_rigid_rigid[c].x;
+            int b = host.bids_rigid_rigid[c].y;
+            if (a >= num_bodies || b >= num_bodies)
+                continue;
+            bool sa = m_state[a] == SLEEPING;
+            bool sb = m_state[b] == SLEEPING;
+            if (!evaluate && sa == sb)
+                continue;
+
+            chrono::real3 f = per_contact ? forces.GetContactForce(c) : chrono::real3(0, 0, 0);
+            double fm = chrono::Length(f);
+            double d = depths ? forces.GetPenetration(c) : 0;
+
+            // Contact between a sleeping body and an awake (or unmanaged) body
+            if (sa != sb) {
+                int s = sa ? a : b;
+                int o = sa ? b : a;
+                bool hit = per_contact ? fm > m_wake_ratio * m_rest_force[s] : d > m_wake_ratio * m_rest_depth[s];
+                if (!bodies[o]->GetBodyFixed() && hit)
+                    m_wake.push_back(m_island[s]);
+                // The sleeping body still supports the awake one
+                if (evaluate && per_contact) {
+                    m_force[o] += (o == b) ? f : -f;
+                    m_max_force[o] = std::max(m_max_force[o], fm);
+                }
+                if (evaluate)
+                    m_max_depth[o] = std::max(m_max_depth[o], d);
+                continue;
+            }
+
+            if (per_contact) {
+                m_force[b] += f;
+                m_force[a] -= f;
+                m_max_force[a] = std::max(m_max_force[a], fm);
+                m_max_force[b] = std::max(m_max_force[b], fm);
+            }
+            m_max_depth[a] = std::max(m_max_depth[a], d);
+            m_max_depth[b] = std::max(m_max_depth[b], d);
+            m_pairs.push_back(std::make_pair(a, b));
+        }
+    }
+
+    // Wake the flagged islands.
+    bool WakeIslands() {
+        if (m_wake.empty())
+            return false;
+
+        const auto& bodies = m_sys->Get_bodylist();
+        for (int k : m_wake) {
+            if (m_islands[k].empty())
+                continue;
+            for (int i : m_islands[k]) {
+                bodies[i]->SetBodyFixed(false);
+                m_state[i] = AWAKE;
+                m_quiet[i] = 0;
+                m_island[i] = -1;
+            }
+            m_num_sleeping -= (int)m_islands[k].size();
+            m_islands[k].clear();
+            m_free_islands.push_back(k);
+            m_num_wakeups++;
+        }
+        m_wake.clear();
+
+        return true;
+    }
+
+    bool IsCandidate(int i) const { return m_state[i] == AWAKE && m_quiet[i] >= m_quiet_evals; }
+
+    bool SameCell(int a, int b) const {
+        if (m_cell_size <= 0)
+            return true;
+        const auto& bodies = m_sys->Get_bodylist();
+        const chrono::ChVector<>& pa = bodies[a]->GetPos();
+        const chrono::ChVector<>& pb = bodies[b]->GetPos();
+        return std::floor(pa.x() / m_cell_size) == std::floor(pb.x() / m_cell_size) &&
+               std::floor(pa.y() / m_cell_size) == std::floor(pb.y() / m_cell_size);
+    }
+
+    int Find(int i) {
+        while (m_parent[i] != i) {
+            m_parent[i] = m_parent[m_parent[i]];
+            i = m_parent[i];
+        }
+        return i;
+    }
+
+    // Update the quiet counters and put the islands of sleep candidates to sleep.
+    bool Evaluate() {
+        const auto& bodies = m_sys->Get_bodylist();
+        int num_bodies = (int)m_state.size();
+        chrono::ChVector<> g = m_sys->Get_G_acc();
+        double g_mag = g.Length();
+
+        // Quiet bodies
+        for (int i = 0; i < num_bodies; i++) {
+            if (m_state[i] != AWAKE)
+                continue;
+            const auto& body = bodies[i];
+            if (body->GetBodyFixed()) {
+                m_quiet[i] = 0;
+                continue;
+            }
+            const chrono::real3& f = m_force[i];
+            chrono::ChVector<> accel = chrono::ChVector<>(f.x, f.y, f.z) / body->GetMass() + g;
+            bool quiet = body->GetPos_dt().Length() < m_max_speed && body->GetWvel_par().Length() < m_max_ang_speed &&
+                         accel.Length() < m_max_accel * g_mag;
+            m_quiet[i] = quiet ? m_quiet[i] + 1 : 0;
+        }
+
+        // Islands of candidates connected through contacts (within a grid cell)
+        m_parent.resize(num_bodies);
+        for (int i = 0; i < num_bodies; i++)
+            m_parent[i] = i;
+        for (const auto& p : m_pairs) {
+            if (IsCandidate(p.first) && IsCandidate(p.second) && SameCell(p.first, p.second)) {
+                int ra = Find(p.first);
+                int rb = Find(p.second);
+                if (ra != rb)
+                    m_parent[ra] = rb;
+            }
+        }
+
+        // Islands touching a moving body stay awake
+        std::vector<char> blocked(num_bodies, 0);
+        for (const auto& p : m_pairs) {
+            bool ca = IsCandidate(p.first);
+            bool cb = IsCandidate(p.second);
+            if (ca != cb && !bodies[ca ? p.second : p.first]->GetBodyFixed())
+                blocked[Find(ca ? p.first : p.second)] = 1;
+        }
+
+        // Put the remaining islands to sleep
+        std::unordered_map<int, int> roots;
+        bool changed = false;
+        for (int i = 0; i < num_bodies; i++) {
+            if (!IsCandidate(i))
+                continue;
+            int root = Find(i);
+            if (blocked[root])
+                continue;
+            auto it = roots.find(root);
+            int k;
+            if (it != roots.end()) {
+                k = it->second;
+            } else {
+                k = NewIsland();
+                roots[root] = k;
+            }
+
+            const auto& body = bodies[i];
+            body->SetBodyFixed(true);
+            body->SetPos_dt(chrono::ChVector<>(0, 0, 0));
+            body->SetWvel_loc(chrono::ChVector<>(0, 0, 0));
+            m_state[i] = SLEEPING;
+            m_island[i] = k;
+            m_rest_force[i] = std::max(m_max_force[i], body->GetMass() * g_mag);
+            m_rest_depth[i] = m_max_depth[i];
+            m_islands[k].push_back(i);
+            m_num_sleeping++;
+            changed = true;
+        }
+
+        return changed;
+    }
+
+    int NewIsland() {
+        if (m_free_islands.empty()) {
+            m_islands.emplace_back();
+            return (int)m_islands.size() - 1;
+        }
+        int k = m_free_islands.back();
+        m_free_islands.pop_back();
+        return k;
+    }
+
+    chrono::ChSystemMulticore* m_sys;  ///< associated system
+    int m_min_id;                      ///< smallest identifier of a managed body
+    int m_max_id;                      ///< largest identifier of a managed body
+    int m_interval;                    ///< steps between two evaluations
+    int m_quiet_evals;                 ///< consecutive quiet evaluations before sleeping
+    double m_max_speed;                ///< linear speed threshold
+    double m_max_ang_speed;            ///< angular speed threshold
+    double m_max_accel;                ///< unbalanced acceleration threshold (fraction of gravity)
+    double m_wake_ratio;               ///< wake force, relative to the resting contact force
+    double m_cell_size;                ///< size of the island grid cells (0: no grid)
+    int m_num_steps;                   ///< number of updates
+    int m_num_managed;                 ///< number of managed bodies
+    int m_num_sleeping;                ///< number of sleeping bodies
+    int m_num_wakeups;                 ///< number of island wakeups
+
+    std::vector<char> m_state;                 ///< state of each body (indexed as the body list)
+    std::vector<int> m_quiet;                  ///< number of consecutive quiet evaluations of each body
+    std::vector<int> m_island;                 ///< island of each sleeping body
+    std::vector<double> m_rest_force;          ///< resting contact force of each sleeping body (NSC, see above)
+    std::vector<double> m_rest_depth;          ///< largest resting contact penetration of each sleeping body (SMC)
+    std::vector<chrono::real3> m_force;        ///< total contact force on each body (evaluation steps)
+    std::vector<double> m_max_force;           ///< largest contact force on each body (evaluation steps)
+    std::vector<double> m_max_depth;           ///< largest contact penetration of each body (evaluation steps, SMC)
+    std::vector<std::pair<int, int>> m_pairs;  ///< contacts between non-sleeping bodies (evaluation steps)
+    std::vector<int> m_parent;                 ///< union-find forest of the island search
+    std::vector<std::vector<int>> m_islands;   ///< bodies of each sleeping island
+    std::vector<int> m_free_islands;           ///< unused island slots
+    std::vector<int> m_wake;                   ///< islands to wake at the next update
+};
+
+#endif
@@ -0,0 +1,445 @@
+#ifndef DEMOS_SNAPSHOT_H
+#define DEMOS_SNAPSHOT_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// =============================================================================
+// Columnar binary snapshot format for particle output.
+//
+// A snapshot file stores any number of frames with the same set of fields
+// (e.g. position and velocity). All values are little-endian, as in memory.
+//
+//   File header (16 bytes)
+//     char[4]   magic "CHSN"
+//     uint32    format version (1)
+//     uint32    number of fields F
+//     uint32    size in bytes of one scalar (4: float32, 8: float64)
+//   Field descriptors (F x 24 bytes)
+//     char[16]  field name (zero padded)
+//     uint32    number of components per item (e.g. 3 for a vector)
+//     uint32    reserved (0)
+//   Frames, each made of
+//     uint64    number of items N
+//     double    simulation time
+//     followed by one column per field, in descriptor order, each holding
+//     N x components scalars (components of an item are contiguous) and
+//     zero padded to a multiple of 8 bytes.
+//   Frame index (written when the file is closed)
+//     uint64    offset of each frame, from the start of the file
+//   Trailer (24 bytes)
+//     uint64    offset of the frame index
+//     uint64    number of frames
+//     char[4]   magic "CHSI"
+//     uint32    reserved (0)
+//
+// Frames are self-describing, so a file left without an index (e.g. by an
+// interrupted run) can still be read by scanning the frames sequentially.
+// All columns are 8-byte aligned, so a memory-mapped file can be accessed
+// in place (e.g. with numpy.memmap).
+
+struct SnapshotField {
+    char name[16];        ///< field name
+    uint32_t components;  ///< number of components per item
+    uint32_t reserved;    ///< unused (0)
+};
+
+// -----------------------------------------------------------------------------
+
+class SnapshotWriter {
+  public:
+    enum Precision { FLOAT32 = 4, FLOAT64 = 8 };
+
+    SnapshotWriter() : m_fp(nullptr), m_precision(FLOAT64), m_pos(0), m_num_items(0), m_next_field(0) {}
+    ~SnapshotWriter() { Close(); }
+
+    /// Create a snapshot file with the given fields (each with 3 components).
+    bool Open(const std::string& filename, const std::vector<std::string>& fields, Precision precision = FLOAT64) {
+        std::vector<SnapshotField> descriptors(fields.size());
+        for (size_t i = 0; i < fields.size(); i++) {
+            std::memset(&descriptors[i], 0, sizeof(SnapshotField));
+            std::strncpy(descriptors[i].name, fields[i].c_str(), sizeof(descriptors[i].name) - 1);
+            descriptors[i].components = 3;
+        }
+        return Open(filename, descriptors, precision);
+    }
+
+    /// Create a snapshot file with the given field descriptors.
+    bool Open(const std::string& filename, const std::vector<SnapshotField>& fields, Precision precision = FLOAT64) {
+        Close();
+        m_fp = std::fopen(filename.c_str(), "wb");
+        if (!m_fp)
+            return false;
+        std::setvbuf(m_fp, nullptr, _IOFBF, 1 << 20);
+
+        m_fields = fields;
+        m_precision = precision;
+        m_offsets.clear();
+        m_pos = 0;
+
+        const char magic[4] = {'C', 'H', 'S', 'N'};
+        uint32_t header[3] = {1, (uint32_t)m_fields.size(), (uint32_t)m_precision};
+        Put(magic, 4);
+        Put(header, sizeof(header));
+        Put(m_fields.data(), m_fields.size() * sizeof(SnapshotField));
+        return !std::ferror(m_fp);
+    }
+
+    /// Start a new frame with 'num_items' items.
+    /// Must be followed by one call to WriteField for each field, in order.
+    void BeginFrame(double time, uint64_t num_items) {
+        m_offsets.push_back(m_pos);
+        m_num_items = num_items;
+        m_next_field = 0;
+        Put(&num_items, sizeof(num_items));
+        Put(&time, sizeof(time));
+    }
+
+    /// Write the next field of the current frame from an array of 'num_items'
+    /// 3-component vectors (any type with x, y, z members, e.g. real3).
+    template <typename V>
+    void WriteField(const V* data) {
+        if (m_precision == FLOAT32)
+            PutColumn<float>(data);
+        else
+            PutColumn<double>(data);
+        m_next_field++;
+    }
+
+    /// Write the next field of the current frame from a contiguous array of
+    /// 'num_items' x components floating point scalars.
+    template <typename T>
+    void WriteFieldScalars(const T* data) {
+        size_t n = (size_t)m_num_items * m_fields[m_next_field].components;
+        if (m_precision == FLOAT32)
+            PutScalars<float>(data, n);
+        else
+            PutScalars<double>(data, n);
+        m_next_field++;
+    }
+
+    /// Return true if a snapshot file is open.
+    bool IsOpen() const { return m_fp != nullptr; }
+
+    /// Return the number of frames written so far.
+    size_t GetNumFrames() const { return m_offsets.size(); }
+
+    /// Write the frame index and close the file.
+    bool Close() {
+        if (!m_fp)
+            return true;
+        uint64_t index_offset = m_pos;
+        uint64_t num_frames = m_offsets.size();
+        const char magic[4] = {'C', 'H', 'S', 'I'};
+        uint32_t reserved = 0;
+        Put(m_offsets.data(), m_offsets.size() * sizeof(uint64_t));
+        Put(&index_offset, sizeof(index_offset));
+        Put(&num_frames, sizeof(num_frames));
+        Put(magic, 4);
+        Put(&reserved, sizeof(reserved));
+        bool ok = !std::ferror(m_fp);
+        ok = (std::fclose(m_fp) == 0) && ok;
+        m_fp = nullptr;
+        return ok;
+    }
+
+  private:
+    void Put(const void* data, size_t size) {
+        std::fwrite(data, 1, size, m_fp);
+        m_pos += size;
+    }
+
+    void Pad() {
+        const char zeros[8] = {0};
+        if (m_pos % 8)
+            Put(zeros, 8 - m_pos % 8);
+    }
+
+    template <typename S, typename V>
+    void PutColumn(const V* data) {
+        const size_t chunk = 1024;
+        S buffer[3 * chunk];
+        for (uint64_t i = 0; i < m_num_items; i += chunk) {
+            size_t n = (size_t)std::min<uint64_t>(chunk, m_num_items - i);
+            for (size_t j = 0; j < n; j++) {
+                buffer[3 * j + 0] = (S)data[i + j].x;
+                buffer[3 * j + 1] = (S)data[i + j].y;
+                buffer[3 * j + 2] = (S)data[i + j].z;
+            }
+            Put(buffer, 3 * n * sizeof(S));
+        }
+        Pad();
+    }
+
+    template <typename S, typename T>
+    void PutScalars(const T* data, size_t num) {
+        if (sizeof(S) == sizeof(T)) {
+            Put(data, num * sizeof(T));
+        } else {
+            const size_t chunk = 2048;
+            S buffer[chunk];
+            for (size_t i = 0; i < num; i += chunk) {
+                size_t n = std::min(chunk, num - i);
+                for (size_t j = 0; j < n; j++)
+                    buffer[j] = (S)data[i + j];
+                Put(buffer, n * sizeof(S));
+            }
+        }
+        Pad();
+    }
+
+    FILE* m_fp;
+    std::vector<SnapshotField> m_fields;
+    Precision m_precision;
+    std::vector<uint64_t> m_offsets;  ///< offsets of the frames written so far
+    uint64_t m_pos;                   ///< current position in the file
+    uint64_t m_num_items;             ///< number of items in the current frame
+    size_t m_next_field;              ///< index of the next field in the current frame
+};
+
+// -----------------------------------------------------------------------------
+// Read-only access to a snapshot file through a memory mapping.
+// Field data is returned as pointers into the mapped file (no copies); frames
+// are loaded by the operating system only when accessed.
+
+class SnapshotReader {
+  public:
+    SnapshotReader() : m_data(nullptr), m_size(0), m_precision(0) {
+#ifdef _WIN32
+        m_file = INVALID_HANDLE_VALUE;
+        m_mapping = nullptr;
+#endif
+    }
+    ~SnapshotReader() { Close(); }
+
+    /// Map the given snapshot file. Return false if it is not a valid snapshot file.
+    bool Open(const std::string& filename) {
+        Close();
+        if (!Map(filename))
+            return false;
+        if (!ReadHeader() || !ReadIndex()) {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    /// Unmap the file.
+    void Close() {
+        Unmap();
+        m_fields.clear();
+        m_offsets.clear();
+        m_precision = 0;
+    }
+
+    /// Return the number of frames.
+    size_t GetNumFrames() const { return m_offsets.size(); }
+
+    /// Return the number of fields.
+    size_t GetNumFields() const { return m_fields.size(); }
+
+    /// Return the descriptor of the given field.
+    const SnapshotField& GetField(size_t field) const { return m_fields[field]; }
+
+    /// Return the index of the field with given name (-1 if not present).
+    int FindField(const std::string& name) const {
+        for (size_t i = 0; i < m_fields.size(); i++) {
+            if (name == m_fields[i].name)
+                return (int)i;
+        }
+        return -1;
+    }
+
+    /// Return true if the scalars are stored in single precision.
+    bool IsSinglePrecision() const { return m_precision == 4; }
+
+    /// Return the number of items in the given frame.
+    uint64_t GetNumItems(size_t frame) const { return FrameHeader(frame)[0]; }
+
+    /// Return the simulation time of the given frame.
+    double GetTime(size_t frame) const {
+        double time;
+        std::memcpy(&time, FrameHeader(frame) + 1, sizeof(time));
+        return time;
+    }
+
+    /// Return a pointer to the data of the given field in the given frame, or
+    /// nullptr if the requested scalar type does not match the stored one.
+    template <typename T>
+    const T* GetData(size_t frame, size_t field) const {
+        if (sizeof(T) != m_precision)
+            return nullptr;
+        return reinterpret_cast<const T*>(m_data + ColumnOffset(frame, field));
+    }
+
+    /// Copy the given field of the given frame into 'out', converting to T.
+    template <typename T>
+    void CopyData(size_t frame, size_t field, std::vector<T>& out) const {
+        size_t n = (size_t)GetNumItems(frame) * m_fields[field].components;
+        out.resize(n);
+        const unsigned char* p = m_data + ColumnOffset(frame, field);
+        if (m_precision == 4) {
+            const float* src = reinterpret_cast<const float*>(p);
+            for (size_t i = 0; i < n; i++)
+                out[i] = (T)src[i];
+        } else {
+            const double* src = reinterpret_cast<const double*>(p);
+            for (size_t i = 0; i < n; i++)
+                out[i] = (T)src[i];
+        }
+    }
+
+  private:
+    static uint64_t Align(uint64_t x) { return (x + 7) & ~uint64_t(7); }
+
+    const uint64_t* FrameHeader(size_t frame) const {
+        return reinterpret_cast<const uint64_t*>(m_data + m_offsets[frame]);
+    }
+
+    uint64_t ColumnSize(uint64_t num_items, size_t field) const {
+        return Align(num_items * m_fields[field].components * m_precision);
+    }
+
+    uint64_t ColumnOffset(size_t frame, size_t field) const {
+        uint64_t num_items = GetNumItems(frame);
+        uint64_t offset = m_offsets[frame] + 16;
+        for (size_t i = 0; i < field; i++)
+            offset += ColumnSize(num_items, i);
+        return offset;
+    }
+
+    bool ReadHeader() {
+        if (m_size < 16 || std::memcmp(m_data, "CHSN", 4) != 0)
+            return false;
+        uint32_t header[3];
+        std::memcpy(header, m_data + 4, sizeof(header));
+        if (header[0] != 1 || (header[2] != 4 && header[2] != 8))
+            return false;
+        if (m_size < 16 + (uint64_t)header[1] * sizeof(SnapshotField))
+            return false;
+        m_precision = header[2];
+        m_fields.resize(header[1]);
+        std::memcpy(m_fields.data(), m_data + 16, m_fields.size() * sizeof(SnapshotField));
+        for (auto& f : m_fields)
+            f.name[sizeof(f.name) - 1] = 0;
+        return true;
+    }
+
+    bool ReadIndex() {
+        uint64_t first = 16 + m_fields.size() * sizeof(SnapshotField);
+
+        // Use the frame index if the file was properly closed
+        if (m_size >= first + 24 && std::memcmp(m_data + m_size - 8, "CHSI", 4) == 0) {
+            uint64_t trailer[2];
+            std::memcpy(trailer, m_data + m_size - 24, sizeof(trailer));
+            if (trailer[0] + trailer[1] * sizeof(uint64_t) == m_size - 24) {
+                m_offsets.resize((size_t)trailer[1]);
+                std::memcpy(m_offsets.data(), m_data + trailer[0], m_offsets.size() * sizeof(uint64_t));
+                return true;
+            }
+        }
+
+        // Otherwise, scan the frames and keep the complete ones
+        uint64_t offset = first;
+        while (offset + 16 <= m_size) {
+            uint64_t num_items;
+            std::memcpy(&num_items, m_data + offset, sizeof(num_items));
+            uint64_t end = offset + 16;
+            for (size_t i = 0; i < m_fields.size(); i++)
+                end += ColumnSize(num_items, i);
+            if (end > m_size || end < offset)
+                break;
+            m_offsets.push_back(offset);
+            offset = end;
+        }
+        return true;
+    }
+
+#ifdef _WIN32
+    bool Map(const std::string& filename) {
+        m_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                             FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (m_file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0) {
+            Unmap();
+            return false;
+        }
+        m_size = (uint64_t)size.QuadPart;
+        m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (m_mapping)
+            m_data = (const unsigned char*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+        if (!m_data) {
+            Unmap();
+            return false;
+        }
+        return true;
+    }
+
+    void Unmap() {
+        if (m_data)
+            UnmapViewOfFile(m_data);
+        if (m_mapping)
+            CloseHandle(m_mapping);
+        if (m_file != INVALID_HANDLE_VALUE)
+            CloseHandle(m_file);
+        m_data = nullptr;
+        m_mapping = nullptr;
+        m_file = INVALID_HANDLE_VALUE;
+        m_size = 0;
+    }
+
+    HANDLE m_file;
+    HANDLE m_mapping;
+#else
+    bool Map(const std::string& filename) {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            close(fd);
+            return false;
+        }
+        void* data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED)
+            return false;
+        m_data = (const unsigned char*)data;
+        m_size = (uint64_t)st.st_size;
+        return true;
+    }
+
+    void Unmap() {
+        if (m_data)
+            munmap((void*)m_data, (size_t)m_size);
+        m_data = nullptr;
+        m_size = 0;
+    }
+#endif
+
+    const unsigned char* m_data;          ///< start of the mapped file
+    uint64_t m_size;                      ///< size of the mapped file
+    uint32_t m_precision;                 ///< size of one scalar (4 or 8)
+    std::vector<SnapshotField> m_fields;  ///< field descriptors
+    std::vector<uint64_t> m_offsets;      ///< offsets of the frames
+};
+
+#endif
@@ -0,0 +1,183 @@
+#ifndef DEMOS_SPHERE_GENERATOR_H
+#define DEMOS_SPHERE_GENERATOR_H
+
+#include <memory>
+#include <vector>
+
+#include "chrono/assets/ChSphereShape.h"
+#include "chrono/physics/ChBody.h"
+#include "chrono/physics/ChMaterialSurface.h"
+#include "chrono_multicore/physics/ChSystemMulticore.h"
+
+#include "sampling.h"
+
+// =============================================================================
+// Bulk generator of uniform spheres in a Chrono::Multicore system.
+//
+// Unlike utils::Generator, which samples, creates, and adds one body at a time,
+// the generator works in batches:
+// - the queued regions are Poisson-disk sampled in parallel (one region per
+//   task, or parallel tiles for a single region, see PoissonDiskSampler);
+// - the bodies are constructed, then initialized in parallel (mass, position,
+//   collision model); all spheres share the same contact material and
+//   visualization asset;
+// - the system-wide body and shape arrays of the data manager are reserved for
+//   the whole batch before the bodies are added to the system.
+//
+//   SphereGenerator gen(sys, material, radius, density);
+//   gen.SetBodyIdentifier(1);
+//   for (int i = 0; i < num_layers; i++)
+//       gen.AddBox(ChVector<>(0, 0, (2 * i + 1) * r), ChVector<>(hdimX - r, hdimY - r, 0), 2 * r);
+//   gen.CreateBodies();
+
+class SphereGenerator {
+  public:
+    SphereGenerator(chrono::ChSystemMulticore* sys,
+                    std::shared_ptr<chrono::ChMaterialSurface> material,
+                    double radius,
+                    double density)
+        : m_sys(sys), m_material(material), m_radius(radius), m_next_id(0), m_seed(0), m_num_regions(0), m_total(0) {
+        m_mass = density * (4.0 / 3.0) * chrono::CH_C_PI * radius * radius * radius;
+        m_inertia = 0.4 * m_mass * radius * radius * chrono::ChVector<>(1, 1, 1);
+        m_asset = chrono_types::make_shared<chrono::ChSphereShape>();
+        m_asset->GetSphereGeometry().rad = radius;
+    }
+
+    /// Set the identifier of the next created body (incremented for each body).
+    void SetBodyIdentifier(int id) { m_next_id = id; }
+
+    /// Set the seed for the random sampling of the regions.
+    void SetSeed(unsigned int seed) { m_seed = seed; }
+
+    /// Queue a box region to be Poisson-disk sampled with the given separation.
+    /// Spheres created in this region will have the given initial velocity.
+    void AddBox(const chrono::ChVector<>& center,
+                const chrono::ChVector<>& hdims,
+                double separation,
+                const chrono::ChVector<>& vel = chrono::ChVector<>(0, 0, 0)) {
+        m_regions.push_back({center, hdims, separation, vel, m_seed + m_num_regions++});
+    }
+
+    /// Sample all queued regions (in parallel). Return the number of sampled positions.
+    /// Several regions are sampled concurrently; a single region is sampled with parallel tiles.
+    size_t Sample() {
+        int num_regions = (int)m_regions.size();
+        std::vector<std::vector<chrono::ChVector<>>> points(num_regions);
+
+        if (num_regions == 1) {
+            const Region& r = m_regions[0];
+            points[0] = PoissonDiskSampler(r.separation, r.seed).SampleBox(r.center, r.hdims);
+        } else {
+#pragma omp parallel for schedule(dynamic)
+            for (int i = 0; i < num_regions; i++) {
+                const Region& r = m_regions[i];
+                PoissonDiskSampler sampler(r.separation, r.seed);
+                sampler.SetTileSize(0);
+                points[i] = sampler.SampleBox(r.center, r.hdims);
+            }
+        }
+
+        for (int i = 0; i < num_regions; i++) {
+            for (const auto& p : points[i])
+                m_samples.push_back({p, m_regions[i].vel});
+        }
+        m_regions.clear();
+
+        return m_samples.size();
+    }
+
+    /// Return the number of sampled positions for which no body was created yet.
+    size_t GetNumSamples() const { return m_samples.size(); }
+
+    /// Create spheres at all sampled positions (sampling any queued regions first).
+    /// Return the number of created bodies.
+    int CreateBodies() {
+        Sample();
+        int num = (int)m_samples.size();
+
+        // Body construction (serial: the construction of Chrono objects is not thread-safe)
+        std::vector<std::shared_ptr<chrono::ChBody>> bodies(num);
+        for (int i = 0; i < num; i++)
+            bodies[i] = std::shared_ptr<chrono::ChBody>(m_sys->NewBody());
+
+        // Body initialization (independent for each body)
+        int first_id = m_next_id;
+#pragma omp parallel for
+        for (int i = 0; i < num; i++) {
+            auto& body = bodies[i];
+            body->SetIdentifier(first_id + i);
+            body->SetMass(m_mass);
+            body->SetInertiaXX(m_inertia);
+            body->SetPos(m_samples[i].pos);
+            body->SetRot(chrono::ChQuaternion<>(1, 0, 0, 0));
+            body->SetPos_dt(m_samples[i].vel);
+            body->SetBodyFixed(false);
+            body->SetCollide(true);
+
+            body->GetCollisionModel()->ClearModel();
+            body->GetCollisionModel()->AddSphere(m_material, m_radius);
+            body->GetCollisionModel()->BuildModel();
+
+            body->AddAsset(m_asset);
+        }
+
+        // Reserve the system-wide arrays for the whole batch, then add the bodies
+        auto dm = m_sys->data_manager;
+        size_t num_bodies = dm->num_rigid_bodies + num;
+        dm->host_data.pos_rigid.reserve(num_bodies);
+        dm->host_data.rot_rigid.reserve(num_bodies);
+        dm->host_data.active_rigid.reserve(num_bodies);
+        dm->host_data.collide_rigid.reserve(num_bodies);
+        size_t num_shapes = dm->shape_data.id_rigid.size() + num;
+        dm->shape_data.ObA_rigid.reserve(num_shapes);
+        dm->shape_data.ObR_rigid.reserve(num_shapes);
+        dm->shape_data.start_rigid.reserve(num_shapes);
+        dm->shape_data.length_rigid.reserve(num_shapes);
+        dm->shape_data.fam_rigid.reserve(num_shapes);
+        dm->shape_data.typ_rigid.reserve(num_shapes);
+        dm->shape_data.id_rigid.reserve(num_shapes);
+        dm->shape_data.sphere_rigid.reserve(dm->shape_data.sphere_rigid.size() + num);
+
+        for (int i = 0; i < num; i++)
+            m_sys->AddBody(bodies[i]);
+
+        m_next_id += num;
+        m_total += num;
+        m_samples.clear();
+
+        return num;
+    }
+
+    /// Return the total number of bodies created by this generator.
+    int GetTotalNumBodies() const { return m_total; }
+
+  private:
+    struct Region {
+        chrono::ChVector<> center;
+        chrono::ChVector<> hdims;
+        double separation;
+        chrono::ChVector<> vel;
+        unsigned int seed;
+    };
+
+    struct SamplePoint {
+        chrono::ChVector<> pos;
+        chrono::ChVector<> vel;
+    };
+
+    chrono::ChSystemMulticore* m_sys;                       ///< associated system
+    std::shared_ptr<chrono::ChMaterialSurface> m_material;  ///< contact material shared by all spheres
+    std::shared_ptr<chrono::ChSphereShape> m_asset;         ///< visualization asset shared by all spheres
+    double m_radius;                                        ///< sphere radius
+    double m_mass;                                          ///< sphere mass
+    chrono::ChVector<> m_inertia;                           ///< sphere moments of inertia
+    int m_next_id;                                          ///< identifier of the next body
+    unsigned int m_seed;                                    ///< base seed for region sampling
+    unsigned int m_num_regions;                             ///< number of regions queued so far
+    int m_total;                                            ///< number of created bodies
+
+    std::vector<Region> m_regions;       ///< queued regions
+    std::vector<SamplePoint> m_samples;  ///< sampled positions
+};
+
+#endif
@@ -0,0 +1,256 @@
+#ifndef DEMOS_TIMELINE_H
+#define DEMOS_TIMELINE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "chrono/physics/ChSystem.h"
+#include "chrono_multicore/physics/ChSystemMulticore.h"
+#include "chrono_multicore/solver/ChIterativeSolverMulticore.h"
+
+// =============================================================================
+// Timers and counters of a single simulation step.
+
+struct TimelineSample {
+    double time;         ///< simulation time (at end of step)
+    double step;         ///< total step time
+    double broad;        ///< broad phase collision detection time
+    double narrow;       ///< narrow phase collision detection time
+    double solver;       ///< solver time
+    double update;       ///< update time
+    double residual;     ///< solver residual (Chrono::Multicore only)
+    int32_t iterations;  ///< solver iterations (Chrono::Multicore only)
+    int32_t bodies;      ///< number of bodies
+    int32_t contacts;    ///< number of contacts
+    int32_t padding;     ///< unused (explicit padding for the binary format)
+
+    /// Collect the timers and counters of the last step of the given system.
+    static TimelineSample Capture(chrono::ChSystem* sys) {
+        TimelineSample s;
+        s.time = sys->GetChTime();
+        s.step = sys->GetTimerStep();
+        s.broad = sys->GetTimerCollisionBroad();
+        s.narrow = sys->GetTimerCollisionNarrow();
+        s.solver = sys->GetTimerLSsolve();
+        s.update = sys->GetTimerUpdate();
+        s.residual = 0;
+        s.iterations = 0;
+        s.bodies = sys->GetNbodies();
+        s.contacts = sys->GetNcontacts();
+        s.padding = 0;
+        if (chrono::ChSystemMulticore* mc_sys = dynamic_cast<chrono::ChSystemMulticore*>(sys)) {
+            auto solver = std::static_pointer_cast<chrono::ChIterativeSolverMulticore>(sys->GetSolver());
+            s.residual = solver->GetResidual();
+            s.iterations = solver->GetIterations();
+            s.bodies = mc_sys->GetNbodies();
+            s.contacts = mc_sys->GetNcontacts();
+        }
+        return s;
+    }
+};
+
+// =============================================================================
+// Annotation of a recorded step (e.g. a change of settings).
+
+struct TimelineMarker {
+    uint64_t step;                                     ///< index of the annotated step
+    std::string name;                                  ///< event name
+    std::vector<std::pair<std::string, double>> args;  ///< event arguments
+};
+
+// =============================================================================
+// Per-step timeline recorder.
+//
+// Samples are stored in a ring buffer allocated at construction, so recording
+// a step does not allocate or format anything; once the buffer is full, the
+// oldest samples are overwritten. The retained samples can be exported to:
+//
+// - a binary file with the following layout (little-endian, as in memory):
+//     char[4]   magic "CHTL"
+//     uint32    format version (1)
+//     uint32    size in bytes of one TimelineSample record
+//     uint32    reserved (0)
+//     uint64    index of first stored step
+//     uint64    number of stored samples
+//     followed by the TimelineSample records, oldest first.
+//
+// - a Chrome trace (JSON) file, which can be loaded in chrome://tracing or
+//   https://ui.perfetto.dev. Each step is a duration event on the "step" track
+//   (placed back to back on a wall-clock time axis), with its broad phase,
+//   narrow phase, solver, and update intervals laid out sequentially on the
+//   "phases" track. Body/contact counts and solver iterations are exported as
+//   counter tracks, and markers as instant events at the end of their step.
+//   Markers are not included in the binary file.
+
+class TimelineRecorder {
+  public:
+    /// Construct a recorder retaining the most recent 'capacity' steps.
+    explicit TimelineRecorder(size_t capacity = 100000)
+        : m_samples(capacity > 0 ? capacity : 1), m_next(0), m_count(0) {}
+
+    /// Record the last step of the given system.
+    void Record(chrono::ChSystem* sys) { Record(TimelineSample::Capture(sys)); }
+
+    /// Record the given sample.
+    void Record(const TimelineSample& sample) {
+        m_samples[m_next] = sample;
+        m_next = (m_next + 1) % m_samples.size();
+        m_count++;
+    }
+
+    /// Annotate the last recorded step with a marker.
+    void AddMarker(const std::string& name, const std::vector<std::pair<std::string, double>>& args = {}) {
+        m_markers.push_back({m_count > 0 ? m_count - 1 : 0, name, args});
+    }
+
+    /// Discard all samples and markers (the buffer is retained).
+    void Reset() {
+        m_next = 0;
+        m_count = 0;
+        m_markers.clear();
+    }
+
+    /// Return the maximum number of retained samples.
+    size_t GetCapacity() const { return m_samples.size(); }
+
+    /// Return the total number of recorded steps (including overwritten ones).
+    uint64_t GetNumRecorded() const { return m_count; }
+
+    /// Return the number of retained samples.
+    size_t GetNumSamples() const { return m_count < m_samples.size() ? (size_t)m_count : m_samples.size(); }
+
+    /// Return the markers (in the order they were added).
+    const std::vector<TimelineMarker>& GetMarkers() const { return m_markers; }
+
+    /// Return the step index of the oldest retained sample.
+    uint64_t GetFirstStep() const { return m_count - GetNumSamples(); }
+
+    /// Return the i-th retained sample (i = 0 is the oldest).
+    const TimelineSample& GetSample(size_t i) const {
+        size_t start = (m_count > m_samples.size()) ? m_next : 0;
+        return m_samples[(start + i) % m_samples.size()];
+    }
+
+    /// Return the most recent sample (requires at least one recorded step).
+    const TimelineSample& GetLast() const { return GetSample(GetNumSamples() - 1); }
+
+    /// Write the retained samples to a binary file.
+    bool WriteBinary(const std::string& filename) const {
+        FILE* fp = std::fopen(filename.c_str(), "wb");
+        if (!fp)
+            return false;
+
+        const char magic[4] = {'C', 'H', 'T', 'L'};
+        uint32_t version = 1;
+        uint32_t record_size = sizeof(TimelineSample);
+        uint32_t reserved = 0;
+        uint64_t first = GetFirstStep();
+        uint64_t num = GetNumSamples();
+        std::fwrite(magic, 1, 4, fp);
+        std::fwrite(&version, sizeof(version), 1, fp);
+        std::fwrite(&record_size, sizeof(record_size), 1, fp);
+        std::fwrite(&reserved, sizeof(reserved), 1, fp);
+        std::fwrite(&first, sizeof(first), 1, fp);
+        std::fwrite(&num, sizeof(num), 1, fp);
+
+        // Retained samples occupy at most two contiguous segments of the ring buffer
+        size_t start = (m_count > m_samples.size()) ? m_next : 0;
+        size_t n1 = std::min((size_t)num, m_samples.size() - start);
+        std::fwrite(&m_samples[start], sizeof(TimelineSample), n1, fp);
+        std::fwrite(&m_samples[0], sizeof(TimelineSample), (size_t)num - n1, fp);
+
+        return std::fclose(fp) == 0;
+    }
+
+    /// Write the retained samples as a Chrome trace (JSON) file.
+    bool WriteChromeTrace(const std::string& filename) const {
+        FILE* fp = std::fopen(filename.c_str(), "w");
+        if (!fp)
+            return false;
+
+        std::fprintf(fp, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+        const char* tracks[2] = {"step", "phases"};
+        for (int j = 0; j < 2; j++) {
+            std::fprintf(fp, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, ",
+                         j ? ",\n" : "", j + 1);
+            std::fprintf(fp, "\"args\": {\"name\": \"%s\"}}", tracks[j]);
+        }
+
+        // Timestamps and durations in microseconds
+        double ts = 0;
+        uint64_t step = GetFirstStep();
+        size_t marker = 0;
+        while (marker < m_markers.size() && m_markers[marker].step < step)
+            marker++;
+        for (size_t i = 0; i < GetNumSamples(); i++, step++) {
+            const TimelineSample& s = GetSample(i);
+            std::fprintf(fp,
+                         ",\n{\"name\": \"step\", \"ph\": \"X\", \"pid\": 1, \"tid\": 1, \"ts\": %.3f, \"dur\": %.3f, "
+                         "\"args\": {\"step\": %llu, \"time\": %.8g, \"residual\": %.6g}}",
+                         ts, 1e6 * s.step, (unsigned long long)step, s.time, s.residual);
+            double t = ts;
+            const char* names[4] = {"broad", "narrow", "solver", "update"};
+            double durations[4] = {s.broad, s.narrow, s.solver, s.update};
+            for (int j = 0; j < 4; j++) {
+                std::fprintf(fp,
+                             ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": 2, \"ts\": %.3f, "
+                             "\"dur\": %.3f}",
+                             names[j], t, 1e6 * durations[j]);
+                t += 1e6 * durations[j];
+            }
+            std::fprintf(fp,
+                         ",\n{\"name\": \"counts\", \"ph\": \"C\", \"pid\": 1, \"ts\": %.3f, "
+                         "\"args\": {\"bodies\": %d, \"contacts\": %d}}",
+                         ts, s.bodies, s.contacts);
+            std::fprintf(fp,
+                         ",\n{\"name\": \"iterations\", \"ph\": \"C\", \"pid\": 1, \"ts\": %.3f, "
+                         "\"args\": {\"iterations\": %d}}",
+                         ts, s.iterations);
+            ts += 1e6 * s.step;
+            for (; marker < m_markers.size() && m_markers[marker].step == step; marker++) {
+                const TimelineMarker& m = m_markers[marker];
+                std::fprintf(fp,
+                             ",\n{\"name\": \"%s\", \"ph\": \"i\", \"s\": \"g\", \"pid\": 1, \"tid\": 1, \"ts\": %.3f, "
+                             "\"args\": {\"step\": %llu",
+                             JsonEscape(m.name).c_str(), ts, (unsigned long long)step);
+                for (const auto& a : m.args)
+                    std::fprintf(fp, ", \"%s\": %.8g", JsonEscape(a.first).c_str(), a.second);
+                std::fprintf(fp, "}}");
+            }
+        }
+
+        std::fprintf(fp, "\n]}\n");
+        return std::fclose(fp) == 0;
+    }
+
+  private:
+    // Escape a string for use in a JSON string literal.
+    static std::string JsonEscape(const std::string& text) {
+        std::string out;
+        out.reserve(text.size());
+        for (unsigned char c : text) {
+            if (c == '"' || c == '\\') {
+                out += '\\';
+                out += (char)c;
+            } else if (c < 0x20) {
+                char buf[8];
+                std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                out += buf;
+            } else {
+                out += (char)c;
+            }
+        }
+        return out;
+    }
+
+    std::vector<TimelineSample> m_samples;  ///< ring buffer
+    size_t m_next;                          ///< slot for next sample
+    uint64_t m_count;                       ///< total number of recorded steps
+    std::vector<TimelineMarker> m_markers;  ///< step annotations
+};
+
+#endif
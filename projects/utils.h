@@ -6,6 +6,8 @@
 #include "core/ChStream.h"
 #include "chrono_multicore/physics/ChSystemMulticore.h"
 
+#include "timeline.h"
+
 // =============================================================================
 // Utility function for displaying an ASCII progress bar for the quantity x
 // which must be a value between 0 and n. The width 'w' represents the number
@@ -27,35 +29,22 @@ static inline void progressbar(unsigned int x, unsigned int n, unsigned int w =
 }
 
 // =============================================================================
-// Utility function to print to console a few important step statistics
+// Utility function to print to console a few important step statistics.
+// For per-step monitoring of long runs, prefer recording with a TimelineRecorder
+// (see timeline.h) and exporting the timeline at the end of the simulation.
 
 static inline void TimingOutput(chrono::ChSystem* mSys, chrono::ChStreamOutAsciiFile* ofile = NULL) {
-  double TIME = mSys->GetChTime();
-  double STEP = mSys->GetTimerStep();
-  double BROD = mSys->GetTimerCollisionBroad();
-  double NARR = mSys->GetTimerCollisionNarrow();
-  double SOLVER = mSys->GetTimerLSsolve();
-  double UPDT = mSys->GetTimerUpdate();
-  double RESID = 0;
-  int REQ_ITS = 0;
-  int BODS = mSys->GetNbodies();
-  int CNTC = mSys->GetNcontacts();
-  if (chrono::ChSystemMulticore* mc_sys = dynamic_cast<chrono::ChSystemMulticore*>(mSys)) {
-      RESID = std::static_pointer_cast<chrono::ChIterativeSolverMulticore>(mSys->GetSolver())->GetResidual();
-      REQ_ITS = std::static_pointer_cast<chrono::ChIterativeSolverMulticore>(mSys->GetSolver())->GetIterations();
-      BODS = mc_sys->GetNbodies();
-      CNTC = mc_sys->GetNcontacts();
-  }
+  TimelineSample s = TimelineSample::Capture(mSys);
 
   if (ofile) {
       char buf[200];
-      sprintf(buf, "%8.5f  %7.4f  %7.4f  %7.4f  %7.4f  %7.4f  %7d  %7d  %7d  %7.4f\n", TIME, STEP, BROD, NARR, SOLVER,
-              UPDT, BODS, CNTC, REQ_ITS, RESID);
+      sprintf(buf, "%8.5f  %7.4f  %7.4f  %7.4f  %7.4f  %7.4f  %7d  %7d  %7d  %7.4f\n", s.time, s.step, s.broad, s.narrow,
+              s.solver, s.update, s.bodies, s.contacts, s.iterations, s.residual);
       *ofile << buf;
   }
 
-  printf("   %8.5f | %7.4f | %7.4f | %7.4f | %7.4f | %7.4f | %7d | %7d | %7d | %7.4f\n", TIME, STEP, BROD, NARR, SOLVER,
-         UPDT, BODS, CNTC, REQ_ITS, RESID);
+  printf("   %8.5f | %7.4f | %7.4f | %7.4f | %7.4f | %7.4f | %7d | %7d | %7d | %7.4f\n", s.time, s.step, s.broad,
+         s.narrow, s.solver, s.update, s.bodies, s.contacts, s.iterations, s.residual);
 }
 
 #endif
@@ -53,6 +53,10 @@
 #include "chrono_thirdparty/filesystem/path.h"
 
 // Utilities
+#include "../../active_window.h"
+#include "../../moving_patch.h"
+#include "../../settling.h"
+#include "../../sphere_generator.h"
 #include "../../utils.h"
 
 using namespace chrono;
@@ -122,6 +126,21 @@ double time_end = 7;
 // This can be used to allow the granular material to settle.
 double time_hold = 0.2;
 
+// Simulate only the particles in a window following the vehicle (see ActiveWindow)?
+// The window is enabled at the end of the hold time, once the granular material settled.
+bool use_active_window = true;
+double window_margin_x = 3.5;  // window extent around the chassis in x
+double window_margin_y = 2.5;  // window extent around the chassis in y
+
+// Recycle the granular particles behind the vehicle to ahead of it (see MovingPatch)?
+// The tiles are captured from the front of the bed once the granular material settled (see SettlingMonitor); the
+// vehicle is held until then, but at most until patch_hold_max (the start of the driver inputs).
+// Recycled particles are teleported, so the active window is not used with a moving patch.
+bool use_moving_patch = false;
+double patch_tile_length = 0.5;  // length of the terrain tiles
+double patch_behind = 4.0;       // terrain length kept behind the chassis
+double patch_hold_max = 0.5;     // maximum hold time waiting for the granular material to settle
+
 // Solver parameters
 double time_step = 1e-3;
 double tolerance = 1e-5;
@@ -179,22 +198,18 @@ class MyDriver : public ChDriver {
 
 // =============================================================================
 
-double CreateParticles(ChSystem* system) {
+double CreateParticles(ChSystemMulticore* system) {
     // Create a material
     auto mat_g = chrono_types::make_shared<ChMaterialSurfaceNSC>();
     mat_g->SetFriction(mu_g);
     mat_g->SetRestitution(0.0f);
     mat_g->SetCohesion(static_cast<float>(coh_force));
 
-    // Create a particle generator and a mixture entirely made out of spheres
-    utils::Generator gen(system);
-    std::shared_ptr<utils::MixtureIngredient> m1 = gen.AddMixtureIngredient(utils::MixtureType::SPHERE, 1.0);
-    m1->setDefaultMaterial(mat_g);
-    m1->setDefaultDensity(rho_g);
-    m1->setDefaultSize(r_g);
+    // Create a generator of identical spheres
+    SphereGenerator gen(system, mat_g, r_g, rho_g);
 
     // Set starting value for body identifiers
-    gen.setBodyIdentifier(Id_g);
+    gen.SetBodyIdentifier(Id_g);
 
     // Create particles in layers until reaching the desired number of particles
     double r = 1.01 * r_g;
@@ -203,12 +218,13 @@ double CreateParticles(ChSystem* system) {
 
     double layerCount = 0;
     while (layerCount < numLayers) {
-        gen.createObjectsBox(utils::SamplingType::POISSON_DISK, 2 * r, center, hdims);
+        gen.AddBox(center, hdims, 2 * r);
         center.z() += 2 * r;
         layerCount++;
     }
+    gen.CreateBodies();
 
-    std::cout << "Created " << gen.getTotalNumBodies() << " particles." << std::endl;
+    std::cout << "Created " << gen.GetTotalNumBodies() << " particles." << std::endl;
 
     return center.z();
 }
@@ -341,6 +357,28 @@ int main(int argc, char* argv[]) {
                                 vehicle::GetDataFile(speed_controller_file), path, "my_path", 0.0);
     driver_steering.Initialize();
 	
+    // Active window following the vehicle
+    ActiveWindow window(&system, Id_g);
+    window.AddTrackedBody(vehicle->GetChassisBody());
+    window.SetMargins(window_margin_x, window_margin_y);
+    window.SetCellSize(4 * r_g);
+
+    // Granular terrain moving with the vehicle
+    bool moving_patch = use_moving_patch && terrain_type == GRANULAR_TERRAIN;
+    bool active_window = use_active_window && !moving_patch;
+    MovingPatch patch(&system, Id_g);
+    patch.SetContainer(ground, -hdimX, hdimX);
+    patch.SetTrackedBody(vehicle->GetChassisBody());
+    patch.SetRadius(r_g);
+    patch.SetTileLength(patch_tile_length);
+    patch.SetDistanceBehind(patch_behind);
+
+    // Settling check before capturing the terrain tiles (zero velocity level: fraction of a grain radius per second)
+    SettlingMonitor monitor(100);
+    monitor.SetMinTime(time_hold);
+    monitor.SetMaxSpeed(0.9 * r_g);
+    bool settled = false;
+
     // ------------------------------------
     // Prepare output directories and files
     // ------------------------------------
@@ -426,6 +464,10 @@ int main(int argc, char* argv[]) {
             std::cout << "     Braking input:  " << driver_inputs.m_braking << std::endl;
             std::cout << "     Steering input: " << driver_inputs.m_steering << std::endl;
             std::cout << "     Execution time: " << exec_time << std::endl;
+            if (active_window)
+                std::cout << "     Active bodies:  " << window.GetNumActive() << std::endl;
+            if (moving_patch)
+                std::cout << "     Patch rear:     " << patch.GetRear() << std::endl;
 
             if (povray_output) {
                 char filename[100];
@@ -441,10 +483,27 @@ int main(int argc, char* argv[]) {
         }
 
         // Release the vehicle chassis at the end of the hold time.
-        if (vehicle->GetChassis()->IsFixed() && time > time_hold) {
+        // With a moving patch, hold the vehicle until the granular material settled.
+        bool hold = time <= time_hold || (moving_patch && !settled && time <= patch_hold_max);
+        if (vehicle->GetChassis()->IsFixed() && !hold) {
             std::cout << std::endl << "Release vehicle t = " << time << std::endl;
             vehicle->GetChassisBody()->SetBodyFixed(false);
+            if (moving_patch && settled) {
+                std::cout << "Captured terrain tile with " << patch.CaptureTile() << " particles" << std::endl;
+            } else if (moving_patch) {
+                std::cout << "Granular material not settled; moving patch disabled" << std::endl;
+                moving_patch = false;
+            }
         }
+        bool released = !vehicle->GetChassis()->IsFixed();
+
+        // Move the active window with the vehicle
+        if (active_window && released)
+            window.Update();
+
+        // Recycle the terrain behind the vehicle
+        if (moving_patch && released)
+            patch.Update();
 
         // Update modules (process inputs from other modules)
         driver_speed.Synchronize(time);
@@ -470,6 +529,10 @@ int main(int argc, char* argv[]) {
             vehicle->LogConstraintViolations();
         }
 
+        // Check settling of the granular material before capturing the terrain tiles
+        if (moving_patch && !released)
+            settled = monitor.Update(&system);
+
         // Update counters.
         time += time_step;
         sim_frame++;
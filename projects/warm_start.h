@@ -0,0 +1,254 @@
+#ifndef DEMOS_WARM_START_H
+#define DEMOS_WARM_START_H
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "chrono_multicore/constraints/ChConstraintUtils.h"
+#include "chrono_multicore/physics/ChSystemMulticore.h"
+#include "chrono_multicore/solver/ChIterativeSolverMulticore.h"
+#include "chrono_multicore/solver/ChSolverMulticore.h"
+
+// =============================================================================
+// Contact impulses persisted across steps of a Chrono::Multicore NSC system.
+//
+// After each solve, the impulse of every contact is stored as a vector in the
+// global frame (divided by the step size), keyed by the pair of collision
+// shape identifiers of the contact (by the pair of body indices if the shape
+// pairs are not available). At the start of the next solve, the contacts found
+// in the store are seeded with the stored impulse, projected on their current
+// normal and tangent directions, so that small changes of the contact frames
+// between steps are accounted for. Contacts are stored sorted by key; matching
+// is one parallel binary search per contact.
+//
+// A shape pair (or body pair) may produce several contacts (e.g. box-box or
+// mesh contacts), which cannot be told apart between steps. Such contacts are
+// neither stored nor seeded, so they start from zero impulses.
+//
+// Call Clear after any discontinuous change of the contact set (e.g. bodies
+// loaded from a checkpoint, or a new stage of a simulation).
+//
+// Only the normal and sliding components are seeded (the rolling and spinning
+// components of SolverMode::SPINNING start from zero).
+
+class ContactCache {
+  public:
+    explicit ContactCache(chrono::ChMulticoreDataManager* data_manager)
+        : m_data_manager(data_manager), m_num_contacts(0), m_num_matched(0) {}
+
+    /// Seed the contact impulses in gamma from the stored impulses, unless the solve continues from a previous
+    /// solve of the same step (non-zero contact impulses). Return true if gamma was seeded.
+    bool Seed(chrono::DynamicVector<chrono::real>& gamma) {
+        const auto& host = m_data_manager->host_data;
+        int num_contacts = (int)m_data_manager->num_rigid_contacts;
+        int num_unilaterals = (int)m_data_manager->num_unilaterals;
+        if (num_contacts == 0 || gamma.size() < (size_t)num_unilaterals)
+            return false;
+        for (int i = 0; i < num_unilaterals; i++) {
+            if (gamma[i] != 0)
+                return false;
+        }
+
+        double step = m_data_manager->settings.step_size;
+        bool tangential = m_data_manager->settings.solver.solver_mode != chrono::SolverMode::NORMAL &&
+                          gamma.size() >= 3 * (size_t)num_contacts;
+
+        int num_matched = 0;
+        if (!m_keys.empty()) {
+            // Keys of the current contacts (sorted, to detect repeated keys)
+            m_current.resize(num_contacts);
+#pragma omp parallel for
+            for (int c = 0; c < num_contacts; c++)
+                m_current[c] = Key(c);
+            std::sort(m_current.begin(), m_current.end());
+
+#pragma omp parallel for reduction(+ : num_matched)
+            for (int c = 0; c < num_contacts; c++) {
+                long long key = Key(c);
+                auto range = std::equal_range(m_current.begin(), m_current.end(), key);
+                if (range.second - range.first > 1)
+                    continue;
+                auto it = std::lower_bound(m_keys.begin(), m_keys.end(), key);
+                if (it == m_keys.end() || *it != key)
+                    continue;
+                chrono::real3 p = step * m_impulses[it - m_keys.begin()];
+                const chrono::real3& n = host.norm_rigid_rigid[c];
+                gamma[c] = std::max(chrono::Dot(p, n), chrono::real(0));
+                if (tangential) {
+                    chrono::real3 u, w;
+                    chrono::Orthogonalize(n, u, w);
+                    gamma[num_contacts + 2 * c] = chrono::Dot(p, u);
+                    gamma[num_contacts + 2 * c + 1] = chrono::Dot(p, w);
+                }
+                num_matched++;
+            }
+        }
+
+        m_num_contacts = num_contacts;
+        m_num_matched = num_matched;
+
+        return true;
+    }
+
+    /// Store the contact impulses in gamma for the next step.
+    void Store(const chrono::DynamicVector<chrono::real>& gamma) {
+        const auto& host = m_data_manager->host_data;
+        int num_contacts = (int)m_data_manager->num_rigid_contacts;
+        double step = m_data_manager->settings.step_size;
+        bool tangential = m_data_manager->settings.solver.solver_mode != chrono::SolverMode::NORMAL &&
+                          gamma.size() >= 3 * (size_t)num_contacts;
+        if (gamma.size() < (size_t)num_contacts || step <= 0)
+            num_contacts = 0;
+
+        std::vector<std::pair<long long, chrono::real3>> entries(num_contacts);
+
+#pragma omp parallel for
+        for (int c = 0; c < num_contacts; c++) {
+            const chrono::real3& n = host.norm_rigid_rigid[c];
+            chrono::real3 p = gamma[c] * n;
+            if (tangential) {
+                chrono::real3 u, w;
+                chrono::Orthogonalize(n, u, w);
+                p += gamma[num_contacts + 2 * c] * u + gamma[num_contacts + 2 * c + 1] * w;
+            }
+            entries[c] = std::make_pair(Key(c), p / step);
+        }
+
+        // The narrowphase usually reports contacts sorted by shape pair
+        auto by_key = [](const std::pair<long long, chrono::real3>& a, const std::pair<long long, chrono::real3>& b) {
+            return a.first < b.first;
+        };
+        if (!std::is_sorted(entries.begin(), entries.end(), by_key))
+            std::sort(entries.begin(), entries.end(), by_key);
+
+        // Keep only the keys of single contacts
+        m_keys.clear();
+        m_impulses.clear();
+        for (int c = 0; c < num_contacts; c++) {
+            long long key = entries[c].first;
+            if ((c > 0 && entries[c - 1].first == key) || (c + 1 < num_contacts && entries[c + 1].first == key))
+                continue;
+            m_keys.push_back(key);
+            m_impulses.push_back(entries[c].second);
+        }
+    }
+
+    /// Discard the stored impulses (e.g. after a discontinuous change of the system).
+    void Clear() {
+        m_keys.clear();
+        m_impulses.clear();
+    }
+
+    /// Return the number of contacts at the last seeded solve.
+    int GetNumContacts() const { return m_num_contacts; }
+
+    /// Return the number of contacts seeded from the previous step at the last seeded solve.
+    int GetNumMatched() const { return m_num_matched; }
+
+    /// Return the fraction of contacts seeded from the previous step at the last seeded solve.
+    double GetMatchedFraction() const { return m_num_contacts > 0 ? (double)m_num_matched / m_num_contacts : 0; }
+
+  private:
+    // Persistent identifier of the given contact.
+    long long Key(int c) const {
+        const auto& host = m_data_manager->host_data;
+        if (host.contact_shapeIDs.size() >= m_data_manager->num_rigid_contacts)
+            return (long long)host.contact_shapeIDs[c];
+        const chrono::vec2& b = host.bids_rigid_rigid[c];
+        return ((long long)b.x << 32) | (unsigned int)b.y;
+    }
+
+    chrono::ChMulticoreDataManager* m_data_manager;  ///< data of the associated system
+    int m_num_contacts;                              ///< number of contacts at the last seeded solve
+    int m_num_matched;                               ///< number of seeded contacts at the last seeded solve
+    std::vector<long long> m_keys;                   ///< stored contact keys (sorted)
+    std::vector<long long> m_current;                ///< keys of the current contacts (sorted)
+    std::vector<chrono::real3> m_impulses;           ///< stored impulses per unit time (global frame)
+};
+
+// =============================================================================
+// Warm-started Chrono::Multicore solver: seeds the contact impulses from the
+// previous step before solving, and stores them after solving.
+
+template <class Solver>
+class WarmStartSolver : public Solver {
+  public:
+    explicit WarmStartSolver(chrono::ChMulticoreDataManager* data_manager) : m_cache(data_manager) {
+        this->data_manager = data_manager;
+    }
+
+    /// Return the contact impulse store.
+    ContactCache& GetCache() { return m_cache; }
+
+    virtual unsigned int Solve(chrono::ChShurProduct& ShurProduct,
+                               chrono::ChProjectConstraints& Project,
+                               const unsigned int max_iter,
+                               const unsigned int size,
+                               const chrono::DynamicVector<chrono::real>& r,
+                               chrono::DynamicVector<chrono::real>& gamma) override {
+        m_cache.Seed(gamma);
+        unsigned int iterations = Solver::Solve(ShurProduct, Project, max_iter, size, r, gamma);
+        m_cache.Store(gamma);
+        return iterations;
+    }
+
+  private:
+    ContactCache m_cache;  ///< contact impulses of the previous step
+};
+
+// =============================================================================
+// Replace the contact solver of a Chrono::Multicore NSC system with its
+// warm-started version and return the contact impulse store (owned by the
+// system). Must be called after ChangeSolverType (which would replace the
+// warm-started solver). Return null if the solver type is not supported.
+//
+//   sys->ChangeSolverType(SolverType::APGD);
+//   ContactCache* warm_start = EnableWarmStart(sys);
+//   while (...) {
+//       sys->DoStepDynamics(time_step);
+//       cout << warm_start->GetMatchedFraction() << endl;
+//   }
+
+inline ContactCache* EnableWarmStart(chrono::ChSystemMulticoreNSC* sys) {
+    auto iterative = std::static_pointer_cast<chrono::ChIterativeSolverMulticore>(sys->GetSolver());
+    chrono::ChMulticoreDataManager* data_manager = sys->data_manager;
+
+    ContactCache* cache = nullptr;
+    chrono::ChSolverMulticore* solver = nullptr;
+    switch (data_manager->settings.solver.solver_type) {
+        case chrono::SolverType::APGD: {
+            auto s = new WarmStartSolver<chrono::ChSolverMulticoreAPGD>(data_manager);
+            cache = &s->GetCache();
+            solver = s;
+            break;
+        }
+        case chrono::SolverType::APGDREF: {
+            auto s = new WarmStartSolver<chrono::ChSolverMulticoreAPGDREF>(data_manager);
+            cache = &s->GetCache();
+            solver = s;
+            break;
+        }
+        case chrono::SolverType::BB: {
+            auto s = new WarmStartSolver<chrono::ChSolverMulticoreBB>(data_manager);
+            cache = &s->GetCache();
+            solver = s;
+            break;
+        }
+        case chrono::SolverType::SPGQP: {
+            auto s = new WarmStartSolver<chrono::ChSolverMulticoreSPGQP>(data_manager);
+            cache = &s->GetCache();
+            solver = s;
+            break;
+        }
+        default:
+            return nullptr;
+    }
+
+    delete iterative->solver;
+    iterative->solver = solver;
+
+    return cache;
+}
+
+#endif